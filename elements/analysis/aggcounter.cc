@@ -23,10 +23,12 @@
 #include <click/packet_anno.hh>
 #include <click/integers.hh>	// for first_bit_set
 #include <click/router.hh>
+#include <click/straccum.hh>
 CLICK_DECLS
 
 AggregateCounter::AggregateCounter()
-    : _root(0), _free(0), _call_nnz_h(0), _call_count_h(0)
+    : _root(0), _free(0), _call_nnz_h(0), _call_count_h(0),
+      _merge_timer(this)
 {
 }
 
@@ -57,6 +59,7 @@ AggregateCounter::configure(Vector<String> &conf, ErrorHandler *errh)
     bool ip_bytes = false;
     bool packet_count = true;
     bool extra_length = true;
+    bool per_thread = false;
     uint32_t freeze_nnz, stop_nnz;
     uint64_t freeze_count, stop_count;
     String call_nnz, call_count;
@@ -74,13 +77,17 @@ AggregateCounter::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("COUNT_STOP", stop_count)
 	.read("AGGREGATE_CALL", AnyArg(), call_nnz)
 	.read("COUNT_CALL", AnyArg(), call_count)
-	.read("BANNER", _output_banner).complete() < 0)
+	.read("BANNER", _output_banner)
+	.read("PER_THREAD", per_thread)
+	.read("MERGE_INTERVAL", _merge_interval)
+	.complete() < 0)
 	return -1;
 
     _bytes = bytes;
     _ip_bytes = ip_bytes;
     _use_packet_count = packet_count;
     _use_extra_length = extra_length;
+    _per_thread = per_thread;
 
     if ((freeze_nnz != (uint32_t)(-1)) + (stop_nnz != (uint32_t)(-1)) + ((bool)call_nnz) > 1)
 	return errh->error("'AGGREGATE_FREEZE', 'AGGREGATE_STOP', and 'AGGREGATE_CALL' are mutually exclusive");
@@ -126,6 +133,12 @@ AggregateCounter::initialize(ErrorHandler *errh)
 
     _frozen = false;
     _active = true;
+    // per-thread tables are merged from any thread, so PER_THREAD always
+    // locks the shared counters
+    _mt = _per_thread || get_passing_threads().weight() > 1;
+    _merge_timer.initialize(this);
+    if (_per_thread && _merge_interval)
+	_merge_timer.schedule_after(_merge_interval);
     return 0;
 }
 
@@ -135,6 +148,12 @@ AggregateCounter::cleanup(CleanupStage)
     for (int i = 0; i < _blocks.size(); i++)
 	delete[] _blocks[i];
     _blocks.clear();
+    for (unsigned i = 0; i < _tables.weight(); i++) {
+	ThreadTable &t = _tables.get_value(i);
+	delete[] t.slots;
+	t.slots = 0;
+	t.used = 0;
+    }
     delete _call_nnz_h;
     delete _call_count_h;
     _call_nnz_h = _call_count_h = 0;
@@ -212,18 +231,9 @@ AggregateCounter::find_node(uint32_t a, bool frozen)
     return 0;
 }
 
-inline bool
-AggregateCounter::update(Packet *p, bool frozen)
+inline uint32_t
+AggregateCounter::amount(const Packet *p) const
 {
-    if (!_active)
-	return false;
-
-    // AGGREGATE_ANNO is already in host byte order!
-    uint32_t agg = AGGREGATE_ANNO(p);
-    Node *n = find_node(agg, frozen);
-    if (!n)
-	return false;
-
     uint32_t amount;
     if (!_bytes)
 	amount = 1 + (_use_packet_count ? EXTRA_PACKETS_ANNO(p) : 0);
@@ -232,14 +242,30 @@ AggregateCounter::update(Packet *p, bool frozen)
 	if (_ip_bytes && p->has_network_header())
 	    amount -= p->network_header_offset();
     }
+    return amount;
+}
+
+/* Add @a p to the trie.  The caller holds _lock.  If an AGGREGATE or COUNT
+   handler must be called, set @a call; the caller should call it after
+   releasing the lock.  An AGGREGATE handler is due before @a p is counted,
+   so update() then returns false and should be retried. */
+inline bool
+AggregateCounter::update(Packet *p, bool frozen, HandlerCall *&call)
+{
+    // AGGREGATE_ANNO is already in host byte order!
+    uint32_t agg = AGGREGATE_ANNO(p);
+    Node *n = find_node(agg, frozen);
+    if (!n)
+	return false;
+
+    uint32_t amount = this->amount(p);
 
     // update _num_nonzero; possibly call handler
     if (amount && !n->count) {
 	if (_num_nonzero >= _call_nnz) {
 	    _call_nnz = (uint32_t)(-1);
-	    _call_nnz_h->call_write();
-	    // handler may have changed our state; reupdate
-	    return update(p, frozen || _frozen);
+	    call = _call_nnz_h;
+	    return false;
 	}
 	_num_nonzero++;
     }
@@ -248,15 +274,145 @@ AggregateCounter::update(Packet *p, bool frozen)
     _count += amount;
     if (_count >= _call_count) {
 	_call_count = (uint64_t)(-1);
-	_call_count_h->call_write();
+	call = _call_count_h;
     }
     return true;
 }
 
+/* Add @a p to the thread's private table.  The caller holds the table's
+   lock.  Returns true if the table should be merged. */
+inline bool
+AggregateCounter::local_update(ThreadTable &t, Packet *p)
+{
+    uint32_t amount = this->amount(p);
+    if (!amount)
+	return false;
+    if (unlikely(!t.slots))
+	t.slots = new Slot[table_size]();
+
+    uint32_t agg = AGGREGATE_ANNO(p);
+    uint32_t i = (agg * 0x9E3779B1U) >> (32 - table_order);
+    while (t.slots[i].count && t.slots[i].aggregate != agg)
+	i = (i + 1) & (table_size - 1);
+    if (!t.slots[i].count) {
+	t.slots[i].aggregate = agg;
+	t.used++;
+    }
+    t.slots[i].count += amount;
+    return t.used >= table_limit;
+}
+
+/* Merge @a t into the trie.  The caller holds @a t's lock.  If an AGGREGATE
+   or COUNT handler must be called, stop early and return it; the caller
+   should call it after releasing the lock, then merge again. */
+HandlerCall *
+AggregateCounter::merge_table(ThreadTable &t)
+{
+    HandlerCall *call = 0;
+    _lock.acquire();
+    for (Slot *s = t.slots; s != t.slots + table_size && t.used; ++s) {
+	if (!s->count)
+	    continue;
+	if (Node *n = find_node(s->aggregate, _frozen)) {
+	    if (!n->count) {
+		if (_num_nonzero >= _call_nnz) {
+		    _call_nnz = (uint32_t)(-1);
+		    call = _call_nnz_h;
+		    break;
+		}
+		_num_nonzero++;
+	    }
+	    n->count += s->count;
+	    _count += s->count;
+	}
+	// Emptying a slot can break a probe sequence, so the table may later
+	// hold the same aggregate twice.  That is harmless: both get merged.
+	s->count = 0;
+	t.used--;
+	if (_count >= _call_count) {
+	    _call_count = (uint64_t)(-1);
+	    call = _call_count_h;
+	    break;
+	}
+    }
+    _lock.release();
+    return call;
+}
+
+void
+AggregateCounter::merge_all()
+{
+    for (unsigned i = 0; i < _tables.weight(); i++) {
+	ThreadTable &t = _tables.get_value(i);
+	while (t.used) {
+	    t.lock.acquire();
+	    HandlerCall *call = merge_table(t);
+	    t.lock.release();
+	    if (!call)
+		break;
+	    call->call_write();
+	}
+    }
+}
+
+/* Count @a p, which arrived on @a port.  Returns true if it was counted. */
+inline bool
+AggregateCounter::count(int port, Packet *p)
+{
+    if (!_active)
+	return false;
+    else if (!_per_thread) {
+	bool frozen = _frozen || (port == 1), counted;
+	HandlerCall *call;
+	do {
+	    call = 0;
+	    if (_mt)
+		_lock.acquire();
+	    counted = update(p, frozen, call);
+	    if (_mt)
+		_lock.release();
+	    if (call) {
+		call->call_write();
+		// handler may have changed our state
+		frozen = frozen || _frozen;
+	    }
+	} while (call && !counted);
+	return counted;
+    } else if (port == 0 && !_frozen) {
+	ThreadTable &t = *_tables;
+	t.lock.acquire();
+	HandlerCall *call = (local_update(t, p) ? merge_table(t) : 0);
+	t.lock.release();
+	if (call)
+	    call->call_write();
+	return true;
+    }
+
+    // frozen: only existing counters change, so no new aggregates appear
+    HandlerCall *call = 0;
+    if (_mt)
+	_lock.acquire();
+    Node *n = find_node(AGGREGATE_ANNO(p), true);
+    if (n) {
+	uint32_t amount = this->amount(p);
+	n->count += amount;
+	_count += amount;
+	if (_count >= _call_count) {
+	    _call_count = (uint64_t)(-1);
+	    call = _call_count_h;
+	}
+    }
+    if (_mt)
+	_lock.release();
+    if (call)
+	call->call_write();
+    return n != 0;
+}
+
 void
 AggregateCounter::push(int port, Packet *p)
 {
-    port = !update(p, _frozen || (port == 1));
+    port = !count(port, p);
     output(noutputs() == 1 ? 0 : port).push(p);
 }
 
@@ -265,10 +421,47 @@ AggregateCounter::pull(int port)
 {
     Packet *p = input(ninputs() == 1 ? 0 : port).pull();
     if (p && _active)
-	update(p, _frozen || (port == 1));
+	count(port, p);
     return p;
 }
 
+#if HAVE_BATCH
+void
+AggregateCounter::push_batch(int port, PacketBatch *batch)
+{
+    if (_per_thread && port == 0 && !_frozen && _active) {
+	// take the table lock once per batch
+	ThreadTable &t = *_tables;
+	t.lock.acquire();
+	FOR_EACH_PACKET(batch, p)
+	    if (local_update(t, p)) {
+		if (HandlerCall *call = merge_table(t)) {
+		    t.lock.release();
+		    call->call_write();
+		    t.lock.acquire();
+		}
+	    }
+	t.lock.release();
+	output_push_batch(0, batch);
+    } else if (noutputs() == 1) {
+	FOR_EACH_PACKET(batch, p)
+	    count(port, p);
+	output_push_batch(0, batch);
+    } else {
+	auto fnt = [this, port](Packet *p) -> int { return !count(port, p); };
+	auto on_finish = [this](int o, PacketBatch *b) { output_push_batch(o, b); };
+	CLASSIFY_EACH_PACKET(2, fnt, batch, on_finish);
+    }
+}
+#endif
+
+void
+AggregateCounter::run_timer(Timer *)
+{
+    merge_all();
+    _merge_timer.reschedule_after(_merge_interval);
+}
+
 
 // CLEAR, REAGGREGATE
 
@@ -371,6 +564,23 @@ AggregateCounter::write_nodes(Node *n, FILE *f, WriteFormat format,
 	write_nodes(n->child[1], f, format, buffer, pos, len, errh);
 }
 
+void
+AggregateCounter::write_header(StringAccum &sa, WriteFormat format) const
+{
+    sa << "!IPAggregate 1.0\n" << _output_banner;
+    if (_output_banner.length() && _output_banner.back() != '\n')
+	sa << '\n';
+    sa << "!num_nonzero " << _num_nonzero << '\n';
+    if (format == WR_BINARY) {
+#if CLICK_BYTE_ORDER == CLICK_BIG_ENDIAN
+	sa << "!packed_be\n";
+#elif CLICK_BYTE_ORDER == CLICK_LITTLE_ENDIAN
+	sa << "!packed_le\n";
+#endif
+    } else if (format == WR_TEXT_IP)
+	sa << "!ip\n";
+}
+
 int
 AggregateCounter::write_file(String where, WriteFormat format,
 			     ErrorHandler *errh) const
@@ -383,21 +593,13 @@ AggregateCounter::write_file(String where, WriteFormat format,
     if (!f)
 	return errh->error("%s: %s", where.c_str(), strerror(errno));
 
-    fprintf(f, "!IPAggregate 1.0\n");
-    ignore_result(fwrite(_output_banner.data(), 1, _output_banner.length(), f));
-    if (_output_banner.length() && _output_banner.back() != '\n')
-	fputc('\n', f);
-    fprintf(f, "!num_nonzero %u\n", _num_nonzero);
-    if (format == WR_BINARY) {
-#if CLICK_BYTE_ORDER == CLICK_BIG_ENDIAN
-	fprintf(f, "!packed_be\n");
-#elif CLICK_BYTE_ORDER == CLICK_LITTLE_ENDIAN
-	fprintf(f, "!packed_le\n");
-#else
+#if CLICK_BYTE_ORDER != CLICK_BIG_ENDIAN && CLICK_BYTE_ORDER != CLICK_LITTLE_ENDIAN
+    if (format == WR_BINARY)
 	format = WR_TEXT;
 #endif
-    } else if (format == WR_TEXT_IP)
-	fprintf(f, "!ip\n");
+    StringAccum sa;
+    write_header(sa, format);
+    ignore_result(fwrite(sa.data(), 1, sa.length(), f));
 
     uint32_t buf[1024];
     int pos = 0;
@@ -414,6 +616,19 @@ AggregateCounter::write_file(String where, WriteFormat format,
 	return 0;
 }
 
+void
+AggregateCounter::snapshot_nodes(Node *n, StringAccum &sa) const
+{
+    if (n->count > 0) {
+	uint32_t rec[2] = { n->aggregate, n->count };
+	sa.append(reinterpret_cast<const char *>(rec), sizeof(rec));
+    }
+    if (n->child[0])
+	snapshot_nodes(n->child[0], sa);
+    if (n->child[1])
+	snapshot_nodes(n->child[1], sa);
+}
+
 int
 AggregateCounter::write_file_handler(const String &data, Element *e, void *thunk, ErrorHandler *errh)
 {
@@ -422,12 +637,16 @@ AggregateCounter::write_file_handler(const String &data, Element *e, void *thunk
     if (!FilenameArg().parse(cp_uncomment(data), fn))
 	return errh->error("argument should be filename");
     int int_thunk = (intptr_t)thunk;
-    return ac->write_file(fn, (WriteFormat)int_thunk, errh);
+    ac->merge_all();
+    ac->_lock.acquire();
+    int r = ac->write_file(fn, (WriteFormat)int_thunk, errh);
+    ac->_lock.release();
+    return r;
 }
 
 enum {
     AC_FROZEN, AC_ACTIVE, AC_BANNER, AC_STOP, AC_REAGGREGATE, AC_CLEAR,
-    AC_AGGREGATE_CALL, AC_COUNT_CALL, AC_NAGG, AC_COUNT
+    AC_AGGREGATE_CALL, AC_COUNT_CALL, AC_NAGG, AC_COUNT, AC_SNAPSHOT
 };
 
 String
@@ -448,9 +667,20 @@ AggregateCounter::read_handler(Element *e, void *thunk)
 	else
 	    return String(ac->_call_count) + " " + ac->_call_count_h->unparse();
       case AC_COUNT:
+	ac->merge_all();
 	return String(ac->_count);
       case AC_NAGG:
+	ac->merge_all();
 	return String(ac->_num_nonzero);
+      case AC_SNAPSHOT: {
+	  StringAccum sa;
+	  ac->merge_all();
+	  ac->_lock.acquire();
+	  ac->write_header(sa, WR_BINARY);
+	  ac->snapshot_nodes(ac->_root, sa);
+	  ac->_lock.release();
+	  return sa.take_string();
+      }
       default:
 	return "<error>";
     }
@@ -481,7 +711,10 @@ AggregateCounter::write_handler(const String &data, Element *e, void *thunk, Err
 	ac->router()->please_stop_driver();
 	return 0;
       case AC_REAGGREGATE:
+	ac->merge_all();
+	ac->_lock.acquire();
 	ac->reaggregate_counts();
+	ac->_lock.release();
 	return 0;
       case AC_BANNER:
 	ac->_output_banner = data;
@@ -490,8 +723,21 @@ AggregateCounter::write_handler(const String &data, Element *e, void *thunk, Err
 	else if (data && data.length() == 1)
 	    ac->_output_banner = "";
 	return 0;
-      case AC_CLEAR:
-	return ac->clear(errh);
+      case AC_CLEAR: {
+	  // discard private tables, then the trie
+	  for (unsigned i = 0; i < ac->_tables.weight(); i++) {
+	      ThreadTable &t = ac->_tables.get_value(i);
+	      t.lock.acquire();
+	      if (t.slots)
+		  memset(t.slots, 0, sizeof(Slot) * table_size);
+	      t.used = 0;
+	      t.lock.release();
+	  }
+	  ac->_lock.acquire();
+	  int r = ac->clear(errh);
+	  ac->_lock.release();
+	  return r;
+      }
       case AC_AGGREGATE_CALL: {
 	  uint32_t new_nnz = (uint32_t)(-1);
 	  if (s) {
@@ -543,8 +789,10 @@ AggregateCounter::add_handlers()
     add_write_handler("count_call", write_handler, AC_COUNT_CALL);
     add_read_handler("count", read_handler, AC_COUNT);
     add_read_handler("nagg", read_handler, AC_NAGG);
+    add_read_handler("snapshot", read_handler, AC_SNAPSHOT, Handler::f_raw);
 }
 
 ELEMENT_REQUIRES(userlevel int64)
 EXPORT_ELEMENT(AggregateCounter)
+ELEMENT_MT_SAFE(AggregateCounter)
 CLICK_ENDDECLS
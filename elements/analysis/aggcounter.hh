@@ -1,8 +1,12 @@
 #ifndef CLICK_AGGCOUNTER_HH
 #define CLICK_AGGCOUNTER_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
+#include <click/multithread.hh>
+#include <click/sync.hh>
+#include <click/timer.hh>
 CLICK_DECLS
 class HandlerCall;
+class StringAccum;
 
 /*
 =c
@@ -97,6 +101,20 @@ them.
 String. This banner is written to the head of any output file. It should
 probably begin with a comment character, like '!' or '#'. Default is empty.
 
+=item PER_THREAD
+
+Boolean. If true, each thread first accumulates counts in a small private
+hash table, which is merged into the shared counters later. This lets
+AggregateCounter run on many threads at once without contending for a lock.
+Otherwise, if packets reach AggregateCounter from more than one thread, every
+packet takes a lock on the shared counters. Default is false.
+
+=item MERGE_INTERVAL
+
+Time. If PER_THREAD is true, merge the private tables at this interval.
+Tables are also merged whenever they fill up, and before any handler reports
+or writes counts. Default is 0, meaning no periodic merge.
+
 =back
 
 =h write_file write-only
@@ -163,6 +181,11 @@ Returns or sets the COUNT_CALL setting.
 
 Returns the number of aggregates that have been seen so far.
 
+=h snapshot read-only
+
+Returns all current data in the packed binary format of C<write_file>. This
+is useful for fetching counts through a ControlSocket.
+
 =n
 
 The aggregate identifier is stored in host byte order. Thus, the aggregate ID
@@ -170,6 +193,11 @@ corresponding to IP address 128.0.0.0 is 2147483648.
 
 Only available in user-level processes.
 
+With PER_THREAD, the AGGREGATE and COUNT keywords take effect when private
+tables are merged, so they may trigger a little late. Packets that arrive on
+the second input, or while AggregateCounter is frozen, always update the
+shared counters directly.
+
 =e
 
 This configuration reads an IP summary dump in from standard input, aggregates
@@ -189,7 +217,7 @@ form.
 
 AggregateIP, AggregatePacketCounter, FromIPSummaryDump, FromDump */
 
-class AggregateCounter : public Element { public:
+class AggregateCounter : public BatchElement { public:
 
     AggregateCounter() CLICK_COLD;
     ~AggregateCounter() CLICK_COLD;
@@ -202,9 +230,13 @@ class AggregateCounter : public Element { public:
     void cleanup(CleanupStage) CLICK_COLD;
     void add_handlers() CLICK_COLD;
 
-    inline bool update(Packet *, bool frozen = false);
+    inline bool update(Packet *, bool frozen, HandlerCall *&call);
     void push(int, Packet *);
     Packet *pull(int);
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *);
+#endif
+    void run_timer(Timer *);
 
     bool empty() const			{ return _num_nonzero == 0; }
     int clear(ErrorHandler * = 0);
@@ -220,12 +252,30 @@ class AggregateCounter : public Element { public:
 	Node *child[2];
     };
 
+    // per-thread write-combining table; a zero count marks an empty slot
+    struct Slot {
+	uint32_t aggregate;
+	uint32_t count;
+    };
+
+    enum { table_order = 10, table_size = 1 << table_order,
+	   table_limit = table_size * 3 / 4 };
+
+    struct ThreadTable {
+	SimpleSpinlock lock;
+	Slot *slots;
+	uint32_t used;
+	ThreadTable() : slots(0), used(0) { }
+    };
+
     bool _bytes : 1;
     bool _ip_bytes : 1;
     bool _use_packet_count : 1;
     bool _use_extra_length : 1;
     bool _frozen;
     bool _active;
+    bool _per_thread;
+    bool _mt;			// lock the shared counters for every packet
 
     Node *_root;
     Node *_free;
@@ -240,6 +290,11 @@ class AggregateCounter : public Element { public:
 
     String _output_banner;
 
+    per_thread<ThreadTable> _tables;
+    SimpleSpinlock _lock;
+    Timer _merge_timer;
+    Timestamp _merge_interval;
+
     Node *new_node();
     Node *new_node_block();
     void free_node(Node *);
@@ -249,7 +304,15 @@ class AggregateCounter : public Element { public:
     void reaggregate_node(Node *);
     void clear_node(Node *);
 
+    inline uint32_t amount(const Packet *) const;
+    inline bool local_update(ThreadTable &, Packet *);
+    inline bool count(int, Packet *);
+    HandlerCall *merge_table(ThreadTable &);
+    void merge_all();
+
     void write_nodes(Node *, FILE *, WriteFormat, uint32_t *, int &, int, ErrorHandler *) const;
+    void write_header(StringAccum &, WriteFormat) const;
+    void snapshot_nodes(Node *, StringAccum &) const;
     static int write_file_handler(const String &, Element *, void *, ErrorHandler *);
     static String read_handler(Element *, void *) CLICK_COLD;
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
@@ -71,9 +71,19 @@ flip_ports(uint32_t ports)
 
 // actual AggregateIPFlows operations
 
+AggregateIPFlows::ThreadState::ThreadState()
+    : active_sec(0), gc_sec(0), next_aggregate(0), end_aggregate(0),
+      nfragments(0), timestamp_warning(false),
+      out_head(0), out_tail(0), out_count(0)
+{
+    for (int c = 0; c < NAGE; c++)
+	age_head[c] = age_tail[c] = 0;
+}
+
 AggregateIPFlows::AggregateIPFlows()
+    : _flow_alloc(sizeof(FlowInfo))
 #if CLICK_USERLEVEL
-    : _traceinfo_file(0), _packet_source(0), _filepos_h(0)
+    , _traceinfo_file(0), _packet_source(0), _filepos_h(0)
 #endif
 {
 }
@@ -123,6 +133,9 @@ AggregateIPFlows::configure(Vector<String> &conf, ErrorHandler *errh)
 
     _smallest_timeout = (_tcp_timeout < _tcp_done_timeout ? _tcp_timeout : _tcp_done_timeout);
     _smallest_timeout = (_smallest_timeout < _udp_timeout ? _smallest_timeout : _udp_timeout);
+    _age_timeout[AGE_TCP] = _tcp_timeout;
+    _age_timeout[AGE_TCP_DONE] = _tcp_done_timeout;
+    _age_timeout[AGE_UDP] = _udp_timeout;
     _handle_icmp_errors = handle_icmp_errors;
     if (fragments_parsed)
 	_fragments = fragments;
@@ -133,8 +146,6 @@ int
 AggregateIPFlows::initialize(ErrorHandler *errh)
 {
     _next = 1;
-    _active_sec = _gc_sec = 0;
-    _timestamp_warning = false;
 
 #if CLICK_USERLEVEL
     if (_traceinfo_filename == "-")
@@ -142,6 +153,7 @@ AggregateIPFlows::initialize(ErrorHandler *errh)
     else if (_traceinfo_filename && !(_traceinfo_file = fopen(_traceinfo_filename.c_str(), "w")))
 	return errh->error("%s: %s", _traceinfo_filename.c_str(), strerror(errno));
     if (_traceinfo_file) {
+	_flow_alloc.increase_size(sizeof(StatFlowInfo));
 	fprintf(_traceinfo_file, "<?xml version='1.0' standalone='yes'?>\n\
 <trace");
 	if (_packet_source) {
@@ -164,8 +176,17 @@ AggregateIPFlows::initialize(ErrorHandler *errh)
 void
 AggregateIPFlows::cleanup(CleanupStage)
 {
-    clean_map(_tcp_map);
-    clean_map(_udp_map);
+    for (unsigned i = 0; i < _state.weight(); i++) {
+	ThreadState &ts = _state.get_value(i);
+	clean_map(ts, ts.tcp_map);
+	clean_map(ts, ts.udp_map);
+	while (Packet *p = ts.out_head) {
+	    ts.out_head = p->next();
+	    p->kill();
+	}
+	ts.out_tail = 0;
+	ts.out_count = 0;
+    }
 #if CLICK_USERLEVEL
     if (_traceinfo_file && _traceinfo_file != stdout) {
 	fprintf(_traceinfo_file, "</trace>\n");
@@ -186,6 +207,7 @@ AggregateIPFlows::delete_flowinfo(const HostPair &hp, FlowInfo *finfo, bool real
 	IPAddress dst(sinfo->reverse() ? hp.a : hp.b);
 	int dport = (ntohl(sinfo->_ports) >> (sinfo->reverse() ? 16 : 0)) & 0xFFFF;
 	Timestamp duration = sinfo->_last_timestamp - sinfo->_first_timestamp;
+	_traceinfo_lock.acquire();
 	fprintf(_traceinfo_file, "<flow aggregate='%u' src='%s' sport='%d' dst='%s' dport='%d' begin='" PRITIMESTAMP "' duration='" PRITIMESTAMP "'",
 
 		sinfo->_aggregate,
@@ -198,16 +220,17 @@ AggregateIPFlows::delete_flowinfo(const HostPair &hp, FlowInfo *finfo, bool real
   <stream dir='0' packets='%d' /><stream dir='1' packets='%d' />\n\
 </flow>\n",
 		sinfo->_packets[0], sinfo->_packets[1]);
-	if (really_delete)
-	    delete sinfo;
-    } else
+	_traceinfo_lock.release();
+    }
 #endif
-	if (really_delete)
-	    delete finfo;
+    if (really_delete) {
+	finfo->~FlowInfo();
+	_flow_alloc.deallocate(finfo);
+    }
 }
 
 void
-AggregateIPFlows::clean_map(Map &table)
+AggregateIPFlows::clean_map(ThreadState &ts, Map &table)
 {
     // free completed flows and emit fragments
     for (Map::iterator iter = table.begin(); iter.live(); iter++) {
@@ -218,9 +241,117 @@ AggregateIPFlows::clean_map(Map &table)
 	}
 	while (FlowInfo *f = hpinfo->_flows) {
 	    hpinfo->_flows = f->_next;
+	    age_unlink(ts, f);
 	    delete_flowinfo(iter.key(), f);
 	}
     }
+    table.clear();
+}
+
+// per-thread state
+
+inline uint32_t
+AggregateIPFlows::new_aggregate(ThreadState &ts)
+{
+    // take aggregate numbers from the shared counter in blocks
+    if (ts.next_aggregate == ts.end_aggregate) {
+	ts.next_aggregate = _next.fetch_and_add(aggregate_block);
+	ts.end_aggregate = ts.next_aggregate + aggregate_block;
+    }
+    return ts.next_aggregate++;
+}
+
+inline void
+AggregateIPFlows::notify_later(ThreadState &ts, uint32_t agg, AggregateListener::AggregateEvent e, const Packet *p)
+{
+    if (has_listeners()) {
+	AggregateListener::Notification n = { agg, e, p };
+	ts.notifications.push_back(n);
+	if (ts.notifications.size() >= notification_batch)
+	    flush_notifications(ts);
+    }
+}
+
+void
+AggregateIPFlows::flush_notifications(ThreadState &ts)
+{
+    if (ts.notifications.size()) {
+	notify_batch(ts.notifications.begin(), ts.notifications.size());
+	ts.notifications.clear();
+    }
+}
+
+inline void
+AggregateIPFlows::emit(ThreadState &ts, Packet *p)
+{
+    p->set_next(0);
+    if (ts.out_tail)
+	ts.out_tail->set_next(p);
+    else
+	ts.out_head = p;
+    ts.out_tail = p;
+    ts.out_count++;
+}
+
+void
+AggregateIPFlows::flush(ThreadState &ts)
+{
+    flush_notifications(ts);
+    // in pull mode, pull() hands out the queued packets
+    if (output_is_pull(0))
+	return;
+    Packet *p = ts.out_head;
+    ts.out_head = ts.out_tail = 0;
+    ts.out_count = 0;
+    while (p) {
+	Packet *next = p->next();
+	p->set_next(0);
+	output(0).push(p);
+	p = next;
+    }
+}
+
+inline Packet *
+AggregateIPFlows::dequeue(ThreadState &ts)
+{
+    Packet *p = ts.out_head;
+    if (p) {
+	ts.out_head = p->next();
+	if (!ts.out_head)
+	    ts.out_tail = 0;
+	ts.out_count--;
+	p->set_next(0);
+    }
+    return p;
+}
+
+// age lists
+
+inline void
+AggregateIPFlows::age_unlink(ThreadState &ts, FlowInfo *f)
+{
+    int c = f->_age_class;
+    if (f->_age_prev)
+	f->_age_prev->_age_next = f->_age_next;
+    else
+	ts.age_head[c] = f->_age_next;
+    if (f->_age_next)
+	f->_age_next->_age_prev = f->_age_prev;
+    else
+	ts.age_tail[c] = f->_age_prev;
+}
+
+inline void
+AggregateIPFlows::age_append(ThreadState &ts, FlowInfo *f)
+{
+    int c = f->_age_class = f->age_class();
+    f->_age_next = 0;
+    f->_age_prev = ts.age_tail[c];
+    if (ts.age_tail[c])
+	ts.age_tail[c]->_age_next = f;
+    else
+	ts.age_head[c] = f;
+    ts.age_tail[c] = f;
 }
 
 #if CLICK_USERLEVEL
@@ -230,13 +361,14 @@ AggregateIPFlows::stat_new_flow_hook(const Packet *p, FlowInfo *finfo)
     StatFlowInfo *sinfo = static_cast<StatFlowInfo *>(finfo);
     sinfo->_first_timestamp = p->timestamp_anno();
     sinfo->_filepos = 0;
+    sinfo->_packets[0] = sinfo->_packets[1] = 0;
     if (_filepos_h)
 	(void) IntArg().parse(_filepos_h->call_read().trim_space(), sinfo->_filepos);
 }
 #endif
 
 inline void
-AggregateIPFlows::packet_emit_hook(const Packet *p, const click_ip *iph, FlowInfo *finfo)
+AggregateIPFlows::packet_emit_hook(ThreadState &ts, const Packet *p, const click_ip *iph, FlowInfo *finfo)
 {
     // account for timestamp
     finfo->_last_timestamp = p->timestamp_anno();
@@ -256,6 +388,10 @@ AggregateIPFlows::packet_emit_hook(const Packet *p, const click_ip *iph, FlowInf
 	    finfo->_flow_over = 0;
     }
 
+    // most recently active flow goes to the end of its age list
+    age_unlink(ts, finfo);
+    age_append(ts, finfo);
+
 #if CLICK_USERLEVEL
     // count packets
     if (stats() && PAINT_ANNO(p) < 2) {
@@ -265,52 +401,94 @@ AggregateIPFlows::packet_emit_hook(const Packet *p, const click_ip *iph, FlowInf
 #endif
 }
 
-void
-AggregateIPFlows::reap_map(Map &table, uint32_t timeout, uint32_t done_timeout)
+inline void
+AggregateIPFlows::emit_old_fragments(ThreadState &ts, HostPairInfo *hpinfo)
 {
-    timeout = _active_sec - timeout;
-    done_timeout = _active_sec - done_timeout;
-    int frag_timeout = _active_sec - _fragment_timeout;
+    int frag_timeout = ts.active_sec - _fragment_timeout;
+    Packet *head;
+    while ((head = hpinfo->_fragment_head)
+	   && (head->timestamp_anno().sec() < frag_timeout
+	       || !IP_ISFRAG(good_ip_header(head))))
+	emit_fragment_head(ts, hpinfo);
+}
 
-    // free completed flows and emit fragments
-    for (Map::iterator iter = table.begin(); iter.live(); iter++) {
+void
+AggregateIPFlows::reap_fragments(ThreadState &ts, Map &table)
+{
+    // emit old fragments, then free host pairs left with nothing
+    for (Map::iterator iter = table.begin(); iter.live(); ) {
 	HostPairInfo *hpinfo = &iter.value();
-	Packet *head;
-	// fragments
-	while ((head = hpinfo->_fragment_head)
-	       && (head->timestamp_anno().sec() < frag_timeout
-		   || !IP_ISFRAG(good_ip_header(head))))
-	    emit_fragment_head(hpinfo);
-
-	// can't delete any flows if there are fragments
 	if (hpinfo->_fragment_head)
-	    continue;
-
-	// completed flows
-	FlowInfo **pprev = &hpinfo->_flows;
-	FlowInfo *f = *pprev;
-	while (f) {
-	    // circular comparison
-	    if (SEC_OLDER(f->_last_timestamp.sec(), (f->_flow_over == 3 ? done_timeout : timeout))) {
-		notify(f->_aggregate, AggregateListener::DELETE_AGG, 0);
-		*pprev = f->_next;
-		delete_flowinfo(iter.key(), f);
-	    } else
-		pprev = &f->_next;
-	    f = *pprev;
+	    emit_old_fragments(ts, hpinfo);
+	if (!hpinfo->_flows && !hpinfo->_fragment_head)
+	    iter = table.erase(iter);
+	else
+	    iter++;
+    }
+}
+
+void
+AggregateIPFlows::reap_flows(ThreadState &ts, int budget)
+{
+    // Age lists are ordered by last activity, so expired flows are at the
+    // front.  Free at most 'budget' of them.
+    for (int c = 0; c < NAGE && budget > 0; c++) {
+	uint32_t limit = ts.active_sec - _age_timeout[c];
+	FlowInfo *f = ts.age_head[c];
+	while (budget > 0 && f && SEC_OLDER(f->_last_timestamp.sec(), limit)) {
+	    HostPairInfo *hpinfo = f->_hpinfo;
+
+	    // can't delete a host pair's flows while it has fragments, but
+	    // other expired flows may go
+	    if (hpinfo->_fragment_head) {
+		unsigned nfragments = ts.nfragments;
+		emit_old_fragments(ts, hpinfo);
+		if (ts.nfragments == nfragments)
+		    f = f->_age_next;
+		else		// emitting may have moved flows
+		    f = ts.age_head[c];
+		continue;
+	    }
+
+	    FlowInfo *next = f->_age_next;
+
+	    notify_later(ts, f->_aggregate, AggregateListener::DELETE_AGG, 0);
+	    FlowInfo **pprev = &hpinfo->_flows;
+	    while (*pprev != f)
+		pprev = &(*pprev)->_next;
+	    *pprev = f->_next;
+	    age_unlink(ts, f);
+	    bool udp = f->_udp;
+	    HostPair hosts = hpinfo->_hosts;
+	    delete_flowinfo(hosts, f);
+	    if (!hpinfo->_flows)
+		(udp ? ts.udp_map : ts.tcp_map).erase(hosts);
+	    budget--;
+	    f = next;
 	}
-	// XXX never free host pairs
     }
 }
 
 void
-AggregateIPFlows::reap()
+AggregateIPFlows::reap(ThreadState &ts)
 {
-    if (_gc_sec) {
-	reap_map(_tcp_map, _tcp_timeout, _tcp_done_timeout);
-	reap_map(_udp_map, _udp_timeout, _udp_timeout);
+    if (ts.gc_sec && ts.nfragments) {
+	reap_fragments(ts, ts.tcp_map);
+	reap_fragments(ts, ts.udp_map);
     }
-    _gc_sec = _active_sec + _gc_interval;
+    ts.gc_sec = ts.active_sec + _gc_interval;
+}
+
+void
+AggregateIPFlows::clear(ThreadState &ts)
+{
+    unsigned active_sec = ts.active_sec, gc_sec = ts.gc_sec;
+    ts.active_sec = 0x7FFFFFFF;
+    reap_fragments(ts, ts.tcp_map);
+    reap_fragments(ts, ts.udp_map);
+    reap_flows(ts, 0x7FFFFFFF);
+    ts.active_sec = active_sec;
+    ts.gc_sec = gc_sec;
 }
 
 const click_ip *
@@ -332,21 +510,16 @@ AggregateIPFlows::icmp_encapsulated_header(const Packet *p)
     return 0;
 }
 
-int
-AggregateIPFlows::relevant_timeout(const FlowInfo *f, const Map &m) const
+inline int
+AggregateIPFlows::relevant_timeout(const FlowInfo *f) const
 {
-    if (&m == &_udp_map)
-	return _udp_timeout;
-    else if (f->_flow_over == 3)
-	return _tcp_done_timeout;
-    else
-	return _tcp_timeout;
+    return _age_timeout[f->age_class()];
 }
 
 // XXX timing when fragments are merged back in?
 
 AggregateIPFlows::FlowInfo *
-AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, bool flipped, const Packet *p)
+AggregateIPFlows::find_flow_info(ThreadState &ts, Map &m, HostPairInfo *hpinfo, uint32_t ports, bool flipped, const Packet *p)
 {
     FlowInfo **pprev = &hpinfo->_flows;
     for (FlowInfo *finfo = *pprev; finfo; pprev = &finfo->_next, finfo = finfo->_next)
@@ -357,26 +530,23 @@ AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, b
 	    // 4.Feb.2004 - Also start a new flow if the old flow closed off,
 	    // and we have a SYN.
 	    if ((age > (int) _smallest_timeout
-		 && age > relevant_timeout(finfo, m))
+		 && age > relevant_timeout(finfo))
 		|| (finfo->_flow_over == 3
 		    && p->ip_header()->ip_p == IP_PROTO_TCP
 		    && (p->tcp_header()->th_flags & TH_SYN))) {
 		// old aggregate has died
-		notify(finfo->aggregate(), AggregateListener::DELETE_AGG, 0);
-		const click_ip *iph = good_ip_header(p);
-		HostPair hp(iph->ip_src.s_addr, iph->ip_dst.s_addr);
-		delete_flowinfo(hp, finfo, false);
+		notify_later(ts, finfo->aggregate(), AggregateListener::DELETE_AGG, 0);
+		delete_flowinfo(hpinfo->_hosts, finfo, false);
 
 		// make a new aggregate
-		finfo->_aggregate = _next;
-		_next++;
+		finfo->_aggregate = new_aggregate(ts);
 		finfo->_reverse = flipped;
 		finfo->_flow_over = 0;
 #if CLICK_USERLEVEL
 		if (stats())
 		    stat_new_flow_hook(p, finfo);
 #endif
-		notify(finfo->aggregate(), AggregateListener::NEW_AGG, p);
+		notify_later(ts, finfo->aggregate(), AggregateListener::NEW_AGG, p);
 	    }
 
 	    // otherwise, move to the front of the list and return
@@ -388,26 +558,33 @@ AggregateIPFlows::find_flow_info(Map &m, HostPairInfo *hpinfo, uint32_t ports, b
 
     // make and install new FlowInfo pair
     FlowInfo *finfo;
+    void *data = _flow_alloc.allocate();
+    if (!data)
+	return 0;
+    uint32_t agg = new_aggregate(ts);
 #if CLICK_USERLEVEL
     if (stats()) {
-	finfo = new StatFlowInfo(ports, hpinfo->_flows, _next);
+	finfo = new(data) StatFlowInfo(ports, hpinfo->_flows, agg, hpinfo);
 	stat_new_flow_hook(p, finfo);
     } else
 #endif
-	finfo = new FlowInfo(ports, hpinfo->_flows, _next);
+	finfo = new(data) FlowInfo(ports, hpinfo->_flows, agg, hpinfo);
 
     finfo->_reverse = flipped;
+    finfo->_udp = (&m == &ts.udp_map);
+    finfo->_last_timestamp = p->timestamp_anno();
+    age_append(ts, finfo);
     hpinfo->_flows = finfo;
-    _next++;
-    notify(finfo->aggregate(), AggregateListener::NEW_AGG, p);
+    notify_later(ts, finfo->aggregate(), AggregateListener::NEW_AGG, p);
     return finfo;
 }
 
 void
-AggregateIPFlows::emit_fragment_head(HostPairInfo *hpinfo)
+AggregateIPFlows::emit_fragment_head(ThreadState &ts, HostPairInfo *hpinfo)
 {
     Packet *head = hpinfo->_fragment_head;
     hpinfo->_fragment_head = head->next();
+    ts.nfragments--;
 
     const click_ip *iph = good_ip_header(head);
     // XXX multiple linear traversals of entire fragment list!
@@ -443,12 +620,12 @@ AggregateIPFlows::emit_fragment_head(HostPairInfo *hpinfo)
 	}
 
     assert(finfo);
-    packet_emit_hook(head, iph, finfo);
-    output(0).push(head);
+    packet_emit_hook(ts, head, iph, finfo);
+    emit(ts, head);
 }
 
 int
-AggregateIPFlows::handle_fragment(Packet *p, HostPairInfo *hpinfo)
+AggregateIPFlows::handle_fragment(ThreadState &ts, Packet *p, HostPairInfo *hpinfo)
 {
     if (hpinfo->_fragment_head)
 	hpinfo->_fragment_tail->set_next(p);
@@ -456,30 +633,26 @@ AggregateIPFlows::handle_fragment(Packet *p, HostPairInfo *hpinfo)
 	hpinfo->_fragment_head = p;
     hpinfo->_fragment_tail = p;
     p->set_next(0);
-    _active_sec = p->timestamp_anno().sec();
+    ts.nfragments++;
+    ts.active_sec = p->timestamp_anno().sec();
 
     // get rid of old fragments
-    int frag_timeout = _active_sec - _fragment_timeout;
-    Packet *head;
-    while ((head = hpinfo->_fragment_head)
-	   && (head->timestamp_anno().sec() < frag_timeout
-	       || !IP_ISFRAG(good_ip_header(head))))
-	emit_fragment_head(hpinfo);
+    emit_old_fragments(ts, hpinfo);
 
     return ACT_NONE;
 }
 
 int
-AggregateIPFlows::handle_packet(Packet *p)
+AggregateIPFlows::handle_packet(ThreadState &ts, Packet *p)
 {
     const click_ip *iph = p->ip_header();
     int paint = 0;
 
     // assign timestamp if no timestamp given
     if (!p->timestamp_anno()) {
-	if (!_timestamp_warning) {
+	if (!ts.timestamp_warning) {
 	    click_chatter("%p{element}: warning: packet received without timestamp", this);
-	    _timestamp_warning = true;
+	    ts.timestamp_warning = true;
 	}
 	p->timestamp_anno().assign_now();
     }
@@ -498,11 +671,12 @@ AggregateIPFlows::handle_packet(Packet *p)
 	return ACT_DROP;
 
     // find relevant HostPairInfo
-    Map &m = (iph->ip_p == IP_PROTO_TCP ? _tcp_map : _udp_map);
+    Map &m = (iph->ip_p == IP_PROTO_TCP ? ts.tcp_map : ts.udp_map);
     HostPair hosts(iph->ip_src.s_addr, iph->ip_dst.s_addr);
     if (hosts.a != iph->ip_src.s_addr)
 	paint ^= 1;
     HostPairInfo *hpinfo = &m[hosts];
+    hpinfo->_hosts = hosts;
 
     // find relevant FlowInfo, if any
     FlowInfo *finfo;
@@ -510,7 +684,7 @@ AggregateIPFlows::handle_packet(Packet *p)
 	const uint8_t *udp_ptr = reinterpret_cast<const uint8_t *>(iph) + (iph->ip_hl << 2);
 	if (udp_ptr + 4 > p->end_data())
 	    // packet not big enough
-	    return ACT_DROP;
+	    goto drop;
 
 	uint32_t ports = *reinterpret_cast<const uint32_t *>(udp_ptr);
 	// 1.Jan.08: handle connections where IP addresses are the same (John
@@ -520,10 +694,10 @@ AggregateIPFlows::handle_packet(Packet *p)
 	if (paint & 1)
 	    ports = flip_ports(ports);
 
-	finfo = find_flow_info(m, hpinfo, ports, paint & 1, p);
+	finfo = find_flow_info(ts, m, hpinfo, ports, paint & 1, p);
 	if (!finfo) {
 	    click_chatter("out of memory!");
-	    return ACT_DROP;
+	    goto drop;
 	}
 	if (finfo->reverse())
 	    paint ^= 1;
@@ -539,63 +713,146 @@ AggregateIPFlows::handle_packet(Packet *p)
 
     // check for fragment
     if ((_fragments && IP_ISFRAG(iph)) || hpinfo->_fragment_head)
-	return handle_fragment(p, hpinfo);
+	return handle_fragment(ts, p, hpinfo);
     else if (!finfo)
-	return ACT_DROP;
+	goto drop;
 
     // packet emit hook
-    _active_sec = p->timestamp_anno().sec();
-    packet_emit_hook(p, iph, finfo);
+    ts.active_sec = p->timestamp_anno().sec();
+    packet_emit_hook(ts, p, iph, finfo);
 
     return ACT_EMIT;
+
+  drop:
+    // don't keep host pairs that hold nothing
+    if (!hpinfo->_flows && !hpinfo->_fragment_head)
+	m.erase(hosts);
+    return ACT_DROP;
 }
 
 void
 AggregateIPFlows::push(int, Packet *p)
 {
-    int action = handle_packet(p);
+    ThreadState &ts = *_state;
+    ts.lock.acquire();
+    int action = handle_packet(ts, p);
 
     // GC if necessary
-    if (_active_sec >= _gc_sec)
-	reap();
+    if (ts.active_sec >= ts.gc_sec)
+	reap(ts);
+    reap_flows(ts, 2);
 
     if (action == ACT_EMIT)
-	output(0).push(p);
-    else if (action == ACT_DROP)
+	emit(ts, p);
+    flush(ts);
+    if (action == ACT_DROP)
 	checked_output_push(1, p);
+    ts.lock.release();
 }
 
 Packet *
 AggregateIPFlows::pull(int)
 {
-    Packet *p = input(0).pull();
-    int action = (p ? handle_packet(p) : ACT_NONE);
+    ThreadState &ts = *_state;
+    ts.lock.acquire();
+    // packets queued earlier, for instance fragments emitted by clear, go
+    // first
+    if (!ts.out_head) {
+	Packet *p = input(0).pull();
+	int action = (p ? handle_packet(ts, p) : ACT_NONE);
+
+	// GC if necessary
+	if (ts.active_sec >= ts.gc_sec)
+	    reap(ts);
+	reap_flows(ts, 2);
+	flush_notifications(ts);
+
+	if (action == ACT_EMIT)
+	    emit(ts, p);
+	else if (action == ACT_DROP)
+	    checked_output_push(1, p);
+    }
+    Packet *p = dequeue(ts);
+    ts.lock.release();
+    return p;
+}
 
-    // GC if necessary
-    if (_active_sec >= _gc_sec)
-	reap();
+#if HAVE_BATCH
+void
+AggregateIPFlows::push_batch(int, PacketBatch *batch)
+{
+    ThreadState &ts = *_state;
+    ts.lock.acquire();
+    Packet *drop_head = 0, *drop_tail = 0;
+    unsigned ndrop = 0;
+    int count = 0;
+
+    Packet *next = batch;
+    while (Packet *p = next) {
+	next = p->next();
+	count++;
+	int action = handle_packet(ts, p);
+	if (action == ACT_EMIT)
+	    emit(ts, p);
+	else if (action == ACT_DROP) {
+	    if (drop_tail)
+		drop_tail->set_next(p);
+	    else
+		drop_head = p;
+	    drop_tail = p;
+	    ndrop++;
+	}
+    }
 
-    if (action == ACT_EMIT)
-	return p;
-    else if (action == ACT_DROP)
-	checked_output_push(1, p);
-    return 0;
+    // GC if necessary
+    if (ts.active_sec >= ts.gc_sec)
+	reap(ts);
+    reap_flows(ts, 2 * count + 8);
+
+    flush_notifications(ts);
+    if (ts.out_head) {
+	PacketBatch *out = PacketBatch::make_from_simple_list(ts.out_head, ts.out_tail, ts.out_count);
+	ts.out_head = ts.out_tail = 0;
+	ts.out_count = 0;
+	output_push_batch(0, out);
+    }
+    if (drop_head)
+	checked_output_push_batch(1, PacketBatch::make_from_simple_list(drop_head, drop_tail, ndrop));
+    ts.lock.release();
 }
+#endif
 
-enum { H_CLEAR };
+enum { H_CLEAR, H_MEMORY };
+
+String
+AggregateIPFlows::read_handler(Element *e, void *thunk)
+{
+    AggregateIPFlows *af = static_cast<AggregateIPFlows *>(e);
+    switch ((intptr_t)thunk) {
+      case H_MEMORY: {
+	  SlabAllocator::Stats stats;
+	  af->_flow_alloc.stats(stats);
+	  return stats.unparse();
+      }
+      default:
+	return String();
+    }
+}
 
 int
 AggregateIPFlows::write_handler(const String &, Element *e, void *thunk, ErrorHandler *)
 {
     AggregateIPFlows *af = static_cast<AggregateIPFlows *>(e);
     switch ((intptr_t)thunk) {
-      case H_CLEAR: {
-	  int active_sec = af->_active_sec, gc_sec = af->_gc_sec;
-	  af->_active_sec = af->_gc_sec = 0x7FFFFFFF;
-	  af->reap();
-	  af->_active_sec = active_sec, af->_gc_sec = gc_sec;
-	  return 0;
-      }
+      case H_CLEAR:
+	for (unsigned i = 0; i < af->_state.weight(); i++) {
+	    ThreadState &ts = af->_state.get_value(i);
+	    ts.lock.acquire();
+	    af->clear(ts);
+	    af->flush(ts);
+	    ts.lock.release();
+	}
+	return 0;
       default:
 	return -1;
     }
@@ -605,8 +862,10 @@ void
 AggregateIPFlows::add_handlers()
 {
     add_write_handler("clear", write_handler, H_CLEAR);
+    add_read_handler("memory", read_handler, H_MEMORY);
 }
 
 ELEMENT_REQUIRES(AggregateNotifier)
 EXPORT_ELEMENT(AggregateIPFlows)
+ELEMENT_MT_SAFE(AggregateIPFlows)
 CLICK_ENDDECLS
@@ -1,9 +1,13 @@
 // -*- c-basic-offset: 4 -*-
 #ifndef CLICK_AGGREGATEIPFLOWS_HH
 #define CLICK_AGGREGATEIPFLOWS_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/ipflowid.hh>
 #include <click/hashtable.hh>
+#include <click/multithread.hh>
+#include <click/atomic.hh>
+#include <click/sync.hh>
+#include <click/slaballocator.hh>
 #include "aggregatenotifier.hh"
 CLICK_DECLS
 class HandlerCall;
@@ -95,7 +99,9 @@ The timeout for fragments, in seconds, Default is 30 seconds.
 
 =item REAP
 
-The garbage collection interval. Default is 20 minutes of packet time.
+The interval between scans for expired fragments. Default is 20 minutes of
+packet time. Expired flows do not wait for this scan; they are reclaimed
+incrementally, a few for every packet processed.
 
 =item ICMP
 
@@ -114,11 +120,39 @@ Default is true in a push context and false in a pull context.
 
 AggregateIPFlows is an AggregateNotifier, so AggregateListeners can request
 notifications when new aggregates are created and old ones are deleted.
+Notifications are delivered through aggregate_notify_batch(), once per
+input batch, before the batch's packets are emitted.
+
+AggregateIPFlows is batch-aware and may run on several threads at once. Each
+thread keeps its own flow tables, so the packets of a flow, in both
+directions, must all arrive on the same thread (for instance, with symmetric
+RSS). Aggregate numbers are still unique across threads: each thread takes
+them from a shared counter in blocks. Numbering is therefore sequential only
+when a single thread is used.
+
+Every flow sits on a list ordered by last activity, one list per timeout
+class (active TCP, completed TCP, UDP). Reaping pops expired flows from the
+heads of these lists, a few per packet, so no full table scan is ever needed.
+Host pairs left without flows are freed.  An expired flow whose host pair
+still holds fragments waiting for their first fragment is skipped until those
+fragments are emitted or time out.
+
+Flow records come from a SlabAllocator shared by all threads, with a cache
+per thread, rather than from the general-purpose heap.
 
 =h clear write-only
 
 Clears all flow information. Future packets will get new aggregate annotation
-values. This may cause packets to be emitted if FRAGMENTS is true.
+values. This may cause packets to be emitted if FRAGMENTS is true. Each
+thread's tables are cleared under that thread's lock, so the handler may be
+called while packets are being processed.
+
+=h memory read-only
+
+Returns the memory used for flow records as "NAME VALUE" lines: 'objects'
+(flow records allocated), 'object_bytes', 'reserved_bytes' (all memory set
+aside for flow records, including free space), 'slabs', and 'huge_slabs'
+(slabs backed by huge pages).
 
 =e
 
@@ -143,7 +177,7 @@ remaining fragments.
 
 AggregateIP, AggregateIPAddrPair, AggregateCounter, DriverManager */
 
-class AggregateIPFlows : public Element, public AggregateNotifier { public:
+class AggregateIPFlows : public BatchElement, public AggregateNotifier { public:
 
     AggregateIPFlows() CLICK_COLD;
     ~AggregateIPFlows() CLICK_COLD;
@@ -164,6 +198,9 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
 
     void push(int, Packet *);
     Packet *pull(int);
+#if HAVE_BATCH
+    void push_batch(int, PacketBatch *);
+#endif
 
     struct HostPair {
 	uint32_t a;
@@ -177,18 +214,29 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
 
   private:
 
+    struct HostPairInfo;
+
+    // age lists, one per timeout class
+    enum { AGE_TCP, AGE_TCP_DONE, AGE_UDP, NAGE };
+
     struct FlowInfo {
 	uint32_t _ports;
 	uint32_t _aggregate;
 	Timestamp _last_timestamp;
 	unsigned _flow_over : 2;
 	bool _reverse : 1;
+	bool _udp : 1;
+	unsigned _age_class : 2;
 	FlowInfo *_next;
-	// have 24 bytes; statistics would double
-	// + 8 + 8 = 16 bytes
-	FlowInfo(uint32_t ports, FlowInfo *next, uint32_t agg) : _ports(ports), _aggregate(agg), _flow_over(0), _next(next) { }
+	FlowInfo *_age_prev;
+	FlowInfo *_age_next;
+	HostPairInfo *_hpinfo;
+	FlowInfo(uint32_t ports, FlowInfo *next, uint32_t agg, HostPairInfo *hpinfo) : _ports(ports), _aggregate(agg), _flow_over(0), _next(next), _age_prev(0), _age_next(0), _hpinfo(hpinfo) { }
 	uint32_t aggregate() const { return _aggregate; }
 	bool reverse() const	{ return _reverse; }
+	int age_class() const {
+	    return _udp ? AGE_UDP : (_flow_over == 3 ? AGE_TCP_DONE : AGE_TCP);
+	}
     };
 
 #if CLICK_USERLEVEL
@@ -196,7 +244,7 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
 	Timestamp _first_timestamp;
 	uint32_t _filepos;
 	uint32_t _packets[2];
-	StatFlowInfo(uint32_t ports, FlowInfo *next, uint32_t agg) : FlowInfo(ports, next, agg) { _packets[0] = _packets[1] = 0; }
+	StatFlowInfo(uint32_t ports, FlowInfo *next, uint32_t agg, HostPairInfo *hpinfo) : FlowInfo(ports, next, agg, hpinfo) { _packets[0] = _packets[1] = 0; }
     };
 #endif
 
@@ -204,17 +252,36 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
 	FlowInfo *_flows;
 	Packet *_fragment_head;
 	Packet *_fragment_tail;
+	HostPair _hosts;
 	HostPairInfo() : _flows(0), _fragment_head(0), _fragment_tail(0) { }
 	FlowInfo *find_force(uint32_t ports);
     };
 
     typedef HashTable<HostPair, HostPairInfo> Map;
-    Map _tcp_map;
-    Map _udp_map;
 
-    uint32_t _next;
-    unsigned _active_sec;
-    unsigned _gc_sec;
+    struct ThreadState {
+	Map tcp_map;
+	Map udp_map;
+	FlowInfo *age_head[NAGE];
+	FlowInfo *age_tail[NAGE];
+	unsigned active_sec;
+	unsigned gc_sec;
+	uint32_t next_aggregate;
+	uint32_t end_aggregate;
+	unsigned nfragments;
+	bool timestamp_warning;
+	Packet *out_head;
+	Packet *out_tail;
+	unsigned out_count;
+	Vector<AggregateListener::Notification> notifications;
+	Spinlock lock;		// held while processing; taken by clear
+	ThreadState();
+    };
+    per_thread<ThreadState> _state;
+    SlabAllocator _flow_alloc;
+
+    enum { aggregate_block = 256, notification_batch = 64 };
+    atomic_uint32_t _next;
 
     uint32_t _tcp_timeout;
     uint32_t _tcp_done_timeout;
@@ -224,13 +291,15 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
     unsigned _gc_interval;
     unsigned _fragment_timeout;
 
+    uint32_t _age_timeout[NAGE];
+
     bool _handle_icmp_errors : 1;
     unsigned _fragments : 2;
-    bool _timestamp_warning : 1;
 
 #if CLICK_USERLEVEL
     FILE *_traceinfo_file;
     String _traceinfo_filename;
+    SimpleSpinlock _traceinfo_lock;
 
     Element *_packet_source;
     HandlerCall *_filepos_h;
@@ -238,25 +307,37 @@ class AggregateIPFlows : public Element, public AggregateNotifier { public:
 
     static const click_ip *icmp_encapsulated_header(const Packet *);
 
-    void clean_map(Map &);
-    void reap_map(Map &, uint32_t, uint32_t);
-    void reap();
+    void clean_map(ThreadState &, Map &);
+    void reap_fragments(ThreadState &, Map &);
+    void reap_flows(ThreadState &, int budget);
+    void reap(ThreadState &);
+    void clear(ThreadState &);
 
-    inline int relevant_timeout(const FlowInfo *, const Map &) const;
+    inline uint32_t new_aggregate(ThreadState &);
+    inline void notify_later(ThreadState &, uint32_t, AggregateListener::AggregateEvent, const Packet *);
+    void flush_notifications(ThreadState &);
+    inline void emit(ThreadState &, Packet *);
+    void flush(ThreadState &);
+    inline Packet *dequeue(ThreadState &);
+
+    static inline void age_unlink(ThreadState &, FlowInfo *);
+    static inline void age_append(ThreadState &, FlowInfo *);
+
+    inline int relevant_timeout(const FlowInfo *) const;
 #if CLICK_USERLEVEL
     void stat_new_flow_hook(const Packet *, FlowInfo *);
 #endif
-    inline void packet_emit_hook(const Packet *, const click_ip *, FlowInfo *);
+    inline void packet_emit_hook(ThreadState &, const Packet *, const click_ip *, FlowInfo *);
     inline void delete_flowinfo(const HostPair &, FlowInfo *, bool really_delete = true);
-    void emit_fragment_head(HostPairInfo *hpinfo);
-    FlowInfo *find_flow_info(Map &, HostPairInfo *, uint32_t ports, bool flipped, const Packet *);
-
-    FlowInfo *uncommon_case(FlowInfo *finfo, const click_ip *iph);
+    void emit_fragment_head(ThreadState &, HostPairInfo *hpinfo);
+    inline void emit_old_fragments(ThreadState &, HostPairInfo *hpinfo);
+    FlowInfo *find_flow_info(ThreadState &, Map &, HostPairInfo *, uint32_t ports, bool flipped, const Packet *);
 
     enum { ACT_EMIT, ACT_DROP, ACT_NONE };
-    int handle_fragment(Packet *, HostPairInfo *);
-    int handle_packet(Packet *);
+    int handle_fragment(ThreadState &, Packet *, HostPairInfo *);
+    int handle_packet(ThreadState &, Packet *);
 
+    static String read_handler(Element *, void *) CLICK_COLD;
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
 
 };
@@ -8,6 +8,13 @@ AggregateListener::aggregate_notify(uint32_t, AggregateEvent, const Packet *)
 {
 }
 
+void
+AggregateListener::aggregate_notify_batch(const Notification *n, int count)
+{
+    for (int i = 0; i < count; i++)
+	aggregate_notify(n[i].aggregate, n[i].event, n[i].packet);
+}
+
 void
 AggregateNotifier::add_listener(AggregateListener *l)
 {
@@ -13,6 +13,19 @@ class AggregateListener { public:
     enum AggregateEvent { NEW_AGG, DELETE_AGG };
     virtual void aggregate_notify(uint32_t, AggregateEvent, const Packet *);
 
+    struct Notification {
+	uint32_t aggregate;
+	AggregateEvent event;
+	const Packet *packet;
+    };
+
+    /** @brief Receive several notifications at once.
+     *
+     * The default implementation calls aggregate_notify() for each
+     * notification in order.  Listeners that can amortize work over many
+     * notifications may override it. */
+    virtual void aggregate_notify_batch(const Notification *n, int count);
+
 };
 
 class AggregateNotifier { public:
@@ -23,7 +36,10 @@ class AggregateNotifier { public:
     void add_listener(AggregateListener *);
     void remove_listener(AggregateListener *);
 
+    bool has_listeners() const		{ return _listeners.size() != 0; }
+
     void notify(uint32_t, AggregateListener::AggregateEvent, const Packet *) const;
+    inline void notify_batch(const AggregateListener::Notification *, int) const;
 
   private:
 
@@ -38,5 +54,12 @@ AggregateNotifier::notify(uint32_t agg, AggregateListener::AggregateEvent e, con
 	_listeners[i]->aggregate_notify(agg, e, p);
 }
 
+inline void
+AggregateNotifier::notify_batch(const AggregateListener::Notification *n, int count) const
+{
+    for (int i = 0; i < _listeners.size(); i++)
+	_listeners[i]->aggregate_notify_batch(n, count);
+}
+
 CLICK_ENDDECLS
 #endif
@@ -27,15 +27,23 @@
 #include <click/llrpc.h>
 #include <click/integers.hh>	// for first_bit_set
 #include <click/bitvector.hh>
+#include <clicknet/tcp.h>
 #ifdef CLICK_USERLEVEL
 # include <unistd.h>
 # include <time.h>
 #endif
+#if defined(__AES__) && !CLICK_LINUXMODULE
+# include <wmmintrin.h>
+# define ANONIPADDR_AESNI 1
+#endif
 CLICK_DECLS
 
 AnonymizeIPAddr::AnonymizeIPAddr()
-    : _root(0), _free(0)
+    : _root(0), _free(0), _keyed(false), _flip16(0)
 {
+    ThreadCache tc;
+    tc.e = 0;
+    _caches.setAll(tc);
 }
 
 AnonymizeIPAddr::~AnonymizeIPAddr()
@@ -58,6 +66,95 @@ AnonymizeIPAddr::new_node_block()
     return &block[0];
 }
 
+static const uint8_t aes_sbox[256] = {
+    0x63, 0x7C, 0x77, 0x7B, 0xF2, 0x6B, 0x6F, 0xC5, 0x30, 0x01, 0x67, 0x2B,
+    0xFE, 0xD7, 0xAB, 0x76, 0xCA, 0x82, 0xC9, 0x7D, 0xFA, 0x59, 0x47, 0xF0,
+    0xAD, 0xD4, 0xA2, 0xAF, 0x9C, 0xA4, 0x72, 0xC0, 0xB7, 0xFD, 0x93, 0x26,
+    0x36, 0x3F, 0xF7, 0xCC, 0x34, 0xA5, 0xE5, 0xF1, 0x71, 0xD8, 0x31, 0x15,
+    0x04, 0xC7, 0x23, 0xC3, 0x18, 0x96, 0x05, 0x9A, 0x07, 0x12, 0x80, 0xE2,
+    0xEB, 0x27, 0xB2, 0x75, 0x09, 0x83, 0x2C, 0x1A, 0x1B, 0x6E, 0x5A, 0xA0,
+    0x52, 0x3B, 0xD6, 0xB3, 0x29, 0xE3, 0x2F, 0x84, 0x53, 0xD1, 0x00, 0xED,
+    0x20, 0xFC, 0xB1, 0x5B, 0x6A, 0xCB, 0xBE, 0x39, 0x4A, 0x4C, 0x58, 0xCF,
+    0xD0, 0xEF, 0xAA, 0xFB, 0x43, 0x4D, 0x33, 0x85, 0x45, 0xF9, 0x02, 0x7F,
+    0x50, 0x3C, 0x9F, 0xA8, 0x51, 0xA3, 0x40, 0x8F, 0x92, 0x9D, 0x38, 0xF5,
+    0xBC, 0xB6, 0xDA, 0x21, 0x10, 0xFF, 0xF3, 0xD2, 0xCD, 0x0C, 0x13, 0xEC,
+    0x5F, 0x97, 0x44, 0x17, 0xC4, 0xA7, 0x7E, 0x3D, 0x64, 0x5D, 0x19, 0x73,
+    0x60, 0x81, 0x4F, 0xDC, 0x22, 0x2A, 0x90, 0x88, 0x46, 0xEE, 0xB8, 0x14,
+    0xDE, 0x5E, 0x0B, 0xDB, 0xE0, 0x32, 0x3A, 0x0A, 0x49, 0x06, 0x24, 0x5C,
+    0xC2, 0xD3, 0xAC, 0x62, 0x91, 0x95, 0xE4, 0x79, 0xE7, 0xC8, 0x37, 0x6D,
+    0x8D, 0xD5, 0x4E, 0xA9, 0x6C, 0x56, 0xF4, 0xEA, 0x65, 0x7A, 0xAE, 0x08,
+    0xBA, 0x78, 0x25, 0x2E, 0x1C, 0xA6, 0xB4, 0xC6, 0xE8, 0xDD, 0x74, 0x1F,
+    0x4B, 0xBD, 0x8B, 0x8A, 0x70, 0x3E, 0xB5, 0x66, 0x48, 0x03, 0xF6, 0x0E,
+    0x61, 0x35, 0x57, 0xB9, 0x86, 0xC1, 0x1D, 0x9E, 0xE1, 0xF8, 0x98, 0x11,
+    0x69, 0xD9, 0x8E, 0x94, 0x9B, 0x1E, 0x87, 0xE9, 0xCE, 0x55, 0x28, 0xDF,
+    0x8C, 0xA1, 0x89, 0x0D, 0xBF, 0xE6, 0x42, 0x68, 0x41, 0x99, 0x2D, 0x0F,
+    0xB0, 0x54, 0xBB, 0x16
+};
+
+/* Expand the 16-byte AES key @a key into 11 round keys. */
+static void
+aes128_expand(const uint8_t *key, uint8_t *rk)
+{
+    memcpy(rk, key, 16);
+    uint8_t rcon = 1;
+    for (int i = 16; i < 176; i += 4) {
+	uint8_t t[4] = { rk[i - 4], rk[i - 3], rk[i - 2], rk[i - 1] };
+	if (i % 16 == 0) {
+	    uint8_t x = t[0];
+	    t[0] = aes_sbox[t[1]] ^ rcon;
+	    t[1] = aes_sbox[t[2]];
+	    t[2] = aes_sbox[t[3]];
+	    t[3] = aes_sbox[x];
+	    rcon = (rcon << 1) ^ ((rcon >> 7) * 0x1B);
+	}
+	for (int j = 0; j < 4; ++j)
+	    rk[i + j] = rk[i - 16 + j] ^ t[j];
+    }
+}
+
+static inline uint8_t
+aes_xtime(uint8_t x)
+{
+    return (x << 1) ^ ((x >> 7) * 0x1B);
+}
+
+/* Encrypt one block with the round keys @a rk. */
+static inline void
+aes128_encrypt(const uint8_t *rk, const uint8_t *in, uint8_t *out)
+{
+#if ANONIPADDR_AESNI
+    __m128i b = _mm_loadu_si128((const __m128i *) in);
+    b = _mm_xor_si128(b, _mm_loadu_si128((const __m128i *) rk));
+    for (int r = 1; r < 10; ++r)
+	b = _mm_aesenc_si128(b, _mm_loadu_si128((const __m128i *) (rk + 16 * r)));
+    b = _mm_aesenclast_si128(b, _mm_loadu_si128((const __m128i *) (rk + 160)));
+    _mm_storeu_si128((__m128i *) out, b);
+#else
+    uint8_t s[16], t[16];
+    for (int i = 0; i < 16; ++i)
+	s[i] = in[i] ^ rk[i];
+    for (int r = 1; r <= 10; ++r) {
+	// SubBytes and ShiftRows; the state is column-major
+	for (int c = 0; c < 4; ++c)
+	    for (int row = 0; row < 4; ++row)
+		t[c * 4 + row] = aes_sbox[s[((c + row) & 3) * 4 + row]];
+	if (r < 10)		// MixColumns
+	    for (int c = 0; c < 4; ++c) {
+		uint8_t *col = t + c * 4;
+		uint8_t a0 = col[0], a1 = col[1], a2 = col[2], a3 = col[3];
+		uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+		col[0] = a0 ^ all ^ aes_xtime(a0 ^ a1);
+		col[1] = a1 ^ all ^ aes_xtime(a1 ^ a2);
+		col[2] = a2 ^ all ^ aes_xtime(a2 ^ a3);
+		col[3] = a3 ^ all ^ aes_xtime(a3 ^ a0);
+	    }
+	for (int i = 0; i < 16; ++i)
+	    s[i] = t[i] ^ rk[16 * r + i];
+    }
+    memcpy(out, s, 16);
+#endif
+}
+
 static inline uint32_t
 rand32()
 {
@@ -68,10 +165,11 @@ int
 AnonymizeIPAddr::configure(Vector<String> &conf, ErrorHandler *errh)
 {
     _preserve_class = 0;
-    String preserve_8;
+    String preserve_8, key;
     bool seed_ignored;
 
     if (Args(conf, this, errh)
+	.read("KEY", AnyArg(), key)
 	.read("CLASS", _preserve_class)
 	.read("PRESERVE_8", AnyArg(), preserve_8)
 	.read("SEED", seed_ignored)
@@ -96,12 +194,58 @@ AnonymizeIPAddr::configure(Vector<String> &conf, ErrorHandler *errh)
 		return errh->error("PRESERVE_8 expects integer between 0 and 255");
     }
 
+    // parse key
+    if ((_keyed = (bool) key)) {
+	uint8_t k[32];
+	if (key.length() != 64)
+	    return errh->error("KEY must have 64 hexadecimal digits");
+	for (int i = 0; i < 64; i++) {
+	    int c = (unsigned char) key[i], d;
+	    if (c >= '0' && c <= '9')
+		d = c - '0';
+	    else if ((c | 0x20) >= 'a' && (c | 0x20) <= 'f')
+		d = (c | 0x20) - 'a' + 10;
+	    else
+		return errh->error("KEY must have 64 hexadecimal digits");
+	    k[i / 2] = (i & 1 ? k[i / 2] | d : d << 4);
+	}
+	aes128_expand(k, _round_keys);
+	aes128_encrypt(_round_keys, k + 16, _pad);
+    }
+
     return 0;
 }
 
 int
 AnonymizeIPAddr::initialize(ErrorHandler *errh)
 {
+    _mt = get_passing_threads().weight() > 1;
+    if (_keyed) {
+	// Compute the flip bit of every prefix shorter than 16 bits once.
+	// Prefix p of length pos is tree node (1 << pos) + p.
+	Vector<uint8_t> flip(1 << 16, 0);
+	for (int pos = 0; pos < 16; ++pos)
+	    for (uint32_t p = 0; p < (1U << pos); ++p) {
+		uint32_t prefix = (pos ? p << (32 - pos) : 0);
+		if (!preserved(prefix, pos))
+		    flip[(1 << pos) + p] = pan_bit(prefix, pos);
+	    }
+	if (!(_flip16 = new uint16_t[1 << 16]))
+	    return errh->error("out of memory!");
+	for (uint32_t v = 0; v < (1U << 16); ++v) {
+	    uint16_t f = 0;
+	    for (uint32_t node = 1, pos = 0; pos < 16; ++pos) {
+		f |= flip[node] << (15 - pos);
+		node = 2 * node + ((v >> (15 - pos)) & 1);
+	    }
+	    _flip16[v] = f;
+	}
+	uint32_t zero = pan_permute(0), ones = pan_permute(0xFFFFFFFFU);
+	_pan_special[0] = (zero != 0 && zero != 0xFFFFFFFFU ? zero : ones);
+	_pan_special[1] = (ones != 0 && ones != 0xFFFFFFFFU ? ones : zero);
+	return 0;
+    }
+
     if (!(_root = new_node()))
 	return errh->error("out of memory!");
     _root->input = 1;		// use 1 instead of 0 b/c 0.0.0.0 is special
@@ -136,7 +280,6 @@ AnonymizeIPAddr::initialize(ErrorHandler *errh)
     _special_nodes[0].input = _special_nodes[0].output = 0;
     _special_nodes[1].input = _special_nodes[1].output = 0xFFFFFFFF;
 
-    _mt = get_passing_threads().weight() > 1;
     return 0;
 }
 
@@ -146,6 +289,12 @@ AnonymizeIPAddr::cleanup(CleanupStage)
     for (int i = 0; i < _blocks.size(); i++)
 	delete[] _blocks[i];
     _blocks.clear();
+    delete[] _flip16;
+    _flip16 = 0;
+    for (unsigned i = 0; i < _caches.weight(); ++i) {
+	delete[] _caches.get_value(i).e;
+	_caches.get_value(i).e = 0;
+    }
 }
 
 uint32_t
@@ -236,13 +385,93 @@ AnonymizeIPAddr::find_node(uint32_t a)
     return 0;
 }
 
+/* Return true if the bit after the @a pos-bit prefix @a prefix must not be
+   flipped, because of CLASS or PRESERVE_8. */
+bool
+AnonymizeIPAddr::preserved(uint32_t prefix, int pos) const
+{
+    uint32_t mask = (pos ? ~(0xFFFFFFFFU >> pos) : 0);
+    if (pos < _preserve_class && prefix == mask)
+	return true;
+    if (pos < 8)
+	for (int i = 0; i < _preserve_8.size(); i++)
+	    if (((_preserve_8[i] << 24) & mask) == prefix)
+		return true;
+    return false;
+}
+
+/* Return the Crypto-PAn flip bit for the bit after the @a pos-bit prefix of
+   @a a. */
+inline uint32_t
+AnonymizeIPAddr::pan_bit(uint32_t a, int pos) const
+{
+    uint32_t pad = (_pad[0] << 24) | (_pad[1] << 16) | (_pad[2] << 8) | _pad[3];
+    uint32_t x = (pos ? (a & ~(0xFFFFFFFFU >> pos)) | (pad & (0xFFFFFFFFU >> pos)) : pad);
+    uint8_t in[16], out[16];
+    in[0] = x >> 24;
+    in[1] = x >> 16;
+    in[2] = x >> 8;
+    in[3] = x;
+    memcpy(in + 4, _pad + 4, 12);
+    aes128_encrypt(_round_keys, in, out);
+    return out[0] >> 7;
+}
+
+/* Return the Crypto-PAn permutation of @a a, in host byte order. */
+uint32_t
+AnonymizeIPAddr::pan_permute(uint32_t a) const
+{
+    uint32_t flips = (uint32_t) _flip16[a >> 16] << 16;
+    for (int pos = 16; pos < 32; ++pos)
+	if (pos >= _preserve_class || !preserved(a & ~(0xFFFFFFFFU >> pos), pos))
+	    flips |= pan_bit(a, pos) << (31 - pos);
+    return a ^ flips;
+}
+
+/* Anonymize @a a, in host byte order, with Crypto-PAn. */
+uint32_t
+AnonymizeIPAddr::pan_anonymize(uint32_t a) const
+{
+    if (a == 0 || a == 0xFFFFFFFFU)
+	return a;
+    uint32_t out = pan_permute(a);
+    // 0.0.0.0 and 255.255.255.255 map to themselves, so the addresses the
+    // permutation sends there take the outputs those two gave up
+    if (unlikely(out == 0 || out == 0xFFFFFFFFU))
+	out = _pan_special[out & 1];
+    return out;
+}
+
 inline uint32_t
 AnonymizeIPAddr::anonymize_addr(uint32_t a)
 {
-    if (Node *n = find_node(ntohl(a)))
-	return htonl(n->output);
+    ThreadCache &tc = *_caches;
+    if (unlikely(!tc.e))
+	tc.e = new CacheEntry[cache_size]();
+    CacheEntry &e = tc.e[(a * 0x9E3779B1U) >> (32 - cache_shift)];
+    if (e.input == a)
+	return e.output;
+
+    uint32_t out;
+    if (_keyed)
+	out = htonl(pan_anonymize(ntohl(a)));
+    else if (Node *n = find_node(ntohl(a)))
+	out = htonl(n->output);
     else
 	return 0;
+    e.input = a;
+    e.output = out;
+    return out;
+}
+
+/* Adjust checksum @a sum for a header change, where @a delta is the sum of
+   the complemented old halfwords and the new halfwords (RFC1624). */
+static inline uint16_t
+adjust_cksum(uint16_t sum, uint32_t delta)
+{
+    delta += ~sum & 0xFFFF;
+    delta = (delta & 0xFFFF) + (delta >> 16);
+    return ~(delta + (delta >> 16));
 }
 
 void
@@ -278,6 +507,50 @@ AnonymizeIPAddr::handle_icmp(WritablePacket *q)
     }
 }
 
+/* Anonymize IPv4 packet @a p. */
+inline Packet *
+AnonymizeIPAddr::anonymize(Packet *p)
+{
+    WritablePacket *q = p->uniqueify();
+    if (!q)
+	return 0;
+    click_ip *iph = q->ip_header();
+    uint32_t src = iph->ip_src.s_addr, dst = iph->ip_dst.s_addr;
+
+    // incrementally update checksums according to RFC1624:
+    // new_sum = ~(~old_sum + ~old_halfword + new_halfword)
+    uint32_t delta = (~src & 0xFFFF) + (~src >> 16) + (~dst & 0xFFFF) + (~dst >> 16);
+
+    iph->ip_src.s_addr = src = anonymize_addr(src);
+    iph->ip_dst.s_addr = dst = anonymize_addr(dst);
+
+    delta += (src & 0xFFFF) + (src >> 16) + (dst & 0xFFFF) + (dst >> 16);
+    iph->ip_sum = adjust_cksum(iph->ip_sum, delta);
+
+    // the TCP and UDP checksums cover the addresses too
+    if (IP_FIRSTFRAG(iph)) {
+	if (iph->ip_p == IP_PROTO_TCP
+	    && q->transport_length() >= (int) sizeof(click_tcp)) {
+	    click_tcp *tcph = q->tcp_header();
+	    tcph->th_sum = adjust_cksum(tcph->th_sum, delta);
+	} else if (iph->ip_p == IP_PROTO_UDP
+		   && q->transport_length() >= (int) sizeof(click_udp)) {
+	    click_udp *udph = q->udp_header();
+	    if (udph->uh_sum) {
+		udph->uh_sum = adjust_cksum(udph->uh_sum, delta);
+		if (!udph->uh_sum)
+		    udph->uh_sum = 0xFFFF;
+	    }
+	}
+    }
+
+    // check encapsulated headers for ICMP
+    if (iph->ip_p == IP_PROTO_ICMP)
+	handle_icmp(q);
+
+    return q;
+}
+
 Packet *
 AnonymizeIPAddr::simple_action(Packet *p)
 {
@@ -285,30 +558,26 @@ AnonymizeIPAddr::simple_action(Packet *p)
     if (!p->has_network_header() || in_iph->ip_v != 4) {
 	checked_output_push(1, p);
 	return 0;
-    } else if (WritablePacket *q = p->uniqueify()) {
-	click_ip *iph = q->ip_header();
-	uint32_t src = iph->ip_src.s_addr, dst = iph->ip_dst.s_addr;
-
-	// incrementally update IP checksum according to RFC1624:
-	// new_sum = ~(~old_sum + ~old_halfword + new_halfword)
-	uint32_t sum = (~iph->ip_sum & 0xFFFF)
-	    + (~src & 0xFFFF) + (~src >> 16) + (~dst & 0xFFFF) + (~dst >> 16);
-
-	iph->ip_src.s_addr = src = anonymize_addr(src);
-	iph->ip_dst.s_addr = dst = anonymize_addr(dst);
-
-	sum += (src & 0xFFFF) + (src >> 16) + (dst & 0xFFFF) + (dst >> 16);
-	sum = (sum & 0xFFFF) + (sum >> 16);
-	iph->ip_sum = ~(sum + (sum >> 16));
-
-	// check encapsulated headers for ICMP
-	if (iph->ip_p == IP_PROTO_ICMP)
-	    handle_icmp(q);
-
-	return q;
     } else
-	return 0;
+	return anonymize(p);
+}
+
+#if HAVE_BATCH
+PacketBatch *
+AnonymizeIPAddr::simple_action_batch(PacketBatch *batch)
+{
+    auto fnt = [this](Packet *p) -> Packet * {
+	if (!p->has_network_header() || p->ip_header()->ip_v != 4) {
+	    p->set_next(0);
+	    checked_output_push(1, p);
+	    return 0;
+	}
+	return anonymize(p);
+    };
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(fnt, batch, [](Packet *){});
+    return batch;
 }
+#endif
 
 int
 AnonymizeIPAddr::llrpc(unsigned command, void *data)
@@ -320,7 +589,7 @@ AnonymizeIPAddr::llrpc(unsigned command, void *data)
 	return 0;
 
     } else
-	return Element::llrpc(command, data);
+	return BatchElement::llrpc(command, data);
 }
 
 CLICK_ENDDECLS
@@ -1,14 +1,15 @@
 // -*- c-basic-offset: 4 -*-
 #ifndef CLICK_ANONIPADDR_HH
 #define CLICK_ANONIPADDR_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/sync.hh>
+#include <click/multithread.hh>
 CLICK_DECLS
 
 /*
 =c
 
-AnonymizeIPAddr
+AnonymizeIPAddr([I<keywords> KEY, CLASS, PRESERVE_8])
 
 =s ip
 
@@ -23,11 +24,22 @@ p-bit prefix, then the corresponding output addresses also share the same
 p-bit prefix. AnonymizeIPAddr was based on Greg Minshall's tcpdpriv(1); see
 L<http://ita.ee.lbl.gov/html/contrib/tcpdpriv.html|http://ita.ee.lbl.gov/html/contrib/tcpdpriv.html>.
 
+By default the mapping is random and built up as addresses are seen, so it
+differs from run to run. If KEY is given, AnonymizeIPAddr instead uses the
+keyed, stateless Crypto-PAn scheme: the mapping depends only on the key, so
+the same key gives the same output in every run and on every thread. With
+the default CLASS and PRESERVE_8, the output matches other Crypto-PAn
+implementations, except for the special addresses below.
+
 The special IP addresses 0.0.0.0 and 255.255.255.255 are always mapped to
-themselves, independent of any other mapping.
+themselves, independent of any other mapping. With KEY, the (at most two)
+addresses that Crypto-PAn would map onto 0.0.0.0 or 255.255.255.255 instead
+get the outputs Crypto-PAn gives those special addresses, so the mapping stays
+one-to-one; for those addresses alone, prefixes are not preserved.
 
-AnonymizeIPAddr also incrementally updates the IP header checksum, so the new
-header is correct iff the old header was correct.
+AnonymizeIPAddr also incrementally updates the IP header checksum, and the TCP
+and UDP checksums, so the new headers are correct iff the old headers were
+correct.
 
 AnonymizeIPAddr only manipulates the IP header pointed to by the IP header
 annotation. This differs from tcpdpriv, which also anonymizes addresses on
@@ -37,6 +49,12 @@ Keyword arguments are:
 
 =over 8
 
+=item KEY
+
+String of 64 hexadecimal digits: a 32-byte Crypto-PAn key. The first 16 bytes
+are the AES key; the rest seeds the pad. Default is no key, for the random
+mapping.
+
 =item CLASS
 
 Integer. Preserve some "class" information from input IP addresses. If CLASS
@@ -75,7 +93,15 @@ to each other. Here is the complete list:
 
 =n
 
-AnonymizeIPAddr's anonymization corresponds to tcpdpriv's -A50 option.
+Without KEY, AnonymizeIPAddr's anonymization corresponds to tcpdpriv's -A50
+option. Threads share the mapping under a lock.
+
+With KEY, AnonymizeIPAddr precomputes the mapping of the top 16 address bits
+at initialization; each new address then costs 16 AES encryptions, using
+AES-NI when the compiler targets it. Nothing is shared, so throughput scales
+with threads. CLASS and PRESERVE_8 work in both modes.
+
+In both modes each thread caches recently anonymized addresses.
 
 Prefix-preserving anonymization is not foolproof. The L<http://ita.ee.lbl.gov/html/contrib/tcpdpriv.html|tcpdpriv distribution> contains a paper describing the possible attack. Tatu Ylonen closes that document by saying: "If you are
 very concerned about leaking your network topology, I would not
@@ -92,7 +118,7 @@ location.
 
 tcpdpriv(1) */
 
-class AnonymizeIPAddr : public Element { public:
+class AnonymizeIPAddr : public BatchElement { public:
 
     AnonymizeIPAddr() CLICK_COLD;
     ~AnonymizeIPAddr() CLICK_COLD;
@@ -105,6 +131,9 @@ class AnonymizeIPAddr : public Element { public:
     void cleanup(CleanupStage) CLICK_COLD;
 
     Packet *simple_action(Packet *);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *);
+#endif
 
     int llrpc(unsigned, void *);
 
@@ -126,6 +155,24 @@ class AnonymizeIPAddr : public Element { public:
     int _preserve_class;
     Vector<uint32_t> _preserve_8;
 
+    // KEY mode
+    bool _keyed;
+    uint8_t _round_keys[176];
+    uint8_t _pad[16];
+    uint16_t *_flip16;		// flip bits for each top 16-bit prefix
+    uint32_t _pan_special[2];	// outputs for addresses permuted onto
+				// 0.0.0.0 and 255.255.255.255
+
+    enum { cache_shift = 12, cache_size = 1 << cache_shift };
+    struct CacheEntry {
+	uint32_t input;		// network byte order
+	uint32_t output;
+    };
+    struct ThreadCache {
+	CacheEntry *e;
+    };
+    per_thread<ThreadCache> _caches;
+
     Node *new_node();
     Node *new_node_block();
     void free_node(Node *);
@@ -133,7 +180,12 @@ class AnonymizeIPAddr : public Element { public:
     uint32_t make_output(uint32_t, int) const;
     Node *make_peer(uint32_t, Node *);
     Node *find_node(uint32_t);
+    bool preserved(uint32_t, int) const;
+    inline uint32_t pan_bit(uint32_t, int) const;
+    uint32_t pan_permute(uint32_t) const;
+    uint32_t pan_anonymize(uint32_t) const;
     inline uint32_t anonymize_addr(uint32_t);
+    inline Packet *anonymize(Packet *);
 
     void handle_icmp(WritablePacket *);
 
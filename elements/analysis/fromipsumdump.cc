@@ -37,6 +37,9 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#if HAVE_USER_MULTITHREAD
+# include <pthread.h>
+#endif
 CLICK_DECLS
 
 #ifdef i386
@@ -49,7 +52,10 @@ CLICK_DECLS
 #define GET1(p)		((p)[0])
 
 FromIPSummaryDump::FromIPSummaryDump()
-    : _work_packet(0), _task(this), _timer(this)
+    : _work_packet(0), _task(this), _timer(this), _block_n(0), _block_pos(0)
+#if HAVE_USER_MULTITHREAD
+    , _prefetch(0)
+#endif
 {
     _ff.set_landmark_pattern("%f:%l");
 }
@@ -64,7 +70,7 @@ FromIPSummaryDump::cast(const char *n)
     if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0 && !output_is_push(0))
 	return static_cast<Notifier *>(&_notifier);
     else
-	return Element::cast(n);
+	return BatchElement::cast(n);
 }
 
 int
@@ -73,6 +79,8 @@ FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     bool stop = false, active = true, zero = true, checksum = false, multipacket = false, timing = false, allow_nonexistent = false;
     uint8_t default_proto = IP_PROTO_TCP;
     _sampling_prob = (1 << SAMPLING_SHIFT);
+    _burst = 1;
+    _nthreads = 0;
     String default_contents, default_flowid, data;
 
     if (Args(conf, this, errh)
@@ -92,6 +100,8 @@ FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("FIELDS", AnyArg(), default_contents)
 	.read("FLOWID", AnyArg(), default_flowid)
 	.read("ALLOW_NONEXISTENT", allow_nonexistent)
+	.read("BURST", _burst)
+	.read("THREADS", _nthreads)
         .read("DATA", data)
 	.complete() < 0)
 	return -1;
@@ -100,8 +110,21 @@ FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	_sampling_prob = (1 << SAMPLING_SHIFT);
     } else if (_sampling_prob == 0)
 	errh->warning("SAMPLE probability is 0; emitting no packets");
+    if (_burst == 0)
+	return errh->error("BURST must be positive");
+#if !HAVE_USER_MULTITHREAD
+    if (_nthreads) {
+	errh->warning("THREADS requires user-level multithreading, ignoring");
+	_nthreads = 0;
+    }
+#endif
+#if HAVE_BATCH
+    // single packets are cheaper to push through elements that do not batch
+    if (_burst > 1)
+	in_batch_mode = BATCH_MODE_YES;
+#endif
 
-    _default_proto = default_proto;
+    _format.default_proto = default_proto;
     _stop = stop;
     _active = active;
     _zero = zero;
@@ -110,7 +133,7 @@ FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     _allow_nonexistent = allow_nonexistent;
     _have_timing = false;
     _multipacket = multipacket;
-    _have_flowid = _have_aggregate = _binary = false;
+    _format.have_flowid = _have_aggregate = _binary = false;
     if (default_contents)
 	bang_data(default_contents, errh);
     if (default_flowid)
@@ -124,19 +147,79 @@ FromIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     return 0;
 }
 
+/* Check the column block in _block and find its columns.  Returns 0 on
+   success. */
+int
+FromIPSummaryDump::read_block(ErrorHandler *errh)
+{
+    const uint8_t *data = reinterpret_cast<const uint8_t *>(_block.data());
+    uint32_t n = (_block.length() >= 4 ? GET4(data) : 0);
+    uint64_t off = 4;
+    _block_column.clear();
+    for (int i = 0; i < _format.fields.size(); i++) {
+	int w = _format.fields[i]->binary_size();
+	if (w < 0)
+	    return _ff.error(errh, "variable-length field in column block");
+	_block_column.push_back((uint32_t) off);
+	off += (uint64_t) n * w;
+    }
+    if (off > (uint64_t) _block.length())
+	return _ff.error(errh, "column block too short");
+    _block_n = n;
+    _block_pos = 0;
+    return 0;
+}
+
+/* Return the next packet record of the current column block, in the form of
+   a regular binary record. */
+String
+FromIPSummaryDump::block_record()
+{
+    int len = 0;
+    for (int i = 0; i < _format.fields.size(); i++)
+	len += _format.fields[i]->binary_size();
+    String result = String::make_uninitialized(len);
+    char *x = result.mutable_data();
+    for (int i = 0; i < _format.fields.size(); i++) {
+	int w = _format.fields[i]->binary_size();
+	memcpy(x, _block.data() + _block_column[i] + _block_pos * w, w);
+	x += w;
+    }
+    _block_pos++;
+    return result;
+}
+
 int
 FromIPSummaryDump::read_binary(String &result, ErrorHandler *errh)
 {
     assert(_binary);
 
+  again:
+    if (_block_pos < _block_n) {
+	result = block_record();
+	_ff.set_lineno(_ff.lineno() + 1);
+	return 1;
+    }
+
     uint8_t record_storage[4];
     const uint8_t *record = _ff.get_unaligned(4, record_storage, errh);
     if (!record)
 	return 0;
     int record_length = GET4(record) & 0x7FFFFFFFU;
+    bool textual = (record[0] & 0x80 ? true : false);
+    bool columnar = !textual && (record[0] & 0x40);
+    if (columnar)
+	record_length &= 0x3FFFFFFFU;
     if (record_length < 4)
 	return _ff.error(errh, "binary record too short");
-    bool textual = (record[0] & 0x80 ? true : false);
+    if (columnar) {
+	_block = _ff.get_string(record_length - 4, errh);
+	if (!_block || read_block(errh) < 0) {
+	    _block_n = _block_pos = 0;
+	    return 0;
+	}
+	goto again;
+    }
     result = _ff.get_string(record_length - 4, errh);
     if (!result)
 	return 0;
@@ -168,16 +251,16 @@ FromIPSummaryDump::initialize(ErrorHandler *errh)
     else if (e < 0)
 	return e;
 
-    _minor_version = IPSummaryDump::MINOR_VERSION; // expected minor version
+    _format.minor_version = IPSummaryDump::MINOR_VERSION; // expected minor version
     String line;
     if (_ff.peek_line(line, errh, true) < 0)
 	return -1;
     else if (line.substring(0, 14) == "!IPSummaryDump") {
 	int major_version;
-	if (sscanf(line.c_str() + 14, " %d.%d", &major_version, &_minor_version) == 2) {
-	    if (major_version != IPSummaryDump::MAJOR_VERSION || _minor_version > IPSummaryDump::MINOR_VERSION) {
-		_ff.warning(errh, "unexpected IPSummaryDump version %d.%d", major_version, _minor_version);
-		_minor_version = IPSummaryDump::MINOR_VERSION;
+	if (sscanf(line.c_str() + 14, " %d.%d", &major_version, &_format.minor_version) == 2) {
+	    if (major_version != IPSummaryDump::MAJOR_VERSION || _format.minor_version > IPSummaryDump::MINOR_VERSION) {
+		_ff.warning(errh, "unexpected IPSummaryDump version %d.%d", major_version, _format.minor_version);
+		_format.minor_version = IPSummaryDump::MINOR_VERSION;
 	    }
 	}
 	(void) _ff.read_line(line, errh, true); // throw away line
@@ -188,7 +271,7 @@ FromIPSummaryDump::initialize(ErrorHandler *errh)
 	    && !line.substring(0, 9).equals("!contents", 9)
 	    && !line.substring(0, 6).equals("!proto", 6)
 	    && !line.substring(0, 7).equals("!flowid", 7)) {
-	    if (!_fields.size() /* don't warn on DEFAULT_CONTENTS */)
+	    if (!_format.fields.size() /* don't warn on DEFAULT_CONTENTS */)
 		_ff.warning(errh, "missing banner line; is this an IP summary dump?");
 	}
     }
@@ -199,6 +282,10 @@ FromIPSummaryDump::initialize(ErrorHandler *errh)
 void
 FromIPSummaryDump::cleanup(CleanupStage)
 {
+#if HAVE_USER_MULTITHREAD
+    if (_prefetch)
+	stop_prefetch();
+#endif
     _ff.cleanup();
     if (_work_packet)
 	_work_packet->kill();
@@ -212,8 +299,8 @@ FromIPSummaryDump::sort_fields_compare(const void *ap, const void *bp,
     int a = *reinterpret_cast<const int *>(ap);
     int b = *reinterpret_cast<const int *>(bp);
     FromIPSummaryDump *f = reinterpret_cast<FromIPSummaryDump *>(user_data);
-    const IPSummaryDump::FieldReader *fa = f->_fields[a];
-    const IPSummaryDump::FieldReader *fb = f->_fields[b];
+    const IPSummaryDump::FieldReader *fa = f->_format.fields[a];
+    const IPSummaryDump::FieldReader *fb = f->_format.fields[b];
     if (fa->order < fb->order)
 	return -1;
     if (fa->order > fb->order)
@@ -227,8 +314,8 @@ FromIPSummaryDump::bang_data(const String &line, ErrorHandler *errh)
     Vector<String> words;
     cp_spacevec(line, words);
 
-    _fields.clear();
-    _field_order.clear();
+    _format.fields.clear();
+    _format.field_order.clear();
     for (int i = 0; i < words.size(); i++) {
 	String word = cp_unquote(words[i]);
 	if (i == 0 && (word == "!data" || word == "!contents"))
@@ -241,14 +328,14 @@ FromIPSummaryDump::bang_data(const String &line, ErrorHandler *errh)
 	    _ff.warning(errh, "content type '%s' ignored on input", word.c_str());
 	    f = &IPSummaryDump::null_reader;
 	}
-	_fields.push_back(f);
-	_field_order.push_back(_fields.size() - 1);
+	_format.fields.push_back(f);
+	_format.field_order.push_back(_format.fields.size() - 1);
     }
 
-    if (_fields.size() == 0)
+    if (_format.fields.size() == 0)
 	_ff.error(errh, "no contents specified");
 
-    click_qsort(_field_order.begin(), _fields.size(), sizeof(int),
+    click_qsort(_format.field_order.begin(), _format.fields.size(), sizeof(int),
 		sort_fields_compare, this);
 }
 
@@ -264,13 +351,13 @@ FromIPSummaryDump::bang_proto(const String &line, const char *type,
 	_ff.error(errh, "bad %s", type);
     else if (NameInfo::query_int(NameInfo::T_IP_PROTO, this, words[1], &proto)
 	     && proto < 256)
-	_default_proto = proto;
+	_format.default_proto = proto;
     else if (words[1] == "T")
-	_default_proto = IP_PROTO_TCP;
+	_format.default_proto = IP_PROTO_TCP;
     else if (words[1] == "U")
-	_default_proto = IP_PROTO_UDP;
+	_format.default_proto = IP_PROTO_UDP;
     else if (words[1] == "I")
-	_default_proto = IP_PROTO_ICMP;
+	_format.default_proto = IP_PROTO_ICMP;
     else
 	_ff.error(errh, "bad protocol in %s", type);
 }
@@ -290,12 +377,12 @@ FromIPSummaryDump::bang_flowid(const String &line, ErrorHandler *errh)
 	|| (!IntArg().parse(words[4], dport) && words[4] != "-")
 	|| sport > 65535 || dport > 65535) {
 	_ff.error(errh, "bad !flowid specification");
-	_have_flowid = false;
+	_format.have_flowid = false;
     } else {
 	if (words.size() >= 6)
 	    bang_proto(String::make_stable("! ", 2) + words[5], "!flowid", errh);
 	_given_flowid = IPFlowID(src, htons(sport), dst, htons(dport));
-	_have_flowid = true;
+	_format.have_flowid = true;
     }
 }
 
@@ -352,14 +439,30 @@ set_checksums(WritablePacket *q, click_ip *iph)
     }
 }
 
+void
+FromIPSummaryDump::bang_line(const String &line, ErrorHandler *errh)
+{
+    const char *data = line.begin(), *end = line.end();
+    if (data + 6 <= end && memcmp(data, "!data", 5) == 0 && isspace((unsigned char) data[5]))
+	bang_data(line, errh);
+    else if (data + 8 <= end && memcmp(data, "!flowid", 7) == 0 && isspace((unsigned char) data[7]))
+	bang_flowid(line, errh);
+    else if (data + 7 <= end && memcmp(data, "!proto", 6) == 0 && isspace((unsigned char) data[6]))
+	bang_proto(line, "!proto", errh);
+    else if (data + 11 <= end && memcmp(data, "!aggregate", 10) == 0 && isspace((unsigned char) data[10]))
+	bang_aggregate(line, errh);
+    else if (data + 8 <= end && memcmp(data, "!binary", 7) == 0 && isspace((unsigned char) data[7]))
+	bang_binary(line, errh);
+    else if (data + 10 <= end && memcmp(data, "!contents", 9) == 0 && isspace((unsigned char) data[9]))
+	bang_data(line, errh);
+}
+
 Packet *
 FromIPSummaryDump::read_packet(ErrorHandler *errh)
 {
     // read non-packet lines
     bool binary;
     String line;
-    const char *data;
-    const char *end;
 
     while (1) {
 	if ((binary = _binary)) {
@@ -374,36 +477,48 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
 	    return 0;
 	}
 
-	data = line.begin();
-	end = line.end();
-
-	if (data == end)
+	if (!line)
 	    /* do nothing */;
-	else if (binary || (data[0] != '!' && data[0] != '#'))
+	else if (binary || (line[0] != '!' && line[0] != '#'))
 	    /* real packet */
 	    break;
+	else if (line[0] == '!')
+	    bang_line(line, errh);
+    }
 
-	// parse bang lines
-	if (data[0] == '!') {
-	    if (data + 6 <= end && memcmp(data, "!data", 5) == 0 && isspace((unsigned char) data[5]))
-		bang_data(line, errh);
-	    else if (data + 8 <= end && memcmp(data, "!flowid", 7) == 0 && isspace((unsigned char) data[7]))
-		bang_flowid(line, errh);
-	    else if (data + 7 <= end && memcmp(data, "!proto", 6) == 0 && isspace((unsigned char) data[6]))
-		bang_proto(line, "!proto", errh);
-	    else if (data + 11 <= end && memcmp(data, "!aggregate", 10) == 0 && isspace((unsigned char) data[10]))
-		bang_aggregate(line, errh);
-	    else if (data + 8 <= end && memcmp(data, "!binary", 7) == 0 && isspace((unsigned char) data[7]))
-		bang_binary(line, errh);
-	    else if (data + 10 <= end && memcmp(data, "!contents", 9) == 0 && isspace((unsigned char) data[9]))
-		bang_data(line, errh);
+    int error;
+    Packet *p = parse_record(_format, line, _binary, error);
+    if (error == -ENOMEM)
+	_ff.error(errh, strerror(ENOMEM));
+    else if (error < 0 && !_format_complaint) {
+	// don't complain if the line was all blank
+	if (binary || !cp_is_space(line)) {
+	    if (_format.fields.size() == 0)
+		_ff.error(errh, "no '!data' provided");
+	    else
+		_ff.error(errh, "packet parse error");
+	    _format_complaint = true;
 	}
     }
+    return p;
+}
+
+/* Make the packet described by one record of @a format; @a binary says
+   whether the dump is binary.  On failure returns null and sets @a error to
+   -ENOMEM or, if no field parsed, -EINVAL.  Does not touch the reader state,
+   so parser threads may call it. */
+Packet *
+FromIPSummaryDump::parse_record(const Format &format, const String &line,
+				bool binary, int &error) const
+{
+    const char *data = line.begin();
+    const char *end = line.end();
+    error = 0;
 
     // read packet data
     WritablePacket *q = Packet::make(16, (const unsigned char *) 0, 0, 1000);
     if (!q) {
-	_ff.error(errh, strerror(ENOMEM));
+	error = -ENOMEM;
 	return 0;
     }
     if (_zero)
@@ -411,14 +526,14 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
 
     // prepare packet data
     StringAccum sa;
-    IPSummaryDump::PacketOdesc d(this, q, _default_proto, (_have_flowid ? &_flowid : 0), _minor_version);
+    IPSummaryDump::PacketOdesc d(this, q, format.default_proto, (format.have_flowid ? &format.flowid : 0), format.minor_version);
     int nfields = 0;
 
     // new code goes here
-    if (_binary) {
+    if (binary) {
 	Vector<const unsigned char *> args;
 	int nbytes;
-	for (const IPSummaryDump::FieldReader * const *fp = _fields.begin(); fp != _fields.end(); ++fp) {
+	for (const IPSummaryDump::FieldReader * const *fp = format.fields.begin(); fp != format.fields.end(); ++fp) {
 	    if (!(*fp)->inb)
 		goto bad_field;
 	    switch ((*fp)->type) {
@@ -463,10 +578,10 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
 	    }
 	}
 
-	for (int *fip = _field_order.begin();
-	     fip != _field_order.end() && d.p;
+	for (const int *fip = format.field_order.begin();
+	     fip != format.field_order.end() && d.p;
 	     ++fip) {
-	    const IPSummaryDump::FieldReader *f = _fields[*fip];
+	    const IPSummaryDump::FieldReader *f = format.fields[*fip];
 	    if (!args[*fip] || !f->inject)
 		continue;
 	    d.clear_values();
@@ -478,7 +593,7 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
 
     } else {
 	Vector<String> args;
-	while (args.size() < _fields.size()) {
+	while (args.size() < format.fields.size()) {
 	    const char *original_data = data;
 	    while (data < end)
 		if (isspace((unsigned char) *data))
@@ -492,10 +607,10 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
 		++data;
 	}
 
-	for (int *fip = _field_order.begin();
-	     fip != _field_order.end() && d.p;
+	for (const int *fip = format.field_order.begin();
+	     fip != format.field_order.end() && d.p;
 	     ++fip) {
-	    const IPSummaryDump::FieldReader *f = _fields[*fip];
+	    const IPSummaryDump::FieldReader *f = format.fields[*fip];
 	    if (!args[*fip] || args[*fip].equals("-", 1) || !f->inject)
 		continue;
 	    d.clear_values();
@@ -507,16 +622,7 @@ FromIPSummaryDump::read_packet(ErrorHandler *errh)
     }
 
     if (!nfields) {	// bad format
-	if (!_format_complaint) {
-	    // don't complain if the line was all blank
-	    if (binary || !cp_is_space(line)) {
-		if (_fields.size() == 0)
-		    _ff.error(errh, "no '!data' provided");
-		else
-		    _ff.error(errh, "packet parse error");
-		_format_complaint = true;
-	    }
-	}
+	error = -EINVAL;
 	if (d.p)
 	    d.p->kill();
 	d.p = 0;
@@ -684,37 +790,380 @@ FromIPSummaryDump::check_timing(Packet *p)
     return true;
 }
 
-bool
-FromIPSummaryDump::run_task(Task *)
+#if HAVE_USER_MULTITHREAD
+/* With THREADS, a reader thread copies the records of a binary dump into
+   chunks, parser threads turn each chunk into a list of packets, and the
+   task emits the chunks in file order.  Bang lines are handled by the reader;
+   a chunk ends at each of them, so the records of a chunk share a Format. */
+
+enum { CHUNK_RECORDS = 256 };
+
+struct FromIPSummaryDump::Chunk {
+    struct Record {
+	uint32_t end;		// end offset in data
+	int lineno;
+	bool binary;
+    };
+    const Format *format;
+    StringAccum data;
+    Vector<Record> records;
+    Packet *head;		// parsed packets, linked by next()
+    int bad_lineno;		// first unparsable record, or 0
+    bool parsed;
+    bool eof;
+    Chunk *next;
+};
+
+struct FromIPSummaryDump::Prefetch {
+    pthread_mutex_t lock;
+    pthread_cond_t space_cond;	// the reader waits for a free chunk
+    pthread_cond_t chunk_cond;	// parsers wait for a chunk to parse
+    pthread_t reader;
+    bool have_reader;
+    Vector<pthread_t> parsers;
+    bool stop;
+    Chunk *head;		// oldest chunk, emitted next
+    Chunk *tail;
+    Chunk *unparsed;		// oldest chunk no parser has taken
+    Chunk *free;
+    int nchunks;
+    int max_chunks;
+    Vector<Format *> formats;	// every format a chunk may point to
+    Packet *packets;		// rest of the chunk being emitted
+};
+
+int
+FromIPSummaryDump::start_prefetch(ErrorHandler *errh)
 {
-    if (!_active)
-	return false;
-    Packet *p;
+    Prefetch *pf = new Prefetch;
+    pthread_mutex_init(&pf->lock, 0);
+    pthread_cond_init(&pf->space_cond, 0);
+    pthread_cond_init(&pf->chunk_cond, 0);
+    pf->have_reader = pf->stop = false;
+    pf->head = pf->tail = pf->unparsed = pf->free = 0;
+    pf->nchunks = 0;
+    pf->max_chunks = 4 * (_nthreads + 1);
+    pf->packets = 0;
+    _prefetch = pf;
+
+    // start the parsers first: until the reader runs, falling back to
+    // reading on the task's thread loses nothing
+    int err = 0;
+    for (uint32_t i = 0; i < _nthreads && !err; ++i) {
+	pthread_t t;
+	if ((err = pthread_create(&t, 0, parser_thread, this)) == 0)
+	    pf->parsers.push_back(t);
+    }
+    if (pf->parsers.size() && (err = pthread_create(&pf->reader, 0, reader_thread, this)) == 0)
+	pf->have_reader = true;
+    if (!pf->have_reader) {
+	stop_prefetch();
+	_nthreads = 0;
+	return errh->error("%p{element}: cannot start threads: %s", this, strerror(err));
+    }
+    if (err)
+	errh->warning("%p{element}: started only %d parser threads: %s", this, pf->parsers.size(), strerror(err));
+    return 0;
+}
+
+void
+FromIPSummaryDump::stop_prefetch()
+{
+    Prefetch *pf = _prefetch;
+    pthread_mutex_lock(&pf->lock);
+    pf->stop = true;
+    pthread_cond_broadcast(&pf->space_cond);
+    pthread_cond_broadcast(&pf->chunk_cond);
+    pthread_mutex_unlock(&pf->lock);
+    if (pf->have_reader)
+	pthread_join(pf->reader, 0);
+    for (pthread_t *tp = pf->parsers.begin(); tp != pf->parsers.end(); ++tp)
+	pthread_join(*tp, 0);
+
+    if (pf->tail)
+	pf->tail->next = pf->free;
+    else
+	pf->head = pf->free;
+    while (Chunk *c = pf->head) {
+	pf->head = c->next;
+	while (Packet *p = c->head) {
+	    c->head = p->next();
+	    p->kill();
+	}
+	delete c;
+    }
+    while (Packet *p = pf->packets) {
+	pf->packets = p->next();
+	p->kill();
+    }
+    for (Format **fp = pf->formats.begin(); fp != pf->formats.end(); ++fp)
+	delete *fp;
+    pthread_cond_destroy(&pf->chunk_cond);
+    pthread_cond_destroy(&pf->space_cond);
+    pthread_mutex_destroy(&pf->lock);
+    delete pf;
+    _prefetch = 0;
+}
+
+void *
+FromIPSummaryDump::reader_thread(void *thunk)
+{
+    FromIPSummaryDump *fd = static_cast<FromIPSummaryDump *>(thunk);
+    Prefetch *pf = fd->_prefetch;
+    const Format *format = 0;
+    Chunk *c = 0;
+    String line;
+    bool eof = false;
 
     while (1) {
-	p = (_work_packet ? _work_packet : read_packet(0));
-	if (!p && !_ff.initialized()) {
-	    if (_stop)
-		router()->please_stop_driver();
-	    return false;
-	} else if (!p)
+	int result = (eof ? 0 : fd->read_binary(line, 0));
+	if (result <= 0)
+	    eof = true;
+	else if (!line)
+	    continue;
+	else if (result == 2 && (line[0] == '!' || line[0] == '#')) {
+	    if (line[0] == '!') {
+		fd->bang_line(line, 0);
+		format = 0;
+		if (c && c->records.size())
+		    goto submit;
+	    }
+	    continue;
+	}
+
+	if (!c) {
+	    pthread_mutex_lock(&pf->lock);
+	    while (!pf->stop && !pf->free && pf->nchunks == pf->max_chunks)
+		pthread_cond_wait(&pf->space_cond, &pf->lock);
+	    if (pf->stop) {
+		pthread_mutex_unlock(&pf->lock);
+		return 0;
+	    }
+	    if ((c = pf->free))
+		pf->free = c->next;
+	    else {
+		c = new Chunk;
+		pf->nchunks++;
+	    }
+	    if (!format && !eof) {
+		Format *f = new Format(fd->_format);
+		pf->formats.push_back(f);
+		format = f;
+	    }
+	    pthread_mutex_unlock(&pf->lock);
+	    c->format = format;
+	    c->head = 0;
+	    c->bad_lineno = 0;
+	    c->parsed = c->eof = false;
+	}
+
+	if (eof)
+	    c->parsed = c->eof = (c->records.size() == 0);
+	else {
+	    c->data.append(line.data(), line.length());
+	    Chunk::Record r = {(uint32_t) c->data.length(), fd->_ff.lineno(), result == 1};
+	    c->records.push_back(r);
+	    if (c->records.size() < CHUNK_RECORDS)
+		continue;
+	}
+
+      submit:
+	pthread_mutex_lock(&pf->lock);
+	c->next = 0;
+	if (pf->tail)
+	    pf->tail->next = c;
+	else
+	    pf->head = c;
+	pf->tail = c;
+	if (!c->parsed && !pf->unparsed)
+	    pf->unparsed = c;
+	pthread_cond_signal(&pf->chunk_cond);
+	pthread_mutex_unlock(&pf->lock);
+	if (c->eof) {
+	    fd->_task.reschedule();
+	    return 0;
+	}
+	c = 0;
+    }
+}
+
+void *
+FromIPSummaryDump::parser_thread(void *thunk)
+{
+    FromIPSummaryDump *fd = static_cast<FromIPSummaryDump *>(thunk);
+    Prefetch *pf = fd->_prefetch;
+
+    pthread_mutex_lock(&pf->lock);
+    while (1) {
+	while (!pf->stop && !pf->unparsed)
+	    pthread_cond_wait(&pf->chunk_cond, &pf->lock);
+	if (pf->stop)
 	    break;
-	if (p && _timing && !check_timing(p))
-	    return false;
+	Chunk *c = pf->unparsed;
+	pf->unparsed = (c->next && !c->next->parsed ? c->next : 0);
+	pthread_mutex_unlock(&pf->lock);
+
+	fd->parse_chunk(c);
+
+	pthread_mutex_lock(&pf->lock);
+	c->parsed = true;
+	if (c == pf->head)
+	    fd->_task.reschedule();
+    }
+    pthread_mutex_unlock(&pf->lock);
+    return 0;
+}
+
+void
+FromIPSummaryDump::parse_chunk(Chunk *c) const
+{
+    Packet *tail = 0;
+    uint32_t pos = 0;
+    for (Chunk::Record *r = c->records.begin(); r != c->records.end(); ++r) {
+	String line = String::make_stable(c->data.data() + pos, r->end - pos);
+	pos = r->end;
+	int error;
+	if (Packet *p = parse_record(*c->format, line, true, error)) {
+	    if (tail)
+		tail->set_next(p);
+	    else
+		c->head = p;
+	    tail = p;
+	} else if (error == -EINVAL && !c->bad_lineno
+		   && (r->binary || !cp_is_space(line)))
+	    c->bad_lineno = r->lineno;
+    }
+    if (tail)
+	tail->set_next(0);
+    c->data.clear();
+    c->records.clear();
+}
+
+/* Return the next prefetched packet, or null with @a status np_wait if the
+   parsers have not caught up (a parser reschedules the task), or np_eof at
+   the end of the dump. */
+Packet *
+FromIPSummaryDump::prefetched_packet(int &status)
+{
+    Prefetch *pf = _prefetch;
+    while (!pf->packets) {
+	pthread_mutex_lock(&pf->lock);
+	Chunk *c = pf->head;
+	if (!c || !c->parsed) {
+	    pthread_mutex_unlock(&pf->lock);
+	    status = np_wait;
+	    return 0;
+	} else if (c->eof) {
+	    pthread_mutex_unlock(&pf->lock);
+	    stop_prefetch();
+	    _ff.cleanup();
+	    status = np_eof;
+	    return 0;
+	}
+	if (!(pf->head = c->next))
+	    pf->tail = 0;
+	pf->packets = c->head;
+	c->head = 0;
+	int bad_lineno = c->bad_lineno;
+	bool no_fields = c->format->fields.size() == 0;
+	c->next = pf->free;
+	pf->free = c;
+	pthread_cond_signal(&pf->space_cond);
+	pthread_mutex_unlock(&pf->lock);
+
+	if (bad_lineno && !_format_complaint) {
+	    String landmark = _ff.print_filename() + ":record " + String(bad_lineno);
+	    ErrorHandler::default_handler()->lerror(landmark, no_fields ? "no '!data' provided" : "packet parse error");
+	    _format_complaint = true;
+	}
+    }
+    Packet *p = pf->packets;
+    pf->packets = p->next();
+    p->set_next(0);
+    return p;
+}
+#endif
+
+/* Fetch the next packet to emit.  Sets @a status to np_packet if a packet
+   was returned, np_empty if the dump produced no packet this time, np_wait if
+   TIMING holds back the next packet or the parser threads have not caught
+   up, and np_eof at the end of the dump. */
+Packet *
+FromIPSummaryDump::next_packet(int &status)
+{
+    while (1) {
+	Packet *p = _work_packet;
+#if HAVE_USER_MULTITHREAD
+	if (!p && !_prefetch && _nthreads && _binary && _ff.initialized())
+	    (void) start_prefetch(ErrorHandler::default_handler());
+	if (!p && _prefetch) {
+	    if (!(p = prefetched_packet(status)))
+		return 0;
+	} else
+#endif
+	if (!p)
+	    p = read_packet(0);
+	if (!p) {
+	    status = (_ff.initialized() ? np_empty : np_eof);
+	    return 0;
+	}
+	if (_timing && !check_timing(p)) {
+	    status = np_wait;
+	    return 0;
+	}
 	if (_multipacket)
 	    p = handle_multipacket(p);
 	// check sampling probability
 	if (_sampling_prob >= (1 << SAMPLING_SHIFT)
-	    || (click_random() & ((1 << SAMPLING_SHIFT) - 1)) < _sampling_prob)
-	    break;
+	    || (click_random() & ((1 << SAMPLING_SHIFT) - 1)) < _sampling_prob) {
+	    status = (p ? np_packet : np_empty);
+	    return p;
+	}
 	if (p)
 	    p->kill();
     }
+}
 
-    if (p)
-	output(0).push(p);
-    _task.fast_reschedule();
-    return true;
+bool
+FromIPSummaryDump::run_task(Task *)
+{
+    if (!_active)
+	return false;
+
+    uint32_t n = 0;
+    int status = np_empty;
+#if HAVE_BATCH
+    PacketBatch *head = 0;
+    Packet *last = 0;
+#endif
+    while (n < _burst) {
+	Packet *p = next_packet(status);
+	if (!p)
+	    break;
+#if HAVE_BATCH
+	if (in_batch_mode == BATCH_MODE_YES) {
+	    if (head)
+		last->set_next(p);
+	    else
+		head = PacketBatch::start_head(p);
+	    last = p;
+	} else
+#endif
+	    output(0).push(p);
+	++n;
+    }
+#if HAVE_BATCH
+    if (head)
+	output_push_batch(0, head->make_tail(last, n));
+#endif
+
+    if (status == np_eof) {
+	if (_stop)
+	    router()->please_stop_driver();
+	return n > 0;
+    } else if (status != np_wait)
+	_task.fast_reschedule();
+    return n > 0 || status == np_empty;
 }
 
 Packet *
@@ -1,7 +1,7 @@
 // -*- mode: c++; c-basic-offset: 4 -*-
 #ifndef CLICK_FROMIPSUMDUMP_HH
 #define CLICK_FROMIPSUMDUMP_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/task.hh>
 #include <click/timer.hh>
 #include <click/notifier.hh>
@@ -13,7 +13,7 @@ CLICK_DECLS
 /*
 =c
 
-FromIPSummaryDump(FILENAME [, I<keywords> STOP, TIMING, ACTIVE, ZERO, CHECKSUM, PROTO, MULTIPACKET, SAMPLE, FIELDS, FLOWID, DATA])
+FromIPSummaryDump(FILENAME [, I<keywords> STOP, TIMING, ACTIVE, ZERO, CHECKSUM, PROTO, MULTIPACKET, SAMPLE, FIELDS, FLOWID, DATA, BURST, THREADS])
 
 =s traces
 
@@ -32,6 +32,8 @@ FromIPSummaryDump reads from the file named FILENAME unless FILENAME is a
 single dash 'C<->', in which case it reads from the standard input. It will
 not uncompress the standard input, however.
 
+Text, binary, and columnar binary dumps are all understood.
+
 Keyword arguments are:
 
 =over 8
@@ -111,6 +113,21 @@ Defaults to false.
 String. If set, FromIPSummaryDump reads from the DATA string, rather than
 from a file.
 
+=item BURST
+
+Unsigned integer. In push mode, FromIPSummaryDump emits up to BURST packets
+each time its task runs, as one batch in batch-enabled builds. The packets
+keep file order; with TIMING, a batch ends at the first packet that is not
+due yet. Default is 1.
+
+=item THREADS
+
+Unsigned integer. In push mode, read binary dumps ahead in a background
+thread and parse their records into packets with THREADS more threads. The
+task still emits the packets in file order, and applies TIMING, MULTIPACKET
+and SAMPLE itself. Text dumps are always read on the task's thread. Needs
+user-level multithreading. Default is 0, meaning no background threads.
+
 =back
 
 Only available in user-level processes.
@@ -126,6 +143,10 @@ extra header length annotations are set correctly.
 FromIPSummaryDump is a notifier signal, active when the element is active and
 the dump contains more packets.
 
+For fast replays of large dumps, use the binary format, MMAP true (the
+default where supported), a BURST of 32 or more and, with several cores,
+THREADS.
+
 =h sampling_prob read-only
 
 Returns the sampling probability (see the SAMPLE keyword argument).
@@ -155,7 +176,7 @@ When written, sets 'active' to false and stops the driver.
 
 ToIPSummaryDump */
 
-class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
+class FromIPSummaryDump : public BatchElement, public IPSummaryDumpInfo { public:
 
     FromIPSummaryDump() CLICK_COLD;
     ~FromIPSummaryDump() CLICK_COLD;
@@ -171,6 +192,13 @@ class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
 
     bool run_task(Task *);
     Packet *pull(int);
+#if HAVE_BATCH
+    PacketBatch *pull_batch(int port, unsigned max) {
+	PacketBatch *batch;
+	MAKE_BATCH(pull(port), batch, max);
+	return batch;
+    }
+#endif
     void run_timer(Timer *timer);
 
   private:
@@ -179,12 +207,21 @@ class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
 
     FromFile _ff;
 
-    Vector<const IPSummaryDump::FieldReader *> _fields;
-    Vector<int> _field_order;
-    uint16_t _default_proto;
+    // everything a record's packet depends on, besides the record itself
+    struct Format {
+	Vector<const IPSummaryDump::FieldReader *> fields;
+	Vector<int> field_order;
+	uint16_t default_proto;
+	bool have_flowid;
+	IPFlowID flowid;
+	int minor_version;
+    };
+
+    Format _format;
     uint32_t _sampling_prob;
-    IPFlowID _flowid;
     uint32_t _aggregate;
+    uint32_t _burst;
+    uint32_t _nthreads;
 
     bool _stop : 1;
     bool _format_complaint : 1;
@@ -192,7 +229,6 @@ class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     bool _checksum : 1;
     bool _active : 1;
     bool _multipacket : 1;
-    bool _have_flowid : 1;
     bool _have_aggregate : 1;
     bool _binary : 1;
     bool _timing : 1;
@@ -208,10 +244,31 @@ class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     ActiveNotifier _notifier;
     Timer _timer;
 
-    int _minor_version;
     IPFlowID _given_flowid;
 
+    // current column block of a COLUMNAR dump
+    String _block;
+    uint32_t _block_n;
+    uint32_t _block_pos;
+    Vector<uint32_t> _block_column;
+
+#if HAVE_USER_MULTITHREAD
+    // background reader and parsers of a binary dump, see THREADS
+    struct Chunk;
+    struct Prefetch;
+    Prefetch *_prefetch;
+
+    int start_prefetch(ErrorHandler *);
+    void stop_prefetch();
+    static void *reader_thread(void *);
+    static void *parser_thread(void *);
+    void parse_chunk(Chunk *) const;
+    Packet *prefetched_packet(int &status);
+#endif
+
     int read_binary(String &, ErrorHandler *);
+    int read_block(ErrorHandler *);
+    String block_record();
 
     static int sort_fields_compare(const void *, const void *, void *);
     void bang_data(const String &, ErrorHandler *);
@@ -219,10 +276,14 @@ class FromIPSummaryDump : public Element, public IPSummaryDumpInfo { public:
     void bang_flowid(const String &, ErrorHandler *);
     void bang_aggregate(const String &, ErrorHandler *);
     void bang_binary(const String &, ErrorHandler *);
+    void bang_line(const String &, ErrorHandler *);
     void check_defaults();
     bool check_timing(Packet *p);
     Packet *read_packet(ErrorHandler *);
+    Packet *parse_record(const Format &, const String &, bool binary, int &error) const;
     Packet *handle_multipacket(Packet *);
+    enum { np_packet, np_empty, np_wait, np_eof };
+    Packet *next_packet(int &status);
 
     static String read_handler(Element *, void *) CLICK_COLD;
     static int write_handler(const String &, Element *, void *, ErrorHandler *) CLICK_COLD;
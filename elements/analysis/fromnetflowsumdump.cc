@@ -51,7 +51,7 @@ FromNetFlowSummaryDump::cast(const char *n)
     if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0 && !output_is_push(0))
 	return static_cast<Notifier *>(&_notifier);
     else
-	return Element::cast(n);
+	return BatchElement::cast(n);
 }
 
 int
@@ -60,6 +60,7 @@ FromNetFlowSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     bool stop = false;
     _active = _zero = true;
     _multipacket = _timing = false;
+    _burst = 1;
     String link = "input";
 
     if (Args(conf, this, errh)
@@ -70,8 +71,16 @@ FromNetFlowSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("MULTIPACKET", _multipacket)
 	.read("LINK", WordArg(), link)
 	.read("TIMING", _timing)
+	.read("BURST", _burst)
 	.complete() < 0)
 	return -1;
+    if (_burst == 0)
+	return errh->error("BURST must be positive");
+#if HAVE_BATCH
+    // single packets are cheaper to push through elements that do not batch
+    if (_burst > 1)
+	in_batch_mode = BATCH_MODE_YES;
+#endif
 
     _stop = stop;
     link = link.lower();
@@ -372,17 +381,39 @@ FromNetFlowSummaryDump::run_task(Task *)
     if (!_active)
 	return false;
 
-    Packet *p = next_packet();
+    uint32_t n = 0;
+    Packet *p = 0;
+#if HAVE_BATCH
+    PacketBatch *head = 0;
+    Packet *last = 0;
+#endif
+    while (n < _burst) {
+	if (!(p = next_packet()) || (_timing && !check_timing(p)))
+	    break;
+	_packet = 0;
+#if HAVE_BATCH
+	if (in_batch_mode == BATCH_MODE_YES) {
+	    if (head)
+		last->set_next(p);
+	    else
+		head = PacketBatch::start_head(p);
+	    last = p;
+	} else
+#endif
+	    output(0).push(p);
+	++n;
+    }
+#if HAVE_BATCH
+    if (head)
+	output_push_batch(0, head->make_tail(last, n));
+#endif
+
     if (!p) {
 	if (_stop)
 	    router()->please_stop_driver();
-	return false;
-    } else if (_timing && !check_timing(p))
-	return false;
-    _packet = 0;
-    output(0).push(p);
-    _task.fast_reschedule();
-    return true;
+    } else if (n == _burst)
+	_task.fast_reschedule();
+    return n > 0;
 }
 
 Packet *
@@ -1,7 +1,7 @@
 // -*- c-basic-offset: 4 -*-
 #ifndef CLICK_FROMNETFLOWSUMDUMP_HH
 #define CLICK_FROMNETFLOWSUMDUMP_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/task.hh>
 #include <click/timer.hh>
 #include <click/notifier.hh>
@@ -64,6 +64,12 @@ interface numbers are pinned at 255 (or 15, for "both").  Default is "input".
 Boolean.  If true, FromNetDlowSummaryDump tries to maintain the timing of the
 original packet stream.  TIMING is false by default.
 
+=item BURST
+
+Unsigned integer.  In push mode, FromNetFlowSummaryDump emits up to BURST
+packets each time its task runs, as one batch in batch-enabled builds.
+Default is 1.
+
 =back
 
 Only available in user-level processes.
@@ -128,7 +134,7 @@ Returns FromNetFlowSummaryDump's position in the file, in bytes.
 
 FromDump, FromIPSummaryDump */
 
-class FromNetFlowSummaryDump : public Element { public:
+class FromNetFlowSummaryDump : public BatchElement { public:
 
     FromNetFlowSummaryDump() CLICK_COLD;
     ~FromNetFlowSummaryDump() CLICK_COLD;
@@ -145,6 +151,13 @@ class FromNetFlowSummaryDump : public Element { public:
     void run_timer(Timer *);
     bool run_task(Task *);
     Packet *pull(int);
+#if HAVE_BATCH
+    PacketBatch *pull_batch(int port, unsigned max) {
+	PacketBatch *batch;
+	MAKE_BATCH(pull(port), batch, max);
+	return batch;
+    }
+#endif
 
   private:
 
@@ -160,6 +173,7 @@ class FromNetFlowSummaryDump : public Element { public:
     bool _active;
     bool _multipacket;
     uint8_t _link;
+    uint32_t _burst;
     Packet *_packet;
     Packet *_work_packet;
     uint32_t _multipacket_length;
@@ -120,10 +120,10 @@ struct FieldWriter {
     static const FieldWriter *find(const String &name);
 
     static int binary_size(int type) {
-        if (type < 0)
+        if (type < 0 || type == B_SPECIAL)
             return -1;
         else
-            return type & 256;
+            return type & 255;
     }
     inline int binary_size() const {
         return binary_size(type);
@@ -27,8 +27,8 @@
 CLICK_DECLS
 
 TimeSortedSched::TimeSortedSched()
-    : _pkt(0), _npkt(0), _input(0), _nready(0),
-      _notifier(Notifier::SEARCH_CONTINUE_WAKE), _buffer(1),
+    : _pkt(0), _input(0), _ready(0), _nready(0), _tree(0), _k(1),
+      _notifier(Notifier::SEARCH_CONTINUE_WAKE), _buffer(1), _burst(32),
       _well_ordered(true)
 {
 }
@@ -43,7 +43,7 @@ TimeSortedSched::cast(const char *n)
     if (strcmp(n, Notifier::EMPTY_NOTIFIER) == 0)
 	return &_notifier;
     else
-	return Element::cast(n);
+	return BatchElement::cast(n);
 }
 
 int
@@ -54,79 +54,202 @@ TimeSortedSched::configure(Vector<String> &conf, ErrorHandler *errh)
     if (Args(conf, this, errh)
 	.read("STOP", _stop)
 	.read("BUFFER", _buffer)
+	.read("BURST", _burst)
 	.complete() < 0)
 	return -1;
     if (_buffer <= 0)
 	return errh->error("BUFFER must be at least 1");
+    if (_burst == 0)
+	return errh->error("BURST must be at least 1");
     return 0;
 }
 
 int
 TimeSortedSched::initialize(ErrorHandler *errh)
 {
-    _pkt = new packet_s[ninputs() * _buffer];
-    _input = new input_s[ninputs()];
-    if (!_pkt || !_input)
+    while (_k < ninputs())
+	_k *= 2;
+    _pkt = new Packet *[ninputs() * _buffer];
+    _input = new input_s[_k];
+    _ready = new int[_k];
+    _tree = new int[_k];
+    if (!_pkt || !_input || !_ready || !_tree)
 	return errh->error("out of memory!");
-    for (int i = 0; i < ninputs(); i++) {
-	_input[i].signal = Notifier::upstream_empty_signal(this, i, &_notifier);
+    // leaves past the last input stay empty forever
+    for (int i = 0; i < _k; i++) {
+	if (i < ninputs())
+	    _input[i].signal = Notifier::upstream_empty_signal(this, i, &_notifier);
 	_input[i].space = _buffer;
-	_input[i].ready = i;
+	_input[i].rpos = (i < ninputs() ? i : -1);
+#if HAVE_BATCH
+	_input[i].staged = 0;
+#endif
+	if (i < ninputs())
+	    _ready[i] = i;
     }
     _nready = ninputs();
+    _tree[0] = build(1);
     return 0;
 }
 
 void
 TimeSortedSched::cleanup(CleanupStage)
 {
-    for (int i = 0; i < _npkt; ++i)
-	_pkt[i].p->kill();
+    if (_input)
+	for (int i = 0; i < ninputs(); ++i) {
+	    Packet **h = _pkt + i * _buffer;
+	    for (int j = 0; j < _buffer - _input[i].space; ++j)
+		h[j]->kill();
+#if HAVE_BATCH
+	    while (Packet *p = _input[i].staged) {
+		_input[i].staged = p->next();
+		p->kill();
+	    }
+#endif
+	}
     delete[] _pkt;
     delete[] _input;
+    delete[] _ready;
+    delete[] _tree;
 }
 
-Packet*
-TimeSortedSched::pull(int)
+/* Return true if input @a a's next packet goes before input @a b's.  An
+   empty input goes after every other. */
+inline bool
+TimeSortedSched::before(int a, int b) const
+{
+    if (empty(a))
+	return false;
+    else if (empty(b))
+	return true;
+    const Timestamp &ta = _pkt[a * _buffer]->timestamp_anno();
+    const Timestamp &tb = _pkt[b * _buffer]->timestamp_anno();
+    return ta < tb || (ta == tb && a < b);
+}
+
+/* Rebuild the subtree rooted at @a node and return its winner. */
+int
+TimeSortedSched::build(int node)
+{
+    if (node >= _k)
+	return node - _k;
+    int w = build(2 * node), l = build(2 * node + 1);
+    if (before(l, w))
+	click_swap(w, l);
+    _tree[node] = l;
+    return w;
+}
+
+/* Restore the tree after the winner, input @a i, changed. */
+inline void
+TimeSortedSched::replay(int i)
 {
-    bool signals_on = false;
-    // first maybe fill in buffer
+    for (int node = (_k + i) >> 1; node; node >>= 1)
+	if (before(_tree[node], i))
+	    click_swap(_tree[node], i);
+    _tree[0] = i;
+}
+
+inline Packet *
+TimeSortedSched::input_packet(int i)
+{
+    input_s &is = _input[i];
+#if HAVE_BATCH
+    if (in_batch_mode == BATCH_MODE_YES) {
+	if (!is.staged && is.signal) {
+	    is.staged = input_pull_batch(i, _burst);
+	}
+	Packet *p = is.staged;
+	if (p) {
+	    is.staged = p->next();
+	    p->set_next(0);
+	}
+	return p;
+    }
+#endif
+    return (is.signal ? input(i).pull() : 0);
+}
+
+/* Top up input @a i's window.  Returns true if it gained a packet. */
+bool
+TimeSortedSched::fill_input(int i)
+{
+    input_s &is = _input[i];
+    Packet **h = _pkt + i * _buffer;
+    int n0 = _buffer - is.space, n = n0;
+    while (n < _buffer) {
+	Packet *p = input_packet(i);
+	if (!p)
+	    break;
+	h[n++] = p;
+	push_heap(h, h + n, heap_less());
+    }
+    is.space = _buffer - n;
+    if (!is.space && n != n0) {
+	int last = _ready[_nready - 1];
+	_ready[is.rpos] = last;
+	_input[last].rpos = is.rpos;
+	is.rpos = -1;
+	--_nready;
+    }
+    return n != n0;
+}
+
+/* Top up every input's window.  Returns true if any upstream signal is
+   active. */
+bool
+TimeSortedSched::fill()
+{
+    bool signals_on = false, rebuild = false, changed = false;
+    int winner = _tree[0];
     for (int rpos = _nready - 1; rpos >= 0; --rpos) {
-	int i = _input[rpos].ready;
-	input_s &is = _input[i];
-	if (is.signal) {
+	int i = _ready[rpos];
+	if (_input[i].signal)
 	    signals_on = true;
-	    while ((_pkt[_npkt].p = input(i).pull())) {
-		_pkt[_npkt].input = i;
-		++_npkt;
-		push_heap(_pkt, _pkt + _npkt, heap_less());
-		--is.space;
-		if (!is.space) {
-		    _input[rpos].ready = _input[_nready - 1].ready;
-		    --_nready;
-		    break;
-		}
-	    }
+	if (fill_input(i)) {
+	    if (i == winner)
+		changed = true;
+	    else
+		rebuild = true;
 	}
     }
+    if (rebuild)
+	_tree[0] = build(1);
+    else if (changed)
+	replay(winner);
+    return signals_on;
+}
 
-    // then maybe emit a packet
-    _notifier.set_active(_npkt > 0 || signals_on);
-    if (_npkt > 0) {
-	Packet *p = _pkt[0].p;
-	if (p->timestamp_anno()) {
-	    if (_last_emission && p->timestamp_anno() < _last_emission)
-		_well_ordered = false;
-	    _last_emission = p->timestamp_anno();
-	}
-	input_s &is = _input[_pkt[0].input];
-	++is.space;
-	if (is.space == 1) {
-	    _input[_nready].ready = _pkt[0].input;
-	    ++_nready;
-	}
-	pop_heap(_pkt, _pkt + _npkt, heap_less());
-	--_npkt;
+/* Remove the earliest packet from input @a i's window.  The caller must
+   replay(@a i). */
+inline Packet *
+TimeSortedSched::pop(int i)
+{
+    input_s &is = _input[i];
+    Packet **h = _pkt + i * _buffer;
+    Packet *p = h[0];
+    pop_heap(h, h + _buffer - is.space, heap_less());
+    if (++is.space == 1) {
+	is.rpos = _nready;
+	_ready[_nready++] = i;
+    }
+    if (p->timestamp_anno()) {
+	if (_last_emission && p->timestamp_anno() < _last_emission)
+	    _well_ordered = false;
+	_last_emission = p->timestamp_anno();
+    }
+    return p;
+}
+
+Packet*
+TimeSortedSched::pull(int)
+{
+    bool signals_on = fill();
+    int i = _tree[0];
+    _notifier.set_active(!empty(i) || signals_on);
+    if (!empty(i)) {
+	Packet *p = pop(i);
+	replay(i);
 	return p;
     } else {
 	if (_stop && !signals_on)
@@ -135,6 +258,37 @@ TimeSortedSched::pull(int)
     }
 }
 
+#if HAVE_BATCH
+PacketBatch *
+TimeSortedSched::pull_batch(int, unsigned max)
+{
+    bool signals_on = fill();
+    _notifier.set_active(!empty(_tree[0]) || signals_on);
+
+    PacketBatch *head = 0;
+    Packet *last = 0;
+    unsigned n = 0;
+    int i;
+    while (n < max && !empty(i = _tree[0])) {
+	Packet *p = pop(i);
+	fill_input(i);
+	replay(i);
+	if (head)
+	    last->set_next(p);
+	else
+	    head = PacketBatch::start_head(p);
+	last = p;
+	++n;
+    }
+
+    if (head)
+	return head->make_tail(last, n);
+    if (_stop && !signals_on)
+	router()->please_stop_driver();
+    return 0;
+}
+#endif
+
 void
 TimeSortedSched::add_handlers()
 {
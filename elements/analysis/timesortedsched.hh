@@ -1,14 +1,14 @@
 // -*- mode: c++; c-basic-offset: 4 -*-
 #ifndef CLICK_TIMESORTEDSCHED_HH
 #define CLICK_TIMESORTEDSCHED_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/notifier.hh>
 CLICK_DECLS
 
 /*
 =c
 
-TimeSortedSched(I<keywords> STOP, BUFFER)
+TimeSortedSched(I<keywords> STOP, BUFFER, BURST)
 
 =s timestamps
 
@@ -31,6 +31,10 @@ TimeSortedSched emitted some packets out of order.  (But see BUFFER, below.)
 TimeSortedSched listens for notification from its inputs to avoid useless
 pulls, and provides notification for its output.
 
+When the downstream element pulls batches, TimeSortedSched answers with a
+batch of up to the requested number of packets, still in timestamp order.  It
+then also pulls batches from its inputs, up to BURST packets at a time.
+
 Keyword arguments are:
 
 =over 8
@@ -45,7 +49,15 @@ Default is false.
 
 Integer. Up to BUFFER packets per input are buffered within
 TimeSortedSched. Default BUFFER is 1. Higher BUFFER values let TimeSortedSched
-cope with minor reordering in its input streams.
+cope with minor reordering in its input streams: BUFFER is a reorder window,
+so a packet that arrives up to BUFFER-1 places late on its input is still
+emitted in order.
+
+=item BURST
+
+Integer. In batch mode, TimeSortedSched pulls up to BURST packets at a time
+from each input. Packets pulled this way wait outside the BUFFER window until
+there is room. Default is 32.
 
 =back
 
@@ -54,6 +66,10 @@ cope with minor reordering in its input streams.
 TimeSortedSched is a notifier signal, active iff any of the upstream notifiers
 are active.
 
+TimeSortedSched merges its inputs with a loser tree. Emitting a packet takes
+time logarithmic in the number of inputs, so TimeSortedSched can merge dozens
+of traces. Equal timestamps are emitted in input order.
+
 =e
 
 This example merges multiple tcpdump(1) files into a single, time-sorted
@@ -77,7 +93,7 @@ streams was not so sorted.
 FromDump
 */
 
-class TimeSortedSched : public Element { public:
+class TimeSortedSched : public BatchElement { public:
 
     TimeSortedSched() CLICK_COLD;
     ~TimeSortedSched() CLICK_COLD;
@@ -94,36 +110,54 @@ class TimeSortedSched : public Element { public:
     void add_handlers() CLICK_COLD;
 
     Packet *pull(int);
+#if HAVE_BATCH
+    PacketBatch *pull_batch(int port, unsigned max);
+#endif
 
   private:
 
-    struct packet_s {
-	Packet *p;
-	int input;		// for space, consider using annotation?
-    };
     struct heap_less {
-	inline bool operator()(packet_s &a, packet_s &b) {
-	    return a.p->timestamp_anno() < b.p->timestamp_anno();
+	inline bool operator()(Packet *a, Packet *b) {
+	    return a->timestamp_anno() < b->timestamp_anno();
 	}
     };
     struct input_s {
 	NotifierSignal signal;
-	int space;
-	int ready;
+	int space;		// free places in this input's BUFFER window
+	int rpos;		// position in _ready, or -1
+#if HAVE_BATCH
+	Packet *staged;		// pulled in a batch, not yet in the window
+#endif
     };
 
-    packet_s *_pkt;
-    int _npkt;
-
+    // Each input's window is a heap of BUFFER packets in _pkt.  _tree is a
+    // loser tree over the inputs, keyed by the earliest packet in each
+    // window; _tree[0] is the winner, the input holding the next packet.
+    Packet **_pkt;
     input_s *_input;
+    int *_ready;		// inputs with space
     int _nready;
+    int *_tree;
+    int _k;			// number of tree leaves, a power of two
 
     Notifier _notifier;
     int _buffer;
+    unsigned _burst;
     Timestamp _last_emission;
     bool _stop;
     bool _well_ordered;
 
+    inline bool empty(int i) const {
+	return _input[i].space == _buffer;
+    }
+    inline bool before(int a, int b) const;
+    int build(int node);
+    inline void replay(int i);
+    inline Packet *input_packet(int i);
+    bool fill_input(int i);
+    bool fill();
+    inline Packet *pop(int i);
+
 };
 
 CLICK_ENDDECLS
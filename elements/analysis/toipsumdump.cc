@@ -50,6 +50,8 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     bool binary = false;
     bool header = true;
     bool extra_length = true;
+    bool columnar = false;
+    _block = 1024;
 
     if (Args(conf, this, errh)
 	.read_mp("FILENAME", FilenameArg(), _filename)
@@ -64,8 +66,14 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	.read("CAREFUL_TRUNC", careful_trunc)
 	.read("EXTRA_LENGTH", extra_length)
 	.read("BINARY", binary)
+	.read("COLUMNAR", columnar)
+	.read("BLOCK", _block)
 	.complete() < 0)
 	return -1;
+    if (columnar)
+	binary = true;
+    if (columnar && _block == 0)
+	return errh->error("BLOCK must be positive");
 
     Vector<String> v;
     cp_spacevec(save, v);
@@ -91,8 +99,11 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
 	// binary size
       found_prepare:
 	int s = f->binary_size();
-	if ((s < 0 || !f->outb) && binary)
+	if (!f->outb && binary)
 	    errh->error("cannot use field %s with BINARY", word.c_str());
+	else if (s < 0 && columnar)
+	    errh->error("cannot use variable-length field %s with COLUMNAR", word.c_str());
+	_column_width.push_back(s);
 	_binary_size += s;
 
 	// remove _multipacket if packet count specified
@@ -109,6 +120,18 @@ ToIPSummaryDump::configure(Vector<String> &conf, ErrorHandler *errh)
     _binary = binary;
     _header = header;
     _extra_length = extra_length;
+    _columnar = columnar;
+
+    if (columnar && !errh->nerrors()) {
+	// columns are laid out back to back, each with room for _block values
+	uint32_t row = _binary_size - 4, off = 0;
+	if (row && _block > (0x3FFFFFF0U - 16) / row)
+	    return errh->error("BLOCK too large");
+	for (int i = 0; i < _column_width.size(); i++) {
+	    _column_offset.push_back(_block * off);
+	    off += _column_width[i];
+	}
+    }
 
     return errh->nerrors() ? -1 : 0;
 }
@@ -121,6 +144,8 @@ ToIPSummaryDump::initialize(ErrorHandler *errh)
 	_f = fopen(_filename.c_str(), "wb");
 	if (!_f)
 	    return errh->error("%s: %s", _filename.c_str(), strerror(errno));
+	if (_columnar)
+	    setvbuf(_f, 0, _IOFBF, 1 << 20);
     } else {
 	_f = stdout;
 	_filename = "<stdout>";
@@ -131,7 +156,6 @@ ToIPSummaryDump::initialize(ErrorHandler *errh)
 	_signal = Notifier::upstream_empty_signal(this, 0, &_task);
     }
     _active = true;
-    _output_count = 0;
 
     // magic number
     StringAccum sa;
@@ -175,6 +199,13 @@ ToIPSummaryDump::initialize(ErrorHandler *errh)
 void
 ToIPSummaryDump::cleanup(CleanupStage)
 {
+    for (unsigned i = 0; i < _blocks.weight(); i++) {
+	ThreadBlock &tb = _blocks.get_value(i);
+	if (_f)
+	    flush_block(tb);
+	delete[] tb.data;
+	tb.data = 0;
+    }
     if (_f && _f != stdout)
 	fclose(_f);
     _f = 0;
@@ -213,7 +244,7 @@ ToIPSummaryDump::summary(Packet* p, StringAccum& sa, StringAccum* bad_sa) const
 }
 
 void
-ToIPSummaryDump::write_packet(Packet* p, int multipacket)
+ToIPSummaryDump::write_packet(Packet* p, ThreadBlock &tb, int multipacket)
 {
     if (multipacket > 0 && EXTRA_PACKETS_ANNO(p) > 0) {
 	uint32_t count = 1 + EXTRA_PACKETS_ANNO(p);
@@ -237,42 +268,139 @@ ToIPSummaryDump::write_packet(Packet* p, int multipacket)
 	    uint32_t l = total_len / i;
 	    SET_EXTRA_LENGTH_ANNO(p, l - len);
 	    total_len -= l;
-	    write_packet(p, -1);
+	    write_packet(p, tb, -1);
 	    if (i == 1)
 		p->timestamp_anno() = end_timestamp;
 	    else
 		p->timestamp_anno() += timestamp_delta;
 	}
 
-    } else {
-	_sa.clear();
-	_bad_sa.clear();
+    } else if (_columnar)
+	write_columnar(p, tb);
+    else {
+	tb.sa.clear();
+	tb.bad_sa.clear();
+
+	summary(p, tb.sa, (_bad_packets ? &tb.bad_sa : 0));
+
+	// keep the record next to its note when threads write concurrently
+	_file_lock.acquire();
+	if (_bad_packets && tb.bad_sa)
+	    put_line(tb.bad_sa.take_string());
+	ignore_result(fwrite(tb.sa.data(), 1, tb.sa.length(), _f));
+	_file_lock.release();
+
+	tb.output_count++;
+    }
+}
 
-	summary(p, _sa, (_bad_packets ? &_bad_sa : 0));
+/* Write @a p's record from the current thread. */
+inline void
+ToIPSummaryDump::locked_write_packet(Packet *p)
+{
+    ThreadBlock &tb = *_blocks;
+    tb.lock.acquire();
+    write_packet(p, tb, _multipacket);
+    tb.lock.release();
+}
 
-	if (_bad_packets && _bad_sa)
-	    write_line(_bad_sa.take_string());
-	ignore_result(fwrite(_sa.data(), 1, _sa.length(), _f));
+/* Add @a p's record to @a tb, the current thread's column block.  The caller
+   holds @a tb's lock. */
+void
+ToIPSummaryDump::write_columnar(Packet *p, ThreadBlock &tb)
+{
+    uint32_t row = _binary_size - 4;
+    if (!tb.data)
+	tb.data = new unsigned char[8 + _block * row + 8];
+
+    tb.sa.clear();
+    tb.bad_sa.clear();
+    summary(p, tb.sa, (_bad_packets ? &tb.bad_sa : 0));
+
+    if ((_bad_packets && tb.bad_sa) || tb.sa.length() != _binary_size) {
+	// keep records in order around metadata and odd-sized records
+	flush_block(tb);
+	if (_bad_packets && tb.bad_sa)
+	    write_line(tb.bad_sa.take_string());
+	if (tb.sa.length() != _binary_size) {
+	    _file_lock.acquire();
+	    ignore_result(fwrite(tb.sa.data(), 1, tb.sa.length(), _f));
+	    _file_lock.release();
+	    tb.output_count++;
+	    return;
+	}
+    }
 
-	_output_count++;
+    const unsigned char *x = reinterpret_cast<const unsigned char *>(tb.sa.data()) + 4;
+    for (int i = 0; i < _column_width.size(); i++) {
+	uint32_t w = _column_width[i];
+	memcpy(tb.data + 8 + _column_offset[i] + tb.n * w, x, w);
+	x += w;
     }
+    tb.output_count++;
+    if (++tb.n == _block)
+	flush_block(tb);
+}
+
+/* Write @a tb's column block, if any, with a single write. */
+void
+ToIPSummaryDump::flush_block(ThreadBlock &tb)
+{
+    if (!tb.n)
+	return;
+
+    // close the gaps between partly filled columns
+    uint32_t pos = 8;
+    for (int i = 0; i < _column_width.size(); i++) {
+	uint32_t len = tb.n * _column_width[i];
+	if (pos != 8 + _column_offset[i])
+	    memmove(tb.data + pos, tb.data + 8 + _column_offset[i], len);
+	pos += len;
+    }
+    while (pos & 7)
+	tb.data[pos++] = 0;
+
+    uint32_t word = htonl(pos | 0x40000000U);
+    memcpy(tb.data, &word, 4);
+    word = htonl(tb.n);
+    memcpy(tb.data + 4, &word, 4);
+    tb.n = 0;
+
+    _file_lock.acquire();
+    ignore_result(fwrite(tb.data, 1, pos, _f));
+    _file_lock.release();
 }
 
 void
 ToIPSummaryDump::push(int, Packet *p)
 {
     if (_active)
-	write_packet(p, _multipacket);
+	locked_write_packet(p);
     checked_output_push(0, p);
 }
 
+#if HAVE_BATCH
+void
+ToIPSummaryDump::push_batch(int, PacketBatch *batch)
+{
+    if (_active) {
+	ThreadBlock &tb = *_blocks;
+	tb.lock.acquire();
+	FOR_EACH_PACKET(batch, p)
+	    write_packet(p, tb, _multipacket);
+	tb.lock.release();
+    }
+    checked_output_push_batch(0, batch);
+}
+#endif
+
 bool
 ToIPSummaryDump::run_task(Task *)
 {
     if (!_active)
 	return false;
     if (Packet *p = input(0).pull()) {
-	write_packet(p, _multipacket);
+	locked_write_packet(p);
 	checked_output_push(0, p);
 	_task.fast_reschedule();
 	return true;
@@ -283,8 +411,9 @@ ToIPSummaryDump::run_task(Task *)
 	return false;
 }
 
+/* Write line @a s.  The caller holds _file_lock. */
 void
-ToIPSummaryDump::write_line(const String& s)
+ToIPSummaryDump::put_line(const String &s)
 {
     if (s.length()) {
 	assert(s.back() == '\n');
@@ -296,11 +425,22 @@ ToIPSummaryDump::write_line(const String& s)
     }
 }
 
+void
+ToIPSummaryDump::write_line(const String& s)
+{
+    if (s.length()) {
+	_file_lock.acquire();
+	put_line(s);
+	_file_lock.release();
+    }
+}
+
 void
 ToIPSummaryDump::add_note(const String &s)
 {
     if (s.length()) {
 	int extra = 1 + (s.back() == '\n' ? 0 : 1);
+	_file_lock.acquire();
 	if (_binary) {
 	    uint32_t marker = htonl((s.length() + extra) | 0x80000000U);
 	    ignore_result(fwrite(&marker, 4, 1, _f));
@@ -309,6 +449,7 @@ ToIPSummaryDump::add_note(const String &s)
 	ignore_result(fwrite(s.data(), 1, s.length(), _f));
 	if (extra > 1)
 	    fputc('\n', _f);
+	_file_lock.release();
     }
 }
 
@@ -316,8 +457,15 @@ int
 ToIPSummaryDump::flush_handler(const String &, Element *e, void *, ErrorHandler *)
 {
     ToIPSummaryDump *tod = (ToIPSummaryDump *) e;
-    if (tod->_f)
+    if (tod->_f) {
+	for (unsigned i = 0; i < tod->_blocks.weight(); i++) {
+	    ThreadBlock &tb = tod->_blocks.get_value(i);
+	    tb.lock.acquire();
+	    tod->flush_block(tb);
+	    tb.lock.release();
+	}
 	fflush(tod->_f);
+    }
     return 0;
 }
 
@@ -175,7 +175,7 @@ CoDel::delegate_codel()
 {
     Packet *p = NULL;
     bool ret_val = false;
-    Timestamp now = Timestamp::now();
+    Timestamp now = Timestamp::now_tsc();
 
     p = dequeue_and_track_sojourn_time(now, ret_val);
 
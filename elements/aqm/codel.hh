@@ -25,9 +25,11 @@ Queues). It tracks the sojourn time of every packet in the queue, and
 increases the frequency of dropping packets until the queue is controlled,
 i.e. the sojourn time goes below the threshold. The sojourn time is tracked
 based on the "first timestamp" annotation, which must be set using the
-SetTimestamp element just before the packet is enqueued. Later, CoDel overwrites
-this annotation with the sojourn time experienced by the corresponding
-packet for (possible) statistical use thereafter.
+SetTimestamp element just before the packet is enqueued. Like SetTimestamp,
+CoDel reads the time from the CPU's cycle counter where possible, so both
+use the same clock. Later, CoDel overwrites this annotation with the sojourn
+time experienced by the corresponding packet for (possible) statistical use
+thereafter.
 
 By default, the Queues are found with flow-based router context and only the
 upstream queues are searched. CoDel is a pull element.
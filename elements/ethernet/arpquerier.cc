@@ -281,6 +281,16 @@ ARPQuerier::handle_ip(Packet *p, bool response)
     } else
 	q->ether_header()->ether_type = htons(ETHERTYPE_IP);
 
+    resolve(q);
+}
+
+/*
+ * Fill in the Ethernet destination of @a q, which already has room for an
+ * Ethernet header, and push it out; or queue it and send a query.
+ */
+void
+ARPQuerier::resolve(WritablePacket *q)
+{
     IPAddress dst_ip = q->dst_ip_anno();
     EtherAddress *dst_eth = reinterpret_cast<EtherAddress *>(q->ether_header()->ether_dhost);
     int r;
@@ -380,6 +390,68 @@ ARPQuerier::push(int port, Packet *p)
     }
 }
 
+#if HAVE_BATCH
+void
+ARPQuerier::push_batch(int port, PacketBatch *batch)
+{
+    if (port != 0) {
+	FOR_EACH_PACKET_SAFE(batch, p) {
+	    handle_response(p);
+	    p->kill();
+	}
+	return;
+    }
+
+    // delete packets if we are not configured
+    if (!_my_ip) {
+	_drops += batch->count();
+	batch->kill();
+	return;
+    }
+
+    PacketBatch *head = 0;
+    Packet *last = 0;
+    unsigned count = 0;
+    IPAddress last_ip;
+    EtherAddress last_eth;
+    bool last_valid = false;
+
+    FOR_EACH_PACKET_SAFE(batch, p) {
+	WritablePacket *q = p->push_mac_header(sizeof(click_ether));
+	if (!q) {
+	    ++_drops;
+	    continue;
+	}
+	click_ether *ethh = q->ether_header();
+	ethh->ether_type = htons(ETHERTYPE_IP);
+
+	// Packets to the same next hop as the previous one reuse its lookup.
+	IPAddress dst_ip = q->dst_ip_anno();
+	if (!last_valid || dst_ip != last_ip) {
+	    last_valid = dst_ip
+		&& _arpt->lookup(dst_ip, &last_eth, _poll_timeout_j) == 0;
+	    last_ip = dst_ip;
+	}
+	if (!last_valid) {
+	    resolve(q);
+	    continue;
+	}
+
+	memcpy(ethh->ether_dhost, last_eth.data(), 6);
+	memcpy(ethh->ether_shost, _my_en.data(), 6);
+	if (last)
+	    last->set_next(q);
+	else
+	    head = PacketBatch::start_head(q);
+	last = q;
+	++count;
+    }
+
+    if (head)
+	output_push_batch(0, head->make_tail(last, count));
+}
+#endif
+
 String
 ARPQuerier::read_handler(Element *e, void *thunk)
 {
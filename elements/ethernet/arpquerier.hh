@@ -1,6 +1,6 @@
 #ifndef CLICK_ARPQUERIER_HH
 #define CLICK_ARPQUERIER_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/etheraddress.hh>
 #include <click/ipaddress.hh>
 #include <click/sync.hh>
@@ -116,6 +116,12 @@ annotations set from the corresponding input packets.
 
 ARPQuerier will send at most 10 queries a second for any IP address.
 
+ARPQuerier is batch-aware.  Resolved packets of a batch leave as a single
+batch, and consecutive packets with the same destination IP address
+annotation share one table lookup.  Packets that need a query, or that go to
+broadcast or multicast addresses, take the per-packet path and may therefore
+leave before the rest of their batch.
+
 =h ipaddr rw
 
 Returns or sets the ARPQuerier's source IP address.
@@ -170,7 +176,7 @@ Clear the ARP table.
 ARPTable, ARPResponder, ARPFaker, AddressInfo
 */
 
-class ARPQuerier : public Element { public:
+class ARPQuerier : public BatchElement { public:
 
     ARPQuerier() CLICK_COLD;
     ~ARPQuerier() CLICK_COLD;
@@ -192,6 +198,9 @@ class ARPQuerier : public Element { public:
     void take_state(Element *e, ErrorHandler *errh);
 
     void push(int port, Packet *p);
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *batch);
+#endif
 
   private:
 
@@ -213,6 +222,7 @@ class ARPQuerier : public Element { public:
     void send_query_for(const Packet *p, bool ether_dhost_valid);
 
     void handle_ip(Packet *p, bool response);
+    void resolve(WritablePacket *q);
     void handle_response(Packet *p);
 
     static void expire_hook(Timer *, void *);
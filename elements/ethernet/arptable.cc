@@ -31,13 +31,15 @@
 CLICK_DECLS
 
 ARPTable::ARPTable()
-    : _entry_capacity(0), _packet_capacity(2048), _entry_packet_capacity(0), _capacity_slim_factor(2), _expire_timer(this)
+    : _fast(0), _fast_mask(0),
+      _entry_capacity(0), _packet_capacity(2048), _entry_packet_capacity(0), _capacity_slim_factor(2), _expire_timer(this)
 {
     _entry_count = _packet_count = _drops = 0;
 }
 
 ARPTable::~ARPTable()
 {
+    delete[] _fast;
 }
 
 int
@@ -55,6 +57,18 @@ ARPTable::configure(Vector<String> &conf, ErrorHandler *errh)
     if (_capacity_slim_factor == 0)
 	return errh->error("CAPACITY_SLIM_FACTOR cannot be zero");
     set_timeout(timeout);
+
+    // Size the lookup cache for the expected number of entries on the first
+    // configuration; live reconfiguration keeps it.
+    if (!_fast) {
+	uint32_t n = 1024;
+	while (_entry_capacity && n < 2 * _entry_capacity && n < 65536)
+	    n <<= 1;
+	if (!(_fast = new FastEntry[n]()))
+	    return errh->error("out of memory!");
+	_fast_mask = n - 1;
+    }
+
     if (_timeout_j) {
 	_expire_timer.initialize(this);
 	_expire_timer.schedule_after_sec(_timeout_j / CLICK_HZ);
@@ -68,6 +82,37 @@ ARPTable::cleanup(CleanupStage)
     clear();
 }
 
+void
+ARPTable::fast_update(IPAddress ip, const ARPEntry *ae)
+{
+    FastEntry &fe = fast_entry(ip);
+    bool known = ae && ae->_known;
+    if (!known && fe._ip != ip.addr())
+	return;
+    fe._seq++;
+    click_write_fence();
+    if (known) {
+	fe._ip = ip.addr();
+	fe._eth = ae->_eth;
+	fe._live_at_j = ae->_live_at_j;
+    } else
+	fe._ip = 0;
+    click_write_fence();
+    fe._seq++;
+}
+
+void
+ARPTable::fast_clear()
+{
+    for (uint32_t i = 0; _fast && i <= _fast_mask; i++) {
+	_fast[i]._seq++;
+	click_write_fence();
+	_fast[i]._ip = 0;
+	click_write_fence();
+	_fast[i]._seq++;
+    }
+}
+
 void
 ARPTable::clear()
 {
@@ -83,6 +128,7 @@ ARPTable::clear()
     }
     _entry_count = _packet_count = 0;
     _age.__clear();
+    fast_clear();
 }
 
 void
@@ -105,6 +151,10 @@ ARPTable::take_state(Element *e, ErrorHandler *errh)
 
     arpt->_entry_count = 0;
     arpt->_packet_count = 0;
+    arpt->fast_clear();
+
+    for (Table::iterator it = _table.begin(); it; ++it)
+	fast_update(it->_ip, it.get());
 }
 
 void
@@ -118,6 +168,7 @@ ARPTable::slim(click_jiffies_t now)
 	       || (_entry_capacity && _entry_count > _entry_capacity))) {
 	_table.erase(ae->_ip);
 	_age.pop_front();
+	fast_update(ae->_ip, 0);
 
 	while (Packet *p = ae->_head) {
 	    ae->_head = p->next();
@@ -207,6 +258,7 @@ ARPTable::insert(IPAddress ip, const EtherAddress &eth, Packet **head)
 	_age.erase(ae);
 	_age.push_back(ae);
     }
+    fast_update(ip, ae);
 
     if (head) {
 	*head = ae->_head;
@@ -313,6 +365,11 @@ ARPTable::read_handler(Element *e, void *user_data)
 	       << Timestamp::make_jiffies(now - ae->_live_at_j) << '\n';
 	}
 	break;
+    case h_memory: {
+	SlabAllocator::Stats stats;
+	arpt->_alloc.stats(stats);
+	return stats.unparse();
+    }
     }
     return sa.take_string();
 }
@@ -357,6 +414,7 @@ ARPTable::add_handlers()
     add_data_handlers("drops", Handler::OP_READ, &_drops);
     add_data_handlers("count", Handler::OP_READ, &_entry_count);
     add_data_handlers("length", Handler::OP_READ, &_packet_count);
+    add_read_handler("memory", read_handler, h_memory);
     add_write_handler("insert", write_handler, h_insert);
     add_write_handler("delete", write_handler, h_delete);
     add_write_handler("clear", write_handler, h_clear);
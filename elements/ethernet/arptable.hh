@@ -3,7 +3,7 @@
 #include <click/element.hh>
 #include <click/etheraddress.hh>
 #include <click/hashcontainer.hh>
-#include <click/hashallocator.hh>
+#include <click/slaballocator.hh>
 #include <click/sync.hh>
 #include <click/timer.hh>
 #include <click/list.hh>
@@ -57,6 +57,13 @@ service attack.
 Time value.  The amount of time after which an ARP entry will expire.  Default
 is 5 minutes.  Zero means ARP entries never expire.
 
+=n
+
+Lookups of resolved entries do not take the table lock.  ARPTable keeps a
+direct-mapped cache of known entries, each protected by a sequence counter
+that writers bump while holding the write lock.  Readers retry through the
+locked table only on a cache miss, or when an entry is due to be polled.
+
 =h table r
 
 Return a table of the ARP entries.  The returned string has four
@@ -88,6 +95,10 @@ Return the number of entries in the table.
 
 Return the number of packets stored in the table.
 
+=h memory r
+
+Return the memory used for ARP entries, as in IPRewriter's 'memory' handler.
+
 =a
 
 ARPQuerier
@@ -161,7 +172,7 @@ class ARPTable : public Element { public:
     void run_timer(Timer *);
 
     enum {
-	h_table, h_insert, h_delete, h_clear
+	h_table, h_insert, h_delete, h_clear, h_memory
     };
     static String read_handler(Element *e, void *user_data) CLICK_COLD;
     static int write_handler(const String &str, Element *e, void *user_data, ErrorHandler *errh) CLICK_COLD;
@@ -210,6 +221,24 @@ class ARPTable : public Element { public:
 
     ReadWriteLock _lock;
 
+    // Lock-free cache of known entries, written only under _lock.
+    struct FastEntry {
+	volatile uint32_t _seq;
+	uint32_t _ip;
+	EtherAddress _eth;
+	click_jiffies_t _live_at_j;
+    };
+    FastEntry *_fast;
+    uint32_t _fast_mask;
+
+    inline FastEntry &fast_entry(IPAddress ip) const {
+	return _fast[(ip.addr() * 0x9E3779B1U >> 16) & _fast_mask];
+    }
+    inline int fast_lookup(IPAddress ip, EtherAddress *eth,
+			   uint32_t poll_timeout_j, click_jiffies_t now) const;
+    void fast_update(IPAddress ip, const ARPEntry *ae);
+    void fast_clear();
+
     typedef HashContainer<ARPEntry> Table;
     Table _table;
     typedef List<ARPEntry, &ARPEntry::_age_link> AgeList;
@@ -222,7 +251,7 @@ class ARPTable : public Element { public:
     uint32_t _capacity_slim_factor;
     uint32_t _timeout_j;
     atomic_uint32_t _drops;
-    SizedHashAllocator<sizeof(ARPEntry)> _alloc;
+    SizedSlabAllocator<sizeof(ARPEntry)> _alloc;
     Timer _expire_timer;
 
     ARPEntry *ensure(IPAddress ip, click_jiffies_t now);
@@ -230,13 +259,40 @@ class ARPTable : public Element { public:
 
 };
 
+/** @brief Look up @a ip in the lock-free cache.
+ *
+ * Returns 0 and sets *@a eth if @a ip is known and not due for a poll, and
+ * -1 otherwise. Never writes to shared state. */
+inline int
+ARPTable::fast_lookup(IPAddress ip, EtherAddress *eth,
+		      uint32_t poll_timeout_j, click_jiffies_t now) const
+{
+    const FastEntry &fe = fast_entry(ip);
+    uint32_t seq = fe._seq;
+    click_read_fence();
+    if ((seq & 1) || fe._ip != ip.addr())
+	return -1;
+    EtherAddress e = fe._eth;
+    click_jiffies_t live_at_j = fe._live_at_j;
+    click_read_fence();
+    if (fe._seq != seq
+	|| (_timeout_j && click_jiffies_less(live_at_j + _timeout_j, now))
+	|| (poll_timeout_j && !click_jiffies_less(now, live_at_j + poll_timeout_j)))
+	return -1;
+    *eth = e;
+    return 0;
+}
+
 inline int
 ARPTable::lookup(IPAddress ip, EtherAddress *eth, uint32_t poll_timeout_j)
 {
+    click_jiffies_t now = click_jiffies();
+    if (fast_lookup(ip, eth, poll_timeout_j, now) == 0)
+	return 0;
+
     _lock.acquire_read();
     int r = -1;
     if (Table::iterator it = _table.find(ip)) {
-	click_jiffies_t now = click_jiffies();
 	if (it->known(now, _timeout_j)) {
 	    *eth = it->_eth;
 	    if (poll_timeout_j
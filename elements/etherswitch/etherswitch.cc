@@ -26,27 +26,51 @@
 CLICK_DECLS
 
 EtherSwitch::EtherSwitch()
-    : _table(AddrInfo(-1, Timestamp())), _timeout(300)
+    : _table(0), _mask(0), _capacity(4096), _timeout(300)
 {
 }
 
 EtherSwitch::~EtherSwitch()
 {
-    _table.clear();
 }
 
 int
 EtherSwitch::configure(Vector<String> &conf, ErrorHandler *errh)
 {
-    return Args(conf, this, errh)
+    if (Args(conf, this, errh)
 	.read("TIMEOUT", SecondsArg(), _timeout)
-	.complete();
+	.read("CAPACITY", _capacity)
+	.complete() < 0)
+	return -1;
+    if (_capacity == 0 || _capacity > (1U << 30))
+	return errh->error("CAPACITY out of range");
+    return 0;
+}
+
+int
+EtherSwitch::initialize(ErrorHandler *errh)
+{
+    uint32_t nbuckets = 1;
+    while (nbuckets * bucket_ways < _capacity)
+	nbuckets <<= 1;
+    // buckets are cache-line aligned, which new[] does not guarantee
+    if (!(_table = (Bucket *) click_aligned_alloc(sizeof(Bucket), sizeof(Bucket) * nbuckets)))
+	return errh->error("out of memory!");
+    memset(_table, 0, sizeof(Bucket) * nbuckets);
+    _mask = nbuckets - 1;
+    return 0;
 }
 
 void
-EtherSwitch::broadcast(int source, Packet *p)
+EtherSwitch::cleanup(CleanupStage)
+{
+    click_aligned_free(_table);
+    _table = 0;
+}
+
+void
+EtherSwitch::broadcast(int source, Packet *p, int n)
 {
-  int n = noutputs();
   assert((unsigned) source < (unsigned) n);
   int sent = 0;
   for (int i = 0; i < n; i++)
@@ -61,34 +85,55 @@ EtherSwitch::broadcast(int source, Packet *p)
 void
 EtherSwitch::push(int source, Packet *p)
 {
-    click_ether* e = (click_ether*) p->data();
-    int outport = -1;		// Broadcast
-
-    // 0 timeout means dumb switch
-    if (_timeout != 0) {
-	_table.set(EtherAddress(e->ether_shost), AddrInfo(source, p->timestamp_anno()));
-
-	// Set outport if dst is unicast, we have info about it, and the
-	// info is still valid.
-	EtherAddress dst(e->ether_dhost);
-	if (!dst.is_group()) {
-	    if (Table::iterator dst_info = _table.find(dst)) {
-		if (p->timestamp_anno() < dst_info.value().stamp + Timestamp(_timeout, 0))
-		    outport = dst_info.value().port;
-		else
-		    _table.erase(dst_info);
-	    }
-	}
-    }
+  int outport = route(source, p);
 
   if (outport < 0)
-    broadcast(source, p);
+    broadcast(source, p, noutputs());
   else if (outport == source)	// Don't send back out on same interface
     p->kill();
   else				// forward
     output(outport).push(p);
 }
 
+#if HAVE_BATCH
+/* Split @a batch among the @a n first outputs. Sub-batch @a n collects
+   packets going back to their source, sub-batch @a n + 1 flooded ones. */
+void
+EtherSwitch::switch_batch(int source, PacketBatch *batch, int n)
+{
+    auto fnt = [this,source,n](Packet *p) -> int {
+	int outport = route(source, p);
+	if (outport < 0)
+	    return n + 1;
+	else if (outport == source)
+	    return n;
+	else
+	    return outport;
+    };
+    auto on_finish = [this,source,n](int o, PacketBatch *b) {
+	if (o < n)
+	    output_push_batch(o, b);
+	else if (o == n)
+	    b->kill();
+	else {
+	    int sent = 0;
+	    for (int i = 0; i < n; i++)
+		if (i != source) {
+		    output_push_batch(i, sent < n - 2 ? b->clone_batch() : b);
+		    sent++;
+		}
+	}
+    };
+    CLASSIFY_EACH_PACKET((n + 2), fnt, batch, on_finish);
+}
+
+void
+EtherSwitch::push_batch(int source, PacketBatch *batch)
+{
+    switch_batch(source, batch, noutputs());
+}
+#endif
+
 String
 EtherSwitch::reader(Element* f, void *thunk)
 {
@@ -96,8 +141,14 @@ EtherSwitch::reader(Element* f, void *thunk)
     switch ((intptr_t) thunk) {
     case 0: {
 	StringAccum sa;
-	for (Table::iterator iter = sw->_table.begin(); iter.live(); iter++)
-	    sa << iter.key() << ' ' << iter.value().port << '\n';
+	for (uint32_t b = 0; sw->_table && b <= sw->_mask; b++)
+	    for (int i = 0; i < bucket_ways; i++)
+		if (uint64_t v = sw->_table[b].e[i].addr_port) {
+		    unsigned char ea[6];
+		    for (int j = 0; j < 6; j++)
+			ea[j] = v >> (56 - 8 * j);
+		    sa << EtherAddress(ea) << ' ' << (int) (v & 0xFFFF) - 1 << '\n';
+		}
 	return sa.take_string();
     }
     case 1:
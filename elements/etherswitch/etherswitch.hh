@@ -1,14 +1,15 @@
 #ifndef CLICK_ETHERSWITCH_HH
 #define CLICK_ETHERSWITCH_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
+#include <clicknet/ether.h>
 #include <click/etheraddress.hh>
-#include <click/hashtable.hh>
+#include <click/sync.hh>
 CLICK_DECLS
 
 /*
 =c
 
-EtherSwitch([I<keywords> TIMEOUT])
+EtherSwitch([I<keywords> TIMEOUT, CAPACITY])
 
 =s ethernet
 
@@ -39,12 +40,27 @@ The timeout for port associations, in seconds.  Any port mapping (i.e.,
 binding between an address and a port number) is dropped after TIMEOUT seconds
 of inactivity.  If 0, the element acts like a dumb hub.  Default is 300.
 
+=item CAPACITY
+
+The maximum number of port associations remembered.  Rounded up to a power
+of two.  When the table is full, the least recently seen association of the
+corresponding bucket is replaced.  Default is 4096.
+
 =back
 
 =n
 
-The EtherSwitch element has no limit on the memory consumed by cached Ethernet
-addresses.
+EtherSwitch is batch-aware and may be used from several threads at once.
+Lookups never take a lock: port associations are stored in a fixed-size table
+of cache-line sized buckets which is only written when an association changes
+or its timestamp moves to a new second.  Expired associations are cleared in
+place, so readers never have to wait for memory reclamation.
+
+Packets of a batch are split into one sub-batch per output port.  Flooded
+packets are sent with one cloned batch per output port.
+
+Timeouts are checked against packets' timestamp annotations, with a resolution
+of one second.
 
 =h table read-only
 
@@ -59,7 +75,7 @@ Returns or sets the TIMEOUT argument.
 ListenEtherSwitch, EtherSpanTree
 */
 
-class EtherSwitch : public Element { public:
+class EtherSwitch : public BatchElement { public:
 
   EtherSwitch() CLICK_COLD;
   ~EtherSwitch() CLICK_COLD;
@@ -72,21 +88,52 @@ class EtherSwitch : public Element { public:
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
     void add_handlers() CLICK_COLD;
 
+    int initialize(ErrorHandler *) CLICK_COLD;
+    void cleanup(CleanupStage) CLICK_COLD;
+
   void push(int port, Packet* p);
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *batch);
+#endif
 
+    /* An association is packed in a single 64-bit word: the 48 bits of the
+       Ethernet address followed by the port number plus one, so that a zero
+       word denotes an empty slot. */
     struct AddrInfo {
-	int port;
-	Timestamp stamp;
-	inline AddrInfo(int p, const Timestamp &t);
+	volatile uint64_t addr_port;
+	volatile uint32_t stamp;
+	uint32_t _pad;
     };
 
-  private:
+    enum { bucket_ways = 4 };
+
+    struct Bucket {
+	AddrInfo e[bucket_ways];
+    } CLICK_CACHE_ALIGN;
+
+  protected:
 
-    typedef HashTable<EtherAddress, AddrInfo> Table;
-    Table _table;
+    Bucket *_table;
+    uint32_t _mask;
+    uint32_t _capacity;
     uint32_t _timeout;
+    SimpleSpinlock _insert_lock;
+
+    static inline uint64_t addr_key(const unsigned char *ea);
+    inline Bucket &bucket(uint64_t key) const;
+    inline bool fresh(uint32_t stamp, uint32_t now) const {
+	return now < stamp || now - stamp < _timeout;
+    }
+    inline int lookup(uint64_t key, uint32_t now);
+    inline void learn(uint64_t key, int port, uint32_t now);
+    inline int route(int source, Packet *p);
+
+    void broadcast(int source, Packet*, int n);
+#if HAVE_BATCH
+    void switch_batch(int source, PacketBatch *batch, int n);
+#endif
 
-    void broadcast(int source, Packet*);
+  private:
 
     static String reader(Element *, void *);
     static int writer(const String &, Element *, void *, ErrorHandler *);
@@ -94,10 +141,101 @@ class EtherSwitch : public Element { public:
 
 };
 
-inline
-EtherSwitch::AddrInfo::AddrInfo(int p, const Timestamp& s)
-    : port(p), stamp(s)
+inline uint64_t
+EtherSwitch::addr_key(const unsigned char *ea)
+{
+    return ((uint64_t) ea[0] << 40) | ((uint64_t) ea[1] << 32)
+	| ((uint64_t) ea[2] << 24) | ((uint64_t) ea[3] << 16)
+	| ((uint64_t) ea[4] << 8) | (uint64_t) ea[5];
+}
+
+inline EtherSwitch::Bucket &
+EtherSwitch::bucket(uint64_t key) const
+{
+    uint32_t h = (uint32_t) (key ^ (key >> 21)) * 0x9E3779B1U;
+    return _table[(h >> 8) & _mask];
+}
+
+/** @brief Return the port associated with @a key, or -1 if unknown.
+ *
+ * Never locks. A stale association is cleared in place. */
+inline int
+EtherSwitch::lookup(uint64_t key, uint32_t now)
+{
+    Bucket &b = bucket(key);
+    for (int i = 0; i < bucket_ways; i++) {
+	uint64_t v = b.e[i].addr_port;
+	if (v && (v >> 16) == key) {
+	    click_read_fence();
+	    if (fresh(b.e[i].stamp, now))
+		return (int) (v & 0xFFFF) - 1;
+	    b.e[i].addr_port = 0;
+	    return -1;
+	}
+    }
+    return -1;
+}
+
+/** @brief Associate @a key with @a port at time @a now.
+ *
+ * Only writes to the table if the association changed. Inserting a new
+ * address takes a lock shared by writers only. */
+inline void
+EtherSwitch::learn(uint64_t key, int port, uint32_t now)
+{
+    uint64_t word = (key << 16) | (uint64_t) (port + 1);
+    Bucket &b = bucket(key);
+    for (int i = 0; i < bucket_ways; i++) {
+	uint64_t v = b.e[i].addr_port;
+	if (v && (v >> 16) == key) {
+	    if (b.e[i].stamp != now)
+		b.e[i].stamp = now;
+	    if (v != word) {
+		click_write_fence();
+		b.e[i].addr_port = word;
+	    }
+	    return;
+	}
+    }
+
+    _insert_lock.acquire();
+    int victim = 0;
+    for (int i = 0; i < bucket_ways; i++) {
+	uint64_t v = b.e[i].addr_port;
+	if (v && (v >> 16) == key) {
+	    victim = i;
+	    break;
+	} else if (!v || !fresh(b.e[i].stamp, now)) {
+	    victim = i;
+	    b.e[i].addr_port = 0;
+	} else if (b.e[victim].addr_port && b.e[i].stamp < b.e[victim].stamp)
+	    victim = i;
+    }
+    b.e[victim].stamp = now;
+    click_write_fence();
+    b.e[victim].addr_port = word;
+    _insert_lock.release();
+}
+
+/** @brief Learn the source of @a p, and return its output port.
+ *
+ * Returns -1 if @a p must be flooded. */
+inline int
+EtherSwitch::route(int source, Packet *p)
 {
+    // 0 timeout means dumb switch
+    if (_timeout == 0)
+	return -1;
+
+    const click_ether *e = (const click_ether *) p->data();
+    uint32_t now = p->timestamp_anno().sec();
+    learn(addr_key(e->ether_shost), source, now);
+
+    // Set outport if dst is unicast, we have info about it, and the
+    // info is still valid.
+    if (e->ether_dhost[0] & 1)
+	return -1;
+    return lookup(addr_key(e->ether_dhost), now);
 }
 
 CLICK_ENDDECLS
@@ -35,28 +35,10 @@ ListenEtherSwitch::~ListenEtherSwitch()
 void
 ListenEtherSwitch::push(int source, Packet *p)
 {
-    const click_ether* e = (const click_ether*) p->data();
-    int outport = -1;		// Broadcast
-
-    // 0 timeout means dumb switch
-    if (_timeout != 0) {
-	_table.set(EtherAddress(e->ether_shost), AddrInfo(source, p->timestamp_anno()));
-
-	// Set outport if dst is unicast, we have info about it, and the
-	// info is still valid.
-	EtherAddress dst(e->ether_dhost);
-	if (!dst.is_group()) {
-	    if (Table::iterator dst_info = _table.find(dst)) {
-		if (p->timestamp_anno() < dst_info.value().stamp + Timestamp(_timeout, 0))
-		    outport = dst_info.value().port;
-		else
-		    _table.erase(dst_info);
-	    }
-	}
-    }
+    int outport = route(source, p);
 
     if (outport < 0)
-	broadcast(source, p);
+	broadcast(source, p, noutputs());
     else if (outport == source)	// Don't send back out on same interface
 	output(noutputs() - 1).push(p);
     else {			// forward
@@ -65,6 +47,15 @@ ListenEtherSwitch::push(int source, Packet *p)
     }
 }
 
+#if HAVE_BATCH
+void
+ListenEtherSwitch::push_batch(int source, PacketBatch *batch)
+{
+    output_push_batch(noutputs() - 1, batch->clone_batch());
+    switch_batch(source, batch, noutputs() - 1);
+}
+#endif
+
 ELEMENT_REQUIRES(EtherSwitch)
 EXPORT_ELEMENT(ListenEtherSwitch)
 CLICK_ENDDECLS
@@ -6,7 +6,7 @@ CLICK_DECLS
 /*
 =c
 
-ListenEtherSwitch([I<keywords> TIMEOUT])
+ListenEtherSwitch([I<keywords> TIMEOUT, CAPACITY])
 
 =s ethernet
 
@@ -34,6 +34,9 @@ class ListenEtherSwitch : public EtherSwitch { public:
     const char *port_count() const		{ return "-/=+"; }
 
     void push(int port, Packet* p);
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *batch);
+#endif
 
 };
 
@@ -109,6 +109,9 @@ class ICMPPingRewriter : public IPRewriterBase { public:
     IPRewriterEntry *add_flow(int ip_p, const IPFlowID &flowid,
 			      const IPFlowID &rewritten_flowid, int input);
     void destroy_flow(IPRewriterFlow *flow);
+    void flow_memory(SlabAllocator::Stats &stats) const {
+	_allocator.stats(stats);
+    }
 
     void push(int, Packet *);
 
@@ -116,7 +119,7 @@ class ICMPPingRewriter : public IPRewriterBase { public:
 
   private:
 
-    SizedHashAllocator<sizeof(ICMPPingFlow)> _allocator;
+    SizedSlabAllocator<sizeof(ICMPPingFlow)> _allocator;
     unsigned _annos;
 
     static String dump_mappings_handler(Element *, void *);
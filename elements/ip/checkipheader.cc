@@ -198,7 +198,7 @@ inline CheckIPHeader::Reason CheckIPHeader::valid(Packet* p) {
 #elif HAVE_FAST_CHECKSUM
     val = ip_fast_csum((unsigned char *)ip, ip->ip_hl);
 #else
-    val = click_in_cksum((const unsigned char *)ip, hlen);
+    val = click_in_cksum_iphdr(ip);
 #endif
     if (val != 0)
       return BAD_CHECKSUM;
@@ -0,0 +1,387 @@
+/*
+ * flowcache.{cc,hh} -- per-thread exact-match cache of a classification path
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "flowcache.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/ipaddress.hh>
+#include <click/packet_anno.hh>
+#include <clicknet/ip.h>
+#include <clicknet/tcp.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+FlowCache::FlowCache()
+    : _mask(0), _dst_anno(true), _paint_anno(true)
+{
+}
+
+FlowCache::~FlowCache()
+{
+}
+
+int
+FlowCache::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uint32_t capacity = 4096;
+    if (Args(conf, this, errh)
+	.read("CAPACITY", capacity)
+	.read("DST_ANNO", _dst_anno)
+	.read("PAINT_ANNO", _paint_anno)
+	.complete() < 0)
+	return -1;
+    if (noutputs() > 256)
+	return errh->error("too many ports");
+    if (capacity > (1U << 24))
+	return errh->error("CAPACITY too large");
+    uint32_t nbuckets = 2;
+    while (nbuckets * bucket_size < capacity)
+	nbuckets *= 2;
+    _mask = nbuckets - 1;
+    return 0;
+}
+
+int
+FlowCache::initialize(ErrorHandler *errh)
+{
+    size_t size = sizeof(Bucket) * (_mask + 1);
+    for (unsigned i = 0; i < _caches.weight(); ++i) {
+	ThreadCache &tc = _caches.get_value(i);
+	if (!(tc.buckets = (Bucket *) click_aligned_alloc(CLICK_CACHE_LINE_SIZE, size)))
+	    return errh->error("out of memory!");
+	memset(tc.buckets, 0, size);
+    }
+    return 0;
+}
+
+void
+FlowCache::cleanup(CleanupStage)
+{
+    for (unsigned i = 0; i < _caches.weight(); ++i) {
+	ThreadCache &tc = _caches.get_value(i);
+	click_aligned_free(tc.buckets);
+	tc.buckets = 0;
+    }
+}
+
+/* Extract the flow key of @a p into @a k.  Returns false if @a p cannot be
+   cached. */
+inline bool
+FlowCache::extract(const Packet *p, Entry &k)
+{
+    if (!p->has_network_header() || p->network_length() < (int) sizeof(click_ip))
+	return false;
+    const click_ip *iph = p->ip_header();
+    if (iph->ip_v != 4 || IP_ISFRAG(iph)
+	|| (iph->ip_p != IP_PROTO_TCP && iph->ip_p != IP_PROTO_UDP)
+	|| p->transport_length() < 4)
+	return false;
+    k.saddr = iph->ip_src.s_addr;
+    k.daddr = iph->ip_dst.s_addr;
+    memcpy(&k.ports, p->transport_header(), 4);
+    k.proto = iph->ip_p;
+    return true;
+}
+
+inline uint64_t
+FlowCache::hash(const Entry &k)
+{
+    uint64_t h = (((uint64_t) k.saddr << 32) | k.daddr) * 0x9E3779B97F4A7C15ULL;
+    h ^= (((uint64_t) k.ports << 8) | k.proto) * 0xC2B2AE3D27D4EB4FULL;
+    return h ^ (h >> 29);
+}
+
+inline bool
+FlowCache::same_flow(const Entry &a, const Entry &b)
+{
+    return a.saddr == b.saddr && a.daddr == b.daddr
+	&& a.ports == b.ports && a.proto == b.proto;
+}
+
+inline bool
+FlowCache::matches(const Entry &e, const Vector<IPAddress> &inv)
+{
+    for (int i = 0; i < inv.size(); i += 2)
+	if (IPAddress(e.saddr).matches_prefix(inv[i], inv[i + 1])
+	    || IPAddress(e.daddr).matches_prefix(inv[i], inv[i + 1]))
+	    return true;
+    return false;
+}
+
+/* Return this thread's cache, after applying any clear or invalidate
+   requests made since it was last used. */
+inline FlowCache::ThreadCache &
+FlowCache::thread_cache()
+{
+    ThreadCache &tc = *_caches;
+    if (unlikely(tc.requests.value() != tc.seen))
+	apply_requests(tc);
+    return tc;
+}
+
+void
+FlowCache::apply_requests(ThreadCache &tc)
+{
+    Vector<IPAddress> inv;
+    tc.lock.acquire();
+    tc.seen = tc.requests.value();
+    bool clear = tc.clear;
+    tc.clear = false;
+    inv.swap(tc.invalidations);
+    tc.lock.release();
+
+    if (clear) {
+	if (!++tc.epoch)
+	    tc.epoch = 1;
+    } else
+	for (uint32_t b = 0; b <= _mask; ++b)
+	    for (Entry *e = tc.buckets[b].e; e != tc.buckets[b].e + bucket_size; ++e)
+		if (e->epoch == tc.epoch && matches(*e, inv))
+		    e->epoch = 0;
+}
+
+/* The two candidate buckets of a flow.  They always differ. */
+#define FLOWCACHE_BUCKETS(tc, h, b)				\
+    Bucket *b[2];						\
+    b[0] = &(tc).buckets[(h) & _mask];				\
+    b[1] = &(tc).buckets[((h) >> 32) & _mask];			\
+    if (b[1] == b[0])						\
+	b[1] = &(tc).buckets[(((h) & _mask) ^ 1)]
+
+/* Return the cached output for @a p, restoring its annotations, or the miss
+   output.  On a miss, @a k is @a p's flow, or has proto 0 if @a p cannot be
+   cached. */
+inline int
+FlowCache::lookup(ThreadCache &tc, Packet *p, Entry &k)
+{
+    if (extract(p, k)) {
+	uint64_t h = hash(k);
+	uint32_t epoch = tc.epoch;
+	FLOWCACHE_BUCKETS(tc, h, b);
+	for (int i = 0; i < 2; ++i)
+	    for (Entry *e = b[i]->e; e != b[i]->e + bucket_size; ++e)
+		if (e->epoch == epoch && same_flow(*e, k)) {
+		    e->used = ++tc.clock;
+		    if (_dst_anno)
+			p->set_dst_ip_anno(IPAddress(e->dst));
+		    if (_paint_anno)
+			SET_PAINT_ANNO(p, e->paint);
+		    ++tc.hits;
+		    return e->port;
+		}
+    } else
+	k.proto = 0;
+    ++tc.misses;
+    return noutputs() - 1;
+}
+
+void
+FlowCache::learn(ThreadCache &tc, Packet *p, int port)
+{
+    // find the flow @a p had when it missed; packets usually come back from
+    // the sub-path in the order they left
+    int n = tc.pending.size(), i = tc.hint, j;
+    for (j = 0; j < n; ++j, ++i) {
+	if (i >= n)
+	    i = 0;
+	if (tc.pending[i].p == p)
+	    break;
+    }
+    if (j == n)
+	return;
+    Pending &x = tc.pending[i];
+    x.p = 0;
+    tc.hint = i + 1;
+    // a clear or invalidate arrived while @a p was in the sub-path, so its
+    // result may be stale
+    if (x.seen != tc.seen)
+	return;
+
+    Entry k = x.k;
+    uint32_t epoch = tc.epoch;
+    k.port = port;
+    k.paint = PAINT_ANNO(p);
+    k._pad = 0;
+    k.dst = p->dst_ip_anno().addr();
+    k.epoch = epoch;
+    k.used = ++tc.clock;
+
+    uint64_t h = hash(k);
+    FLOWCACHE_BUCKETS(tc, h, b);
+    Entry *slot = 0;
+    for (int i = 0; i < 2; ++i)
+	for (Entry *e = b[i]->e; e != b[i]->e + bucket_size; ++e)
+	    if (e->epoch != epoch) {
+		if (!slot)
+		    slot = e;
+	    } else if (same_flow(*e, k)) {
+		*e = k;
+		return;
+	    }
+
+    // both buckets full: try to move a resident flow to its other bucket
+    for (int i = 0; i < 2 && !slot; ++i)
+	for (Entry *e = b[i]->e; e != b[i]->e + bucket_size && !slot; ++e) {
+	    uint64_t eh = hash(*e);
+	    FLOWCACHE_BUCKETS(tc, eh, alt);
+	    Bucket *other = (alt[0] == b[i] ? alt[1] : alt[0]);
+	    for (Entry *f = other->e; f != other->e + bucket_size; ++f)
+		if (f->epoch != epoch) {
+		    *f = *e;
+		    slot = e;
+		    break;
+		}
+	}
+
+    // otherwise evict the least recently used flow
+    if (!slot) {
+	slot = b[0]->e;
+	for (int i = 0; i < 2; ++i)
+	    for (Entry *e = b[i]->e; e != b[i]->e + bucket_size; ++e)
+		if (tc.clock - e->used > tc.clock - slot->used)
+		    slot = e;
+	++tc.evictions;
+    }
+    *slot = k;
+}
+
+#undef FLOWCACHE_BUCKETS
+
+void
+FlowCache::push(int port, Packet *p)
+{
+    ThreadCache &tc = thread_cache();
+    if (port == 0) {
+	Entry k;
+	int o = lookup(tc, p, k);
+	if (o == noutputs() - 1 && k.proto) {
+	    // remember the flow until the packet comes back
+	    int n = tc.pending.size();
+	    tc.pending.push_back(Pending(p, k, tc.seen));
+	    output(o).push(p);
+	    tc.pending.resize(n);
+	} else
+	    output(o).push(p);
+    } else {
+	learn(tc, p, port - 1);
+	output(port - 1).push(p);
+    }
+}
+
+#if HAVE_BATCH
+void
+FlowCache::push_batch(int port, PacketBatch *batch)
+{
+    ThreadCache &tc = thread_cache();
+    if (port == 0) {
+	int n = tc.pending.size(), miss = noutputs() - 1;
+	auto fnt = [this, &tc, miss](Packet *p) -> int {
+	    Entry k;
+	    int o = lookup(tc, p, k);
+	    if (o == miss && k.proto)
+		tc.pending.push_back(Pending(p, k, tc.seen));
+	    return o;
+	};
+	auto on_finish = [this](int o, PacketBatch *b) { output_push_batch(o, b); };
+	CLASSIFY_EACH_PACKET(noutputs(), fnt, batch, on_finish);
+	tc.pending.resize(n);
+    } else {
+	FOR_EACH_PACKET(batch, p)
+	    learn(tc, p, port - 1);
+	output_push_batch(port - 1, batch);
+    }
+}
+#endif
+
+String
+FlowCache::read_handler(Element *e, void *user_data)
+{
+    FlowCache *fc = static_cast<FlowCache *>(e);
+    uint64_t n = 0;
+    for (unsigned i = 0; i < fc->_caches.weight(); ++i) {
+	ThreadCache &tc = fc->_caches.get_value(i);
+	switch ((intptr_t) user_data) {
+	case h_hits:
+	    n += tc.hits;
+	    break;
+	case h_misses:
+	    n += tc.misses;
+	    break;
+	case h_evictions:
+	    n += tc.evictions;
+	    break;
+	case h_count:
+	    // leave out flows that the thread has yet to forget
+	    tc.lock.acquire();
+	    if (tc.buckets && !tc.clear)
+		for (uint32_t b = 0; b <= fc->_mask; ++b)
+		    for (int j = 0; j < bucket_size; ++j) {
+			const Entry &ent = tc.buckets[b].e[j];
+			n += (ent.epoch == tc.epoch
+			      && !matches(ent, tc.invalidations));
+		    }
+	    tc.lock.release();
+	    break;
+	case h_capacity:
+	    return String((fc->_mask + 1) * bucket_size);
+	}
+    }
+    return String(n);
+}
+
+int
+FlowCache::write_handler(const String &str, Element *e, void *user_data,
+			 ErrorHandler *errh)
+{
+    FlowCache *fc = static_cast<FlowCache *>(e);
+    bool clear = ((intptr_t) user_data == h_clear);
+    IPAddress addr, mask;
+    if (!clear && !IPPrefixArg(true).parse(str, addr, mask, fc))
+	return errh->error("expected IP prefix");
+
+    // Each thread applies the request to its own cache when it next handles
+    // a packet.  That also keeps it from learning results of packets that
+    // were in the sub-path when the request arrived.
+    for (unsigned i = 0; i < fc->_caches.weight(); ++i) {
+	ThreadCache &tc = fc->_caches.get_value(i);
+	tc.lock.acquire();
+	if (clear || tc.invalidations.size() >= 2 * max_invalidations) {
+	    tc.clear = true;
+	    tc.invalidations.clear();
+	} else if (!tc.clear) {
+	    tc.invalidations.push_back(addr);
+	    tc.invalidations.push_back(mask);
+	}
+	++tc.requests;
+	tc.lock.release();
+    }
+    return 0;
+}
+
+void
+FlowCache::add_handlers()
+{
+    add_read_handler("hits", read_handler, h_hits);
+    add_read_handler("misses", read_handler, h_misses);
+    add_read_handler("evictions", read_handler, h_evictions);
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("capacity", read_handler, h_capacity);
+    add_write_handler("clear", write_handler, h_clear, Handler::BUTTON);
+    add_write_handler("invalidate", write_handler, h_invalidate);
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(FlowCache)
+ELEMENT_MT_SAFE(FlowCache)
@@ -0,0 +1,227 @@
+#ifndef CLICK_FLOWCACHE_HH
+#define CLICK_FLOWCACHE_HH
+#include <click/batchelement.hh>
+#include <click/atomic.hh>
+#include <click/multithread.hh>
+#include <click/ipaddress.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+
+/*
+=c
+
+FlowCache([I<keywords> CAPACITY, DST_ANNO, PAINT_ANNO])
+
+=s ip
+
+memoizes a classification sub-path per flow
+
+=d
+
+FlowCache remembers, for each TCP or UDP flow, which way a classification
+sub-path sent the flow's packets.  Later packets of the flow bypass the
+sub-path.  The sub-path can be any chain of elements, such as IPClassifier,
+IPFilter and LookupIPRoute.
+
+FlowCache has N inputs and N outputs, where N is at least 2.  Packets arrive
+on input 0.  A packet whose flow is known is emitted on the output recorded
+for that flow.  Every other packet is emitted on output N-1, which should lead
+to the sub-path.  The sub-path's results come back into FlowCache: a packet
+arriving on input I (1 E<lt>= I E<lt> N) is recorded for its flow, then
+emitted on output I-1.  A packet dropped by the sub-path is not recorded, so
+that flow's next packet takes the sub-path again.
+
+FlowCache also records, and restores on later packets, the destination IP
+address annotation and the paint annotation set by the sub-path.
+
+Input packets must have their IP header annotations set.  Fragments, and
+packets that are neither TCP nor UDP, are never cached; they always take the
+sub-path.  The cache is only correct if the sub-path's decision depends
+solely on the flow's addresses, ports and protocol.  It must not depend on
+TCP flags, on payload, or on state such as counters.
+
+Keyword arguments are:
+
+=over 8
+
+=item CAPACITY
+
+The number of flows each thread's cache holds.  Rounded up to a power of two.
+Default is 4096.
+
+=item DST_ANNO
+
+Boolean.  If true, memoize the destination IP address annotation.  Default is
+true.
+
+=item PAINT_ANNO
+
+Boolean.  If true, memoize the paint annotation.  Default is true.
+
+=back
+
+=n
+
+Each thread has its own cache, so lookups need no locking.  A cache is a
+bucketized cuckoo hash table with four flows per bucket.  Each flow can live
+in one of two buckets.  When both of a new flow's buckets are full,
+FlowCache tries to move one resident flow to its other bucket.  If that
+fails, it evicts the least recently used flow of the two buckets.
+
+FlowCache remembers each missed packet's flow, as it was before the
+sub-path, until the packet comes back.  So the sub-path may rewrite headers,
+but it must return packets to FlowCache before FlowCache's push into it
+returns: a packet that passes through a Queue in the sub-path is forwarded,
+but its flow is not learned.
+
+When a table consulted by the sub-path changes, call the C<clear> or
+C<invalidate> handler.  No packet that arrives after the handler returns uses
+a result learned before, including results of packets that were inside the
+sub-path at the time.  Each thread applies these handlers to its own cache
+when it next handles a packet.
+
+=h hits read-only
+
+Returns the number of packets that bypassed the sub-path.
+
+=h misses read-only
+
+Returns the number of packets sent to the sub-path.
+
+=h evictions read-only
+
+Returns the number of flows evicted to make room for new ones.
+
+=h count read-only
+
+Returns the number of flows currently cached, summed over all threads.
+
+=h capacity read-only
+
+Returns the per-thread capacity.
+
+=h clear write-only
+
+Forgets every cached flow.  This takes constant time.
+
+=h invalidate write-only
+
+Takes an IP prefix.  Forgets every cached flow whose source or destination
+address matches the prefix.  If invalidations pile up for a thread that is
+not handling packets, that thread's cache is cleared instead.
+
+=e
+
+  fc :: FlowCache;
+  FromDevice(eth0) -> Strip(14) -> CheckIPHeader -> fc;
+  fc[2] -> IPFilter(allow tcp, deny all)
+        -> rt :: LookupIPRoute(10.0.0.0/8 0, 0.0.0.0/0 1);
+  rt[0] -> [1]fc;
+  rt[1] -> [2]fc;
+  fc[0] -> ...;  // local
+  fc[1] -> ...;  // default route
+
+=a IPClassifier, IPFilter, LookupIPRoute */
+
+class FlowCache : public BatchElement { public:
+
+    FlowCache() CLICK_COLD;
+    ~FlowCache() CLICK_COLD;
+
+    const char *class_name() const	{ return "FlowCache"; }
+    const char *port_count() const	{ return "2-/="; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void push(int port, Packet *p);
+#if HAVE_BATCH
+    void push_batch(int port, PacketBatch *batch);
+#endif
+
+  private:
+
+    struct Entry {
+	uint32_t saddr;
+	uint32_t daddr;
+	uint32_t ports;
+	uint8_t proto;
+	uint8_t port;
+	uint8_t paint;
+	uint8_t _pad;
+	uint32_t dst;
+	uint32_t epoch;		// valid iff equal to ThreadCache::epoch
+	uint32_t used;		// per-thread LRU clock
+    };
+
+    enum { bucket_size = 4 };
+    struct Bucket {
+	Entry e[bucket_size];
+    } CLICK_CACHE_ALIGN;
+
+    // a missed packet inside the sub-path, with its flow as it was before
+    struct Pending {
+	const Packet *p;
+	Entry k;
+	uint32_t seen;		// ThreadCache::seen when the packet missed
+	Pending() {
+	}
+	Pending(const Packet *p_, const Entry &k_, uint32_t seen_)
+	    : p(p_), k(k_), seen(seen_) {
+	}
+    };
+
+    enum { max_invalidations = 16 };
+
+    struct ThreadCache {
+	Bucket *buckets;
+	uint32_t epoch;
+	uint32_t seen;		// value of requests last applied
+	uint32_t clock;
+	uint32_t hint;		// where to start looking in pending
+	Vector<Pending> pending;
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+
+	// written by handlers on any thread
+	atomic_uint32_t requests;
+	SimpleSpinlock lock;
+	bool clear;
+	Vector<IPAddress> invalidations;	// address/mask pairs
+
+	ThreadCache()
+	    : buckets(0), epoch(1), seen(0), clock(0), hint(0),
+	      hits(0), misses(0), evictions(0), clear(false) {
+	    requests = 0;
+	}
+    };
+
+    per_thread<ThreadCache> _caches;
+    uint32_t _mask;
+    bool _dst_anno;
+    bool _paint_anno;
+
+    enum { h_hits, h_misses, h_evictions, h_count, h_capacity,
+	   h_clear, h_invalidate };
+
+    static inline bool extract(const Packet *p, Entry &k);
+    static inline uint64_t hash(const Entry &k);
+    static inline bool same_flow(const Entry &a, const Entry &b);
+    static inline bool matches(const Entry &e, const Vector<IPAddress> &inv);
+    inline ThreadCache &thread_cache();
+    void apply_requests(ThreadCache &tc);
+    inline int lookup(ThreadCache &tc, Packet *p, Entry &k);
+    void learn(ThreadCache &tc, Packet *p, int port);
+
+    static String read_handler(Element *e, void *user_data) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *user_data,
+			     ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
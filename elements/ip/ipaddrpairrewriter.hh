@@ -110,6 +110,10 @@ Returns the number of mappings in the table.
 Returns a human-readable description of the patterns associated with this
 IPAddrRewriter.
 
+=h memory r
+
+Returns the memory used for this element's flows; see IPRewriter.
+
 =a IPRewriter, IPAddrRewriter, TCPRewriter, IPRewriterPatterns,
 RoundRobinIPMapper, FTPPortMapper, ICMPRewriter, ICMPPingRewriter,
 StoreIPAddress (for simple uses) */
@@ -144,6 +148,9 @@ class IPAddrPairRewriter : public IPRewriterBase { public:
     IPRewriterEntry *add_flow(int ip_p, const IPFlowID &flowid,
 			      const IPFlowID &rewritten_flowid, int input);
     void destroy_flow(IPRewriterFlow *flow);
+    void flow_memory(SlabAllocator::Stats &stats) const {
+	_allocator.stats(stats);
+    }
 
     void push(int, Packet *);
 
@@ -151,7 +158,7 @@ class IPAddrPairRewriter : public IPRewriterBase { public:
 
   private:
 
-    SizedHashAllocator<sizeof(IPAddrPairFlow)> _allocator;
+    SizedSlabAllocator<sizeof(IPAddrPairFlow)> _allocator;
     unsigned _annos;
 
     static String dump_mappings_handler(Element *, void *);
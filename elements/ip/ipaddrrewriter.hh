@@ -109,6 +109,10 @@ Returns the number of mappings in the table.
 Returns a human-readable description of the patterns associated with this
 IPAddrRewriter.
 
+=h memory r
+
+Returns the memory used for this element's flows; see IPRewriter.
+
 =a IPRewriter, IPAddrPairRewriter, TCPRewriter, IPRewriterPatterns,
 RoundRobinIPMapper, FTPPortMapper, ICMPRewriter, ICMPPingRewriter,
 StoreIPAddress (for simple uses) */
@@ -143,6 +147,9 @@ class IPAddrRewriter : public IPRewriterBase { public:
     IPRewriterEntry *add_flow(int ip_p, const IPFlowID &flowid,
 			      const IPFlowID &rewritten_flowid, int input);
     void destroy_flow(IPRewriterFlow *flow);
+    void flow_memory(SlabAllocator::Stats &stats) const {
+	_allocator.stats(stats);
+    }
 
     void push(int, Packet *);
 
@@ -150,7 +157,7 @@ class IPAddrRewriter : public IPRewriterBase { public:
 
   protected:
 
-    SizedHashAllocator<sizeof(IPAddrFlow)> _allocator;
+    SizedSlabAllocator<sizeof(IPAddrFlow)> _allocator;
     unsigned _annos;
 
     static String dump_mappings_handler(Element *, void *);
@@ -103,7 +103,7 @@ IPInputCombo::smaction(Packet *p)
   if (ip_fast_csum((unsigned char *)ip, ip->ip_hl) != 0)
     goto bad;
 #else
-  if (click_in_cksum((unsigned char *)ip, hlen) != 0)
+  if (click_in_cksum_iphdr(ip) != 0)
     goto bad;
 #endif
 
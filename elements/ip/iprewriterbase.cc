@@ -365,6 +365,11 @@ IPRewriterBase::read_handler(Element *e, void *user_data)
     case h_capacity:
 	sa << rw->_heap->_capacity;
 	break;
+    case h_memory: {
+	SlabAllocator::Stats stats;
+	rw->flow_memory(stats);
+	return stats.unparse();
+    }
     default:
 	for (int i = 0; i < rw->_input_specs.size(); ++i) {
 	    if (what != h_patterns && what != i)
@@ -452,6 +457,7 @@ IPRewriterBase::add_rewriter_handlers(bool writable_patterns)
     add_read_handler("patterns", read_handler, h_patterns);
     add_read_handler("size", read_handler, h_size);
     add_read_handler("capacity", read_handler, h_capacity);
+    add_read_handler("memory", read_handler, h_memory);
     add_write_handler("capacity", write_handler, h_capacity);
     add_write_handler("clear", write_handler, h_clear);
     for (int i = 0; i < ninputs(); ++i) {
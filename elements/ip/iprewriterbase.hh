@@ -4,6 +4,7 @@
 #include <click/timer.hh>
 #include "elements/ip/iprwmapping.hh"
 #include <click/bitvector.hh>
+#include <click/slaballocator.hh>
 CLICK_DECLS
 class IPMapper;
 class IPRewriterPattern;
@@ -126,6 +127,10 @@ class IPRewriterBase : public Element { public:
     virtual click_jiffies_t best_effort_expiry(const IPRewriterFlow *flow) {
 	return flow->expiry() + _timeouts[0] - _timeouts[1];
     }
+    /** @brief Add the memory used by this element's flows to @a stats. */
+    virtual void flow_memory(SlabAllocator::Stats &stats) const {
+	(void) stats;
+    }
 
     int llrpc(unsigned command, void *data);
 
@@ -162,7 +167,7 @@ class IPRewriterBase : public Element { public:
 
     enum {			// < 0 because individual patterns are >= 0
 	h_nmappings = -1, h_mapping_failures = -2, h_patterns = -3,
-	h_size = -4, h_capacity = -5, h_clear = -6
+	h_size = -4, h_capacity = -5, h_clear = -6, h_memory = -7
     };
     static String read_handler(Element *e, void *user_data) CLICK_COLD;
     static int write_handler(const String &str, Element *e, void *user_data, ErrorHandler *errh) CLICK_COLD;
@@ -43,7 +43,7 @@ SetIPChecksum::simple_action(Packet *p_in)
 	    && likely((hlen = iph->ip_hl << 2) >= sizeof(click_ip))
 	    && likely(hlen <= plen)) {
 	    iph->ip_sum = 0;
-	    iph->ip_sum = click_in_cksum((unsigned char *) iph, hlen);
+	    iph->ip_sum = click_in_cksum_iphdr(iph);
 	    return p;
 	}
 
@@ -54,6 +54,15 @@ SetIPChecksum::simple_action(Packet *p_in)
     return 0;
 }
 
+#if HAVE_BATCH
+PacketBatch *
+SetIPChecksum::simple_action_batch(PacketBatch *batch)
+{
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(simple_action, batch, [](Packet *){});
+    return batch;
+}
+#endif
+
 void
 SetIPChecksum::add_handlers()
 {
@@ -1,6 +1,6 @@
 #ifndef CLICK_SETIPCHECKSUM_HH
 #define CLICK_SETIPCHECKSUM_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/glue.hh>
 CLICK_DECLS
 
@@ -17,9 +17,12 @@ CLICK_DECLS
  * header, like DecIPTTL, SetIPDSCP, and IPRewriter, already update the
  * checksum incrementally.
  *
+ * SetIPChecksum handles batches natively.  The common 20-byte header is
+ * checksummed without a loop.
+ *
  * =a CheckIPHeader, DecIPTTL, SetIPDSCP, IPRewriter */
 
-class SetIPChecksum : public Element { public:
+class SetIPChecksum : public BatchElement { public:
 
     SetIPChecksum() CLICK_COLD;
     ~SetIPChecksum() CLICK_COLD;
@@ -29,6 +32,9 @@ class SetIPChecksum : public Element { public:
     void add_handlers() CLICK_COLD;
 
     Packet *simple_action(Packet *p);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *batch);
+#endif
 
   private:
 
@@ -110,6 +110,7 @@ class Counter : public Element { public:
 
     const char *class_name() const		{ return "Counter"; }
     const char *port_count() const		{ return PORTS_1_1; }
+    const char *flags() const			{ return "C"; }
 
     counter_t count() const                     { return _count; }
     counter_t byte_count() const                { return _byte_count; }
@@ -0,0 +1,329 @@
+/*
+ * latencyhistogram.{cc,hh} -- element records packet latencies
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "latencyhistogram.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#include <click/packet_anno.hh>
+#include <click/integers.hh>
+CLICK_DECLS
+
+LatencyHistogram::LatencyHistogram()
+    : _timer(this), _epoch(1)
+{
+}
+
+LatencyHistogram::~LatencyHistogram()
+{
+    for (unsigned i = 0; i < _hist.weight(); ++i)
+	delete[] _hist.get_value(i).buckets;
+}
+
+int
+LatencyHistogram::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String unit = "CYCLES";
+    _anno = PERFCTR_ANNO_OFFSET;
+    if (Args(conf, this, errh)
+	.read("ANNO", AnnoArg(8), _anno)
+	.read("UNIT", WordArg(), unit)
+	.read("RESET_INTERVAL", _interval)
+	.complete() < 0)
+	return -1;
+    unit = unit.upper();
+    if (unit == "CYCLES")
+	_ns = false;
+    else if (unit == "NS")
+	_ns = true;
+    else
+	return errh->error("bad UNIT");
+    return 0;
+}
+
+int
+LatencyHistogram::initialize(ErrorHandler *)
+{
+    for (unsigned i = 0; i < _hist.weight(); ++i) {
+	Hist &h = _hist.get_value(i);
+	h.buckets = new uint64_t[nbuckets];
+	clear(h);
+    }
+    _cycles0 = click_get_cycles();
+    _time0 = Timestamp::now_steady();
+    _timer.initialize(this);
+    if (_interval)
+	_timer.schedule_after(_interval);
+    return 0;
+}
+
+/* Values below sub_count get a bucket each. Above, each power of two
+   [2^b, 2^(b+1)) is split into half_count buckets. */
+inline int
+LatencyHistogram::bucket(uint64_t v)
+{
+    if (v < (uint64_t) sub_count)
+	return v;
+    int b = 63 - ffs_msb(v) + 1;
+    if (b > max_bit) {
+	b = max_bit;
+	v = (uint64_t(1) << (max_bit + 1)) - 1;
+    }
+    int shift = b - sub_bits + 1;
+    return sub_count + (shift - 1) * half_count + (int) (v >> shift) - half_count;
+}
+
+/* Return the largest value that falls in bucket @a b. */
+inline uint64_t
+LatencyHistogram::bucket_value(int b)
+{
+    if (b < sub_count)
+	return b;
+    int shift = (b - sub_count) / half_count + 1;
+    uint64_t top = (b - sub_count) % half_count + half_count;
+    return ((top + 1) << shift) - 1;
+}
+
+void
+LatencyHistogram::clear(Hist &h)
+{
+    h.count = h.sum = h.max = 0;
+    h.min = ~uint64_t(0);
+    memset(h.buckets, 0, sizeof(uint64_t) * nbuckets);
+    h.epoch = _epoch;
+}
+
+inline void
+LatencyHistogram::record(Hist &h, uint64_t v)
+{
+    ++h.count;
+    h.sum += v;
+    if (v < h.min)
+	h.min = v;
+    if (v > h.max)
+	h.max = v;
+    ++h.buckets[bucket(v)];
+}
+
+Packet *
+LatencyHistogram::simple_action(Packet *p)
+{
+    if (uint64_t stamp = p->anno_u64(_anno)) {
+	Hist &h = *_hist;
+	if (unlikely(h.epoch != _epoch))
+	    clear(h);
+	uint64_t now = click_get_cycles();
+	record(h, now > stamp ? now - stamp : 0);
+    }
+    return p;
+}
+
+#if HAVE_BATCH
+PacketBatch *
+LatencyHistogram::simple_action_batch(PacketBatch *batch)
+{
+    uint64_t now = click_get_cycles();
+    Hist &h = *_hist;
+    if (unlikely(h.epoch != _epoch))
+	clear(h);
+    FOR_EACH_PACKET(batch, p)
+	if (uint64_t stamp = p->anno_u64(_anno))
+	    record(h, now > stamp ? now - stamp : 0);
+    return batch;
+}
+#endif
+
+/* Merge the current epoch's per-thread histograms into @a s. Threads that
+   have not recorded since the last reset count as empty. */
+void
+LatencyHistogram::collect(Summary &s)
+{
+    uint32_t epoch = _epoch;
+    s.count = s.sum = s.max = 0;
+    s.min = ~uint64_t(0);
+    memset(s.buckets.begin(), 0, sizeof(uint64_t) * nbuckets);
+    for (unsigned i = 0; i < _hist.weight(); ++i) {
+	const Hist &h = _hist.get_value(i);
+	if (h.epoch != epoch || !h.count)
+	    continue;
+	s.count += h.count;
+	s.sum += h.sum;
+	if (h.min < s.min)
+	    s.min = h.min;
+	if (h.max > s.max)
+	    s.max = h.max;
+	for (int b = 0; b < nbuckets; ++b)
+	    s.buckets[b] += h.buckets[b];
+    }
+    if (!s.count)
+	s.min = 0;
+}
+
+/* Fill @a s with the statistics the handlers report: the last complete
+   interval if RESET_INTERVAL is set, otherwise everything since the last
+   reset. */
+void
+LatencyHistogram::summarize(Summary &s)
+{
+    if (_interval) {
+	_last_lock.acquire();
+	s = _last;
+	_last_lock.release();
+    } else
+	collect(s);
+}
+
+/* Return the @a q'th percentile, where @a q is in thousandths of a
+   percent. */
+uint64_t
+LatencyHistogram::Summary::percentile(uint32_t q) const
+{
+    if (!count)
+	return 0;
+    uint64_t rank = (count * q + 99999) / 100000;
+    if (rank == 0)
+	rank = 1;
+    uint64_t seen = 0;
+    for (int b = 0; b < nbuckets; ++b) {
+	seen += buckets[b];
+	if (seen >= rank) {
+	    uint64_t v = bucket_value(b);
+	    return v < max ? v : max;
+	}
+    }
+    return max;
+}
+
+void
+LatencyHistogram::run_timer(Timer *)
+{
+    Summary s;
+    collect(s);
+    _last_lock.acquire();
+    _last = s;
+    _last_lock.release();
+    ++_epoch;
+    _timer.reschedule_after(_interval);
+}
+
+double
+LatencyHistogram::cycles_hz() const
+{
+    Timestamp elapsed = Timestamp::now_steady() - _time0;
+    click_cycles_t cycles = click_get_cycles() - _cycles0;
+    if (!elapsed)
+	return 0;
+    return cycles / elapsed.doubleval();
+}
+
+String
+LatencyHistogram::unparse(uint64_t v) const
+{
+    if (!_ns)
+	return String(v);
+    double hz = cycles_hz();
+    return String(hz ? (uint64_t) (v * 1e9 / hz + 0.5) : 0);
+}
+
+enum { h_count, h_min, h_max, h_mean, h_p50, h_p90, h_p99, h_p999,
+       h_histogram, h_cycles_hz, h_reset };
+
+String
+LatencyHistogram::read_handler(Element *e, void *user_data)
+{
+    LatencyHistogram *lh = static_cast<LatencyHistogram *>(e);
+    int what = (intptr_t) user_data;
+    if (what == h_cycles_hz)
+	return String((uint64_t) (lh->cycles_hz() + 0.5));
+
+    Summary s;
+    lh->summarize(s);
+    switch (what) {
+    case h_count:
+	return String(s.count);
+    case h_min:
+	return lh->unparse(s.min);
+    case h_max:
+	return lh->unparse(s.max);
+    case h_mean:
+	return lh->unparse(s.count ? (s.sum + s.count / 2) / s.count : 0);
+    case h_p50:
+	return lh->unparse(s.percentile(50000));
+    case h_p90:
+	return lh->unparse(s.percentile(90000));
+    case h_p99:
+	return lh->unparse(s.percentile(99000));
+    case h_p999:
+	return lh->unparse(s.percentile(99900));
+    case h_histogram: {
+	StringAccum sa;
+	for (int b = 0; b < nbuckets; ++b)
+	    if (s.buckets[b])
+		sa << lh->unparse(bucket_value(b)) << ' ' << s.buckets[b] << '\n';
+	return sa.take_string();
+    }
+    default:
+	return String();
+    }
+}
+
+int
+LatencyHistogram::percentile_handler(int, String &str, Element *e,
+				     const Handler *, ErrorHandler *errh)
+{
+    LatencyHistogram *lh = static_cast<LatencyHistogram *>(e);
+    uint32_t q;
+    if (!DecimalFixedPointArg(3).parse(cp_uncomment(str), q) || q > 100000)
+	return errh->error("expected percentage between 0 and 100");
+    Summary s;
+    lh->summarize(s);
+    str = lh->unparse(s.percentile(q));
+    return 0;
+}
+
+int
+LatencyHistogram::write_handler(const String &, Element *e, void *, ErrorHandler *)
+{
+    LatencyHistogram *lh = static_cast<LatencyHistogram *>(e);
+    ++lh->_epoch;
+    if (lh->_interval) {
+	lh->_last_lock.acquire();
+	lh->_last = Summary();
+	lh->_last_lock.release();
+    }
+    return 0;
+}
+
+void
+LatencyHistogram::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("min", read_handler, h_min);
+    add_read_handler("max", read_handler, h_max);
+    add_read_handler("mean", read_handler, h_mean);
+    add_read_handler("p50", read_handler, h_p50);
+    add_read_handler("p90", read_handler, h_p90);
+    add_read_handler("p99", read_handler, h_p99);
+    add_read_handler("p999", read_handler, h_p999);
+    add_read_handler("histogram", read_handler, h_histogram);
+    add_read_handler("cycles_hz", read_handler, h_cycles_hz);
+    set_handler("percentile", Handler::f_read | Handler::f_read_param, percentile_handler);
+    add_write_handler("reset", write_handler, h_reset, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(int64)
+EXPORT_ELEMENT(LatencyHistogram)
+ELEMENT_MT_SAFE(LatencyHistogram)
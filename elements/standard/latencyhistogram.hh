@@ -0,0 +1,189 @@
+#ifndef CLICK_LATENCYHISTOGRAM_HH
+#define CLICK_LATENCYHISTOGRAM_HH
+#include <click/batchelement.hh>
+#include <click/multithread.hh>
+#include <click/timer.hh>
+#include <click/sync.hh>
+CLICK_DECLS
+
+/*
+=c
+
+LatencyHistogram([I<keywords> ANNO, UNIT, RESET_INTERVAL])
+
+=s counters
+
+records packet latencies in a histogram
+
+=d
+
+Measures how long packets took since they were stamped by SetLatencyStamp.
+LatencyHistogram reads the cycle counter and subtracts the stamp in each
+packet's annotation. The difference goes into a histogram. Packets with a
+zero stamp, such as those skipped by SetLatencyStamp's SAMPLE, are passed
+through without being recorded. In batch mode, the cycle counter is read
+once per batch.
+
+The histogram is log-linear, like an HDR histogram. Each power-of-two range
+of latencies is split into 64 equal buckets. So a percentile is reported
+with a relative error of at most 1/64, no matter how large it is. Values
+up to 2^48 cycles are recorded. Each thread records into its own
+histogram, and the handlers merge them.
+
+Keyword arguments are:
+
+=over 8
+
+=item ANNO
+
+Annotation offset. The 8-byte annotation that holds the stamp. Default is
+the performance counter annotation, as used by SetLatencyStamp.
+
+=item UNIT
+
+Either CYCLES or NS. The unit that handlers report latencies in. For NS,
+cycles are converted with the cycle counter frequency, measured against
+the system clock since LatencyHistogram was initialized. Default is
+CYCLES.
+
+=item RESET_INTERVAL
+
+Time. If given, the histograms are reset every RESET_INTERVAL. The handlers
+then report on the last complete interval. Default is never to reset.
+
+=back
+
+=h count read-only
+
+Returns the number of packets recorded.
+
+=h min read-only
+
+Returns the smallest latency recorded.
+
+=h max read-only
+
+Returns the largest latency recorded.
+
+=h mean read-only
+
+Returns the mean latency.
+
+=h p50 read-only
+
+Returns the median latency. Handlers C<p90>, C<p99> and C<p999> return the
+90th, 99th and 99.9th percentiles.
+
+=h percentile read-only
+
+Takes a percentage as a parameter, such as "99.99", and returns that
+percentile of the latency.
+
+=h histogram read-only
+
+Returns the non-empty buckets, one per line, as "VALUE COUNT", where VALUE
+is the largest latency the bucket holds.
+
+=h cycles_hz read-only
+
+Returns the measured cycle counter frequency, in cycles per second.
+
+=h reset write-only
+
+Resets the histograms.
+
+=e
+
+  FromDPDKDevice(0) -> SetLatencyStamp(SAMPLE 64) -> ...
+      -> lat :: LatencyHistogram(UNIT NS, RESET_INTERVAL 10s)
+      -> ToDPDKDevice(1);
+
+Reading C<lat.p99> then reports the 99th percentile latency, in
+nanoseconds, over the last 10 seconds.
+
+=a SetLatencyStamp, CycleCountAccum */
+
+class LatencyHistogram : public BatchElement { public:
+
+    LatencyHistogram() CLICK_COLD;
+    ~LatencyHistogram() CLICK_COLD;
+
+    const char *class_name() const	{ return "LatencyHistogram"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    Packet *simple_action(Packet *p);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *batch);
+#endif
+
+    void run_timer(Timer *timer);
+
+  private:
+
+    enum {
+	sub_bits = 7, sub_count = 1 << sub_bits, half_count = sub_count / 2,
+	max_bit = 47,
+	nbuckets = sub_count + (max_bit - sub_bits + 1) * half_count
+    };
+
+    struct Hist {
+	uint32_t epoch;
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	uint64_t *buckets;
+	Hist()
+	    : epoch(0), buckets(0) {
+	}
+    };
+
+    struct Summary {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t min;
+	uint64_t max;
+	Vector<uint64_t> buckets;
+	Summary()
+	    : count(0), sum(0), min(0), max(0), buckets(nbuckets, 0) {
+	}
+	uint64_t percentile(uint32_t q) const;
+    };
+
+    int _anno;
+    bool _ns;
+    Timestamp _interval;
+    Timer _timer;
+
+    per_thread<Hist> _hist;
+    volatile uint32_t _epoch;
+
+    Summary _last;
+    SimpleSpinlock _last_lock;
+
+    click_cycles_t _cycles0;
+    Timestamp _time0;
+
+    static inline int bucket(uint64_t v);
+    static inline uint64_t bucket_value(int b);
+    inline void record(Hist &h, uint64_t v);
+    void clear(Hist &h);
+    void collect(Summary &s);
+    void summarize(Summary &s);
+    double cycles_hz() const;
+    String unparse(uint64_t v) const;
+
+    static String read_handler(Element *e, void *user_data) CLICK_COLD;
+    static int percentile_handler(int op, String &str, Element *e,
+				  const Handler *h, ErrorHandler *errh) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *user_data,
+			     ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -162,11 +162,12 @@ RatedSource::run_task(Task *)
     if (_limit != NO_LIMIT && n + _count >= _limit)
         n = _limit - _count;
 
-    // Create a batch
+    // Create a batch; its packets share one timestamp
+    Timestamp now = Timestamp::recent_tsc();
     for (int i=0 ; i<n; i++) {
         if (_tb.remove_if(1)) {
             Packet *p = _packet->clone();
-            p->set_timestamp_anno(Timestamp::now());
+            p->set_timestamp_anno(now);
 
             if (head == NULL) {
                 head = PacketBatch::start_head(p);
@@ -199,7 +200,7 @@ RatedSource::run_task(Task *)
 #else
     if (_tb.remove_if(1)) {
         Packet *p = _packet->clone();
-        p->set_timestamp_anno(Timestamp::now());
+        p->set_timestamp_anno(Timestamp::recent_tsc());
         output(0).push(p);
         _count++;
         _task.fast_reschedule();
@@ -230,7 +231,7 @@ RatedSource::pull(int)
     if (_tb.remove_if(1)) {
         _count++;
         Packet *p = _packet->clone();
-        p->set_timestamp_anno(Timestamp::now());
+        p->set_timestamp_anno(Timestamp::recent_tsc());
         return p;
     }
 
@@ -0,0 +1,75 @@
+/*
+ * setlatencystamp.{cc,hh} -- element stores cycle counter in an annotation
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "setlatencystamp.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/packet_anno.hh>
+CLICK_DECLS
+
+SetLatencyStamp::SetLatencyStamp()
+    : _countdown(1)
+{
+}
+
+int
+SetLatencyStamp::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _sample = 1;
+    _anno = PERFCTR_ANNO_OFFSET;
+    if (Args(conf, this, errh)
+	.read("SAMPLE", _sample)
+	.read("ANNO", AnnoArg(8), _anno)
+	.complete() < 0)
+	return -1;
+    if (_sample == 0)
+	return errh->error("SAMPLE must be positive");
+    return 0;
+}
+
+Packet *
+SetLatencyStamp::simple_action(Packet *p)
+{
+    uint64_t stamp = 0;
+    if (--*_countdown == 0) {
+	*_countdown = _sample;
+	stamp = click_get_cycles();
+    }
+    p->set_anno_u64(_anno, stamp);
+    return p;
+}
+
+#if HAVE_BATCH
+PacketBatch *
+SetLatencyStamp::simple_action_batch(PacketBatch *batch)
+{
+    uint64_t now = click_get_cycles();
+    uint32_t &countdown = *_countdown;
+    FOR_EACH_PACKET(batch, p) {
+	uint64_t stamp = 0;
+	if (--countdown == 0) {
+	    countdown = _sample;
+	    stamp = now;
+	}
+	p->set_anno_u64(_anno, stamp);
+    }
+    return batch;
+}
+#endif
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(int64)
+EXPORT_ELEMENT(SetLatencyStamp)
+ELEMENT_MT_SAFE(SetLatencyStamp)
@@ -0,0 +1,79 @@
+#ifndef CLICK_SETLATENCYSTAMP_HH
+#define CLICK_SETLATENCYSTAMP_HH
+#include <click/batchelement.hh>
+#include <click/multithread.hh>
+CLICK_DECLS
+
+/*
+=c
+
+SetLatencyStamp([I<keywords> SAMPLE, ANNO])
+
+=s timestamps
+
+stores the cycle counter in an annotation for latency measurement
+
+=d
+
+Stores the current value of the CPU cycle counter (the TSC on x86) in an
+8-byte annotation of passing packets. LatencyHistogram, placed further along
+the configuration, then measures how long each stamped packet took to get
+there. Reading the cycle counter is much cheaper than reading the system
+time, as SetTimestamp does. In batch mode, the counter is read once per
+batch.
+
+Keyword arguments are:
+
+=over 8
+
+=item SAMPLE
+
+Unsigned. Stamp only every SAMPLE-th packet; other packets get a zero
+annotation, which LatencyHistogram ignores. This keeps the cost low enough
+to leave latency measurement on in production. Default is 1, which stamps
+every packet.
+
+=item ANNO
+
+Annotation offset. The 8-byte annotation that holds the stamp. Default is
+the performance counter annotation, as used by SetCycleCount.
+
+=back
+
+=n
+
+The cycle counter must be synchronized across CPUs, as invariant TSCs on
+current x86 processors are, if packets are stamped on one thread and
+measured on another.
+
+=e
+
+  FromDPDKDevice(0) -> SetLatencyStamp(SAMPLE 64) -> ...
+      -> LatencyHistogram -> ToDPDKDevice(1);
+
+=a LatencyHistogram, SetCycleCount, SetTimestamp */
+
+class SetLatencyStamp : public BatchElement { public:
+
+    SetLatencyStamp() CLICK_COLD;
+
+    const char *class_name() const	{ return "SetLatencyStamp"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+
+    Packet *simple_action(Packet *p);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *batch);
+#endif
+
+  private:
+
+    uint32_t _sample;
+    int _anno;
+    per_thread<uint32_t> _countdown;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -50,15 +50,33 @@ Packet *
 SetTimestamp::simple_action(Packet *p)
 {
     if (_action == ACT_NOW)
-	p->timestamp_anno().assign_now();
+	p->timestamp_anno() = Timestamp::recent_tsc();
     else if (_action == ACT_TIME)
 	p->timestamp_anno() = _tv;
     else if (_action == ACT_FIRST_NOW)
-	FIRST_TIMESTAMP_ANNO(p).assign_now();
+	FIRST_TIMESTAMP_ANNO(p) = Timestamp::recent_tsc();
     else
 	FIRST_TIMESTAMP_ANNO(p) = _tv;
     return p;
 }
 
+#if HAVE_BATCH
+PacketBatch *
+SetTimestamp::simple_action_batch(PacketBatch *batch)
+{
+    Timestamp t = _tv;
+    if (_action == ACT_NOW || _action == ACT_FIRST_NOW)
+	t = Timestamp::recent_tsc();
+    if (_action < ACT_FIRST_NOW) {
+	FOR_EACH_PACKET(batch, p)
+	    p->timestamp_anno() = t;
+    } else {
+	FOR_EACH_PACKET(batch, p)
+	    FIRST_TIMESTAMP_ANNO(p) = t;
+    }
+    return batch;
+}
+#endif
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(SetTimestamp)
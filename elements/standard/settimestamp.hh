@@ -1,7 +1,7 @@
 // -*- c-basic-offset: 4 -*-
 #ifndef CLICK_SETTIMESTAMP_HH
 #define CLICK_SETTIMESTAMP_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 CLICK_DECLS
 
 /*
@@ -19,6 +19,13 @@ Store the specified TIMESTAMP in the packet's timestamp annotation. If
 TIMESTAMP is not specified, then sets the annotation to the system time when
 the packet arrived at the SetTimestamp element.
 
+The system time is read from the CPU's cycle counter where possible, which is
+much cheaper than a system clock call. Each driver thread reads the counter
+once per scheduling iteration and SetTimestamp uses that value (see
+Timestamp::recent_tsc()), so a timestamp may be up to one iteration old. In
+batch mode, the time is read once per batch, and every packet in the batch
+gets the same timestamp.
+
 Keyword arguments are:
 
 =over 8
@@ -32,7 +39,7 @@ timestamp annotation.  Default is false.
 
 =a StoreTimestamp, AdjustTimestamp, SetTimestampDelta, PrintOld */
 
-class SetTimestamp : public Element { public:
+class SetTimestamp : public BatchElement { public:
 
     SetTimestamp() CLICK_COLD;
 
@@ -41,6 +48,9 @@ class SetTimestamp : public Element { public:
     int configure(Vector<String> &, ErrorHandler *) CLICK_COLD;
 
     Packet *simple_action(Packet *);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *);
+#endif
 
   private:
 
@@ -0,0 +1,423 @@
+/*
+ * fastudpgen.{cc,hh} -- multithreaded UDP traffic generator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "fastudpgen.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/etheraddress.hh>
+#include <click/router.hh>
+#include <click/master.hh>
+#include <click/bitvector.hh>
+#include <click/handlercall.hh>
+#include <click/packet_anno.hh>
+#include <click/standard/scheduleinfo.hh>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+FastUDPGen::FastUDPGen()
+    : _end_h(0)
+{
+#if HAVE_BATCH
+    in_batch_mode = BATCH_MODE_YES;
+#endif
+}
+
+FastUDPGen::~FastUDPGen()
+{
+}
+
+int
+FastUDPGen::parse_lengths(const String &str, ErrorHandler *errh)
+{
+    _lengths.clear();
+    _weights.clear();
+    Vector<String> words;
+    cp_spacevec(str, words);
+    for (String *w = words.begin(); w != words.end(); ++w) {
+	uint32_t len, weight = 1;
+	int colon = w->find_left(':');
+	if (!IntArg().parse(w->substring(0, colon < 0 ? w->length() : colon), len)
+	    || (colon >= 0 && !IntArg().parse(w->substring(colon + 1), weight)))
+	    return errh->error("bad LENGTH %<%s%>", w->c_str());
+	if (len < 60 || len > 0xFFFF - 14)
+	    return errh->error("LENGTH %u out of range", len);
+	if (weight > 0) {
+	    _lengths.push_back(len);
+	    _weights.push_back(weight);
+	}
+    }
+    if (!_lengths.size())
+	return errh->error("LENGTH is empty");
+    return 0;
+}
+
+int
+FastUDPGen::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String lengths = "60";
+    bool imix = false, active = true, stop = false;
+    int64_t limit = -1;
+    HandlerCall end_h;
+    _sport = 1024;
+    _dport = 9;
+    _nflows = 1;
+    _rate = 0;
+    _burst = 32;
+    _nthreads = 1;
+    _cksum = true;
+    _sequence = _timestamp = _stamp = false;
+
+    if (Args(conf, this, errh)
+	.read_mp("SRCETH", EtherAddressArg(), _ethh.ether_shost)
+	.read_mp("SRCIP", _sipaddr)
+	.read_mp("DSTETH", EtherAddressArg(), _ethh.ether_dhost)
+	.read_mp("DSTIP", _dipaddr)
+	.read("LENGTH", AnyArg(), lengths)
+	.read("IMIX", imix)
+	.read("FLOWS", _nflows)
+	.read("SPORT", IPPortArg(IP_PROTO_UDP), _sport)
+	.read("DPORT", IPPortArg(IP_PROTO_UDP), _dport)
+	.read("RATE", _rate)
+	.read("LIMIT", limit)
+	.read("BURST", _burst)
+	.read("THREADS", _nthreads)
+	.read("CHECKSUM", _cksum)
+	.read("SEQUENCE", _sequence)
+	.read("TIMESTAMP", _timestamp)
+	.read("STAMP", _stamp)
+	.read("ACTIVE", active)
+	.read("STOP", stop)
+	.read("END_CALL", HandlerCallArg(HandlerCall::writable), end_h)
+	.complete() < 0)
+	return -1;
+
+    if (imix)
+	lengths = "60:7 590:4 1514:1";
+    if (parse_lengths(cp_unquote(lengths), errh) < 0)
+	return -1;
+    if (_nflows == 0 || _burst == 0 || _nthreads == 0)
+	return errh->error("FLOWS, BURST and THREADS must be positive");
+    if ((uint64_t) _sport + (uint64_t) _nflows * _nthreads > 0x10000)
+	return errh->error("too many flows for SPORT");
+    if (limit > 0xFFFFFFFFLL)
+	return errh->error("LIMIT too large");
+    if (stop && end_h)
+	return errh->error("END_CALL and STOP are mutually exclusive");
+
+    _ethh.ether_type = htons(ETHERTYPE_IP);
+    _limit = limit;
+    _active = active;
+    delete _end_h;
+    if (end_h)
+	_end_h = new HandlerCall(end_h);
+    else if (stop)
+	_end_h = new HandlerCall("stop");
+    else
+	_end_h = 0;
+    return 0;
+}
+
+WritablePacket *
+FastUDPGen::make_template(uint32_t len, uint16_t sport) const
+{
+    WritablePacket *q = Packet::make(len);
+    if (!q)
+	return 0;
+    memset(q->data(), 0, len);
+    memcpy(q->data(), &_ethh, sizeof(click_ether));
+    click_ip *ip = reinterpret_cast<click_ip *>(q->data() + sizeof(click_ether));
+    click_udp *udp = reinterpret_cast<click_udp *>(ip + 1);
+
+    ip->ip_v = 4;
+    ip->ip_hl = sizeof(click_ip) >> 2;
+    ip->ip_len = htons(len - sizeof(click_ether));
+    ip->ip_p = IP_PROTO_UDP;
+    ip->ip_src = _sipaddr;
+    ip->ip_dst = _dipaddr;
+    ip->ip_ttl = 250;
+    ip->ip_sum = click_in_cksum((unsigned char *) ip, sizeof(click_ip));
+
+    uint16_t ulen = len - sizeof(click_ether) - sizeof(click_ip);
+    udp->uh_sport = htons(sport);
+    udp->uh_dport = htons(_dport);
+    udp->uh_ulen = htons(ulen);
+    if (_cksum) {
+	unsigned csum = click_in_cksum((unsigned char *) udp, ulen);
+	udp->uh_sum = click_in_cksum_pseudohdr(csum, ip, ulen);
+    }
+
+    q->set_mac_header(q->data(), sizeof(click_ether));
+    q->set_ip_header(ip, sizeof(click_ip));
+    q->set_dst_ip_anno(IPAddress(_dipaddr));
+    return q;
+}
+
+void
+FastUDPGen::set_rate(uint32_t rate)
+{
+    _rate = rate;
+    _gap = rate ? (uint64_t) (_cycles_hz / rate) : 0;
+    if (rate && !_gap)
+	_gap = 1;
+}
+
+int
+FastUDPGen::initialize(ErrorHandler *errh)
+{
+    // Measure the cycle counter against the steady clock for pacing.
+    click_cycles_t c0 = click_get_cycles();
+    Timestamp t0 = Timestamp::now_steady(), t1;
+    do {
+	t1 = Timestamp::now_steady();
+    } while (_rate && t1 - t0 < Timestamp::make_msec(10));
+    click_cycles_t c1 = click_get_cycles();
+    _cycles_hz = t1 > t0 ? (c1 - c0) / (t1 - t0).doubleval() : 1e9;
+    set_rate(_rate);
+
+    _remaining = _limit >= 0 ? (uint32_t) _limit : 0;
+    _sent = 0;
+
+    // Shuffle the length sequence once; every thread uses the same order.
+    Vector<uint16_t> lengths;
+    for (int i = 0; i < _lengths.size(); ++i)
+	for (uint32_t j = 0; j < _weights[i]; ++j)
+	    lengths.push_back(i);
+    for (int i = lengths.size() - 1; i > 0; --i) {
+	int j = click_random(0, i);
+	uint16_t x = lengths[i];
+	lengths[i] = lengths[j];
+	lengths[j] = x;
+    }
+
+    int nthreads = master()->nthreads();
+    int home = router()->home_thread_id(this);
+    _thread_state.assign(nthreads, 0);
+    for (uint32_t t = 0; t < _nthreads; ++t) {
+	int thread = (home + t) % nthreads;
+	if (_thread_state[thread])
+	    return errh->error("THREADS %u is more than the %d threads available", _nthreads, nthreads);
+	State *s = new State(this);
+	_states.push_back(s);
+	_thread_state[thread] = s;
+	s->lengths = lengths;
+	for (uint32_t f = 0; f < _nflows; ++f)
+	    for (int l = 0; l < _lengths.size(); ++l) {
+		WritablePacket *q = make_template(_lengths[l], _sport + t * _nflows + f);
+		if (!q)
+		    return errh->error("out of memory");
+		s->templates.push_back(q);
+	    }
+	ScheduleInfo::initialize_task(this, &s->task, _active, errh);
+	s->task.move_thread(thread);
+	s->nonfull_signal = Notifier::downstream_full_signal(this, 0, &s->task);
+    }
+
+    if (_end_h && _end_h->initialize_write(this, errh) < 0)
+	return -1;
+    return 0;
+}
+
+void
+FastUDPGen::cleanup(CleanupStage)
+{
+    for (int i = 0; i < _states.size(); ++i) {
+	State *s = _states[i];
+	for (int j = 0; j < s->templates.size(); ++j)
+	    s->templates[j]->kill();
+	delete s;
+    }
+    _states.clear();
+    delete _end_h;
+}
+
+bool
+FastUDPGen::get_spawning_threads(Bitvector &b)
+{
+    int home = router()->home_thread_id(this);
+    for (uint32_t t = 0; t < _nthreads; ++t)
+	b[(home + t) % master()->nthreads()] = true;
+    return true;
+}
+
+/* Take up to @a n packets from the remaining LIMIT. */
+uint32_t
+FastUDPGen::reserve(uint32_t n)
+{
+    uint32_t left;
+    do {
+	left = _remaining.value();
+	if (left < n)
+	    n = left;
+	if (!n)
+	    return 0;
+    } while (_remaining.compare_swap(left, left - n) != left);
+    return n;
+}
+
+bool
+FastUDPGen::run_task(Task *task)
+{
+    State &s = *_thread_state[task->home_thread_id()];
+    if (!_active || !s.nonfull_signal)
+	return false;
+
+    uint32_t n = _burst;
+    uint64_t now = 0;
+    if (_gap || _stamp) {
+	now = click_get_cycles();
+	if (_gap) {
+	    if (now < s.next) {
+		task->fast_reschedule();
+		return false;
+	    }
+	    uint64_t due = (now - s.next) / _gap + 1;
+	    if (due < n)
+		n = due;
+	    // Do not try to make up for more than one burst of lost time.
+	    if (s.next + _burst * _gap < now)
+		s.next = now - _burst * _gap;
+	    s.next += n * _gap;
+	}
+    }
+    if (_limit >= 0 && !(n = reserve(n)))
+	return false;
+
+    Timestamp ts;
+    if (_timestamp)
+	ts = Timestamp::now();
+    uint32_t nlengths = s.lengths.size();
+    Packet *head = 0, *last = 0;
+    uint32_t i;
+    for (i = 0; i < n; ++i) {
+	Packet *p = s.templates[s.flow * _lengths.size() + s.lengths[s.length_pos]]->clone();
+	if (!p)
+	    break;
+	if (++s.flow == _nflows)
+	    s.flow = 0;
+	if (++s.length_pos == nlengths)
+	    s.length_pos = 0;
+	if (_sequence)
+	    SET_SEQUENCE_NUMBER_ANNO(p, s.seq++);
+	if (_timestamp)
+	    p->set_timestamp_anno(ts);
+	if (_stamp)
+	    SET_PERFCTR_ANNO(p, now);
+#if HAVE_BATCH
+	if (in_batch_mode == BATCH_MODE_YES) {
+	    if (last)
+		last->set_next(p);
+	    else
+		head = p;
+	    last = p;
+	    continue;
+	}
+#endif
+	output(0).push(p);
+    }
+#if HAVE_BATCH
+    if (head)
+	output_push_batch(0, PacketBatch::start_head(head)->make_tail(last, i));
+#endif
+    (void) head, (void) last;
+    s.count += i;
+    if (_limit >= 0) {
+	// Give packets we could not build back to LIMIT.  Call END_CALL once
+	// the last packet has left, whichever thread reserved it.
+	if (i < n)
+	    _remaining += n - i;
+	if (i && _sent.fetch_and_add(i) + i == (uint32_t) _limit && _end_h)
+	    (void) _end_h->call_write();
+    }
+    task->fast_reschedule();
+    return true;
+}
+
+void
+FastUDPGen::reset()
+{
+    for (int i = 0; i < _states.size(); ++i)
+	_states[i]->count = 0;
+    _remaining = _limit >= 0 ? (uint32_t) _limit : 0;
+    _sent = 0;
+}
+
+enum { h_count, h_rate, h_active, h_reset };
+
+String
+FastUDPGen::read_handler(Element *e, void *user_data)
+{
+    FastUDPGen *g = static_cast<FastUDPGen *>(e);
+    switch ((intptr_t) user_data) {
+    case h_count: {
+	uint64_t count = 0;
+	for (int i = 0; i < g->_states.size(); ++i)
+	    count += g->_states[i]->count;
+	return String(count);
+    }
+    case h_rate:
+	return String(g->_rate);
+    case h_active:
+	return String(g->_active);
+    default:
+	return String();
+    }
+}
+
+int
+FastUDPGen::write_handler(const String &str, Element *e, void *user_data,
+			  ErrorHandler *errh)
+{
+    FastUDPGen *g = static_cast<FastUDPGen *>(e);
+    switch ((intptr_t) user_data) {
+    case h_rate: {
+	uint32_t rate;
+	if (!IntArg().parse(str, rate))
+	    return errh->error("syntax error");
+	g->set_rate(rate);
+	return 0;
+    }
+    case h_active: {
+	bool active;
+	if (!BoolArg().parse(str, active))
+	    return errh->error("syntax error");
+	g->_active = active;
+	break;
+    }
+    case h_reset:
+	g->reset();
+	break;
+    }
+    for (int i = 0; i < g->_states.size(); ++i)
+	if (g->_active)
+	    g->_states[i]->task.reschedule();
+    return 0;
+}
+
+void
+FastUDPGen::add_handlers()
+{
+    add_read_handler("count", read_handler, h_count);
+    add_read_handler("rate", read_handler, h_rate);
+    add_write_handler("rate", write_handler, h_rate);
+    add_read_handler("active", read_handler, h_active, Handler::f_checkbox);
+    add_write_handler("active", write_handler, h_active);
+    add_write_handler("reset", write_handler, h_reset, Handler::f_button);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(int64)
+EXPORT_ELEMENT(FastUDPGen)
+ELEMENT_MT_SAFE(FastUDPGen)
@@ -0,0 +1,225 @@
+#ifndef CLICK_FASTUDPGEN_HH
+#define CLICK_FASTUDPGEN_HH
+#include <click/batchelement.hh>
+#include <click/task.hh>
+#include <click/notifier.hh>
+#include <click/atomic.hh>
+#include <clicknet/ether.h>
+CLICK_DECLS
+class HandlerCall;
+
+/*
+=c
+
+FastUDPGen(SRCETH, SRCIP, DSTETH, DSTIP [, I<keywords> LENGTH, IMIX, FLOWS,
+	   SPORT, DPORT, RATE, LIMIT, BURST, THREADS, CHECKSUM, SEQUENCE,
+	   TIMESTAMP, STAMP, ACTIVE, STOP, END_CALL])
+
+=s udp
+
+generates UDP/IP/Ethernet traffic at high rates from several threads
+
+=d
+
+FastUDPGen is a packet generator meant to fill fast links from a few cores.
+It pushes batches of BURST UDP packets with Ethernet headers from SRCETH to
+DSTETH, and IP headers from SRCIP to DSTIP.
+
+FastUDPGen runs one task on each of THREADS threads, starting at its home
+thread (see StaticThreadSched). At initialization, each thread builds its own
+set of template packets, one for each combination of flow and packet length.
+Generating a packet costs a clone of a template: the packet data is shared
+and reference counted, never copied. So packets from FastUDPGen must not be
+modified in place; elements that write to them will make a private copy
+first.
+
+The FLOWS flows of thread I<t> have UDP source ports SPORT + I<t>*FLOWS,
+SPORT + I<t>*FLOWS + 1, and so on. Packets cycle through the flows in order.
+Packet lengths, which include the Ethernet header but not the CRC, are drawn
+from LENGTH. This is a space-separated list of lengths, each optionally
+followed by a colon and a weight: "60:7 590:4 1514:1" sends 7 60-byte packets
+for every 4 590-byte and 1 1514-byte packets. The order of lengths is
+shuffled once at initialization.
+
+RATE limits each thread to that many packets per second. Threads pace
+themselves against the CPU cycle counter, which is much cheaper than reading
+the system time. A thread that falls behind catches up with at most one
+extra burst.
+
+Keyword arguments are:
+
+=over 8
+
+=item LENGTH
+
+Packet length distribution, as described above. Lengths are at least 60.
+Default is 60.
+
+=item IMIX
+
+Boolean. If true, use the simple IMIX distribution, "60:7 590:4 1514:1".
+Default is false.
+
+=item FLOWS
+
+Unsigned. Number of flows per thread. Default is 1.
+
+=item SPORT
+
+UDP source port of the first flow. Default is 1024.
+
+=item DPORT
+
+UDP destination port. Default is 9.
+
+=item RATE
+
+Unsigned. Packets per second per thread. 0 means as fast as possible. Default
+is 0.
+
+=item LIMIT
+
+Integer. Total number of packets to send, over all threads. -1 means no limit.
+Default is -1.
+
+=item BURST
+
+Unsigned. Maximum number of packets pushed at once. Default is 32.
+
+=item THREADS
+
+Unsigned. Number of threads generating packets. Default is 1.
+
+=item CHECKSUM
+
+Boolean. If true, compute UDP checksums. Default is true.
+
+=item SEQUENCE
+
+Boolean. If true, set the sequence number annotation of each packet. Each
+thread counts its packets separately, starting at 0. Default is false.
+
+=item TIMESTAMP
+
+Boolean. If true, set the timestamp annotation. It is read once per batch.
+Default is false.
+
+=item STAMP
+
+Boolean. If true, store the cycle counter in the performance counter
+annotation, as SetLatencyStamp does, once per batch. Default is false.
+
+=item ACTIVE
+
+Boolean. If false, do not send packets. Default is true.
+
+=item STOP
+
+Boolean. If true, stop the driver once LIMIT packets are sent. Default is
+false.
+
+=item END_CALL
+
+A write handler called once LIMIT packets are sent. END_CALL and STOP are
+mutually exclusive.
+
+=back
+
+=h count read-only
+
+Returns the number of packets sent by all threads.
+
+=h rate read/write
+
+Returns or sets the RATE parameter.
+
+=h active read/write
+
+Returns or sets the ACTIVE parameter.
+
+=h reset write-only
+
+Resets the counts and the remaining LIMIT.
+
+=e
+
+  FastUDPGen(0:0:0:0:0:1, 10.0.0.1, 0:0:0:0:0:2, 10.0.0.2,
+	     IMIX true, FLOWS 1024, THREADS 4)
+    -> ToDPDKDevice(0);
+
+=a FastUDPFlows, InfiniteSource, SetLatencyStamp */
+
+class FastUDPGen : public BatchElement { public:
+
+    FastUDPGen() CLICK_COLD;
+    ~FastUDPGen() CLICK_COLD;
+
+    const char *class_name() const	{ return "FastUDPGen"; }
+    const char *port_count() const	{ return PORTS_0_1; }
+    const char *processing() const	{ return PUSH; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    bool get_spawning_threads(Bitvector &b);
+    bool run_task(Task *task);
+
+  private:
+
+    struct State {
+	Task task;
+	NotifierSignal nonfull_signal;
+	Vector<Packet *> templates;	// flow-major, one per length
+	Vector<uint16_t> lengths;	// shuffled indexes into _lengths
+	uint32_t flow;
+	uint32_t length_pos;
+	uint32_t seq;
+	uint64_t next;			// cycle count when the next packet is due
+	uint64_t count;
+	State(Element *e)
+	    : task(e), flow(0), length_pos(0), seq(0), next(0), count(0) {
+	}
+    };
+
+    click_ether _ethh;
+    struct in_addr _sipaddr;
+    struct in_addr _dipaddr;
+    uint16_t _sport;
+    uint16_t _dport;
+    Vector<uint32_t> _lengths;
+    Vector<uint32_t> _weights;
+    uint32_t _nflows;
+    uint32_t _burst;
+    uint32_t _nthreads;
+    uint32_t _rate;
+    int64_t _limit;
+    bool _cksum;
+    bool _sequence;
+    bool _timestamp;
+    bool _stamp;
+    volatile bool _active;
+
+    Vector<State *> _states;
+    Vector<State *> _thread_state;	// indexed by thread ID
+    atomic_uint32_t _remaining;		// packets left to send if _limit >= 0
+    atomic_uint32_t _sent;		// packets pushed towards LIMIT
+    double _cycles_hz;
+    uint64_t _gap;			// cycles between packets
+    HandlerCall *_end_h;
+
+    int parse_lengths(const String &str, ErrorHandler *errh);
+    WritablePacket *make_template(uint32_t len, uint16_t sport) const;
+    void set_rate(uint32_t rate);
+    uint32_t reserve(uint32_t n);
+    void reset();
+
+    static String read_handler(Element *e, void *user_data) CLICK_COLD;
+    static int write_handler(const String &str, Element *e, void *user_data,
+			     ErrorHandler *errh) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
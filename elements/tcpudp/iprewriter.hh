@@ -193,6 +193,13 @@ space-separated numbers, where the first is the capacity and the second is the
 short-term flow reservation.  When writing, the short-term reservation can be
 omitted; it is then set to the minimum of 50 and one-eighth the capacity.
 
+=h memory r
+
+Returns the memory used for this element's flows as "NAME VALUE" lines:
+'objects' (flows allocated), 'object_bytes', 'reserved_bytes' (all memory
+set aside for flows, including free space), 'slabs', and 'huge_slabs' (slabs
+backed by huge pages).
+
 =h tcp_table read-only
 
 Returns a human-readable description of the IPRewriter's current TCP mapping
@@ -240,6 +247,10 @@ class IPRewriter : public TCPRewriter { public:
     IPRewriterEntry *add_flow(int ip_p, const IPFlowID &flowid,
 			      const IPFlowID &rewritten_flowid, int input);
     void destroy_flow(IPRewriterFlow *flow);
+    void flow_memory(SlabAllocator::Stats &stats) const {
+	TCPRewriter::flow_memory(stats);
+	_udp_allocator.stats(stats);
+    }
     click_jiffies_t best_effort_expiry(const IPRewriterFlow *flow) {
 	if (flow->ip_p() == IP_PROTO_TCP)
 	    return TCPRewriter::best_effort_expiry(flow);
@@ -254,7 +265,7 @@ class IPRewriter : public TCPRewriter { public:
   private:
 
     Map _udp_map;
-    SizedHashAllocator<sizeof(UDPFlow)> _udp_allocator;
+    SizedSlabAllocator<sizeof(UDPFlow)> _udp_allocator;
     uint32_t _udp_timeouts[2];
     uint32_t _udp_streaming_timeout;
 
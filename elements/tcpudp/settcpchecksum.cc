@@ -74,6 +74,15 @@ SetTCPChecksum::simple_action(Packet *p_in)
   return(0);
 }
 
+#if HAVE_BATCH
+PacketBatch *
+SetTCPChecksum::simple_action_batch(PacketBatch *batch)
+{
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(simple_action, batch, [](Packet *){});
+    return batch;
+}
+#endif
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(SetTCPChecksum)
 ELEMENT_MT_SAFE(SetTCPChecksum)
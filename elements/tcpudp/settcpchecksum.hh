@@ -1,6 +1,6 @@
 #ifndef CLICK_SETTCPCHECKSUM_HH
 #define CLICK_SETTCPCHECKSUM_HH
-#include <click/element.hh>
+#include <click/batchelement.hh>
 #include <click/glue.hh>
 CLICK_DECLS
 
@@ -18,7 +18,7 @@ CLICK_DECLS
  * =a CheckTCPHeader, SetIPChecksum, CheckIPHeader, SetUDPChecksum
  */
 
-class SetTCPChecksum : public Element { public:
+class SetTCPChecksum : public BatchElement { public:
 
   SetTCPChecksum() CLICK_COLD;
   ~SetTCPChecksum() CLICK_COLD;
@@ -28,6 +28,9 @@ class SetTCPChecksum : public Element { public:
   int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
 
   Packet *simple_action(Packet *);
+#if HAVE_BATCH
+  PacketBatch *simple_action_batch(PacketBatch *);
+#endif
 
 private:
   bool _fixoff;
@@ -68,6 +68,15 @@ SetUDPChecksum::simple_action(Packet *p_in)
     return p;
 }
 
+#if HAVE_BATCH
+PacketBatch *
+SetUDPChecksum::simple_action_batch(PacketBatch *batch)
+{
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(simple_action, batch, [](Packet *){});
+    return batch;
+}
+#endif
+
 CLICK_ENDDECLS
 EXPORT_ELEMENT(SetUDPChecksum)
 ELEMENT_MT_SAFE(SetUDPChecksum)
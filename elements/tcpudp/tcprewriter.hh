@@ -80,6 +80,10 @@ packets to the rewritten destination address. Default is true.
 Returns a human-readable description of the TCPRewriter's current mapping
 table.
 
+=h memory r
+
+Returns the memory used for this element's flows; see IPRewriter.
+
 =h lookup read
 
 Takes a flow as a space-separated
@@ -165,6 +169,9 @@ class TCPRewriter : public IPRewriterBase { public:
     IPRewriterEntry *add_flow(int ip_p, const IPFlowID &flowid,
 			      const IPFlowID &rewritten_flowid, int input);
     void destroy_flow(IPRewriterFlow *flow);
+    void flow_memory(SlabAllocator::Stats &stats) const {
+	_allocator.stats(stats);
+    }
     click_jiffies_t best_effort_expiry(const IPRewriterFlow *flow) {
 	return flow->expiry() + tcp_flow_timeout(static_cast<const TCPFlow *>(flow)) - _timeouts[1];
     }
@@ -175,7 +182,7 @@ class TCPRewriter : public IPRewriterBase { public:
 
  protected:
 
-    SizedHashAllocator<sizeof(TCPFlow)> _allocator;
+    SizedSlabAllocator<sizeof(TCPFlow)> _allocator;
     unsigned _annos;
     uint32_t _tcp_data_timeout;
     uint32_t _tcp_done_timeout;
@@ -157,6 +157,10 @@ packets to the rewritten destination address. Default is true.
 Returns a human-readable description of the UDPRewriter's current mapping
 table.
 
+=h memory r
+
+Returns the memory used for this element's flows; see IPRewriter.
+
 =a TCPRewriter, IPAddrRewriter, IPAddrPairRewriter, IPRewriterPatterns,
 RoundRobinIPMapper, FTPPortMapper, ICMPRewriter, ICMPPingRewriter */
 
@@ -190,6 +194,9 @@ class UDPRewriter : public IPRewriterBase { public:
     IPRewriterEntry *add_flow(int ip_p, const IPFlowID &flowid,
 			      const IPFlowID &rewritten_flowid, int input);
     void destroy_flow(IPRewriterFlow *flow);
+    void flow_memory(SlabAllocator::Stats &stats) const {
+	_allocator.stats(stats);
+    }
     click_jiffies_t best_effort_expiry(const IPRewriterFlow *flow) {
 	return flow->expiry() + udp_flow_timeout(static_cast<const UDPFlow *>(flow)) - _timeouts[1];
     }
@@ -200,7 +207,7 @@ class UDPRewriter : public IPRewriterBase { public:
 
   private:
 
-    SizedHashAllocator<sizeof(UDPFlow)> _allocator;
+    SizedSlabAllocator<sizeof(UDPFlow)> _allocator;
     unsigned _annos;
     uint32_t _udp_streaming_timeout;
 
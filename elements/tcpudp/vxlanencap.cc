@@ -0,0 +1,183 @@
+/*
+ * vxlanencap.{cc,hh} -- element encapsulates frames in VXLAN/UDP/IP headers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "vxlanencap.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/etheraddress.hh>
+#include <clicknet/ether.h>
+#include <clicknet/ip.h>
+#include <clicknet/udp.h>
+CLICK_DECLS
+
+VXLANEncap::VXLANEncap()
+    : _template_len(0), _ip_offset(0), _fixed_sport(false), _cksum(false)
+{
+}
+
+VXLANEncap::~VXLANEncap()
+{
+}
+
+int
+VXLANEncap::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    uint32_t vni;
+    IPAddress saddr, daddr;
+    click_ether ethh;
+    bool have_ethsrc, have_ethdst;
+    uint16_t sport = 0, dport = 4789;
+    uint8_t ttl = 64, tos = 0;
+    bool cksum = false, fixed_sport;
+
+    if (Args(conf, this, errh)
+	.read_mp("VNI", vni)
+	.read_mp("SRC", saddr)
+	.read_mp("DST", daddr)
+	.read("ETHSRC", EtherAddressArg(), ethh.ether_shost).read_status(have_ethsrc)
+	.read("ETHDST", EtherAddressArg(), ethh.ether_dhost).read_status(have_ethdst)
+	.read("SPORT", IPPortArg(IP_PROTO_UDP), sport).read_status(fixed_sport)
+	.read("DPORT", IPPortArg(IP_PROTO_UDP), dport)
+	.read("TTL", ttl)
+	.read("TOS", tos)
+	.read("CHECKSUM", cksum)
+	.complete() < 0)
+	return -1;
+    if (vni >= (1U << 24))
+	return errh->error("VNI out of range");
+    if (have_ethdst != have_ethsrc)
+	return errh->error("ETHSRC and ETHDST must be given together");
+
+    unsigned char *x = _template;
+    memset(_template, 0, sizeof(_template));
+    if (have_ethdst) {
+	ethh.ether_type = htons(ETHERTYPE_IP);
+	memcpy(x, &ethh, sizeof(click_ether));
+	x += sizeof(click_ether);
+    }
+    _ip_offset = x - _template;
+
+    // The IP checksum is computed with a zero length, then adjusted
+    // incrementally for each packet.
+    click_ip *iph = reinterpret_cast<click_ip *>(x);
+    iph->ip_v = 4;
+    iph->ip_hl = sizeof(click_ip) >> 2;
+    iph->ip_tos = tos;
+    iph->ip_off = htons(IP_DF);
+    iph->ip_ttl = ttl;
+    iph->ip_p = IP_PROTO_UDP;
+    iph->ip_src = saddr;
+    iph->ip_dst = daddr;
+    iph->ip_sum = click_in_cksum(x, sizeof(click_ip));
+    x += sizeof(click_ip);
+
+    click_udp *udph = reinterpret_cast<click_udp *>(x);
+    udph->uh_sport = htons(sport);
+    udph->uh_dport = htons(dport);
+    x += sizeof(click_udp);
+
+    // VXLAN header: I flag, then the 24-bit VNI
+    x[0] = 0x08;
+    x[4] = vni >> 16;
+    x[5] = vni >> 8;
+    x[6] = vni;
+    x += 8;
+
+    _template_len = x - _template;
+    _daddr = daddr;
+    _fixed_sport = fixed_sport;
+    _cksum = cksum;
+    return 0;
+}
+
+/* Return a UDP source port, in network byte order, that is the same for all
+   frames of a flow. */
+inline uint16_t
+VXLANEncap::flow_sport(const Packet *p)
+{
+    const unsigned char *d = p->data();
+    int len = p->length();
+    uint64_t h = 0;
+#define VXLAN_MIX(v) h = (h ^ (v)) * 0x9E3779B97F4A7C15ULL
+    if (len >= (int) (sizeof(click_ether) + sizeof(click_ip))
+	&& d[12] == 0x08 && d[13] == 0x00) {
+	const click_ip *iph = reinterpret_cast<const click_ip *>(d + sizeof(click_ether));
+	uint32_t a;
+	memcpy(&a, &iph->ip_src, 4);
+	VXLAN_MIX(ntohl(a));
+	memcpy(&a, &iph->ip_dst, 4);
+	VXLAN_MIX(ntohl(a));
+	VXLAN_MIX(iph->ip_p);
+	int thoff = sizeof(click_ether) + (iph->ip_hl << 2);
+	if ((iph->ip_p == IP_PROTO_TCP || iph->ip_p == IP_PROTO_UDP)
+	    && !IP_ISFRAG(iph) && len >= thoff + 4) {
+	    memcpy(&a, d + thoff, 4);
+	    VXLAN_MIX(ntohl(a));
+	}
+    } else if (len >= (int) sizeof(click_ether)) {
+	uint32_t a[3];
+	memcpy(a, d, 12);
+	VXLAN_MIX(ntohl(a[0]));
+	VXLAN_MIX(ntohl(a[1]));
+	VXLAN_MIX(ntohl(a[2]));
+    }
+#undef VXLAN_MIX
+    return htons(0xC000 | ((h >> 40) & 0x3FFF));
+}
+
+Packet *
+VXLANEncap::simple_action(Packet *p_in)
+{
+    uint16_t sport = (_fixed_sport ? 0 : flow_sport(p_in));
+    WritablePacket *p = p_in->push(_template_len);
+    if (!p)
+	return 0;
+
+    memcpy(p->data(), _template, _template_len);
+    click_ip *iph = reinterpret_cast<click_ip *>(p->data() + _ip_offset);
+    click_udp *udph = reinterpret_cast<click_udp *>(iph + 1);
+    uint16_t ip_len = htons(p->length() - _ip_offset);
+    iph->ip_len = ip_len;
+    click_update_in_cksum(&iph->ip_sum, 0, ip_len);
+    unsigned udp_len = p->length() - _ip_offset - sizeof(click_ip);
+    udph->uh_ulen = htons(udp_len);
+    if (!_fixed_sport)
+	udph->uh_sport = sport;
+    if (_cksum) {
+	unsigned csum = click_in_cksum((unsigned char *) udph, udp_len);
+	udph->uh_sum = click_in_cksum_pseudohdr(csum, iph, udp_len);
+	if (udph->uh_sum == 0)
+	    udph->uh_sum = 0xFFFF;
+    }
+
+    if (_ip_offset)
+	p->set_mac_header(p->data(), sizeof(click_ether));
+    p->set_ip_header(iph, sizeof(click_ip));
+    p->set_dst_ip_anno(_daddr);
+    return p;
+}
+
+#if HAVE_BATCH
+PacketBatch *
+VXLANEncap::simple_action_batch(PacketBatch *batch)
+{
+    EXECUTE_FOR_EACH_PACKET_DROPPABLE(simple_action, batch, [](Packet *){});
+    return batch;
+}
+#endif
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(VXLANEncap)
+ELEMENT_MT_SAFE(VXLANEncap)
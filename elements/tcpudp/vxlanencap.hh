@@ -0,0 +1,108 @@
+#ifndef CLICK_VXLANENCAP_HH
+#define CLICK_VXLANENCAP_HH
+#include <click/batchelement.hh>
+#include <click/glue.hh>
+#include <click/ipaddress.hh>
+CLICK_DECLS
+
+/*
+=c
+
+VXLANEncap(VNI, SRC, DST [, I<keywords> ETHSRC, ETHDST, SPORT, DPORT, TTL, TOS, CHECKSUM])
+
+=s udp
+
+encapsulates Ethernet frames in VXLAN/UDP/IP (and Ethernet) headers
+
+=d
+
+Expects Ethernet frames.  VXLANEncap prepends to each frame a VXLAN header
+with network identifier VNI, a UDP header, an IP header from SRC to DST and,
+if ETHDST is given, an outer Ethernet header.  This does the work of
+UDPIPEncap, SetUDPChecksum and EtherEncap in one pass.  All outer headers
+are built once, as a template, at configuration time.  Per packet,
+VXLANEncap copies the template and fills in the lengths and the UDP source
+port.  The IP checksum is adjusted incrementally for the new length.
+
+Unless SPORT is given, the UDP source port is derived from a hash of the
+inner frame's addresses and, for IPv4 TCP and UDP, its ports.  Packets of a
+flow therefore share a source port, and different flows are spread over
+ports 49152-65535, as RFC 7348 recommends.  This lets routers on the path
+balance the flows over their links.
+
+The outer IP header has the Don't Fragment bit set and an IP ID of 0.
+VXLANEncap sets the destination IP address annotation to DST.
+
+Keyword arguments are:
+
+=over 8
+
+=item ETHSRC, ETHDST
+
+Ethernet addresses.  If ETHDST is given, VXLANEncap also prepends an outer
+Ethernet header from ETHSRC to ETHDST, and ETHSRC must be given too.
+Otherwise the output packets start with the IP header.
+
+=item SPORT
+
+UDP source port.  If given, every packet uses this port.
+
+=item DPORT
+
+UDP destination port.  Default is 4789.
+
+=item TTL
+
+Outer IP time to live.  Default is 64.
+
+=item TOS
+
+Outer IP type of service.  Default is 0.
+
+=item CHECKSUM
+
+Boolean.  If true, the UDP checksum is computed over the whole packet.  If
+false, the UDP checksum is left zero, which RFC 7348 recommends.  Default is
+false.
+
+=back
+
+=e
+
+  VXLANEncap(42, 10.0.0.1, 10.0.0.2, ETHSRC 0:1:2:3:4:5, ETHDST 0:1:2:3:4:6)
+
+=a UDPIPEncap, EtherEncap, SetUDPChecksum, Strip */
+
+class VXLANEncap : public BatchElement { public:
+
+    VXLANEncap() CLICK_COLD;
+    ~VXLANEncap() CLICK_COLD;
+
+    const char *class_name() const	{ return "VXLANEncap"; }
+    const char *port_count() const	{ return PORTS_1_1; }
+    const char *flags() const		{ return "A"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+
+    Packet *simple_action(Packet *p);
+#if HAVE_BATCH
+    PacketBatch *simple_action_batch(PacketBatch *batch);
+#endif
+
+  private:
+
+    enum { max_template = 14 + 20 + 8 + 8 };
+
+    unsigned char _template[max_template];
+    uint32_t _template_len;
+    uint32_t _ip_offset;
+    IPAddress _daddr;
+    bool _fixed_sport;
+    bool _cksum;
+
+    static inline uint16_t flow_sport(const Packet *p);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,132 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * checksumtest.{cc,hh} -- regression test element for Internet checksums
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "checksumtest.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/glue.hh>
+#include <click/timestamp.hh>
+#include <clicknet/ip.h>
+CLICK_DECLS
+
+ChecksumTest::ChecksumTest()
+    : _benchmark(0)
+{
+}
+
+int
+ChecksumTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    return Args(conf, this, errh).read("BENCHMARK", _benchmark).complete();
+}
+
+// The classic algorithm: add 16-bit words into a 32-bit accumulator.
+static uint16_t
+reference_cksum(const unsigned char *x, int len)
+{
+    uint32_t sum = 0;
+    uint16_t w;
+    for (; len > 1; x += 2, len -= 2) {
+	memcpy(&w, x, 2);
+	sum += w;
+    }
+    if (len == 1) {
+	w = 0;
+	*reinterpret_cast<unsigned char *>(&w) = *x;
+	sum += w;
+    }
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum += sum >> 16;
+    return ~sum;
+}
+
+#define CHECK(x, len, off) ((x) ? 0 : errh->error("%s:%d: test %<%s%> failed (length %d, offset %d)", __FILE__, __LINE__, #x, (len), (off)))
+
+int
+ChecksumTest::initialize(ErrorHandler *errh)
+{
+    enum { maxlen = 4096, maxoff = 8 };
+    unsigned char *data = new unsigned char[maxlen + maxoff];
+    for (int i = 0; i < maxlen + maxoff; ++i)
+	data[i] = click_random(0, 255);
+
+    int ret = 0;
+    for (int off = 0; off < maxoff && ret == 0; ++off)
+	for (int len = 0; len <= maxlen && ret == 0;
+	     len += (len < 512 ? 1 : click_random(1, 97))) {
+	    uint16_t expected = reference_cksum(data + off, len);
+	    ret = CHECK(click_in_cksum(data + off, len) == expected, len, off);
+	}
+
+    // all-zero and all-ones data exercise the ~+0 and ~-0 cases
+    for (int fill = 0; fill < 256 && ret == 0; fill += 255) {
+	unsigned char *x = new unsigned char[maxlen];
+	memset(x, fill, maxlen);
+	for (int len = 0; len <= maxlen && ret == 0; len += 31)
+	    ret = CHECK(click_in_cksum(x, len) == reference_cksum(x, len), len, fill);
+	delete[] x;
+    }
+
+    // IP headers of every legal length, valid and corrupted
+    for (int hl = 5; hl <= 15 && ret == 0; ++hl)
+	for (int trial = 0; trial < 64 && ret == 0; ++trial) {
+	    click_ip *iph = reinterpret_cast<click_ip *>(data + 64 * trial);
+	    iph->ip_hl = hl;
+	    iph->ip_sum = 0;
+	    ret = CHECK(click_in_cksum_iphdr(iph) == reference_cksum(reinterpret_cast<unsigned char *>(iph), hl << 2), hl << 2, trial);
+	    iph->ip_sum = click_in_cksum_iphdr(iph);
+	    if (ret == 0)
+		ret = CHECK(click_in_cksum_iphdr(iph) == 0, hl << 2, trial);
+	    iph->ip_ttl ^= 1;
+	    if (ret == 0)
+		ret = CHECK(click_in_cksum_iphdr(iph) != 0, hl << 2, trial);
+	}
+
+#if CLICK_USERLEVEL
+    if (ret == 0 && _benchmark > 0)
+	benchmark(data, errh);
+#endif
+    delete[] data;
+    if (ret == 0)
+	errh->message("All tests pass!");
+    return ret;
+}
+
+#if CLICK_USERLEVEL
+void
+ChecksumTest::benchmark(const unsigned char *data, ErrorHandler *errh)
+{
+    static const int lengths[] = { 20, 64, 576, 1500, 4096 };
+    for (const int *lp = lengths; lp != lengths + sizeof(lengths) / sizeof(lengths[0]); ++lp) {
+	uint32_t sink = 0;
+	Timestamp t0 = Timestamp::now_steady();
+	for (int i = 0; i < _benchmark; ++i)
+	    sink += reference_cksum(data + (i & 6), *lp);
+	Timestamp t1 = Timestamp::now_steady();
+	for (int i = 0; i < _benchmark; ++i)
+	    sink += click_in_cksum(data + (i & 6), *lp);
+	Timestamp t2 = Timestamp::now_steady();
+	int64_t ref_ps = (t1 - t0).nsecval() * 1000 / _benchmark;
+	int64_t new_ps = (t2 - t1).nsecval() * 1000 / _benchmark;
+	errh->message("length %d: reference %d.%03d ns, click_in_cksum %d.%03d ns (%x)",
+		      *lp, (int) (ref_ps / 1000), (int) (ref_ps % 1000),
+		      (int) (new_ps / 1000), (int) (new_ps % 1000), sink & 0xF);
+    }
+}
+#endif
+
+EXPORT_ELEMENT(ChecksumTest)
+CLICK_ENDDECLS
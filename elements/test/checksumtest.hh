@@ -0,0 +1,59 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_CHECKSUMTEST_HH
+#define CLICK_CHECKSUMTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+ChecksumTest([I<keywords>])
+
+=s test
+
+runs regression tests for Internet checksum functions
+
+=d
+
+ChecksumTest runs regression tests for Click's Internet checksum functions,
+click_in_cksum() and click_in_cksum_iphdr(), at initialization time.  Each
+function is compared against a straightforward 16-bit reference
+implementation over many lengths and alignments.  ChecksumTest does not route
+packets.
+
+Keyword arguments are:
+
+=over 8
+
+=item BENCHMARK
+
+Integer.  If set to a positive number, then user-level ChecksumTest also times
+BENCHMARK checksum computations for several data lengths, comparing
+click_in_cksum() with the reference implementation, and reports the
+nanoseconds per computation for each.  Default is 0 (don't benchmark).
+
+=back
+
+*/
+
+class ChecksumTest : public Element { public:
+
+    ChecksumTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "ChecksumTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+
+  private:
+
+    int _benchmark;
+
+#if CLICK_USERLEVEL
+    void benchmark(const unsigned char *data, ErrorHandler *errh);
+#endif
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,257 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * flathashtabletest.{cc,hh} -- regression test and benchmark element for
+ * FlatHashTable<K, V>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "flathashtabletest.hh"
+#include <click/flathashtable.hh>
+#include <click/hashtable.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+
+FlatHashTableTest::FlatHashTableTest()
+{
+}
+
+int
+FlatHashTableTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _benchmark = false;
+    _nlookups = 10000000;
+    if (Args(conf, this, errh)
+	.read("BENCHMARK", _benchmark)
+	.read_all("SIZE", _sizes)
+	.read("LOOKUPS", _nlookups)
+	.complete() < 0)
+	return -1;
+    if (!_sizes.size()) {
+	_sizes.push_back(1000000);
+	_sizes.push_back(10000000);
+    }
+    return 0;
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+static inline uint64_t
+splitmix64(uint64_t &state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static int
+check_strings(ErrorHandler *errh)
+{
+    typedef FlatHashTable<String, int> S2I;
+    S2I h;
+    CHECK(h.empty() && h.size() == 0 && !h.begin().live());
+    CHECK(h.get("Foo") == 0 && !h.get_pointer("Foo") && !h.find("Foo"));
+
+    CHECK(h.set("Foo", 1));
+    CHECK(h.set("bar", 2));
+    CHECK(h.set("facker", 3));
+    CHECK(!h.set("Foo", 1));
+    h["Anne Elizabeth Dudfield"] = 4;
+    CHECK(h.size() == 4);
+
+    char seen[4] = {0, 0, 0, 0};
+    int n = 0;
+    for (S2I::iterator it = h.begin(); it; ++it) {
+	CHECK(it.value() >= 1 && it.value() <= 4);
+	CHECK(!seen[it.value() - 1]);
+	seen[it.value() - 1] = 1;
+	CHECK(h.get(it.key()) == it.value());
+	++n;
+    }
+    CHECK(n == 4);
+
+    {
+	S2I hh(h);
+	CHECK(hh.size() == 4 && hh["bar"] == 2);
+	hh["crap"] = 5;
+	CHECK(hh.size() == 5 && h.size() == 4);
+	hh.swap(h);
+	CHECK(hh.size() == 4 && h.size() == 5);
+	hh.swap(h);
+    }
+
+    CHECK(h.erase("Foo") == 1);
+    CHECK(h.erase("Foo") == 0);
+    CHECK(h.size() == 3 && !h.count("Foo") && h.count("bar"));
+
+    const S2I &ch = h;
+    CHECK(ch["NOT IN TABLE"] == 0 && h.size() == 3);
+    CHECK(h["NOT IN TABLE"] == 0 && h.size() == 4);
+
+    for (S2I::iterator it = h.begin(); it; )
+	if (it.key() == "NOT IN TABLE")
+	    it = h.erase(it);
+	else
+	    ++it;
+    CHECK(h.size() == 3 && h.find("NOT IN TABLE") == h.end());
+
+    FlatHashTable<String, int> hd(-1);
+    CHECK(hd["x"] == -1 && hd.find_insert("y").value() == -1);
+    CHECK(hd.find_insert("z", 9).value() == 9 && hd.size() == 3);
+
+    h.clear();
+    CHECK(h.empty() && !h.begin().live() && h.bucket_count() > 0);
+    return 0;
+}
+
+static int
+check_ints(ErrorHandler *errh)
+{
+    typedef FlatHashTable<uint32_t, uint32_t> I2I;
+    I2I h;
+    enum { N = 100000 };
+
+    for (uint32_t i = 0; i < N; ++i)
+	h[i * 3] = i;
+    CHECK(h.size() == N);
+    CHECK(h.bucket_count() * 7 >= h.size() * 8);
+    for (uint32_t i = 0; i < N; ++i) {
+	CHECK(h.get(i * 3) == i);
+	CHECK(!h.count(i * 3 + 1));
+    }
+
+    // erase every other element, then reinsert others, so deleted slots
+    // are reused and purged
+    for (uint32_t i = 0; i < N; i += 2)
+	CHECK(h.erase(i * 3) == 1);
+    CHECK(h.size() == N / 2);
+    for (int round = 0; round < 4; ++round) {
+	for (uint32_t i = 0; i < N / 2; ++i)
+	    h[i * 3 + 1 + round * 1000000] = i;
+	for (uint32_t i = 0; i < N / 2; ++i)
+	    CHECK(h.erase(i * 3 + 1 + round * 1000000) == 1);
+    }
+    CHECK(h.size() == N / 2);
+    uint64_t sum = 0;
+    size_t n = 0;
+    for (I2I::const_iterator it = h.begin(); it; ++it, ++n) {
+	CHECK(it.key() % 6 == 3);
+	sum += it.value();
+    }
+    CHECK(n == N / 2 && sum == (uint64_t) (N / 2) * (N / 2));
+
+    // find_many agrees with get_pointer
+    uint32_t keys[77];
+    uint32_t *values[77];
+    for (int i = 0; i < 77; ++i)
+	keys[i] = i * 7;
+    h.find_many(keys, 77, values);
+    for (int i = 0; i < 77; ++i)
+	CHECK(values[i] == h.get_pointer(keys[i]));
+    CHECK(values[3] && !values[1]);	// 21 is present, 7 is not
+    *values[3] = 12345;
+    CHECK(h.get(21) == 12345);
+
+    I2I empty;
+    empty.find_many(keys, 77, values);
+    CHECK(values[0] == 0 && values[76] == 0);
+
+    I2I copy;
+    copy = h;
+    CHECK(copy.size() == h.size() && copy.get(9) == h.get(9));
+    h.rehash(1 << 20);
+    CHECK(h.bucket_count() == (1 << 20) && h.get(9) == copy.get(9));
+    return 0;
+}
+
+int
+FlatHashTableTest::initialize(ErrorHandler *errh)
+{
+    if (check_strings(errh) < 0 || check_ints(errh) < 0)
+	return -1;
+    errh->message("All tests pass!");
+
+    if (_benchmark)
+	for (int i = 0; i < _sizes.size(); ++i)
+	    benchmark(_sizes[i], errh);
+    return 0;
+}
+
+static double
+elapsed(const Timestamp &t0)
+{
+    return (Timestamp::now_steady() - t0).doubleval();
+}
+
+void
+FlatHashTableTest::benchmark(uint32_t size, ErrorHandler *errh)
+{
+    enum { window = 32 };
+    Vector<uint64_t> keys;
+    uint64_t state = size;
+    for (uint32_t i = 0; i < size; ++i)
+	keys.push_back(splitmix64(state));
+    uint64_t sum = 0;
+
+    {
+	HashTable<uint64_t, uint64_t> h;
+	for (uint32_t i = 0; i < size; ++i)
+	    h[keys[i]] = i;
+	uint64_t r = 1;
+	Timestamp t0 = Timestamp::now_steady();
+	for (uint32_t i = 0; i < _nlookups; ++i)
+	    sum += h.get(keys[splitmix64(r) % size]);
+	double t = elapsed(t0);
+	double bytes = h.bucket_count() * sizeof(void *)
+	    + h.size() * (sizeof(Pair<const uint64_t, uint64_t>) + sizeof(void *));
+	errh->message("%u HashTable %.0f %.1f", size, _nlookups / t, bytes / size);
+    }
+
+    {
+	FlatHashTable<uint64_t, uint64_t> h;
+	for (uint32_t i = 0; i < size; ++i)
+	    h[keys[i]] = i;
+	double bytes = h.memory_usage();
+
+	uint64_t r = 1;
+	Timestamp t0 = Timestamp::now_steady();
+	for (uint32_t i = 0; i < _nlookups; ++i)
+	    sum += h.get(keys[splitmix64(r) % size]);
+	double t = elapsed(t0);
+	errh->message("%u FlatHashTable %.0f %.1f", size, _nlookups / t, bytes / size);
+
+	uint64_t batch[window];
+	uint64_t *values[window];
+	r = 1;
+	t0 = Timestamp::now_steady();
+	for (uint32_t i = 0; i < _nlookups; i += window) {
+	    int n = _nlookups - i < (uint32_t) window ? _nlookups - i : (uint32_t) window;
+	    for (int j = 0; j < n; ++j)
+		batch[j] = keys[splitmix64(r) % size];
+	    h.find_many(batch, n, values);
+	    for (int j = 0; j < n; ++j)
+		sum += *values[j];
+	}
+	t = elapsed(t0);
+	errh->message("%u FlatHashTable.find_many %.0f %.1f", size, _nlookups / t, bytes / size);
+    }
+
+    // all three passes looked up the same keys
+    if (sum % 3 != 0)
+	errh->warning("lookup results differ");
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(FlatHashTableTest)
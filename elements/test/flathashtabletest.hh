@@ -0,0 +1,78 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_FLATHASHTABLETEST_HH
+#define CLICK_FLATHASHTABLETEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+FlatHashTableTest([I<keywords> BENCHMARK, SIZE, LOOKUPS])
+
+=s test
+
+runs regression tests and benchmarks for FlatHashTable<K, V>
+
+=d
+
+FlatHashTableTest runs FlatHashTable regression tests at initialization time.
+It does not route packets.
+
+If BENCHMARK is true, FlatHashTableTest then compares FlatHashTable with
+HashTable, which is built on HashContainer.  For each SIZE, it fills each
+table with SIZE random 64-bit keys, then looks up LOOKUPS random present
+keys.  FlatHashTable is measured both with one find() per key and with
+find_many() on windows of 32 keys, as an element would look up the keys of a
+PacketBatch.  It reports one line per table and size:
+
+   SIZE TABLE LOOKUPS/S BYTES/ENTRY
+
+BYTES/ENTRY counts the table's buckets or slots and, for HashTable, its
+chained elements, but not allocator overhead.
+
+Keyword arguments are:
+
+=over 8
+
+=item BENCHMARK
+
+Boolean. If true, run the benchmark. Default is false.
+
+=item SIZE
+
+Unsigned integer. Number of entries in the benchmarked tables. May be given
+more than once. Default is 1000000 and 10000000.
+
+=item LOOKUPS
+
+Unsigned integer. Number of lookups per table. Default is 10000000.
+
+=back
+
+=e
+
+  FlatHashTableTest(BENCHMARK true, SIZE 1000000, SIZE 4000000)
+
+=a HashTableTest */
+
+class FlatHashTableTest : public Element { public:
+
+    FlatHashTableTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "FlatHashTableTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+
+  private:
+
+    bool _benchmark;
+    Vector<uint32_t> _sizes;
+    uint32_t _nlookups;
+
+    void benchmark(uint32_t size, ErrorHandler *errh);
+
+};
+
+CLICK_ENDDECLS
+#endif
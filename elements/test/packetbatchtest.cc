@@ -0,0 +1,153 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * packetbatchtest.{cc,hh} -- regression test element for packet batches
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "packetbatchtest.hh"
+#include <click/packetbatch.hh>
+#include <click/packet_anno.hh>
+#include <click/error.hh>
+CLICK_DECLS
+
+PacketBatchTest::PacketBatchTest()
+{
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+static const unsigned char zeros[64] = {0};
+
+/* Return a batch of @a n packets whose lengths cycle from 1 to 50. */
+static PacketBatch *
+make_test_batch(int n)
+{
+    PacketBatch *batch = 0;
+    Packet *last = 0;
+    for (int i = 0; i < n; ++i) {
+	Packet *q = Packet::make(0, zeros, 1 + (i % 50), 0);
+	if (last)
+	    last->set_next(q);
+	else
+	    batch = PacketBatch::start_head(q);
+	last = q;
+    }
+    return batch->make_tail(last, n);
+}
+
+int
+PacketBatchTest::initialize(ErrorHandler *errh)
+{
+    // PacketBatch basics
+    PacketBatch *batch = make_test_batch(10);
+    CHECK(batch->count() == 10 && !batch->tail()->next());
+    PacketBatch *second;
+    Packet *middle = batch->next()->next();
+    batch->cut(middle, 3, second);
+    CHECK(batch->count() == 3 && batch->tail() == middle && !middle->next());
+    CHECK(second && second->count() == 7 && second->length() == 4);
+    batch->append_batch(second);
+    CHECK(batch->count() == 10 && batch->tail()->length() == 10);
+    // the count does not overlay the first packet's annotations
+    SET_EXTRA_PACKETS_ANNO(batch, 77);
+    CHECK(batch->count() == 10 && EXTRA_PACKETS_ANNO(batch) == 77);
+    CHECK(BATCH_COUNT_ANNO(batch) == 10);
+    batch->kill();
+
+    // PacketVector conversions
+    batch = make_test_batch(300);
+    Packet *last = batch->tail();
+    PacketVector v;
+    PacketBatch *rest = v.append_batch(batch);
+    CHECK(v.full() && v.count() == PacketVector::capacity);
+    CHECK(rest && rest->count() == 300 - PacketVector::capacity);
+    CHECK(rest->tail() == last && rest == v[v.count() - 1]->next());
+    rest->kill();
+
+    int i = 0;
+    FOR_EACH_PACKET_VECTOR_PREFETCH(v, p, 4) {
+	CHECK(p->length() == (uint32_t) 1 + (i % 50));
+	++i;
+    }
+    CHECK(i == (int) v.count());
+    // the macro is a single statement
+    i = 0;
+    if (v.empty())
+	FOR_EACH_PACKET_VECTOR_PREFETCH(v, p, 4)
+	    i += (p != 0);
+    CHECK(i == 0);
+
+    // drop packets of odd length
+    int ndrop = 0;
+    auto fnt = [](Packet *p) -> Packet * {
+	return (p->length() & 1) ? 0 : p;
+    };
+    EXECUTE_FOR_EACH_PACKET_VECTOR_DROPPABLE(fnt, v, [&ndrop](Packet *p) { p->kill(); ++ndrop; });
+    CHECK(v.count() + ndrop == PacketVector::capacity);
+    FOR_EACH_PACKET_VECTOR(v, p)
+	CHECK(!(p->length() & 1));
+
+    // compact
+    v[0]->kill();
+    v[0] = 0;
+    v.compact();
+    CHECK(v.count() + ndrop + 1 == PacketVector::capacity);
+    CHECK(v[0]->length() == 4);
+
+    // classify into batches
+    unsigned n = v.count(), nout[2] = {0, 0};
+    PacketBatch *out[2] = {0, 0};
+    auto classify = [](Packet *p) -> int {
+	return p->length() > 25;
+    };
+    auto finish = [&out, &nout](int o, PacketBatch *b) {
+	out[o] = b;
+	nout[o] = b->count();
+    };
+    i = 0;
+    FOR_EACH_PACKET(v, p)
+	i += (p != 0);
+    CHECK(i == (int) n);
+    CLASSIFY_EACH_PACKET(2, classify, v, finish);
+    CHECK(v.empty() && out[0] && out[1] && nout[0] + nout[1] == n);
+    FOR_EACH_PACKET(out[0], p)
+	CHECK(p->length() <= 25);
+    FOR_EACH_PACKET(out[1], p)
+	CHECK(p->length() > 25);
+
+    // back to one batch
+    CHECK(!v.append_batch(out[0]) && !v.append_batch(out[1]));
+    CHECK(v.count() == n);
+    batch = v.make_batch();
+    CHECK(v.empty() && batch->count() == n && !batch->tail()->next());
+
+    // the same macro classifies a batch
+    out[0] = out[1] = 0;
+    CLASSIFY_EACH_PACKET(2, classify, batch, finish);
+    CHECK(out[0] && out[1] && nout[0] + nout[1] == n);
+    CHECK(!out[0]->tail()->next() && !out[1]->tail()->next());
+    FOR_EACH_PACKET(out[1], p)
+	CHECK(p->length() > 25);
+    out[0]->append_batch(out[1]);
+    batch = out[0];
+    CHECK(batch->count() == n);
+    CHECK(!v.make_batch() && !v.append_batch(0));
+    batch->kill();
+
+    errh->message("All tests pass!");
+    return 0;
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(batch)
+EXPORT_ELEMENT(PacketBatchTest)
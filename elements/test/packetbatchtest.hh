@@ -0,0 +1,36 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_PACKETBATCHTEST_HH
+#define CLICK_PACKETBATCHTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+PacketBatchTest()
+
+=s test
+
+runs regression tests for PacketBatch and PacketVector
+
+=d
+
+PacketBatchTest runs PacketBatch and PacketVector regression tests at
+initialization time. It does not route packets.
+
+=a
+
+PacketTest */
+
+class PacketBatchTest : public Element { public:
+
+    PacketBatchTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "PacketBatchTest"; }
+
+    int initialize(ErrorHandler *) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -95,6 +95,34 @@ PacketTest::initialize(ErrorHandler *errh)
     p->kill();
 #endif
 
+    // clear_annotations(false) clears only the user annotation area
+    {
+	WritablePacket *q = Packet::make(10, lowers, 60, 10);
+	Timestamp ts = Timestamp::make_usec(1, 2);
+	q->set_mac_header(q->data(), 14);
+	q->set_network_header(q->data() + 14, 20);
+	q->set_timestamp_anno(ts);
+	q->set_packet_type_anno(Packet::MULTICAST);
+	q->set_next(q);
+	q->set_dst_ip_anno(addr);
+	q->set_anno_u8(Packet::anno_size - 1, 7);
+	q->clear_annotations(false);
+	CHECK(q->mac_header() == q->data());
+	CHECK(q->network_header() == q->data() + 14);
+	CHECK(q->transport_header() == q->data() + 34);
+	CHECK(q->timestamp_anno() == ts);
+	CHECK(q->packet_type_anno() == Packet::MULTICAST);
+	CHECK(q->next() == q);
+	CHECK(!q->dst_ip_anno());
+	CHECK(q->anno_u8(Packet::anno_size - 1) == 0);
+	q->clear_annotations(true);
+	CHECK(!q->mac_header() && !q->network_header() && !q->transport_header());
+	CHECK(q->timestamp_anno() == Timestamp());
+	CHECK(q->packet_type_anno() == Packet::HOST);
+	CHECK(!q->next());
+	q->kill();
+    }
+
     // test shift_data()
     p = Packet::make(10, lowers, 60, 4);
     CHECK(p->headroom() == 10 && p->tailroom() == 4);
@@ -0,0 +1,211 @@
+// -*- c-basic-offset: 4 -*-
+/*
+ * slaballocatortest.{cc,hh} -- regression test and benchmark element for
+ * SlabAllocator
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "slaballocatortest.hh"
+#include <click/slaballocator.hh>
+#include <click/hashallocator.hh>
+#include <click/hashtable.hh>
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/timestamp.hh>
+CLICK_DECLS
+
+SlabAllocatorTest::SlabAllocatorTest()
+{
+}
+
+int
+SlabAllocatorTest::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    _benchmark = false;
+    _noperations = 10000000;
+    if (Args(conf, this, errh)
+	.read("BENCHMARK", _benchmark)
+	.read_all("SIZE", _sizes)
+	.read("OPERATIONS", _noperations)
+	.complete() < 0)
+	return -1;
+    if (!_sizes.size())
+	_sizes.push_back(1000000);
+    return 0;
+}
+
+#define CHECK(x) if (!(x)) return errh->error("%s:%d: test `%s' failed", __FILE__, __LINE__, #x);
+
+static inline uint64_t
+splitmix64(uint64_t &state)
+{
+    uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static SlabAllocator::Stats
+stats_of(const SlabAllocator &a)
+{
+    SlabAllocator::Stats s;
+    a.stats(s);
+    return s;
+}
+
+static int
+check_basic(ErrorHandler *errh)
+{
+    enum { n = 20000 };
+    SlabAllocator a(37);
+    CHECK(a.size() == 40);
+    CHECK(stats_of(a).reserved_bytes == 0);
+
+    // objects are distinct, aligned, and hold their contents
+    Vector<uint32_t *> objs;
+    HashTable<uintptr_t, int> seen;
+    for (int i = 0; i < n; ++i) {
+	uint32_t *x = static_cast<uint32_t *>(a.allocate());
+	CHECK(x);
+	CHECK((reinterpret_cast<uintptr_t>(x) & (sizeof(void *) - 1)) == 0);
+	CHECK(seen.set(reinterpret_cast<uintptr_t>(x), i));
+	for (int j = 0; j < 10; ++j)
+	    x[j] = i;
+	objs.push_back(x);
+    }
+    for (int i = 0; i < n; ++i)
+	for (int j = 0; j < 10; ++j)
+	    CHECK(objs[i][j] == (uint32_t) i);
+
+    SlabAllocator::Stats s = stats_of(a);
+    CHECK(s.objects == n);
+    CHECK(s.object_bytes == n * 40);
+    CHECK(s.reserved_bytes >= s.object_bytes);
+    CHECK(s.slabs > 0);
+    // slabs grow geometrically, so there are few of them
+    CHECK(s.slabs < 16);
+
+    // freed objects, including those moved to the depot in batches, are
+    // reused before any new slab is made
+    for (int i = 0; i < n; ++i)
+	a.deallocate(objs[i]);
+    CHECK(stats_of(a).objects == 0);
+    for (int i = 0; i < n; ++i)
+	CHECK((objs[i] = static_cast<uint32_t *>(a.allocate())));
+    CHECK(stats_of(a).reserved_bytes == s.reserved_bytes);
+    CHECK(stats_of(a).slabs == s.slabs);
+    a.deallocate(0);
+
+    // swap exchanges everything
+    SlabAllocator b(8);
+    a.swap(b);
+    CHECK(a.size() == 8 && b.size() == 40);
+    CHECK(stats_of(a).objects == 0 && stats_of(b).objects == n);
+    for (int i = 0; i < n; ++i)
+	b.deallocate(objs[i]);
+
+    // size can grow until the first allocation
+    SizedSlabAllocator<24> c;
+    c.increase_size(100);
+    CHECK(c.size() == 104);
+    void *p = c.allocate();
+    CHECK(stats_of(c).object_bytes == 104);
+    c.deallocate(p);
+
+    // stats accumulate and unparse
+    SlabAllocator::Stats sum;
+    b.stats(sum);
+    c.stats(sum);
+    CHECK(sum.reserved_bytes == stats_of(b).reserved_bytes + stats_of(c).reserved_bytes);
+    CHECK(sum.unparse().starts_with("objects 0\nobject_bytes 0\nreserved_bytes "));
+    return 0;
+}
+
+int
+SlabAllocatorTest::initialize(ErrorHandler *errh)
+{
+    if (check_basic(errh) < 0)
+	return -1;
+    errh->message("All tests pass!");
+
+    if (_benchmark)
+	for (int i = 0; i < _sizes.size(); ++i)
+	    benchmark(_sizes[i], errh);
+    return 0;
+}
+
+static double
+elapsed(const Timestamp &t0)
+{
+    return (Timestamp::now_steady() - t0).doubleval();
+}
+
+namespace {
+enum { object_size = 96 };
+
+struct NewDelete {
+    void *allocate() {
+	return new char[object_size];
+    }
+    void deallocate(void *p) {
+	delete[] static_cast<char *>(p);
+    }
+};
+
+template <typename A>
+double
+replace_objects(A &a, uint32_t size, uint32_t noperations)
+{
+    // write every object first, so page faults on fresh memory are not
+    // timed
+    Vector<void *> objs(size, 0);
+    for (uint32_t i = 0; i < size; ++i) {
+	objs[i] = a.allocate();
+	*static_cast<uint64_t *>(objs[i]) = i;
+    }
+    uint64_t r = size;
+    Timestamp t0 = Timestamp::now_steady();
+    for (uint32_t i = 0; i < noperations; ++i) {
+	void *&x = objs[splitmix64(r) % size];
+	a.deallocate(x);
+	x = a.allocate();
+	*static_cast<uint64_t *>(x) = i;
+    }
+    double t = elapsed(t0);
+    for (uint32_t i = 0; i < size; ++i)
+	a.deallocate(objs[i]);
+    return noperations / t;
+}
+}
+
+void
+SlabAllocatorTest::benchmark(uint32_t size, ErrorHandler *errh)
+{
+    {
+	NewDelete a;
+	errh->message("%u new %.0f", size, replace_objects(a, size, _noperations));
+    }
+    {
+	HashAllocator a(object_size);
+	errh->message("%u HashAllocator %.0f", size, replace_objects(a, size, _noperations));
+    }
+    {
+	SlabAllocator a(object_size);
+	double rate = replace_objects(a, size, _noperations);
+	SlabAllocator::Stats s = stats_of(a);
+	errh->message("%u SlabAllocator %.0f %.1f", size, rate, (double) s.reserved_bytes / size);
+    }
+}
+
+CLICK_ENDDECLS
+EXPORT_ELEMENT(SlabAllocatorTest)
@@ -0,0 +1,76 @@
+// -*- c-basic-offset: 4 -*-
+#ifndef CLICK_SLABALLOCATORTEST_HH
+#define CLICK_SLABALLOCATORTEST_HH
+#include <click/element.hh>
+CLICK_DECLS
+
+/*
+=c
+
+SlabAllocatorTest([I<keywords> BENCHMARK, SIZE, OPERATIONS])
+
+=s test
+
+runs regression tests and benchmarks for SlabAllocator
+
+=d
+
+SlabAllocatorTest runs SlabAllocator regression tests at initialization
+time. It does not route packets.
+
+If BENCHMARK is true, SlabAllocatorTest then compares SlabAllocator with
+HashAllocator and with new and delete on a flow-table workload.  For each
+SIZE, it allocates SIZE 96-byte objects, then performs OPERATIONS
+replacements, each freeing a random live object and allocating a new one.
+It reports one line per allocator and size:
+
+   SIZE ALLOCATOR REPLACEMENTS/S
+
+SlabAllocator's line also reports the bytes it reserved per live object.
+
+Keyword arguments are:
+
+=over 8
+
+=item BENCHMARK
+
+Boolean. If true, run the benchmark. Default is false.
+
+=item SIZE
+
+Unsigned integer. Number of live objects. May be given more than once.
+Default is 1000000.
+
+=item OPERATIONS
+
+Unsigned integer. Number of replacements per allocator. Default is 10000000.
+
+=back
+
+=e
+
+  SlabAllocatorTest(BENCHMARK true, SIZE 100000, SIZE 10000000)
+
+=a FlatHashTableTest */
+
+class SlabAllocatorTest : public Element { public:
+
+    SlabAllocatorTest() CLICK_COLD;
+
+    const char *class_name() const		{ return "SlabAllocatorTest"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+
+  private:
+
+    bool _benchmark;
+    Vector<uint32_t> _sizes;
+    uint32_t _noperations;
+
+    void benchmark(uint32_t size, ErrorHandler *errh);
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,412 @@
+/*
+ * telemetrysocket.{cc,hh} -- element streams handler values to Unix-domain
+ * sockets
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include "telemetrysocket.hh"
+#include <click/args.hh>
+#include <click/error.hh>
+#include <click/router.hh>
+#include <click/handler.hh>
+#include <unistd.h>
+#include <stdlib.h>
+#include <math.h>
+#include <ctype.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+CLICK_DECLS
+
+const char TelemetrySocket::protocol_version[] = "1.0";
+
+TelemetrySocket::TelemetrySocket()
+    : _socket_fd(-1), _timer(this), _seq(0), _nlive(0)
+{
+}
+
+TelemetrySocket::~TelemetrySocket()
+{
+}
+
+int
+TelemetrySocket::configure(Vector<String> &conf, ErrorHandler *errh)
+{
+    String format = "BINARY";
+    _interval = Timestamp(1);
+    _greeting = true;
+    if (Args(conf, this, errh)
+	.read_mp("FILENAME", FilenameArg(), _pathname)
+	.read_all("HANDLER", AnyArg(), _patterns)
+	.read("INTERVAL", _interval)
+	.read("FORMAT", WordArg(), format)
+	.read("GREETING", _greeting)
+	.complete() < 0)
+	return -1;
+
+    if (_pathname.length() >= (int) sizeof(((struct sockaddr_un *) 0)->sun_path))
+	return errh->error("filename too long");
+    format = format.upper();
+    if (format == "BINARY")
+	_prometheus = false;
+    else if (format == "PROMETHEUS")
+	_prometheus = true;
+    else
+	return errh->error("bad FORMAT");
+    if (!_interval)
+	return errh->error("INTERVAL must be positive");
+    return 0;
+}
+
+String
+TelemetrySocket::handler_name(int i) const
+{
+    if (_elements[i] == router()->root_element())
+	return _handlers[i]->name();
+    else
+	return _elements[i]->name() + "." + _handlers[i]->name();
+}
+
+int
+TelemetrySocket::find_handlers(ErrorHandler *errh)
+{
+    for (int p = 0; p < _patterns.size(); ++p) {
+	String pattern = cp_unquote(_patterns[p]);
+	int dot = pattern.find_right('.');
+	String hname = pattern.substring(dot + 1);
+	int nfound = 0;
+	if (dot < 0) {
+	    const Handler *h = Router::handler(router()->root_element(), hname);
+	    if (h && h->readable()) {
+		_elements.push_back(router()->root_element());
+		_handlers.push_back(h);
+		++nfound;
+	    }
+	} else {
+	    String epattern = pattern.substring(0, dot);
+	    for (int i = 0; i < router()->nelements(); ++i) {
+		Element *e = router()->element(i);
+		if (!e->name().glob_match(epattern))
+		    continue;
+		const Handler *h = Router::handler(e, hname);
+		if (h && h->readable()) {
+		    _elements.push_back(e);
+		    _handlers.push_back(h);
+		    ++nfound;
+		}
+	    }
+	}
+	if (!nfound)
+	    errh->warning("no read handlers match %<%s%>", pattern.c_str());
+    }
+    return 0;
+}
+
+int
+TelemetrySocket::initialize(ErrorHandler *errh)
+{
+    // add_handlers() runs before initialize(), so every handler exists now
+    find_handlers(errh);
+
+    _socket_fd = socket(PF_UNIX, SOCK_STREAM, 0);
+    if (_socket_fd < 0)
+	return errh->error("socket: %s", strerror(errno));
+    // remove a socket left behind by a router that did not clean up
+    struct stat st;
+    if (lstat(_pathname.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+	unlink(_pathname.c_str());
+
+    struct sockaddr_un sa;
+    sa.sun_family = AF_UNIX;
+    memcpy(sa.sun_path, _pathname.c_str(), _pathname.length() + 1);
+    if (bind(_socket_fd, (struct sockaddr *) &sa, sizeof(sa)) < 0)
+	return errh->error("bind: %s", strerror(errno));
+    if (listen(_socket_fd, 8) < 0)
+	return errh->error("listen: %s", strerror(errno));
+    fcntl(_socket_fd, F_SETFL, O_NONBLOCK);
+    fcntl(_socket_fd, F_SETFD, FD_CLOEXEC);
+    add_select(_socket_fd, SELECT_READ);
+
+    _timer.initialize(this);
+    return 0;
+}
+
+void
+TelemetrySocket::cleanup(CleanupStage)
+{
+    if (_socket_fd >= 0) {
+	close(_socket_fd);
+	unlink(_pathname.c_str());
+	_socket_fd = -1;
+    }
+    for (int fd = 0; fd < _clients.size(); ++fd)
+	if (_clients[fd].alive)
+	    close_client(fd);
+}
+
+static inline void
+append_u32(StringAccum &sa, uint32_t x)
+{
+    if (char *s = sa.extend(4)) {
+	s[0] = x >> 24;
+	s[1] = x >> 16;
+	s[2] = x >> 8;
+	s[3] = x;
+    }
+}
+
+static inline void
+set_u32(StringAccum &sa, int pos, uint32_t x)
+{
+    char *s = sa.data() + pos;
+    s[0] = x >> 24;
+    s[1] = x >> 16;
+    s[2] = x >> 8;
+    s[3] = x;
+}
+
+/* Parse a handler value as a number. */
+static double
+parse_value(const String &str)
+{
+    const char *s = str.c_str(), *end = str.end();
+    char *rest;
+    double d = strtod(s, &rest);
+    while (rest < end && isspace((unsigned char) *rest))
+	++rest;
+    if (rest != s && rest == end)
+	return d;
+    bool b;
+    if (BoolArg().parse(cp_uncomment(str), b))
+	return b;
+    return NAN;
+}
+
+void
+TelemetrySocket::names_record(StringAccum &sa) const
+{
+    int start = sa.length();
+    append_u32(sa, 0);
+    append_u32(sa, T_NAMES);
+    append_u32(sa, _handlers.size());
+    for (int i = 0; i < _handlers.size(); ++i)
+	sa << handler_name(i) << '\0';
+    set_u32(sa, start, sa.length() - start);
+}
+
+void
+TelemetrySocket::sample_record(StringAccum &sa)
+{
+    Timestamp now = Timestamp::now();
+    int start = sa.length();
+    append_u32(sa, 0);
+    append_u32(sa, T_SAMPLE);
+    append_u32(sa, _seq++);
+    append_u32(sa, now.sec());
+    append_u32(sa, now.nsec());
+    append_u32(sa, _handlers.size());
+    for (int i = 0; i < _handlers.size(); ++i) {
+	double d = parse_value(_handlers[i]->call_read(_elements[i]));
+	uint64_t x;
+	memcpy(&x, &d, 8);
+	append_u32(sa, x >> 32);
+	append_u32(sa, x);
+    }
+    set_u32(sa, start, sa.length() - start);
+}
+
+static void
+append_metric_name(StringAccum &sa, const String &str)
+{
+    for (const char *s = str.begin(); s != str.end(); ++s)
+	sa << (isalnum((unsigned char) *s) ? *s : '_');
+}
+
+void
+TelemetrySocket::prometheus_text(StringAccum &sa)
+{
+    for (int i = 0; i < _handlers.size(); ++i) {
+	double d = parse_value(_handlers[i]->call_read(_elements[i]));
+	sa << "click_";
+	append_metric_name(sa, _handlers[i]->name());
+	sa << "{element=\"";
+	if (_elements[i] != router()->root_element())
+	    sa << _elements[i]->name();
+	sa << "\"} ";
+	if (d != d)
+	    sa << "NaN";
+	else if (d == (double) (int64_t) d)
+	    sa << (int64_t) d;
+	else
+	    sa << d;
+	sa << '\n';
+    }
+}
+
+void
+TelemetrySocket::close_client(int fd)
+{
+    Client &c = _clients[fd];
+    remove_select(fd, SELECT_READ | SELECT_WRITE);
+    close(fd);
+    c.alive = false;
+    c.out = String();
+    c.pos = 0;
+    if (!_prometheus && --_nlive == 0)
+	_timer.unschedule();
+}
+
+void
+TelemetrySocket::flush(int fd)
+{
+    Client &c = _clients[fd];
+    while (c.pos < c.out.length()) {
+	ssize_t w = write(fd, c.out.data() + c.pos, c.out.length() - c.pos);
+	if (w > 0)
+	    c.pos += w;
+	else if (w < 0 && errno == EINTR)
+	    continue;
+	else if (w < 0 && errno == EAGAIN)
+	    break;
+	else {
+	    close_client(fd);
+	    return;
+	}
+    }
+    if (c.pos == c.out.length()) {
+	c.out = String();
+	c.pos = 0;
+	remove_select(fd, SELECT_WRITE);
+	// a Prometheus scrape ends once its snapshot is written
+	if (_prometheus)
+	    close_client(fd);
+    } else
+	add_select(fd, SELECT_WRITE);
+}
+
+void
+TelemetrySocket::send(int fd, const String &data)
+{
+    Client &c = _clients[fd];
+    if (c.out.length() - c.pos + data.length() > MAX_BACKLOG)
+	close_client(fd);
+    else {
+	if (c.pos) {
+	    c.out = c.out.substring(c.pos);
+	    c.pos = 0;
+	}
+	c.out += data;
+	flush(fd);
+    }
+}
+
+void
+TelemetrySocket::run_timer(Timer *)
+{
+    if (!_nlive)
+	return;
+    StringAccum sa;
+    sample_record(sa);
+    String s = sa.take_string();
+    for (int fd = 0; fd < _clients.size(); ++fd)
+	if (_clients[fd].alive)
+	    send(fd, s);
+    _timer.reschedule_after(_interval);
+}
+
+void
+TelemetrySocket::selected(int fd, int mask)
+{
+    if (fd != _socket_fd) {
+	if (fd >= _clients.size() || !_clients[fd].alive)
+	    return;
+	if (mask & SELECT_READ) {
+	    // clients have nothing to say; notice when they hang up
+	    char buf[256];
+	    ssize_t r = read(fd, buf, sizeof(buf));
+	    if (r == 0 || (r < 0 && errno != EAGAIN && errno != EINTR)) {
+		close_client(fd);
+		return;
+	    }
+	}
+	if (mask & SELECT_WRITE)
+	    flush(fd);
+	return;
+    }
+
+    int new_fd = accept(_socket_fd, 0, 0);
+    if (new_fd < 0) {
+	if (errno != EAGAIN)
+	    click_chatter("%s: accept: %s", declaration().c_str(), strerror(errno));
+	return;
+    }
+    fcntl(new_fd, F_SETFL, O_NONBLOCK);
+    fcntl(new_fd, F_SETFD, FD_CLOEXEC);
+    while (new_fd >= _clients.size())
+	_clients.push_back(Client());
+    _clients[new_fd].alive = true;
+    add_select(new_fd, SELECT_READ);
+
+    StringAccum sa;
+    if (_prometheus)
+	prometheus_text(sa);
+    else {
+	if (_greeting)
+	    sa << "Click::TelemetrySocket/" << protocol_version << "\r\n";
+	names_record(sa);
+	sample_record(sa);
+	if (_nlive++ == 0)
+	    _timer.schedule_after(_interval);
+    }
+    send(new_fd, sa.take_string());
+}
+
+String
+TelemetrySocket::read_handler(Element *e, void *user_data)
+{
+    TelemetrySocket *ts = static_cast<TelemetrySocket *>(e);
+    StringAccum sa;
+    switch ((intptr_t) user_data) {
+    case h_names:
+	for (int i = 0; i < ts->_handlers.size(); ++i)
+	    sa << ts->handler_name(i) << '\n';
+	break;
+    case h_sample:
+	ts->sample_record(sa);
+	break;
+    case h_prometheus:
+	ts->prometheus_text(sa);
+	break;
+    case h_clients: {
+	int n = 0;
+	for (int fd = 0; fd < ts->_clients.size(); ++fd)
+	    n += ts->_clients[fd].alive;
+	return String(n);
+    }
+    }
+    return sa.take_string();
+}
+
+void
+TelemetrySocket::add_handlers()
+{
+    add_read_handler("names", read_handler, h_names);
+    add_read_handler("sample", read_handler, h_sample, Handler::f_raw);
+    add_read_handler("prometheus", read_handler, h_prometheus, Handler::f_raw);
+    add_read_handler("clients", read_handler, h_clients);
+}
+
+CLICK_ENDDECLS
+ELEMENT_REQUIRES(userlevel)
+EXPORT_ELEMENT(TelemetrySocket)
@@ -0,0 +1,165 @@
+#ifndef CLICK_TELEMETRYSOCKET_HH
+#define CLICK_TELEMETRYSOCKET_HH
+#include <click/element.hh>
+#include <click/timer.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+class Handler;
+
+/*
+=c
+
+TelemetrySocket(FILENAME [, I<keywords> HANDLER, INTERVAL, FORMAT, GREETING])
+
+=s control
+
+streams handler values to Unix-domain sockets
+
+=d
+
+Listens on a UNIX-domain socket named FILENAME, and sends connected clients
+the values of a fixed set of read handlers. Clients need not ask for each
+value: every INTERVAL, TelemetrySocket reads all the handlers at once and
+sends the values as one binary record. This is much cheaper than polling
+ControlSocket with one C<READ> per handler. An existing socket named FILENAME,
+such as one left by a router that crashed, is replaced; other files are not.
+
+The handlers are given by HANDLER keywords. Each is a handler name, such as
+"C<c.count>", where the element name may be a glob pattern: "C<*.drops>"
+selects the C<drops> handler of every element that has one. Handler values
+are read as numbers. "true" and "false" read as 1 and 0, and other values
+read as NaN.
+
+When a connection is opened in BINARY format, TelemetrySocket sends a greeting
+line like "Click::TelemetrySocket/1.0\r\n", then a names record, then a sample
+record every INTERVAL. A client that falls more than 500,000 bytes behind is
+disconnected. All record fields are in network byte order:
+
+   Offset  Size  Meaning
+   0       4     record length in bytes, including this header
+   4       4     record type: 1 for names, 2 for a sample
+
+A names record then has a 4-byte handler count N, followed by N handler
+names, each terminated by a NUL byte. A sample record has a 4-byte sequence
+number, a 4-byte timestamp in seconds and a 4-byte nanosecond part, the
+4-byte count N, then N 8-byte IEEE doubles, one per handler in names order.
+
+In PROMETHEUS format, each connection gets one snapshot of the values in the
+Prometheus text exposition format, and is then closed. A handler C<H> of
+element C<E> is reported as metric C<click_H> with label C<element="E">.
+Characters other than letters, digits and underscores become underscores.
+
+Keyword arguments are:
+
+=over 8
+
+=item HANDLER
+
+Handler name, possibly with a glob pattern for the element. May be given
+more than once.
+
+=item INTERVAL
+
+Time. How often to sample the handlers in BINARY format. Default is 1 second.
+
+=item FORMAT
+
+Either BINARY or PROMETHEUS. Default is BINARY.
+
+=item GREETING
+
+Boolean. Determines whether the greeting line is sent in BINARY format.
+Default is true.
+
+=back
+
+=n
+
+Handlers are only read when a BINARY client is connected, or on request.
+TelemetrySocket reads the handlers on its home thread. To keep sampling off
+packet-forwarding threads, give TelemetrySocket a thread of its own with
+StaticThreadSched.
+
+=h names read-only
+
+Returns the selected handler names, one per line.
+
+=h sample read-only
+
+Reads all the handlers and returns one binary sample record.
+
+=h prometheus read-only
+
+Reads all the handlers and returns them in Prometheus text format.
+
+=h clients read-only
+
+Returns the number of connected clients.
+
+=e
+
+  TelemetrySocket(/tmp/click-telemetry, HANDLER *.count, HANDLER *.drops,
+                  INTERVAL 1s);
+
+=a ControlSocket, ChatterSocket, StaticThreadSched */
+
+class TelemetrySocket : public Element { public:
+
+    TelemetrySocket() CLICK_COLD;
+    ~TelemetrySocket() CLICK_COLD;
+
+    const char *class_name() const	{ return "TelemetrySocket"; }
+
+    int configure(Vector<String> &conf, ErrorHandler *errh) CLICK_COLD;
+    int initialize(ErrorHandler *errh) CLICK_COLD;
+    void cleanup(CleanupStage stage) CLICK_COLD;
+    void add_handlers() CLICK_COLD;
+
+    void run_timer(Timer *timer);
+    void selected(int fd, int mask);
+
+  private:
+
+    String _pathname;
+    int _socket_fd;
+    Vector<String> _patterns;
+    Timestamp _interval;
+    Timer _timer;
+    bool _prometheus;
+    bool _greeting;
+    uint32_t _seq;
+
+    Vector<Element *> _elements;
+    Vector<const Handler *> _handlers;
+
+    struct Client {
+	String out;
+	int pos;
+	bool alive;
+	Client()
+	    : pos(0), alive(false) {
+	}
+    };
+    Vector<Client> _clients;	// indexed by file descriptor
+    int _nlive;
+
+    static const char protocol_version[];
+    enum { MAX_BACKLOG = 500000 };
+    enum { T_NAMES = 1, T_SAMPLE = 2 };
+    enum { h_names, h_sample, h_prometheus, h_clients };
+
+    String handler_name(int i) const;
+    int find_handlers(ErrorHandler *errh);
+    void names_record(StringAccum &sa) const;
+    void sample_record(StringAccum &sa);
+    void prometheus_text(StringAccum &sa);
+    void send(int fd, const String &data);
+    void flush(int fd);
+    void close_client(int fd);
+
+    static String read_handler(Element *e, void *user_data) CLICK_COLD;
+
+};
+
+CLICK_ENDDECLS
+#endif
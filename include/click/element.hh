@@ -8,6 +8,7 @@
 #include <click/packetbatch.hh>
 #include <click/handler.hh>
 #include <click/multithread.hh>
+#include <click/integers.hh>
 CLICK_DECLS
 class Router;
 class Master;
@@ -61,6 +62,43 @@ class Element { public:
 
     enum batch_mode {BATCH_MODE_NO, BATCH_MODE_IFPOSSIBLE, BATCH_MODE_YES};
 
+    // PROFILING
+    struct Profile {
+        enum { nbuckets = 10 };
+        uint64_t calls;         // Push and pull calls into this element.
+        uint64_t batch_calls;   // ... of which were push_batch or pull_batch.
+        uint64_t packets;       // Packets passed by those calls.
+        click_cycles_t cycles;  // Cycles spent in self and children.
+        click_cycles_t own_cycles;      // Cycles spent in self.
+        uint64_t batch_sizes[nbuckets]; // Calls by batch size: 0, 1, 2-3, ...
+
+        Profile() {
+            clear();
+        }
+        void clear() {
+            memset(this, 0, sizeof(Profile));
+        }
+        static inline int bucket(unsigned n) {
+            int b = n ? 33 - ffs_msb(n) : 0;
+            return b < nbuckets ? b : nbuckets - 1;
+        }
+        inline void account(click_cycles_t all_delta, click_cycles_t own_delta,
+                            unsigned n, bool batch) {
+            ++calls;
+            batch_calls += batch;
+            packets += n;
+            cycles += all_delta;
+            own_cycles += own_delta;
+            ++batch_sizes[bucket(n)];
+        }
+        Profile &operator+=(const Profile &x);
+    };
+
+    inline bool profiling() const;
+    void set_profiling(bool on);
+    void reset_profile();
+    Profile profile() const;
+
     virtual bool get_runnable_threads(Bitvector&) final = delete;
 
     inline void checked_output_push(int port, Packet *p) const;
@@ -254,6 +292,13 @@ class Element { public:
 
       private:
 
+        void profiled_push(Packet *p) const;
+        Packet *profiled_pull() const;
+#if HAVE_BATCH
+        void profiled_push_batch(PacketBatch *batch) const;
+        PacketBatch *profiled_pull_batch(unsigned max) const;
+#endif
+
         Element* _e;
         int _port;
         per_thread<PacketBatch*> current_batch;
@@ -269,6 +314,9 @@ class Element { public:
             PacketBatch* (*pull_batch)(Element *e, int port, unsigned max);
 #endif
         } _bound_batch;
+# if HAVE_BATCH
+        bool _unbatch;          // push_batch calls _bound.push per packet
+# endif
 #endif
 
 #if CLICK_STATS >= 1
@@ -283,6 +331,7 @@ class Element { public:
 
         friend class Element;
         friend class BatchElement;
+        friend class Router;
 
     };
 
@@ -308,6 +357,15 @@ class Element { public:
     Router* _router;
     int _eindex;
     bool _is_fullpush;
+#if HAVE_BATCH
+    bool _rebatch;              // batch-mode elements are downstream of
+                                //   push outputs through unbatched elements
+#endif
+
+    per_thread<Profile> *_profile;      // Non-null iff profiling is on.
+    per_thread<Profile> *_profile_data;
+    static per_thread<click_cycles_t> *profile_cycles;
+    static String read_profile_handler(Element *, void *);
 
 #if CLICK_STATS >= 2
     // STATISTICS
@@ -341,6 +399,7 @@ class Element { public:
 
     void initialize_ports(const int* input_codes, const int* output_codes);
     int connect_port(bool isoutput, int port, Element*, int);
+    Bitvector passing_threads(bool is_pull, bool &fullpush);
 
     static String read_handlers_handler(Element *e, void *user_data);
     void add_default_handlers(bool writable_config);
@@ -580,6 +639,9 @@ Element::Port::assign(bool isoutput, Element *e, int port)
         current_batch.set_value(i,0);
     (void) isoutput;
 #if HAVE_BOUND_PORT_TRANSFER
+# if HAVE_BATCH
+    _unbatch = false;
+# endif
     if (e) {
         if (isoutput) {
             void (Element::*pusher)(int, Packet *) = &Element::push;
@@ -684,6 +746,8 @@ Element::Port::push(Packet* p) const
         } else {
             (*current_batch)->append_packet(p);
         }
+    } else if (unlikely(_e->_profile != 0)) {
+        profiled_push(p);
     } else {
 # if HAVE_BOUND_PORT_TRANSFER
     _bound.push(_e, _port, p);
@@ -730,10 +794,14 @@ Element::Port::pull() const
     _e->_xfer_own_cycles += own_delta;
     _owner->_child_cycles += all_delta;
 #else
+    Packet *p;
+    if (unlikely(_e->_profile != 0))
+        p = profiled_pull();
+    else
 # if HAVE_BOUND_PORT_TRANSFER
-    Packet *p = _bound.pull(_e, _port);
+        p = _bound.pull(_e, _port);
 # else
-    Packet *p = _e->pull(_port);
+        p = _e->pull(_port);
 # endif
 #endif
 #if CLICK_STATS >= 1
@@ -752,10 +820,19 @@ Element::Port::push_batch(PacketBatch* batch) const {
 #if BATCH_DEBUG
     click_chatter("Pushing batch of %d packets to %p{element}",batch->count(),_e);
 #endif
+    if (unlikely(_e->_profile != 0))
+        profiled_push_batch(batch);
 #if HAVE_BOUND_PORT_TRANSFER
-    _bound_batch.push_batch(_e,_port,batch);
+    else if (_unbatch) {
+        // The next element would only unbatch: call its push() directly.
+        FOR_EACH_PACKET_SAFE(batch, p) {
+            _bound.push(_e, _port, p);
+        }
+    } else
+        _bound_batch.push_batch(_e,_port,batch);
 #else
-    _e->push_batch(_port,batch);
+    else
+        _e->push_batch(_port,batch);
 #endif
 }
 
@@ -765,7 +842,7 @@ void Element::Port::start_batch() {
 #endif
     if (_e->in_batch_mode == BATCH_MODE_YES) { //Rebuild for the next element
         current_batch.set((PacketBatch*)-1);
-    } else { //Pass the rebuild message
+    } else if (_e->_rebatch) { //Pass the rebuild message
         if (*current_batch != (PacketBatch*)-1) {
             *current_batch = (PacketBatch*)-1;
             for (int i = 0; i < _e->noutputs(); i++) {
@@ -784,11 +861,18 @@ void Element::Port::end_batch() {
     if (_e->in_batch_mode == BATCH_MODE_YES) { //Send the buffered batch to the next element
         if (cur != 0) {
            if (cur != (PacketBatch*)-1) {
-               _e->push_batch(_port,current_batch.get());
+               if (unlikely(_e->_profile != 0))
+                   profiled_push_batch(cur);
+               else
+#if HAVE_BOUND_PORT_TRANSFER
+                   _bound_batch.push_batch(_e,_port,cur);
+#else
+                   _e->push_batch(_port,cur);
+#endif
            }
            cur = 0;
         }
-    } else { //Pass the message
+    } else if (_e->_rebatch) { //Pass the message
         if (*current_batch == (PacketBatch*)-1) {
             *current_batch = 0;
             for (int i = 0; i < _e->noutputs(); i++) {
@@ -803,15 +887,28 @@ void Element::Port::end_batch() {
 PacketBatch*
 Element::Port::pull_batch(unsigned max) const {
     PacketBatch* batch = NULL;
+    if (unlikely(_e->_profile != 0))
+        batch = profiled_pull_batch(max);
+    else
 #if HAVE_BOUND_PORT_TRANSFER
-    batch = _bound_batch.pull_batch(_e,_port, max);
+        batch = _bound_batch.pull_batch(_e,_port, max);
 #else
-    batch = _e->pull_batch(_port, max);
+        batch = _e->pull_batch(_port, max);
 #endif
     return batch;
 }
 #endif
 
+/** @brief Return true iff push and pull calls into this element are being
+ * profiled.
+ *
+ * @sa set_profiling, profile */
+inline bool
+Element::profiling() const
+{
+    return _profile != 0;
+}
+
 /**
  * @brief Tell if the path up to this element is a full push path
  *
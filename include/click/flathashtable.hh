@@ -0,0 +1,796 @@
+#ifndef CLICK_FLATHASHTABLE_HH
+#define CLICK_FLATHASHTABLE_HH
+/*
+ * flathashtable.hh -- open-addressing FlatHashTable template
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software")
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+#include <click/pair.hh>
+#include <click/hashcode.hh>
+#include <click/integers.hh>
+#include <click/glue.hh>
+#if CLICK_USERLEVEL && defined(__SSE2__)
+# include <emmintrin.h>
+# define CLICK_FLATHASHTABLE_SSE2 1
+#endif
+CLICK_DECLS
+
+/** @file <click/flathashtable.hh>
+ * @brief Click's open-addressing hash table template.
+ */
+
+template <typename K, typename V> class FlatHashTable_iterator;
+template <typename K, typename V> class FlatHashTable_const_iterator;
+
+/** @class FlatHashTable
+  @brief Open-addressing hash table template.
+
+  FlatHashTable<K, V> maps keys K to values V, like HashTable<K, V>, but
+  stores its elements in one flat array rather than in chains.  It is meant
+  for large flow tables, where HashTable spends most of a lookup waiting for
+  cache misses as it follows bucket and chain pointers.  Its interface is a
+  subset of HashTable<K, V>'s, so a flow-state element can switch from one to
+  the other by changing its table's type.
+
+  Slots are grouped by 16.  Each slot has a control byte, which is either
+  "empty", "deleted", or the low 7 bits of the hash of the slot's key.  The
+  16 control bytes of a group fill one SSE2 register, so a lookup compares
+  its hash tag against a whole group in a couple of instructions, and only
+  compares keys for slots whose tag matches.  Because the key comparisons
+  almost always succeed at the first try, a lookup usually touches one
+  control-byte cache line and one slot cache line.  Groups are probed
+  quadratically.  Without SSE2, for example in the kernel, the group is
+  scanned a byte at a time.
+
+  find_many() looks up many keys at once, such as the flow keys of a whole
+  PacketBatch.  It first hashes every key and prefetches its group's control
+  bytes, then prefetches the slot of each key's first tag match, and only
+  then probes, so the cache misses of different keys overlap.
+
+  Unlike HashTable, a FlatHashTable holds its elements by value: inserting
+  may move every element, and invalidates all iterators and pointers into
+  the table.  It grows when 7/8 of its slots are full or deleted.  The key
+  type must support hashcode() and operator==, like HashTable keys.
+
+  @warning FlatHashTable needs one large contiguous allocation.  Prefer
+  HashTable in the Linux kernel module. */
+template <typename K, typename V>
+class FlatHashTable {
+
+  public:
+
+    /** @brief Key type. */
+    typedef K key_type;
+
+    /** @brief Const reference to key type. */
+    typedef const K &key_const_reference;
+
+    /** @brief Value type. */
+    typedef V mapped_type;
+
+    /** @brief Pair of key type and value type. */
+    typedef Pair<const K, V> value_type;
+
+    /** @brief Type of sizes. */
+    typedef size_t size_type;
+
+    /** @brief Type of bucket counts (bucket_count()). */
+    typedef size_t bucket_count_type;
+
+    typedef FlatHashTable_const_iterator<K, V> const_iterator;
+    typedef FlatHashTable_iterator<K, V> iterator;
+
+    enum { group_size = 16 };
+
+
+    /** @brief Construct an empty hash table with normal default value. */
+    FlatHashTable()
+	: _ctrl(0), _slots(0), _size(0), _ndeleted(0), _capacity(0),
+	  _default_value() {
+    }
+
+    /** @brief Construct an empty hash table with default value @a d. */
+    explicit FlatHashTable(const mapped_type &d)
+	: _ctrl(0), _slots(0), _size(0), _ndeleted(0), _capacity(0),
+	  _default_value(d) {
+    }
+
+    /** @brief Construct an empty hash table with room for @a n elements.
+     * @param d default value
+     * @param n number of elements that fit without growing */
+    FlatHashTable(const mapped_type &d, size_type n)
+	: _ctrl(0), _slots(0), _size(0), _ndeleted(0), _capacity(0),
+	  _default_value(d) {
+	reserve(n);
+    }
+
+    /** @brief Construct a hash table as a copy of @a x. */
+    FlatHashTable(const FlatHashTable<K, V> &x)
+	: _ctrl(0), _slots(0), _size(0), _ndeleted(0), _capacity(0),
+	  _default_value(x._default_value) {
+	copy_elements(x);
+    }
+
+#if HAVE_CXX_RVALUE_REFERENCES
+    /** @overload */
+    FlatHashTable(FlatHashTable<K, V> &&x)
+	: _ctrl(0), _slots(0), _size(0), _ndeleted(0), _capacity(0),
+	  _default_value() {
+	x.swap(*this);
+    }
+#endif
+
+    /** @brief Destroy this hash table, freeing its memory. */
+    ~FlatHashTable() {
+	destroy_elements();
+	free_storage(_ctrl, _capacity);
+    }
+
+
+    /** @brief Return the number of elements in the hash table. */
+    inline size_type size() const {
+	return _size;
+    }
+
+    /** @brief Return true iff size() == 0. */
+    inline bool empty() const {
+	return _size == 0;
+    }
+
+    /** @brief Return the number of slots in the hash table. */
+    inline bucket_count_type bucket_count() const {
+	return _capacity;
+    }
+
+    /** @brief Return the number of bytes used by the slots and their
+     * control bytes.
+     *
+     * This does not include memory the keys and values point to. */
+    inline size_t memory_usage() const {
+	return storage_size(_capacity);
+    }
+
+    /** @brief Return the hash table's default value. */
+    inline const mapped_type &default_value() const {
+	return _default_value;
+    }
+
+
+    /** @brief Return an iterator for the first element in the table.
+     *
+     * @note FlatHashTable iterators return elements in undefined order. */
+    inline iterator begin() {
+	return iterator(this, next_full(0));
+    }
+    /** @overload */
+    inline const_iterator begin() const {
+	return const_iterator(this, next_full(0));
+    }
+
+    /** @brief Return an iterator for the end of the table.
+     * @invariant end().live() == false */
+    inline iterator end() {
+	return iterator(this, _capacity);
+    }
+    /** @overload */
+    inline const_iterator end() const {
+	return const_iterator(this, _capacity);
+    }
+
+
+    /** @brief Return 1 if an element with key @a key exists, 0 otherwise. */
+    inline size_type count(key_const_reference key) const {
+	return find_slot(key, hash(key)) != _capacity;
+    }
+
+    /** @brief Return an iterator for the element with key @a key, if any.
+     *
+     * Returns end() if no such element exists. */
+    inline const_iterator find(key_const_reference key) const {
+	return const_iterator(this, find_slot(key, hash(key)));
+    }
+    /** @overload */
+    inline iterator find(key_const_reference key) {
+	return iterator(this, find_slot(key, hash(key)));
+    }
+
+    /** @brief Look up many keys at once.
+     * @param keys array of @a n keys
+     * @param n number of keys
+     * @param[out] values array of @a n value pointers
+     *
+     * Sets @a values[i] to a pointer to the value for @a keys[i], or to null
+     * if there is no such element.  Equivalent to calling get_pointer() on
+     * each key, but faster for large tables, since the memory accesses of
+     * different keys overlap. */
+    void find_many(const K *keys, int n, mapped_type **values);
+    /** @overload */
+    void find_many(const K *keys, int n, const mapped_type **values) const;
+
+    /** @brief Prefetch the control bytes that a lookup of @a key will
+     * examine.
+     *
+     * Call this early, for example while parsing the previous packet, so a
+     * later find() does not wait for memory. */
+    inline void prefetch(key_const_reference key) const {
+	if (_capacity)
+	    prefetch_group(group_of(hash(key)));
+    }
+
+
+    /** @brief Return the value for @a key.
+     *
+     * If no element for @a key currently exists (find(@a key) == end()),
+     * returns default_value(). */
+    const mapped_type &get(key_const_reference key) const {
+	size_type i = find_slot(key, hash(key));
+	return i != _capacity ? slot(i)->second : _default_value;
+    }
+
+    /** @brief Return a pointer to the value for @a key.
+     *
+     * If no element for @a key currently exists (find(@a key) == end()),
+     * returns null. */
+    mapped_type *get_pointer(key_const_reference key) {
+	size_type i = find_slot(key, hash(key));
+	return i != _capacity ? &slot(i)->second : 0;
+    }
+    /** @overload */
+    const mapped_type *get_pointer(key_const_reference key) const {
+	size_type i = find_slot(key, hash(key));
+	return i != _capacity ? &slot(i)->second : 0;
+    }
+
+    /** @brief Return the value for @a key.
+     *
+     * If no element for @a key currently exists, returns default_value(). */
+    const mapped_type &operator[](key_const_reference key) const {
+	return get(key);
+    }
+
+    /** @brief Return a reference to the value for @a key.
+     *
+     * If no element for @a key currently exists (find(@a key) == end()),
+     * adds a new element with default_value() and returns a reference to
+     * that value.
+     *
+     * @note Inserting an element into a FlatHashTable invalidates all
+     * existing iterators and pointers. */
+    inline mapped_type &operator[](key_const_reference key) {
+	return slot(insert_slot(key, _default_value))->second;
+    }
+
+
+    /** @brief Ensure an element with key @a key and return its iterator.
+     *
+     * If no element with @a key exists, adds one with value
+     * default_value().
+     *
+     * @note Inserting an element into a FlatHashTable invalidates all
+     * existing iterators and pointers. */
+    inline iterator find_insert(key_const_reference key) {
+	return iterator(this, insert_slot(key, _default_value));
+    }
+
+    /** @brief Ensure an element for key @a key and return its iterator.
+     *
+     * If no element with @a key exists, adds one with value @a value.
+     *
+     * @note Inserting an element into a FlatHashTable invalidates all
+     * existing iterators and pointers. */
+    inline iterator find_insert(key_const_reference key,
+				const mapped_type &value) {
+	return iterator(this, insert_slot(key, value));
+    }
+
+    /** @brief Set the mapping for @a key to @a value.
+     *
+     * Returns true if a new element was added, false if an existing
+     * element's value was assigned.
+     *
+     * @note Inserting an element into a FlatHashTable invalidates all
+     * existing iterators and pointers. */
+    bool set(key_const_reference key, const mapped_type &value);
+
+    /** @brief Remove the element indicated by @a it.
+     * @return A valid iterator pointing at the next element remaining, or
+     * end() if no such element exists.
+     *
+     * Unlike insertion, erasing does not move other elements. */
+    iterator erase(const iterator &it) {
+	erase_slot(it._pos);
+	return iterator(this, next_full(it._pos + 1));
+    }
+
+    /** @brief Remove any element with @a key.
+     *
+     * Returns the number of elements removed, which is always 0 or 1. */
+    size_type erase(key_const_reference key) {
+	size_type i = find_slot(key, hash(key));
+	if (i == _capacity)
+	    return 0;
+	erase_slot(i);
+	return 1;
+    }
+
+    /** @brief Remove all elements.
+     * @post size() == 0
+     *
+     * The slot array is kept, so refilling the table does not allocate. */
+    void clear();
+
+
+    /** @brief Swap the contents of this hash table and @a x. */
+    void swap(FlatHashTable<K, V> &x) {
+	click_swap(_ctrl, x._ctrl);
+	click_swap(_slots, x._slots);
+	click_swap(_size, x._size);
+	click_swap(_ndeleted, x._ndeleted);
+	click_swap(_capacity, x._capacity);
+	click_swap(_default_value, x._default_value);
+    }
+
+    /** @brief Rehash the table, ensuring it has at least @a n slots.
+     *
+     * All existing iterators and pointers are invalidated.  The slot count
+     * is rounded up to a power of two, and the table never shrinks below
+     * what its elements need. */
+    void rehash(bucket_count_type n);
+
+    /** @brief Ensure the table can hold @a n elements without growing. */
+    void reserve(size_type n) {
+	rehash(n + n / 7 + 1);
+    }
+
+
+    /** @brief Assign this hash table's contents to a copy of @a x. */
+    FlatHashTable<K, V> &operator=(const FlatHashTable<K, V> &x) {
+	if (&x != this) {
+	    clear();
+	    _default_value = x._default_value;
+	    copy_elements(x);
+	}
+	return *this;
+    }
+
+#if HAVE_CXX_RVALUE_REFERENCES
+    /** @overload */
+    FlatHashTable<K, V> &operator=(FlatHashTable<K, V> &&x) {
+	x.swap(*this);
+	return *this;
+    }
+#endif
+
+  private:
+
+    enum { c_empty = 0x80, c_deleted = 0xFE };
+    enum { prefetch_batch = 16 };
+
+    uint8_t *_ctrl;
+    char *_slots;
+    size_type _size;
+    size_type _ndeleted;
+    size_type _capacity;
+    V _default_value;
+
+    static inline uint64_t hash(key_const_reference key) {
+	// hashcode() is the identity for integers, so mix it: the tag comes
+	// from the low bits and the group from the bits above them
+	uint64_t h = (uint64_t) hashcode(key) * 0x9E3779B97F4A7C15ULL;
+	return h ^ (h >> 29);
+    }
+    static inline uint8_t tag_of(uint64_t h) {
+	return h & 0x7F;
+    }
+    inline size_type group_of(uint64_t h) const {
+	return (h >> 7) & (_capacity / group_size - 1);
+    }
+
+    inline value_type *slot(size_type i) const {
+	return reinterpret_cast<value_type *>(_slots + i * sizeof(value_type));
+    }
+    static inline size_t storage_size(size_type capacity) {
+	return capacity * (1 + sizeof(value_type));
+    }
+    static void free_storage(uint8_t *ctrl, size_type capacity) {
+	if (ctrl)
+	    CLICK_LFREE(ctrl, storage_size(capacity));
+    }
+
+    /** Return a bitmask of the slots in the group at @a g whose control
+     * byte equals @a c. */
+    static inline unsigned group_match(const uint8_t *g, uint8_t c) {
+#if CLICK_FLATHASHTABLE_SSE2
+	__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(g));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_set1_epi8(c)));
+#else
+	unsigned m = 0;
+	for (int i = 0; i < group_size; ++i)
+	    m |= (unsigned) (g[i] == c) << i;
+	return m;
+#endif
+    }
+    /** Return a bitmask of the empty or deleted slots in the group at
+     * @a g. */
+    static inline unsigned group_match_free(const uint8_t *g) {
+#if CLICK_FLATHASHTABLE_SSE2
+	return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(g)));
+#else
+	unsigned m = 0;
+	for (int i = 0; i < group_size; ++i)
+	    m |= (unsigned) (g[i] >> 7) << i;
+	return m;
+#endif
+    }
+
+    inline void prefetch_group(size_type g) const {
+#ifdef __GNUC__
+	__builtin_prefetch(_ctrl + g * group_size);
+#else
+	(void) g;
+#endif
+    }
+    /** Prefetch the slot of the first match for @a h's tag in its group.
+     * Reads the control bytes, so call after prefetch_group(). */
+    inline void prefetch_match(uint64_t h) const {
+#ifdef __GNUC__
+	size_type g = group_of(h);
+	if (unsigned m = group_match(_ctrl + g * group_size, tag_of(h)))
+	    __builtin_prefetch(slot(g * group_size + ffs_lsb(m) - 1));
+#else
+	(void) h;
+#endif
+    }
+
+    inline size_type find_slot(key_const_reference key, uint64_t h) const;
+    size_type insert_slot(key_const_reference key, const mapped_type &value);
+    size_type free_slot(uint64_t h) const;
+    void erase_slot(size_type i);
+    size_type next_full(size_type i) const {
+	while (i < _capacity && (_ctrl[i] & 0x80))
+	    ++i;
+	return i;
+    }
+    void destroy_elements();
+    void copy_elements(const FlatHashTable<K, V> &x);
+
+    friend class FlatHashTable_iterator<K, V>;
+    friend class FlatHashTable_const_iterator<K, V>;
+
+};
+
+
+template <typename K, typename V>
+class FlatHashTable_const_iterator { public:
+
+    typedef typename FlatHashTable<K, V>::size_type size_type;
+
+    /** @brief Construct an uninitialized iterator. */
+    FlatHashTable_const_iterator() {
+    }
+
+    /** @brief Return a pointer to the element, null if *this == end(). */
+    const Pair<const K, V> *get() const {
+	return live() ? _t->slot(_pos) : 0;
+    }
+
+    /** @brief Return a pointer to the element.
+     * @pre *this != end() */
+    const Pair<const K, V> *operator->() const {
+	return _t->slot(_pos);
+    }
+
+    /** @brief Return a reference to the element.
+     * @pre *this != end() */
+    const Pair<const K, V> &operator*() const {
+	return *_t->slot(_pos);
+    }
+
+    /** @brief Return this element's key.
+     * @pre *this != end() */
+    const K &key() const {
+	return _t->slot(_pos)->first;
+    }
+
+    /** @brief Return this element's value.
+     * @pre *this != end() */
+    const V &value() const {
+	return _t->slot(_pos)->second;
+    }
+
+    /** @brief Return true iff *this != end(). */
+    bool live() const {
+	return _pos < _t->_capacity;
+    }
+
+    typedef bool (FlatHashTable_const_iterator::*unspecified_bool_type)() const;
+    /** @brief Return true iff *this != end(). */
+    inline operator unspecified_bool_type() const {
+	return live() ? &FlatHashTable_const_iterator::live : 0;
+    }
+
+    /** @brief Advance this iterator to the next element. */
+    void operator++() {
+	_pos = _t->next_full(_pos + 1);
+    }
+    /** @brief Advance this iterator to the next element. */
+    void operator++(int) {
+	++*this;
+    }
+
+    bool operator==(const FlatHashTable_const_iterator<K, V> &x) const {
+	return _t == x._t && _pos == x._pos;
+    }
+    bool operator!=(const FlatHashTable_const_iterator<K, V> &x) const {
+	return !(*this == x);
+    }
+
+  protected:
+
+    const FlatHashTable<K, V> *_t;
+    size_type _pos;
+
+    FlatHashTable_const_iterator(const FlatHashTable<K, V> *t, size_type pos)
+	: _t(t), _pos(pos) {
+    }
+
+    friend class FlatHashTable<K, V>;
+
+};
+
+template <typename K, typename V>
+class FlatHashTable_iterator : public FlatHashTable_const_iterator<K, V> { public:
+
+    typedef FlatHashTable_const_iterator<K, V> inherited;
+
+    /** @brief Construct an uninitialized iterator. */
+    FlatHashTable_iterator() {
+    }
+
+    /** @brief Return a pointer to the element, null if *this == end(). */
+    Pair<const K, V> *get() const {
+	return const_cast<Pair<const K, V> *>(inherited::get());
+    }
+
+    /** @brief Return a pointer to the element.
+     * @pre *this != end() */
+    inline Pair<const K, V> *operator->() const {
+	return this->_t->slot(this->_pos);
+    }
+
+    /** @brief Return a reference to the element.
+     * @pre *this != end() */
+    inline Pair<const K, V> &operator*() const {
+	return *this->_t->slot(this->_pos);
+    }
+
+    /** @brief Return a mutable reference to this element's value.
+     * @pre *this != end() */
+    V &value() const {
+	return this->_t->slot(this->_pos)->second;
+    }
+
+  private:
+
+    FlatHashTable_iterator(FlatHashTable<K, V> *t, typename inherited::size_type pos)
+	: inherited(t, pos) {
+    }
+
+    friend class FlatHashTable<K, V>;
+
+};
+
+
+template <typename K, typename V>
+inline typename FlatHashTable<K, V>::size_type
+FlatHashTable<K, V>::find_slot(key_const_reference key, uint64_t h) const
+{
+    if (!_capacity)
+	return 0;
+    uint8_t tag = tag_of(h);
+    size_type gmask = _capacity / group_size - 1;
+    size_type g = group_of(h);
+    for (size_type step = 1; ; ++step) {
+	const uint8_t *c = _ctrl + g * group_size;
+	for (unsigned m = group_match(c, tag); m; m &= m - 1) {
+	    size_type i = g * group_size + ffs_lsb(m) - 1;
+	    if (likely(slot(i)->first == key))
+		return i;
+	}
+	// a probe sequence never continues past a group with an empty slot
+	if (likely(group_match(c, c_empty)))
+	    return _capacity;
+	g = (g + step) & gmask;
+    }
+}
+
+template <typename K, typename V>
+typename FlatHashTable<K, V>::size_type
+FlatHashTable<K, V>::free_slot(uint64_t h) const
+{
+    size_type gmask = _capacity / group_size - 1;
+    size_type g = group_of(h);
+    for (size_type step = 1; ; ++step) {
+	if (unsigned m = group_match_free(_ctrl + g * group_size))
+	    return g * group_size + ffs_lsb(m) - 1;
+	g = (g + step) & gmask;
+    }
+}
+
+template <typename K, typename V>
+typename FlatHashTable<K, V>::size_type
+FlatHashTable<K, V>::insert_slot(key_const_reference key, const mapped_type &value)
+{
+    uint64_t h = hash(key);
+    size_type i = find_slot(key, h);
+    if (i != _capacity)
+	return i;
+    if (unlikely((_size + _ndeleted + 1) * 8 > _capacity * 7)) {
+	// grow if live elements take more than half the allowed load,
+	// otherwise just squeeze out deleted slots
+	if ((_size + 1) * 16 > _capacity * 7)
+	    rehash(_capacity ? _capacity * 2 : (size_type) group_size);
+	else
+	    rehash(_capacity);
+    }
+    i = free_slot(h);
+    if (_ctrl[i] == c_deleted)
+	--_ndeleted;
+    _ctrl[i] = tag_of(h);
+    new((void *) slot(i)) value_type(key, value);
+    ++_size;
+    return i;
+}
+
+template <typename K, typename V>
+bool
+FlatHashTable<K, V>::set(key_const_reference key, const mapped_type &value)
+{
+    size_type old_size = _size;
+    size_type i = insert_slot(key, value);
+    if (_size == old_size) {
+	slot(i)->second = value;
+	return false;
+    } else
+	return true;
+}
+
+template <typename K, typename V>
+void
+FlatHashTable<K, V>::erase_slot(size_type i)
+{
+    slot(i)->~value_type();
+    // If the group already has an empty slot, no probe sequence continues
+    // past it, so this slot can become empty rather than deleted.
+    uint8_t *g = _ctrl + (i & ~(size_type) (group_size - 1));
+    if (group_match(g, c_empty))
+	_ctrl[i] = c_empty;
+    else {
+	_ctrl[i] = c_deleted;
+	++_ndeleted;
+    }
+    --_size;
+}
+
+template <typename K, typename V>
+void
+FlatHashTable<K, V>::destroy_elements()
+{
+    for (size_type i = 0; _size && i < _capacity; ++i)
+	if (!(_ctrl[i] & 0x80)) {
+	    slot(i)->~value_type();
+	    --_size;
+	}
+}
+
+template <typename K, typename V>
+void
+FlatHashTable<K, V>::clear()
+{
+    destroy_elements();
+    if (_capacity)
+	memset(_ctrl, c_empty, _capacity);
+    _size = _ndeleted = 0;
+}
+
+template <typename K, typename V>
+void
+FlatHashTable<K, V>::copy_elements(const FlatHashTable<K, V> &x)
+{
+    if (x._size)
+	reserve(x._size);
+    for (size_type i = 0; i < x._capacity; ++i)
+	if (!(x._ctrl[i] & 0x80))
+	    insert_slot(x.slot(i)->first, x.slot(i)->second);
+}
+
+template <typename K, typename V>
+void
+FlatHashTable<K, V>::rehash(bucket_count_type n)
+{
+    size_type capacity = group_size;
+    while (capacity < n || capacity * 7 < _size * 8)
+	capacity *= 2;
+
+    uint8_t *old_ctrl = _ctrl;
+    char *old_slots = _slots;
+    size_type old_capacity = _capacity;
+
+    _ctrl = reinterpret_cast<uint8_t *>(CLICK_LALLOC(storage_size(capacity)));
+    _slots = reinterpret_cast<char *>(_ctrl + capacity);
+    _capacity = capacity;
+    _ndeleted = 0;
+    memset(_ctrl, c_empty, capacity);
+
+    for (size_type i = 0; i < old_capacity; ++i)
+	if (!(old_ctrl[i] & 0x80)) {
+	    value_type *v = reinterpret_cast<value_type *>(old_slots + i * sizeof(value_type));
+	    uint64_t h = hash(v->first);
+	    size_type j = free_slot(h);
+	    _ctrl[j] = tag_of(h);
+	    new((void *) slot(j)) value_type(*v);
+	    v->~value_type();
+	}
+    free_storage(old_ctrl, old_capacity);
+}
+
+template <typename K, typename V>
+void
+FlatHashTable<K, V>::find_many(const K *keys, int n, mapped_type **values)
+{
+    const FlatHashTable<K, V> *ct = this;
+    ct->find_many(keys, n, const_cast<const mapped_type **>(values));
+}
+
+template <typename K, typename V>
+void
+FlatHashTable<K, V>::find_many(const K *keys, int n, const mapped_type **values) const
+{
+    uint64_t hashes[prefetch_batch];
+    if (!_capacity) {
+	for (int i = 0; i < n; ++i)
+	    values[i] = 0;
+	return;
+    }
+    // Hash a window of keys and prefetch their control bytes, then the
+    // slots their tags point to, then probe them, so the cache misses of
+    // the whole window are in flight at once.
+    for (int base = 0; base < n; base += prefetch_batch) {
+	int w = n - base < prefetch_batch ? n - base : prefetch_batch;
+	for (int i = 0; i < w; ++i) {
+	    hashes[i] = hash(keys[base + i]);
+	    prefetch_group(group_of(hashes[i]));
+	}
+	for (int i = 0; i < w; ++i)
+	    prefetch_match(hashes[i]);
+	for (int i = 0; i < w; ++i) {
+	    size_type j = find_slot(keys[base + i], hashes[i]);
+	    values[base + i] = j != _capacity ? &slot(j)->second : 0;
+	}
+    }
+}
+
+template <typename K, typename V>
+inline void
+click_swap(FlatHashTable<K, V> &a, FlatHashTable<K, V> &b)
+{
+    a.swap(b);
+}
+
+template <typename K, typename V>
+inline void
+assign_consume(FlatHashTable<K, V> &a, FlatHashTable<K, V> &b)
+{
+    a.swap(b);
+}
+
+CLICK_ENDDECLS
+#endif
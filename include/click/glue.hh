@@ -134,6 +134,11 @@ void click_lfree(volatile void *p, size_t size);
 # define CLICK_LFREE(p, size)	delete[] ((void) (size), (uint8_t *)(p))
 #endif
 
+CLICK_DECLS
+void *click_aligned_alloc(size_t alignment, size_t size);
+void click_aligned_free(void *p);
+CLICK_ENDDECLS
+
 
 // RANDOMNESS
 
@@ -7,6 +7,7 @@
 #include <click/variableenv.hh>
 CLICK_DECLS
 class LexerExtra;
+struct RouterImage;
 
 enum Lexemes {
     lexEOF = 0,
@@ -104,6 +105,10 @@ class Lexer { public:
     void ystep();
 
     Router *create_router(Master *);
+#if CLICK_USERLEVEL
+    Router *create_router(const RouterImage &image, LexerExtra *lextra,
+			  ErrorHandler *errh, Master *master);
+#endif
 
   private:
 
@@ -170,7 +175,7 @@ class Lexer { public:
     ParseState *_ps;
     int _group_depth;
 
-    Vector<TunnelEnd *> _tunnels;
+    HashTable<int, TunnelEnd *> _tunnels;	// element index -> tunnel ends
 
     // compound elements
     int _anonymous_offset;
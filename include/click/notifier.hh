@@ -119,6 +119,8 @@ class Notifier { public:
     static inline NotifierSignal downstream_full_signal(Element *e, int port, Notifier *dependent_notifier);
     static NotifierSignal downstream_full_signal(Element *e, int port, callback_type f, void *user_data);
 
+    static bool search_notifiers(Element *e, bool isoutput, int port, const char *name, Vector<Notifier *> &notifiers);
+
     static inline NotifierSignal upstream_empty_signal(Element *e, int port, int) CLICK_DEPRECATED;
     static inline NotifierSignal upstream_empty_signal(Element *e, int port, int, Notifier *) CLICK_DEPRECATED;
     static inline NotifierSignal downstream_full_signal(Element *e, int port, int) CLICK_DEPRECATED;
@@ -22,6 +22,18 @@
 #if !CLICK_PACKET_USE_DPDK && (CLICK_USERLEVEL || CLICK_NS || CLICK_MINIOS) && (!HAVE_MULTITHREAD || HAVE___THREAD_STORAGE_CLASS) && !(NETMAP_PACKET_POOL)
 # define HAVE_CLICK_PACKET_POOL 1
 #endif
+/* The compact layout orders userlevel Packet fields by how often elements
+   touch them; see the Packet data members.  Define CLICK_PACKET_COMPACT_LAYOUT
+   to 0 for the original, sk_buff-like order. */
+#ifndef CLICK_PACKET_COMPACT_LAYOUT
+# if CLICK_USERLEVEL && !CLICK_PACKET_USE_DPDK
+#  define CLICK_PACKET_COMPACT_LAYOUT 1
+# else
+#  define CLICK_PACKET_COMPACT_LAYOUT 0
+# endif
+#elif CLICK_PACKET_COMPACT_LAYOUT && !(CLICK_USERLEVEL && !CLICK_PACKET_USE_DPDK)
+# error "CLICK_PACKET_COMPACT_LAYOUT requires userlevel without DPDK packets"
+#endif
 #ifndef CLICK_PACKET_DEPRECATED_ENUM
 # define CLICK_PACKET_DEPRECATED_ENUM CLICK_DEPRECATED_ENUM
 #endif
@@ -788,14 +800,32 @@ class Packet { public:
     // All packet annotations are stored in AllAnno so that
     // clear_annotations(true) can memset() the structure to zero.
     struct AllAnno {
+# if CLICK_PACKET_COMPACT_LAYOUT
+	// Fields in access order; see the Packet data members.
+	Packet *next;
+	Packet *prev;
+	unsigned char *nh;
+	unsigned char *h;
+	unsigned char *mac;
+	Timestamp timestamp;
+	Anno cb;
+	Packet::PacketType pkt_type;
+#  if HAVE_BATCH
+	uint32_t batch_count;	// PacketBatch::count(), on a batch's head
+#  endif
+# else
 	Anno cb;
 	unsigned char *mac;
 	unsigned char *nh;
 	unsigned char *h;
 	Packet::PacketType pkt_type;
+#  if HAVE_BATCH
+	uint32_t batch_count;	// PacketBatch::count(), on a batch's head
+#  endif
 	Timestamp timestamp;
 	Packet *next;
 	Packet *prev;
+# endif
 	AllAnno()
 	    : timestamp(Timestamp::uninitialized_t()) {
 	}
@@ -813,7 +843,23 @@ class Packet { public:
 #endif
     /** @endcond never */
 
-#if !(CLICK_LINUXMODULE || CLICK_PACKET_USE_DPDK)
+#if CLICK_PACKET_COMPACT_LAYOUT
+    // Fields every element touches come first.  Packet headers are
+    // cache-line aligned, so the data pointers, batch links, header
+    // pointers and timestamp share the first cache line, the annotation
+    // area fills the second, and fields used only to allocate, clone and
+    // free packets go in the third.
+private:
+    unsigned char *_data; /* where the packet starts */
+    unsigned char *_tail; /* one beyond end of packet */
+    AllAnno _aa;
+protected:
+    atomic_uint32_t _use_count;
+    Packet *_data_packet;
+private:
+    unsigned char *_head; /* start of allocated buffer */
+    unsigned char *_end;  /* one beyond end of allocated buffer */
+#elif !(CLICK_LINUXMODULE || CLICK_PACKET_USE_DPDK)
     // User-space and BSD kernel module implementations.
 protected:
     atomic_uint32_t _use_count;
@@ -828,6 +874,8 @@ private:
     struct mbuf *_m;
 # endif
     AllAnno _aa;
+#endif
+#if !(CLICK_LINUXMODULE || CLICK_PACKET_USE_DPDK)
 # if CLICK_NS
     SimPacketinfoWrapper _sim_packetinfo;
 # endif
@@ -848,6 +896,16 @@ private:
     ~Packet();
     Packet &operator=(const Packet &x);
 
+#if CLICK_PACKET_COMPACT_LAYOUT
+  public:
+    /** @cond never */
+    // Packet headers are cache-line aligned for the compact layout.
+    static void *operator new(size_t size) throw ();
+    static void operator delete(void *p);
+    /** @endcond never */
+  private:
+#endif
+
 #if !(CLICK_LINUXMODULE || CLICK_PACKET_USE_DPDK)
     bool alloc_data(uint32_t headroom, uint32_t length, uint32_t tailroom);
 #endif
@@ -993,7 +1051,10 @@ Packet::clear_annotations(bool all)
 	set_prev(0);
     }
 #else
-    memset(&_aa, 0, all ? sizeof(AllAnno) : sizeof(Anno));
+    if (all)
+	memset((void *) &_aa, 0, sizeof(AllAnno));
+    else
+	memset(&_aa.cb, 0, sizeof(Anno));
 #endif
 }
 
@@ -7,7 +7,12 @@
 #include <click/packet.hh>
 CLICK_DECLS
 
-#define FOR_EACH_PACKET(batch,p) for(Packet* p = batch;p != NULL;p=p->next())
+/**
+ * Iterate over the packets of a batch, or of a PacketVector with no null
+ * entries.
+ */
+#define FOR_EACH_PACKET(batch,p) \
+                for (auto p##_it = packet_iterator(batch); Packet* p = p##_it.get(); p##_it.advance())
 
 #define FOR_EACH_PACKET_SAFE(batch,p) \
                 Packet* next = ((batch != NULL)? batch->next() : NULL );\
@@ -74,59 +79,16 @@ CLICK_DECLS
 
 /**
  * Split a batch into multiple batch according to a given function which will
- * give the index of an output to choose.
+ * give the index of an output to choose. The batch may also be a
+ * PacketVector, which is left empty.
  * @fnt Function to call which will return a value between 0 and nbatches
  * #on_finish function which take an output index and a number to call when classification is finished
  */
 #define CLASSIFY_EACH_PACKET(nbatches,fnt,batch,on_finish)\
-    {\
-        PacketBatch* out[nbatches];\
-        bzero(out,sizeof(PacketBatch*)*nbatches);\
-        PacketBatch* next = ((batch != NULL)? static_cast<PacketBatch*>(batch->next()) : NULL );\
-        PacketBatch* p = batch;\
-        PacketBatch* last = NULL;\
-        int last_o = -1;\
-        int passed = 0;\
-        for (;p != NULL;p=next,next=(p==0?0:static_cast<PacketBatch*>(p->next()))) {\
-            int o = (fnt(p));\
-            if (o < 0 || o>=(nbatches)) o = (nbatches - 1);\
-            if (o == last_o) {\
-                passed ++;\
-            } else {\
-                if (last == NULL) {\
-                    out[o] = p;\
-                    p->set_count(1);\
-                    p->set_tail(p);\
-                } else {\
-                    out[last_o]->set_tail(last);\
-                    out[last_o]->set_count(out[last_o]->count() + passed);\
-                    if (!out[o]) {\
-                        out[o] = p;\
-                        out[o]->set_count(1);\
-                        out[o]->set_tail(p);\
-                    } else {\
-                        out[o]->append_packet(p);\
-                    }\
-                    passed = 0;\
-                }\
-            }\
-            last = p;\
-            last_o = o;\
-        }\
-\
-        if (passed) {\
-            out[last_o]->set_tail(last);\
-            out[last_o]->set_count(out[last_o]->count() + passed);\
-        }\
-\
-        int i = 0;\
-        for (; i < nbatches; i++) {\
-            if (out[i]) {\
-                out[i]->tail()->set_next(NULL);\
-                (on_finish(i,out[i]));\
-            }\
-        }\
-    }
+    classify_each_packet((nbatches),\
+                         [&](Packet* p) -> int { return fnt(p); },\
+                         batch,\
+                         [&](int o, PacketBatch* b) { on_finish(o, b); })
 
 /**
  * Create a batch by calling multiple times (up to max) a given function
@@ -156,12 +118,34 @@ CLICK_DECLS
  *
  * Internally, the head contains all the information usefull for the batch. The
  *  prev annotation points to the tail, the next to the next packet. It is
- *  implemented by a *simply* linked list. The BATCH_COUNT annotation is set
- *  on the first packet of the batch to remember the number of packets in the
- *  batch.
+ *  implemented by a *simply* linked list. The first packet of the batch also
+ *  remembers the number of packets in the batch.  The count is kept outside
+ *  the annotation area, so annotations of the first packet, like
+ *  EXTRA_PACKETS, are not affected by batching.
  *
  * Batches must not mix cloned and unique packets. Use cut to split batches and have part of them cloned.
  */
+/**
+ * Iterator over a linked list of packets, for FOR_EACH_PACKET
+ */
+class PacketListIterator { public:
+    inline PacketListIterator(Packet* p)
+        : _p(p) {
+    }
+    inline Packet* get() const {
+        return _p;
+    }
+    inline void advance() {
+        _p = _p->next();
+    }
+  private:
+    Packet* _p;
+};
+
+inline PacketListIterator packet_iterator(Packet* p) {
+    return PacketListIterator(p);
+}
+
 class PacketBatch : public WritablePacket {
 
 //Consider a batch size bigger as bogus (prevent infinite loop on bad pointer manipulation)
@@ -193,7 +177,7 @@ public :
      * Return the number of packets in this batch
      */
     inline unsigned count() {
-        unsigned int r = BATCH_COUNT_ANNO(this);
+        unsigned int r = batch_count();
         assert(r); //If this is a batch, this anno has to be set
         return r;
     }
@@ -238,7 +222,7 @@ public :
      * Set the number of packets in this batch
      */
     inline void set_count(unsigned int c) {
-        SET_BATCH_COUNT_ANNO(this,c);
+        batch_count() = c;
     }
 
     /**
@@ -364,6 +348,16 @@ public :
 
     void fast_kill();
 #endif
+
+  private:
+
+    inline uint32_t &batch_count() {
+#if CLICK_PACKET_USE_DPDK
+        return all_anno()->batch_count;
+#else
+        return _aa.batch_count;
+#endif
+    }
 };
 
 /**
@@ -441,6 +435,347 @@ inline void PacketBatch::kill() {
 #define BATCH_RECYCLE_UNSAFE_PACKET(p) {p->kill();}
 #endif
 
+/**
+ * Iterate over the packets of a PacketVector.
+ */
+#define FOR_EACH_PACKET_VECTOR(vec,p) \
+                for (Packet **p##_it = (vec).begin(), *p = 0; \
+                     p##_it != (vec).end() && ((p = *p##_it), true); ++p##_it)
+
+/**
+ * Iterate over the packets of a PacketVector, prefetching the packet
+ * @a ahead positions further and the descriptor 2 * @a ahead positions
+ * further. This hides cache misses when the loop touches packet data.
+ */
+#define FOR_EACH_PACKET_VECTOR_PREFETCH(vec,p,ahead) \
+                for (Packet **p##_it = ((vec).prefetch_start(ahead), (vec).begin()), *p = 0; \
+                     p##_it != (vec).end() && ((p = *p##_it), true); \
+                     (vec).prefetch_ahead(p##_it - (vec).begin(), ahead), ++p##_it)
+
+/**
+ * Execute a function on each packet of a PacketVector. The function may
+ * return another packet, or null if the packet could be dropped. Dropped
+ * packets are removed from the vector, which keeps its order.
+ */
+#define EXECUTE_FOR_EACH_PACKET_VECTOR_DROPPABLE(fnt,vec,on_drop) {\
+                Packet **_w = (vec).begin();\
+                for (Packet **_r = (vec).begin(); _r != (vec).end(); ++_r) {\
+                    Packet *p = *_r;\
+                    Packet *q = fnt(p);\
+                    if (q == 0)\
+                        on_drop(p);\
+                    else\
+                        *_w++ = q;\
+                }\
+                (vec).set_count(_w - (vec).begin());\
+            }
+
+/**
+ * Split a PacketVector into one PacketBatch per output. Same as
+ * CLASSIFY_EACH_PACKET, which also takes a PacketVector.
+ */
+#define CLASSIFY_EACH_PACKET_VECTOR(nbatches,fnt,vec,on_finish)\
+    CLASSIFY_EACH_PACKET(nbatches,fnt,vec,on_finish)
+
+/**
+ * Array of packets.
+ *
+ * PacketVector is an alternative to PacketBatch's linked list for code that
+ *  works on a whole batch at once. The packets are stored in a fixed-size
+ *  array of pointers, so a loop can index any packet, prefetch packets ahead
+ *  of the one it works on, and remove dropped packets without relinking.
+ *  Elements keep exchanging PacketBatch: convert with append_batch() when a
+ *  batch arrives and make_batch() before pushing it on. Sources that receive
+ *  arrays, like rte_eth_rx_burst(), can fill a PacketVector directly, so
+ *  that the list is linked only once.
+ *
+ * A PacketVector does not own its packets: it never kills them, unless
+ *  kill() is called.
+ */
+class PacketVector { public:
+
+    enum { capacity = 256 };  // same as BATCH_MAX_PULL
+
+    PacketVector()
+        : _count(0) {
+    }
+
+    /**
+     * Return the number of packets in this vector
+     */
+    inline unsigned count() const {
+        return _count;
+    }
+
+    inline bool empty() const {
+        return _count == 0;
+    }
+
+    inline bool full() const {
+        return _count == capacity;
+    }
+
+    /**
+     * Set the number of packets, for code that writes the array directly
+     */
+    inline void set_count(unsigned c) {
+        assert(c <= capacity);
+        _count = c;
+    }
+
+    inline Packet *&operator[](unsigned i) {
+        return _packets[i];
+    }
+
+    inline Packet *operator[](unsigned i) const {
+        return _packets[i];
+    }
+
+    inline Packet **begin() {
+        return _packets;
+    }
+
+    inline Packet **end() {
+        return _packets + _count;
+    }
+
+    /**
+     * Append a packet. The vector must not be full().
+     */
+    inline void push_back(Packet *p) {
+        assert(_count < capacity);
+        _packets[_count++] = p;
+    }
+
+    /**
+     * Forget all packets, without killing them
+     */
+    inline void clear() {
+        _count = 0;
+    }
+
+    /**
+     * @brief Move the packets of a batch to the end of this vector
+     *
+     * @param batch A batch, or null
+     *
+     * @return The packets that did not fit, as a batch, or null
+     */
+    inline PacketBatch *append_batch(PacketBatch *batch);
+
+    /**
+     * @brief Link the packets into a batch and empty this vector
+     *
+     * @return The batch, or null if the vector was empty
+     */
+    inline PacketBatch *make_batch();
+
+    /**
+     * Remove null entries, keeping the order of the other packets
+     */
+    inline void compact();
+
+    /**
+     * Kill all packets and empty this vector
+     */
+    inline void kill();
+
+    /**
+     * Prefetch the packet descriptor at index @a i, for writing
+     */
+    inline void prefetch(unsigned i) const {
+#ifdef __GNUC__
+        if (i < _count)
+            __builtin_prefetch(_packets[i], 1);
+#else
+        (void) i;
+#endif
+    }
+
+    /**
+     * Prefetch the first data bytes of the packet at index @a i. Its
+     *  descriptor should already be in the cache.
+     */
+    inline void prefetch_data(unsigned i) const {
+#ifdef __GNUC__
+        if (i < _count)
+            __builtin_prefetch(_packets[i]->data());
+#else
+        (void) i;
+#endif
+    }
+
+    /**
+     * Start prefetching for a loop that will call prefetch_ahead()
+     */
+    inline void prefetch_start(unsigned ahead) const {
+        for (unsigned i = 0; i < 2 * ahead; ++i)
+            prefetch(i);
+        for (unsigned i = 0; i < ahead; ++i)
+            prefetch_data(i);
+    }
+
+    /**
+     * Prefetch for a loop that just handled index @a i
+     */
+    inline void prefetch_ahead(unsigned i, unsigned ahead) const {
+        prefetch(i + 1 + 2 * ahead);
+        prefetch_data(i + 1 + ahead);
+    }
+
+  private:
+
+    Packet *_packets[capacity];
+    unsigned _count;
+
+};
+
+inline PacketBatch *PacketVector::append_batch(PacketBatch *batch) {
+    if (!batch)
+        return 0;
+    unsigned n = batch->count();
+    Packet *p = batch;
+    while (p && _count < capacity) {
+        _packets[_count++] = p;
+        p = p->next();
+        --n;
+    }
+    if (!p)
+        return 0;
+    PacketBatch *rest = PacketBatch::start_head(p);
+    rest->set_tail(batch->tail());
+    rest->set_count(n);
+    return rest;
+}
+
+inline PacketBatch *PacketVector::make_batch() {
+    if (!_count)
+        return 0;
+    for (unsigned i = 0; i + 1 < _count; ++i)
+        _packets[i]->set_next(_packets[i + 1]);
+    PacketBatch *batch = PacketBatch::make_from_simple_list(_packets[0], _packets[_count - 1], _count);
+    _count = 0;
+    return batch;
+}
+
+inline void PacketVector::compact() {
+    unsigned w = 0;
+    for (unsigned r = 0; r < _count; ++r)
+        if (_packets[r])
+            _packets[w++] = _packets[r];
+    _count = w;
+}
+
+inline void PacketVector::kill() {
+    for (unsigned i = 0; i < _count; ++i)
+        _packets[i]->kill();
+    _count = 0;
+}
+
+/**
+ * Iterator over a PacketVector, for FOR_EACH_PACKET. It stops at the end of
+ * the vector or at the first null entry.
+ */
+class PacketVectorIterator { public:
+    inline PacketVectorIterator(PacketVector &vec)
+        : _it(vec.begin()), _end(vec.end()) {
+    }
+    inline Packet* get() const {
+        return _it != _end ? *_it : 0;
+    }
+    inline void advance() {
+        ++_it;
+    }
+  private:
+    Packet** _it;
+    Packet** _end;
+};
+
+inline PacketVectorIterator packet_iterator(PacketVector &vec) {
+    return PacketVectorIterator(vec);
+}
+
+/**
+ * Implementation of CLASSIFY_EACH_PACKET for a batch. Runs of packets
+ * going to the same output are linked as they are.
+ */
+template <typename F, typename G>
+inline void classify_each_packet(int nbatches, F fnt, PacketBatch* batch, G on_finish) {
+    PacketBatch* out[nbatches];
+    bzero(out,sizeof(PacketBatch*)*nbatches);
+    PacketBatch* next = ((batch != NULL)? static_cast<PacketBatch*>(batch->next()) : NULL );
+    PacketBatch* p = batch;
+    PacketBatch* last = NULL;
+    int last_o = -1;
+    int passed = 0;
+    for (;p != NULL;p=next,next=(p==0?0:static_cast<PacketBatch*>(p->next()))) {
+        int o = (fnt(p));
+        if (o < 0 || o>=(nbatches)) o = (nbatches - 1);
+        if (o == last_o) {
+            passed ++;
+        } else {
+            if (last == NULL) {
+                out[o] = p;
+                p->set_count(1);
+                p->set_tail(p);
+            } else {
+                out[last_o]->set_tail(last);
+                out[last_o]->set_count(out[last_o]->count() + passed);
+                if (!out[o]) {
+                    out[o] = p;
+                    out[o]->set_count(1);
+                    out[o]->set_tail(p);
+                } else {
+                    out[o]->append_packet(p);
+                }
+                passed = 0;
+            }
+        }
+        last = p;
+        last_o = o;
+    }
+
+    if (passed) {
+        out[last_o]->set_tail(last);
+        out[last_o]->set_count(out[last_o]->count() + passed);
+    }
+
+    for (int i = 0; i < nbatches; i++) {
+        if (out[i]) {
+            out[i]->tail()->set_next(NULL);
+            on_finish(i,out[i]);
+        }
+    }
+}
+
+/**
+ * Implementation of CLASSIFY_EACH_PACKET for a PacketVector, which is left
+ * empty. Out of range indexes choose the last output, as for a batch.
+ */
+template <typename F, typename G>
+inline void classify_each_packet(int nbatches, F fnt, PacketVector &vec, G on_finish) {
+    Packet* head[nbatches];
+    Packet* tail[nbatches];
+    unsigned n[nbatches];
+    bzero(head,sizeof(Packet*)*nbatches);
+    bzero(n,sizeof(unsigned)*nbatches);
+    for (Packet** it = vec.begin(); it != vec.end(); ++it) {
+        Packet* p = *it;
+        int o = fnt(p);
+        if (o < 0 || o>=(nbatches)) o = (nbatches - 1);
+        if (head[o])
+            tail[o]->set_next(p);
+        else
+            head[o] = p;
+        tail[o] = p;
+        n[o]++;
+    }
+    vec.clear();
+    for (int i = 0; i < nbatches; i++)
+        if (head[i])
+            on_finish(i,PacketBatch::make_from_simple_list(head[i],tail[i],n[i]));
+}
+
 typedef Packet::PacketType PacketType;
 
 CLICK_ENDDECLS
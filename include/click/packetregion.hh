@@ -0,0 +1,149 @@
+// -*- c-basic-offset: 4; related-file-name: "../../lib/packetregion.cc" -*-
+#ifndef CLICK_PACKETREGION_HH
+#define CLICK_PACKETREGION_HH
+#include <click/packet.hh>
+#include <click/sync.hh>
+#include <click/vector.hh>
+#if HAVE_CLICK_PACKET_POOL && CLICK_USERLEVEL && !HAVE_DPDK_PACKET_POOL && !HAVE_NETMAP_PACKET_POOL
+# define HAVE_CLICK_PACKET_REGION 1
+#endif
+CLICK_DECLS
+class ErrorHandler;
+class String;
+
+/** @file <click/packetregion.hh>
+ * @brief Huge-page backed memory for packet data buffers. */
+
+#if HAVE_CLICK_PACKET_REGION
+/** @class PacketRegion
+ * @brief A region of memory from which packet data buffers are carved.
+ *
+ * By default, the user-level packet pool gets data buffers from the regular
+ * allocator, so buffers end up scattered across many small pages and a
+ * router forwarding millions of packets per second spends a noticeable part
+ * of its time on TLB misses.  When the driver initializes a PacketRegion at
+ * startup (<tt>click --packet-memory</tt>), the data buffers of the packet
+ * pool are instead carved from one mapping, backed by the largest huge pages
+ * (1GB or 2MB) no larger than the region that hugetlbfs has reserved, and
+ * otherwise by normal pages advised toward transparent huge pages.
+ *
+ * All buffers are buffer_size bytes long.  Each thread allocates from and
+ * frees to its own cache; a thread whose cache grows long moves a batch of
+ * buffers to a shared depot, from which other threads take whole batches, so
+ * buffers freed on another thread cost one lock per batch.  Unused parts of
+ * the region are carved up in batches on demand, so pages are first touched,
+ * and on NUMA systems placed, by the thread that uses them.
+ *
+ * When the region is exhausted, allocate() returns null and Packet falls back
+ * to the regular allocator.  Packet recognizes region buffers by address when
+ * they are freed. */
+class PacketRegion { public:
+
+    enum {
+	buffer_size = 2048	///< Size of every buffer in the region
+    };
+
+    /** @brief Map a region of at least @a bytes bytes and start carving
+     * packet buffers from it.
+     * @return 0 on success, or a negative error code
+     *
+     * Call at most once, after the number of threads is known and before
+     * any packets are made. */
+    static int initialize(size_t bytes, ErrorHandler *errh);
+
+    /** @brief Return true iff the region has been initialized. */
+    static bool enabled() {
+	return _begin;
+    }
+    /** @brief Return true iff @a p points into the region. */
+    static bool contains(const void *p) {
+	return p >= _begin && p < _end;
+    }
+
+    /** @brief Allocate a buffer, or return null if the region is exhausted
+     * or not enabled. */
+    static inline unsigned char *allocate();
+    /** @brief Free a buffer returned by allocate().
+     * @pre contains(@a p) */
+    static inline void deallocate(unsigned char *p);
+
+    /** @brief Region utilization. */
+    struct Stats {
+	uint64_t buffers;	///< Buffers the region holds
+	uint64_t in_use;	///< Buffers allocated and not yet freed
+	uint64_t bytes;		///< Size of the region
+	size_t page_size;	///< Page size backing the region
+	bool huge_pages;	///< True iff backed by hugetlbfs pages
+	uint64_t exhausted;	///< Allocations the region could not serve
+
+	/** @brief Unparse as "name value" lines, for a handler. */
+	String unparse() const;
+    };
+
+    /** @brief Return the region's current utilization.
+     *
+     * Buffers kept by the packet pool for reuse count as in use.  Threads
+     * update their caches unlocked, so in_use and exhausted are
+     * approximate. */
+    static Stats stats();
+
+  private:
+
+    struct link {
+	link *next;
+    };
+
+    struct CLICK_CACHE_ALIGN cache {
+	link *free;
+	unsigned nfree;
+	uint64_t exhausted;
+    };
+
+    enum {
+	batch = 64
+    };
+
+    static unsigned char *_begin;
+    static unsigned char *_end;
+    static unsigned char *_carve;
+    static cache *_caches;
+    static unsigned _ncaches;
+    static SimpleSpinlock _lock;
+    static Vector<link *> _depot;
+    static size_t _page_size;
+    static bool _huge_pages;
+
+    static unsigned char *hard_allocate(cache &c);
+    static void flush(cache &c);
+
+};
+
+
+inline unsigned char *
+PacketRegion::allocate()
+{
+    if (!_begin)
+	return 0;
+    cache &c = _caches[click_current_cpu_id()];
+    if (link *l = c.free) {
+	c.free = l->next;
+	--c.nfree;
+	return reinterpret_cast<unsigned char *>(l);
+    } else
+	return hard_allocate(c);
+}
+
+inline void
+PacketRegion::deallocate(unsigned char *p)
+{
+    cache &c = _caches[click_current_cpu_id()];
+    link *l = reinterpret_cast<link *>(p);
+    l->next = c.free;
+    c.free = l;
+    if (++c.nfree >= 2 * batch)
+	flush(c);
+}
+#endif
+
+CLICK_ENDDECLS
+#endif
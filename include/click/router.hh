@@ -15,6 +15,7 @@ class ElementFilter;
 class RouterVisitor;
 class RouterThread;
 class HashMap_ArenaFactory;
+class Notifier;
 class NotifierSignal;
 class ThreadSched;
 class Handler;
@@ -95,6 +96,12 @@ class Router { public:
     inline bool is_fullpush() const;
     inline void non_fullpush();
 
+    // PROFILING
+    inline bool profiling() const;
+    void set_profiling(bool on);
+    void reset_profile();
+    void unparse_profile(StringAccum &sa) const;
+
     /** @cond never */
     // Needs to be public for NameInfo, but not useful outside
     inline NameInfo* name_info() const;
@@ -132,6 +139,7 @@ class Router { public:
 
     inline Router* hotswap_router() const;
     void set_hotswap_router(Router* router);
+    int hotswap_in_place(Router* r, ErrorHandler* errh);
 
     int initialize(ErrorHandler* errh);
     void activate(bool foreground, ErrorHandler* errh);
@@ -140,6 +148,7 @@ class Router { public:
 
     int new_notifier_signal(const char *name, NotifierSignal &signal);
     String notifier_signal_name(const atomic_uint32_t *signal) const;
+    void add_notifier_search(Element *e, bool isoutput, int port, const char *name, void (*f)(void *, Notifier *), void *user_data);
     //@}
 
     /** @cond never */
@@ -291,10 +300,24 @@ class Router { public:
         }
     };
     notifier_signals_t *_notifier_signals;
+
+    struct notifier_search_t {
+        Element *e;
+        bool isoutput;
+        int port;
+        const char *name;
+        void (*f)(void *, Notifier *);
+        void *user_data;
+    };
+    Vector<notifier_search_t> _notifier_searches;
+#if HAVE_BATCH
+    Vector<int> _element_batch_modes;
+#endif
     HashMap_ArenaFactory* _arena_factory;
     Router* _hotswap_router;
     ThreadSched* _thread_sched;
     bool _is_fullpush;
+    bool _profiling;
     mutable NameInfo* _name_info;
     Vector<int> _flow_code_override_eindex;
     Vector<String> _flow_code_override;
@@ -315,11 +338,22 @@ class Router { public:
     int check_hookup_range(ErrorHandler*);
     int check_hookup_completeness(ErrorHandler*);
 
+    int configure_element(int i, Vector<String> &conf, ErrorHandler *errh);
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+    struct ParallelConfigure;
+    int configure_parallel(int ord, Vector<int> &element_stage, ErrorHandler *errh);
+    static void *configure_parallel_thread(void *thunk);
+#endif
+
     const char *hard_flow_code_override(int e) const;
     int processing_error(const Connection &conn, bool, int, ErrorHandler*);
     int check_push_and_pull(ErrorHandler*);
 
     void set_connections();
+#if HAVE_BATCH
+    void set_batch_modes();
+    void bind_ports();
+#endif
     void sort_connections() const;
     int connindex_lower_bound(bool isoutput, const Port &port) const;
 
@@ -331,6 +365,13 @@ class Router { public:
 
     int hard_home_thread_id(const Element *e) const;
 
+    struct Hotswap;
+    bool hotswap_match(Hotswap &hs);
+    int hotswap_install(Hotswap &hs, ErrorHandler *errh);
+    int hotswap_rollback(Hotswap &hs, int result);
+    void hotswap_commit(Hotswap &hs, ErrorHandler *errh);
+    static inline void reattach(Element *e, Router *r, int eindex);
+
     int element_lerror(ErrorHandler*, Element*, const char*, ...) const;
 
     // private handler methods
@@ -341,6 +382,7 @@ class Router { public:
     void store_local_handler(int eindex, Handler &h);
     static void store_global_handler(Handler &h);
     static inline void store_handler(const Element *element, Handler &h);
+    void compact_ehandlers();
 
     // global handlers
     static String router_read_handler(Element *e, void *user_data);
@@ -490,6 +532,14 @@ Router::non_fullpush() {
     _is_fullpush = false;
 }
 
+/** @brief  Return true iff the router's elements are being profiled.
+ *  @sa set_profiling */
+inline bool
+Router::profiling() const
+{
+    return _profiling;
+}
+
 /** @cond never */
 /** @brief  Return the NameInfo object for this router, if it exists.
  *
@@ -0,0 +1,73 @@
+// -*- c-basic-offset: 4; related-file-name: "../../lib/routerimage.cc" -*-
+#ifndef CLICK_ROUTERIMAGE_HH
+#define CLICK_ROUTERIMAGE_HH
+#include <click/string.hh>
+#include <click/vector.hh>
+CLICK_DECLS
+class ErrorHandler;
+
+/** @file <click/routerimage.hh>
+ * @brief Class for precompiled router configurations. */
+
+/** @class RouterImage
+ * @brief A flattened, checked router configuration in binary form.
+ *
+ * A RouterImage holds everything a driver needs to build a Router without
+ * running the Lexer: the configuration's requirements, its primitive
+ * elements with their configuration strings and landmarks, and its
+ * connections.  The click-precompile tool flattens and type-checks a
+ * configuration and writes it as an image; the user-level driver recognizes
+ * images by their magic number and loads them directly.
+ *
+ * Each element also records the processing code the element map gave its
+ * class when the image was written, so a driver can notice images made for
+ * different element definitions.  The flattened configuration text is kept
+ * as well, for the router's <tt>config</tt> handler.
+ *
+ * Images are versioned; parse() rejects versions it does not understand.
+ * All integers are stored as 32-bit big-endian values, and strings as a
+ * length followed by their bytes. */
+struct RouterImage {
+
+    enum { version = 1 };
+
+    struct Element {
+	String name;		///< Element name
+	String class_name;	///< Element class name (always primitive)
+	String configuration;	///< Configuration string, variables expanded
+	String filename;	///< Landmark file name
+	unsigned lineno;	///< Landmark line number
+	String processing;	///< Class processing code, or empty if unknown
+    };
+
+    struct Connection {
+	int from;		///< Source element index
+	int from_port;		///< Source output port
+	int to;			///< Destination element index
+	int to_port;		///< Destination input port
+    };
+
+    Vector<String> requirements; ///< Requirement (type, value) pairs
+    Vector<Element> elements;	///< Elements, in element index order
+    Vector<Connection> connections; ///< Connections
+    String configuration;	///< Flattened configuration text
+
+    /** @brief Return true iff @a str starts with a router image's magic
+     * number. */
+    static bool is_image(const String &str);
+
+    /** @brief Parse a router image.
+     * @param str image string
+     * @param errh error message receiver
+     * @return 0 on success, < 0 on failure
+     *
+     * The parsed strings share @a str's memory. */
+    int parse(const String &str, ErrorHandler *errh = 0);
+
+    /** @brief Unparse this image into a string suitable for parse(). */
+    String unparse() const;
+
+};
+
+CLICK_ENDDECLS
+#endif
@@ -0,0 +1,205 @@
+// -*- c-basic-offset: 4; related-file-name: "../../lib/slaballocator.cc" -*-
+#ifndef CLICK_SLABALLOCATOR_HH
+#define CLICK_SLABALLOCATOR_HH
+#include <click/glue.hh>
+#include <click/sync.hh>
+#include <click/vector.hh>
+#if HAVE_VALGRIND && HAVE_VALGRIND_MEMCHECK_H
+# include <valgrind/memcheck.h>
+#endif
+CLICK_DECLS
+class String;
+
+/** @file <click/slaballocator.hh>
+ * @brief Per-thread slab allocator for fixed-size flow state. */
+
+/** @class SlabAllocator
+ * @brief A per-thread slab allocator for many fixed-size objects.
+ *
+ * SlabAllocator hands out objects of one size, like HashAllocator, but is
+ * meant for elements holding millions of flows.  Each thread allocates from
+ * its own cache: a free list, one spare full batch of free objects, and a
+ * region of the slab it is carving up, so the common allocate() and
+ * deallocate() touch no shared state.  When a thread's free list fills a
+ * batch, it becomes the spare, and any previous spare moves to a shared
+ * depot, where any thread that runs out can take the whole batch back;
+ * objects freed by a timer on one thread and allocated again by another
+ * therefore cost one lock per batch, not one per object.  A thread that only
+ * allocates from its own slab or spare takes no lock at all.
+ *
+ * Slabs grow geometrically per thread, starting small so that quiet elements
+ * stay cheap.  At user level, slabs of huge page size are mapped with huge
+ * pages when the system has them reserved, and advised toward transparent
+ * huge pages otherwise, which cuts TLB misses for large flow tables.  Slabs
+ * are first touched by the thread that carves them up, so on NUMA systems
+ * they are placed on that thread's node.  Memory is returned to the system
+ * only when the allocator is destroyed.
+ *
+ * The per-thread caches are sized by click_max_cpu_ids() at construction,
+ * so a SlabAllocator must be constructed after the thread count is known,
+ * as element members are.  Objects must be at least a pointer in size.
+ *
+ * On one thread, allocate() and deallocate() cost a thread-local lookup
+ * more than HashAllocator's, but reach shared state only when a whole batch
+ * moves.
+ *
+ * stats() reports the allocator's memory use; elements export it in a
+ * <tt>memory</tt> read handler. */
+class SlabAllocator { public:
+
+    /** @brief Construct an allocator for objects of @a size bytes. */
+    SlabAllocator(size_t size);
+    ~SlabAllocator();
+
+    /** @brief Increase the object size to @a new_size.
+     * @pre No objects have been allocated. */
+    void increase_size(size_t new_size);
+
+    /** @brief Return the object size. */
+    size_t size() const {
+	return _size;
+    }
+
+    /** @brief Allocate an object, or return null if memory is exhausted. */
+    inline void *allocate();
+    /** @brief Free an object returned by allocate(). Null is ignored. */
+    inline void deallocate(void *p);
+
+    void swap(SlabAllocator &x);
+
+    /** @brief Memory accounting for one or more allocators. */
+    struct Stats {
+	uint64_t objects;	///< Objects allocated and not yet freed
+	uint64_t object_bytes;	///< Bytes in those objects
+	uint64_t reserved_bytes; ///< Bytes in all slabs
+	unsigned slabs;		///< Number of slabs
+	unsigned huge_slabs;	///< Number of slabs backed by huge pages
+
+	Stats()
+	    : objects(0), object_bytes(0), reserved_bytes(0),
+	      slabs(0), huge_slabs(0) {
+	}
+	/** @brief Unparse as "name value" lines, for a handler. */
+	String unparse() const;
+    };
+
+    /** @brief Add this allocator's memory use to @a stats. */
+    void stats(Stats &stats) const;
+
+  private:
+
+    struct link {
+	link *next;
+    };
+
+    struct slab {
+	slab *next;
+	size_t length;
+	int kind;
+    };
+
+    struct CLICK_CACHE_ALIGN cache {
+	link *free;
+	unsigned nfree;
+	link *spare;		// a full batch, or null
+	char *pos;		// carving region of the current slab
+	char *end;
+	char *begin;
+	size_t carved;		// objects carved from earlier slabs
+	size_t slab_size;
+    };
+
+    struct pool {
+	SimpleSpinlock lock;
+	Vector<link *> depot;
+	slab *slabs;
+	uint64_t reserved_bytes;
+	unsigned nslabs;
+	unsigned nhuge_slabs;
+    };
+
+    enum {
+	min_slab_size = 4096,
+#if CLICK_USERLEVEL
+	huge_slab_size = 2097152,
+#else
+	huge_slab_size = 16384,
+#endif
+	min_batch = 8,
+	max_batch = 256
+    };
+
+    size_t _size;
+    unsigned _batch;
+    cache *_caches;
+    unsigned _ncaches;
+    pool *_pool;
+
+    inline cache &my_cache() const;
+    void *hard_allocate(cache &c);
+    void flush(cache &c);
+    void *new_slab(size_t length, int &kind);
+    static void free_slab(slab *s);
+
+    SlabAllocator(const SlabAllocator &x);
+    SlabAllocator &operator=(const SlabAllocator &x);
+
+};
+
+
+template <size_t object_size>
+class SizedSlabAllocator : public SlabAllocator { public:
+
+    SizedSlabAllocator()
+	: SlabAllocator(object_size) {
+    }
+
+};
+
+
+inline SlabAllocator::cache &SlabAllocator::my_cache() const
+{
+    return _caches[click_current_cpu_id()];
+}
+
+inline void *SlabAllocator::allocate()
+{
+    cache &c = my_cache();
+    if (link *l = c.free) {
+#ifdef VALGRIND_MEMPOOL_ALLOC
+	VALGRIND_MEMPOOL_ALLOC(_pool, l, _size);
+	VALGRIND_MAKE_MEM_DEFINED(&l->next, sizeof(l->next));
+#endif
+	c.free = l->next;
+#ifdef VALGRIND_MAKE_MEM_DEFINED
+	VALGRIND_MAKE_MEM_UNDEFINED(&l->next, sizeof(l->next));
+#endif
+	--c.nfree;
+	return l;
+    } else if (c.pos != c.end) {
+	void *data = c.pos;
+	c.pos += _size;
+#ifdef VALGRIND_MEMPOOL_ALLOC
+	VALGRIND_MEMPOOL_ALLOC(_pool, data, _size);
+#endif
+	return data;
+    } else
+	return hard_allocate(c);
+}
+
+inline void SlabAllocator::deallocate(void *p)
+{
+    if (p) {
+	cache &c = my_cache();
+	reinterpret_cast<link *>(p)->next = c.free;
+	c.free = reinterpret_cast<link *>(p);
+#ifdef VALGRIND_MEMPOOL_FREE
+	VALGRIND_MEMPOOL_FREE(_pool, p);
+#endif
+	if (++c.nfree == _batch)
+	    flush(c);
+    }
+}
+
+CLICK_ENDDECLS
+#endif
@@ -118,6 +118,13 @@ Timestamp operator+(Timestamp, const Timestamp &);
 # define TIMESTAMP_WARPABLE 1
 #endif
 
+// TIMESTAMP_TSC is defined if this Timestamp implementation can read the
+// time from the CPU's timestamp counter; see Timestamp::now_tsc().
+
+#if CLICK_USERLEVEL && !CLICK_TOOL && !CLICK_NS && HAVE_INT64_TYPES && (__x86_64__ || __i386__)
+# define TIMESTAMP_TSC 1
+#endif
+
 #if HAVE_USER_TIMESTAMP
 typedef int64_t (*user_clock_fct)(void* user, bool steady);
 #endif
@@ -500,6 +507,99 @@ class Timestamp { public:
     inline void assign_now_nouser(bool steady);
 
 
+    /** @brief Return the current system time as read from the cycle counter.
+     *
+     * Like now(), but computed from the CPU's timestamp counter, which is
+     * several times cheaper than a clock_gettime() call.  The driver
+     * re-anchors the counter to the system clocks about once a second, so
+     * steps and frequency adjustments of the system clock (for instance by
+     * NTP) show up within a second.  Between re-anchors the result may
+     * differ from now() by a few microseconds.  Use it for per-packet
+     * timestamps on the data path; use now() where exact agreement with
+     * other hosts' clocks matters.
+     *
+     * Returns now() if the cycle counter is unusable (it is not invariant
+     * across CPU frequency changes, or calibration has not finished), or if
+     * timewarping is active.
+     * @sa now_steady_tsc(), recent_tsc() */
+    static inline Timestamp now_tsc();
+
+    /** @brief Return the current steady-clock time as read from the cycle
+     * counter.
+     *
+     * Like now_tsc(), but for the steady clock; see now_steady().  At a
+     * re-anchor the result does not jump; instead, its rate is adjusted so
+     * that it catches up with the steady clock over the next second, so it
+     * does not jump backwards. */
+    static inline Timestamp now_steady_tsc();
+
+    /** @brief Return the cycle-counter system time cached by this thread.
+     *
+     * Each RouterThread calls refresh_recent_tsc() once per scheduling
+     * iteration, so for code running in tasks and timers, recent_tsc()
+     * costs a thread-local load and is at most one iteration old.  Read it
+     * once per batch, not once per packet.  A thread that has never
+     * refreshed its cache gets now_tsc().
+     * @sa now_tsc(), refresh_recent_tsc() */
+    static inline Timestamp recent_tsc();
+
+    /** @brief Return the cycle-counter steady-clock time cached by this
+     * thread.
+     * @sa recent_tsc(), now_steady_tsc() */
+    static inline Timestamp recent_steady_tsc();
+
+    /** @brief Update this thread's recent_tsc() and recent_steady_tsc()
+     * cache from the cycle counter. */
+    static inline void refresh_recent_tsc();
+
+#if TIMESTAMP_TSC
+    /** @brief Start calibrating the cycle-counter clock.
+     *
+     * Samples the cycle counter and the system clocks.  A later
+     * tsc_calibrate_poll() measures the cycle counter's rate over the
+     * elapsed interval and enables the cycle-counter clock.  The driver
+     * starts calibration at startup, and its threads poll it, so startup
+     * never waits for calibration. */
+    static void tsc_calibrate_start();
+
+    /** @brief Return true iff tsc_calibrate_poll() has work to do.
+     *
+     * Cheap enough to call from every iteration of a driver loop. */
+    static inline bool tsc_calibrate_due();
+
+    /** @brief Finish calibrating or re-anchor the cycle-counter clock, if
+     * due.
+     * @return true iff the cycle-counter clock is active
+     *
+     * Finishes calibration once at least 10 milliseconds have passed since
+     * tsc_calibrate_start().  After that, re-anchors the clock to the
+     * system clocks, and re-measures the counter's rate, once a second.
+     * Each new calibration is published through a pointer, so readers
+     * always see a consistent set of values.  Any thread may call this
+     * function; only one does the work at a time. */
+    static bool tsc_calibrate_poll();
+
+    /** @brief Calibrate the cycle-counter clock, waiting for the result.
+     * @return true iff the cycle-counter clock is active
+     *
+     * Like tsc_calibrate_start(), then spinning until tsc_calibrate_poll()
+     * can finish. */
+    static bool tsc_calibrate();
+
+    /** @brief Return the calibrated cycle-counter frequency in Hz, or 0 if
+     * the cycle-counter clock is unusable. */
+    static inline click_cycles_t tsc_hz();
+
+    /** @brief Convert a number of cycles to nanoseconds.
+     * @pre tsc_hz() != 0 */
+    static inline value_type cycles_to_nsec(click_cycles_t cycles);
+
+    /** @brief Convert a number of nanoseconds to cycles.
+     * @pre tsc_hz() != 0 */
+    static inline click_cycles_t nsec_to_cycles(value_type nsec);
+#endif
+
+
     /** @brief Unparse this timestamp into a String.
      *
      * Returns a string formatted like "10.000000", with at least six
@@ -729,6 +829,11 @@ class Timestamp { public:
     }
 
     inline void assign_now(bool recent, bool steady, bool unwarped, bool no_user = false);
+#if TIMESTAMP_TSC
+    static inline bool tsc_usable();
+    static bool tsc_anchor();
+    static inline Timestamp recent_tsc(bool steady);
+#endif
 
 #if TIMESTAMP_WARPABLE
     static inline void warp_adjust(bool steady, const Timestamp &t_raw, const Timestamp &t_warped);
@@ -776,6 +881,39 @@ inline Timestamp Timestamp::warped(bool steady) const {
 }
 #endif
 
+#if TIMESTAMP_TSC
+/** @cond never */
+class TimestampTSC {
+    struct calibration {
+        click_cycles_t hz;
+        double nsec_per_cycle;
+        click_cycles_t base_cycles;
+        int64_t base_nsec[2];	// system, steady
+
+        inline int64_t nsec(click_cycles_t c, bool steady) const {
+            return base_nsec[steady]
+                + (int64_t) ((int64_t) (c - base_cycles) * nsec_per_cycle);
+        }
+    };
+    enum { ncal = 4 };
+    // Readers load 'active' once.  Each re-anchor fills in the next entry
+    // of 'cal' before publishing it there, so an entry is rewritten only
+    // after ncal - 1 more re-anchors, several seconds later.
+    static const calibration * volatile active;
+    static calibration cal[ncal];
+    static calibration sample;		// last reading of the system clocks
+    static volatile click_cycles_t next_cycles;	// when poll is next due
+    static bool calibrating;
+# if HAVE___THREAD_STORAGE_CLASS
+    static __thread int64_t recent_nsec[2];
+# else
+    static int64_t recent_nsec[2];
+# endif
+    friend class Timestamp;
+};
+/** @endcond never */
+#endif
+
 
 /** @brief Create a Timestamp measuring @a tv.
     @param tv timeval structure */
@@ -1032,6 +1170,112 @@ Timestamp::now_steady_unwarped()
 }
 #endif
 
+#if TIMESTAMP_TSC
+inline bool
+Timestamp::tsc_usable()
+{
+    return true
+# if TIMESTAMP_WARPABLE
+        && !TimestampWarp::kind
+# endif
+# if HAVE_USER_TIMESTAMP
+        && !_user_clock
+# endif
+        ;
+}
+
+inline Timestamp
+Timestamp::recent_tsc(bool steady)
+{
+    int64_t nsec = TimestampTSC::recent_nsec[steady];
+    if (nsec && TimestampTSC::active && tsc_usable())
+        return make_nsec(nsec);
+    else if (steady)
+        return now_steady_tsc();
+    else
+        return now_tsc();
+}
+
+inline bool
+Timestamp::tsc_calibrate_due()
+{
+    return click_get_cycles() >= TimestampTSC::next_cycles;
+}
+
+inline click_cycles_t
+Timestamp::tsc_hz()
+{
+    const TimestampTSC::calibration *c = TimestampTSC::active;
+    return c ? c->hz : 0;
+}
+
+inline Timestamp::value_type
+Timestamp::cycles_to_nsec(click_cycles_t cycles)
+{
+    return (value_type) (cycles * TimestampTSC::active->nsec_per_cycle);
+}
+
+inline click_cycles_t
+Timestamp::nsec_to_cycles(value_type nsec)
+{
+    return (click_cycles_t) (nsec / TimestampTSC::active->nsec_per_cycle);
+}
+#endif
+
+inline Timestamp
+Timestamp::now_tsc()
+{
+#if TIMESTAMP_TSC
+    const TimestampTSC::calibration *c = TimestampTSC::active;
+    if (c && tsc_usable())
+        return make_nsec(c->nsec(click_get_cycles(), false));
+#endif
+    return now();
+}
+
+inline Timestamp
+Timestamp::now_steady_tsc()
+{
+#if TIMESTAMP_TSC
+    const TimestampTSC::calibration *c = TimestampTSC::active;
+    if (c && tsc_usable())
+        return make_nsec(c->nsec(click_get_cycles(), true));
+#endif
+    return now_steady();
+}
+
+inline Timestamp
+Timestamp::recent_tsc()
+{
+#if TIMESTAMP_TSC
+    return recent_tsc(false);
+#else
+    return recent();
+#endif
+}
+
+inline Timestamp
+Timestamp::recent_steady_tsc()
+{
+#if TIMESTAMP_TSC
+    return recent_tsc(true);
+#else
+    return recent_steady();
+#endif
+}
+
+inline void
+Timestamp::refresh_recent_tsc()
+{
+#if TIMESTAMP_TSC
+    if (const TimestampTSC::calibration *c = TimestampTSC::active) {
+        click_cycles_t cycles = click_get_cycles();
+        TimestampTSC::recent_nsec[0] = c->nsec(cycles, false);
+        TimestampTSC::recent_nsec[1] = c->nsec(cycles, true);
+    }
+#endif
+}
+
 /** @brief Set this timestamp's seconds component.
 
     The subseconds component is left unchanged. */
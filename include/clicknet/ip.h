@@ -137,6 +137,30 @@ uint16_t click_in_cksum_pseudohdr_raw(uint32_t csum, uint32_t src, uint32_t dst,
 		csum_tcpudp_magic((src), (dst), (transport_len), (proto), ~(csum) & 0xFFFF)
 #endif
 uint16_t click_in_cksum_pseudohdr_hard(uint32_t csum, const struct click_ip *iph, int packet_len);
+
+/** @brief Calculate the checksum of an IP header.
+ * @param iph IP header
+ *
+ * Returns the same value as click_in_cksum((const unsigned char *) iph,
+ * iph->ip_hl << 2), but the common 20-byte header is summed without a loop.
+ * @a iph must be two-byte aligned and @a iph->ip_hl must be at least 5.
+ * The result is 0 for a header with a correct checksum. */
+static inline uint16_t
+click_in_cksum_iphdr(const struct click_ip *iph)
+{
+#if CLICK_LINUXMODULE
+    return ip_fast_csum((unsigned char *) iph, iph->ip_hl);
+#else
+    const uint16_t *w = (const uint16_t *) iph;
+    uint32_t sum = (uint32_t) w[0] + w[1] + w[2] + w[3] + w[4]
+	+ w[5] + w[6] + w[7] + w[8] + w[9];
+    const uint16_t *end = w + (iph->ip_hl << 1);
+    for (w += 10; w < end; w += 2)
+	sum += (uint32_t) w[0] + w[1];
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    return ~(sum + (sum >> 16)) & 0xFFFF;
+#endif
+}
 void click_update_zero_in_cksum_hard(uint16_t *csum, const unsigned char *addr, int len);
 
 /** @brief Adjust an Internet checksum according to a pseudoheader.
@@ -302,6 +302,12 @@ ArgContext::error_prefix() const
 void
 ArgContext::error(const char *fmt, ...) const
 {
+    // Parsers often probe with a null ErrorHandler; don't format messages
+    // no one will see.
+    if (!_errh) {
+        _read_status = false;
+        return;
+    }
     va_list val;
     va_start(val, fmt);
     xmessage(ErrorHandler::e_error, fmt, val);
@@ -311,6 +317,8 @@ ArgContext::error(const char *fmt, ...) const
 void
 ArgContext::warning(const char *fmt, ...) const
 {
+    if (!_errh)
+        return;
     va_list val;
     va_start(val, fmt);
     xmessage(ErrorHandler::e_warning_annotated, fmt, val);
@@ -320,6 +328,8 @@ ArgContext::warning(const char *fmt, ...) const
 void
 ArgContext::message(const char *fmt, ...) const
 {
+    if (!_errh)
+        return;
     va_list val;
     va_start(val, fmt);
     xmessage(ErrorHandler::e_info, fmt, val);
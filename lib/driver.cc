@@ -57,6 +57,9 @@
 # include <click/nameinfo.hh>
 # include <click/bighashmap_arena.hh>
 #endif
+#if CLICK_USERLEVEL
+# include <click/routerimage.hh>
+#endif
 
 #if HAVE_DYNAMIC_LINKING && !CLICK_LINUXMODULE && !CLICK_BSDMODULE
 # define CLICK_PACKAGE_LOADED   1
@@ -439,6 +442,9 @@ read_handler(Element *, void *thunk)
 void
 click_static_initialize()
 {
+#if TIMESTAMP_TSC
+    Timestamp::tsc_calibrate_start();
+#endif
     NameInfo::static_initialize();
     cp_va_static_initialize();
 
@@ -525,14 +531,32 @@ click_read_router(String filename, bool is_expr, ErrorHandler *errh, bool initia
         }
     }
 
-    // lex
     Lexer *l = click_lexer();
     RequireLexerExtra lextra(&archive);
-    int cookie = l->begin_parse(config_str, filename, &lextra, errh);
-    while (!l->ydone())
-        l->ystep();
-    Router *router = l->create_router(master ? master : new Master(1));
-    l->end_parse(cookie);
+    Router *router;
+#if CLICK_USERLEVEL
+    // load precompiled images directly
+    if (RouterImage::is_image(config_str)) {
+        RouterImage image;
+        PrefixErrorHandler perrh(errh, filename + ": ");
+        if (image.parse(config_str, &perrh) < 0)
+            return 0;
+        Master *image_master = master ? master : new Master(1);
+        if (!(router = l->create_router(image, &lextra, errh, image_master))) {
+            if (image_master != master)
+                delete image_master;
+            return 0;
+        }
+    } else
+#endif
+    {
+        // lex
+        int cookie = l->begin_parse(config_str, filename, &lextra, errh);
+        while (!l->ydone())
+            l->ystep();
+        router = l->create_router(master ? master : new Master(1));
+        l->end_parse(cookie);
+    }
 
     // initialize if requested
     if (initialize)
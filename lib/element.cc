@@ -425,11 +425,15 @@ Element::Element()
     in_batch_mode(BATCH_MODE_NO),
 #endif
     receives_batch(false),
-    _router(0), _eindex(-1), _is_fullpush(false)
+    _router(0), _eindex(-1), _is_fullpush(false),
+    _profile(0), _profile_data(0)
 {
     nelements_allocated++;
     _ports[0] = _ports[1] = &_inline_ports[0];
     _nports[0] = _nports[1] = 0;
+#if HAVE_BATCH
+    _rebatch = true;
+#endif
 
 #if CLICK_STATS >= 2
     reset_cycles();
@@ -443,6 +447,7 @@ Element::~Element()
 	delete[] _ports[0];
     if (_ports[1] < _inline_ports || _ports[1] > _inline_ports + INLINE_PORTS)
 	delete[] _ports[1];
+    delete _profile_data;
 }
 
 // CHARACTERISTICS
@@ -1222,6 +1227,13 @@ Element::processing_vector(int* in_v, int* out_v, ErrorHandler* errh) const
  * RoundRobinSched has 0 inputs, are idle rather than busy, and waste no
  * CPU time.</dd>
  *
+ * <dt><tt>C</tt></dt> <dd>This element's configure() touches no state
+ * outside the element itself: it does not look up other elements, register
+ * notifiers, names or attachments with the router, or use other global
+ * state.  At user level with several threads, Router::initialize() may
+ * configure C-flagged elements concurrently with one another, and before
+ * other elements in the same configure_phase().</dd>
+ *
  * </dl>
  */
 const char*
@@ -1710,12 +1722,18 @@ bool Element::get_spawning_threads(Bitvector& bmp) {
 }
 
 Bitvector Element::get_passing_threads(bool is_pull) {
+    Bitvector b = passing_threads(is_pull, _is_fullpush);
+    if (!_is_fullpush)
+        router()->non_fullpush();
+    return b;
+}
+
+/* Compute get_passing_threads() without recording the result. */
+Bitvector Element::passing_threads(bool is_pull, bool &fullpush) {
     Bitvector b(master()->nthreads());
     InputThreadVisitor visitor(b);
     router()->visit(this,is_pull,-1,&visitor);
-    _is_fullpush = visitor.fullpush;
-    if (!_is_fullpush)
-        router()->non_fullpush();
+    fullpush = visitor.fullpush;
     return b;
 }
 
@@ -2122,6 +2140,166 @@ read_ocounts_handler(Element *f, void *)
 
 #endif /* CLICK_STATS >= 1 */
 
+
+// PROFILING
+
+per_thread<click_cycles_t> *Element::profile_cycles;
+
+Element::Profile &
+Element::Profile::operator+=(const Profile &x)
+{
+    calls += x.calls;
+    batch_calls += x.batch_calls;
+    packets += x.packets;
+    cycles += x.cycles;
+    own_cycles += x.own_cycles;
+    for (int i = 0; i < nbuckets; ++i)
+	batch_sizes[i] += x.batch_sizes[i];
+    return *this;
+}
+
+/** @brief Turn profiling of this element on or off.
+ *
+ * While profiling is on, every push, pull, push_batch and pull_batch call
+ * into this element is timed with click_get_cycles() and counted, along
+ * with the number of packets it passed.  Statistics are kept per thread,
+ * so profiling threads do not contend.  The cycles spent in downstream
+ * (push) or upstream (pull) elements that are also being profiled are
+ * subtracted from this element's own cycles.
+ *
+ * While profiling is off, each transfer pays one extra test.  Turning
+ * profiling off keeps the statistics collected so far; see reset_profile().
+ * Routers built with CLICK_STATS >= 2 count push and pull calls with their
+ * own statistics instead, so only batch calls are profiled there.
+ *
+ * @sa profile, Router::set_profiling */
+void
+Element::set_profiling(bool on)
+{
+    if (on) {
+	if (!profile_cycles)
+	    profile_cycles = new per_thread<click_cycles_t>(0);
+	if (!_profile_data)
+	    _profile_data = new per_thread<Profile>;
+	_profile = _profile_data;
+    } else
+	_profile = 0;
+}
+
+/** @brief Clear this element's profiling statistics. */
+void
+Element::reset_profile()
+{
+    if (_profile_data)
+	for (unsigned i = 0; i < _profile_data->weight(); ++i)
+	    _profile_data->get_value(i).clear();
+}
+
+/** @brief Return this element's profiling statistics, summed over threads.
+ * @sa set_profiling */
+Element::Profile
+Element::profile() const
+{
+    Profile total;
+    if (_profile_data)
+	for (unsigned i = 0; i < _profile_data->weight(); ++i)
+	    total += _profile_data->get_value(i);
+    return total;
+}
+
+namespace {
+/* Times one profiled transfer.  profile_cycles accumulates, per thread, the
+   cycles of every profiled call; its growth during a call is the time spent
+   in profiled children. */
+class ProfiledCall { public:
+    ProfiledCall(per_thread<Element::Profile> *prof, click_cycles_t &acc)
+	: _prof(prof ? &**prof : 0), _acc(acc),
+	  _acc0(acc), _start(click_get_cycles()) {
+    }
+    void finish(unsigned n, bool batch) {
+	click_cycles_t all_delta = click_get_cycles() - _start;
+	if (_prof)
+	    _prof->account(all_delta, all_delta - (_acc - _acc0), n, batch);
+	_acc = _acc0 + all_delta;
+    }
+  private:
+    Element::Profile *_prof;
+    click_cycles_t &_acc;
+    click_cycles_t _acc0;
+    click_cycles_t _start;
+};
+}
+
+void
+Element::Port::profiled_push(Packet *p) const
+{
+    ProfiledCall pc(_e->_profile, **profile_cycles);
+#if HAVE_BOUND_PORT_TRANSFER
+    _bound.push(_e, _port, p);
+#else
+    _e->push(_port, p);
+#endif
+    pc.finish(1, false);
+}
+
+Packet *
+Element::Port::profiled_pull() const
+{
+    ProfiledCall pc(_e->_profile, **profile_cycles);
+#if HAVE_BOUND_PORT_TRANSFER
+    Packet *p = _bound.pull(_e, _port);
+#else
+    Packet *p = _e->pull(_port);
+#endif
+    pc.finish(p != 0, false);
+    return p;
+}
+
+#if HAVE_BATCH
+void
+Element::Port::profiled_push_batch(PacketBatch *batch) const
+{
+    ProfiledCall pc(_e->_profile, **profile_cycles);
+    unsigned n = batch->count();
+#if HAVE_BOUND_PORT_TRANSFER
+    _bound_batch.push_batch(_e, _port, batch);
+#else
+    _e->push_batch(_port, batch);
+#endif
+    pc.finish(n, true);
+}
+
+PacketBatch *
+Element::Port::profiled_pull_batch(unsigned max) const
+{
+    ProfiledCall pc(_e->_profile, **profile_cycles);
+#if HAVE_BOUND_PORT_TRANSFER
+    PacketBatch *batch = _bound_batch.pull_batch(_e, _port, max);
+#else
+    PacketBatch *batch = _e->pull_batch(_port, max);
+#endif
+    pc.finish(batch ? batch->count() : 0, true);
+    return batch;
+}
+#endif
+
+String
+Element::read_profile_handler(Element *e, void *)
+{
+    StringAccum sa;
+    Profile p = e->profile();
+    sa << "calls " << p.calls << '\n'
+       << "batch_calls " << p.batch_calls << '\n'
+       << "packets " << p.packets << '\n'
+       << "cycles " << p.cycles << '\n'
+       << "own_cycles " << p.own_cycles << '\n'
+       << "batch_sizes";
+    for (int i = 0; i < Profile::nbuckets; ++i)
+	sa << ' ' << p.batch_sizes[i];
+    sa << '\n';
+    return sa.take_string();
+}
+
 #if CLICK_STATS >= 2
 String
 Element::read_cycles_handler(Element *e, void *)
@@ -2154,6 +2332,7 @@ Element::add_default_handlers(bool allow_write_config)
     add_write_handler("config", write_config_handler, 0);
   add_read_handler("ports", read_ports_handler, 0, Handler::f_calm);
   add_read_handler("handlers", read_handlers_handler, 0, Handler::f_calm);
+  add_read_handler("profile", read_profile_handler, 0);
 #if CLICK_STATS >= 1
   add_read_handler("icounts", read_icounts_handler, 0);
   add_read_handler("ocounts", read_ocounts_handler, 0);
@@ -2973,6 +3152,13 @@ Element::pull(int port)
 
 #if HAVE_BATCH
 void Element::push_batch(int port, PacketBatch* batch) {
+    if (!_rebatch) {
+        // nothing downstream rebuilds batches; see Router::bind_ports()
+        FOR_EACH_PACKET_SAFE(batch,p) {
+            push(port,p);
+        }
+        return;
+    }
     for (int i = 0; i < noutputs(); i++) {
         if (output_is_push(i))
             _ports[1][i].start_batch();
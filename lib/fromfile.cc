@@ -164,6 +164,10 @@ FromFile::read_buffer_mmap(ErrorHandler *errh)
 # ifdef HAVE_MADVISE
     // don't care about errors
     (void) madvise((caddr_t)mmap_data, _len, MADV_SEQUENTIAL);
+#  ifdef MADV_WILLNEED
+    // start reading the whole unit now, rather than a page at a time
+    (void) madvise((caddr_t)mmap_data, _len, MADV_WILLNEED);
+#  endif
 # endif
 
     return 1;
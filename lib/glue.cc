@@ -416,6 +416,52 @@ click_lfree(volatile void *p, size_t size)
 #endif
 
 
+// ALIGNED ALLOCATION
+
+CLICK_DECLS
+
+/** @brief Allocate @a size bytes aligned to @a alignment, a power of two.
+ * @return the memory, or null if none is available
+ *
+ * Use for arrays of CLICK_CACHE_ALIGN types, which operator new[] does not
+ * align before C++17.  Free the result with click_aligned_free(). */
+void *
+click_aligned_alloc(size_t alignment, size_t size)
+{
+    if (alignment < sizeof(void *))
+	alignment = sizeof(void *);
+#if CLICK_USERLEVEL || CLICK_NS || CLICK_MINIOS
+    void *p;
+    if (posix_memalign(&p, alignment, size) != 0)
+	return 0;
+    return p;
+#else
+    // over-allocate, and remember the real allocation just below the result
+    char *x = new char[size + alignment + sizeof(void *)];
+    if (!x)
+	return 0;
+    uintptr_t a = reinterpret_cast<uintptr_t>(x) + sizeof(void *) + alignment - 1;
+    void **p = reinterpret_cast<void **>(a & ~(uintptr_t) (alignment - 1));
+    p[-1] = x;
+    return p;
+#endif
+}
+
+/** @brief Free memory returned by click_aligned_alloc(). Null is ignored. */
+void
+click_aligned_free(void *p)
+{
+#if CLICK_USERLEVEL || CLICK_NS || CLICK_MINIOS
+    free(p);
+#else
+    if (p)
+	delete[] reinterpret_cast<char *>(reinterpret_cast<void **>(p)[-1]);
+#endif
+}
+
+CLICK_ENDDECLS
+
+
 // RANDOMNESS
 
 CLICK_DECLS
@@ -701,7 +747,7 @@ click_gettimeofday(timeval *tvp)
 click_jiffies_t
 click_jiffies()
 {
-    return Timestamp::now().msecval();
+    return Timestamp::now_tsc().msecval();
 }
 
 CLICK_ENDDECLS
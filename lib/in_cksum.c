@@ -16,34 +16,106 @@
 # include <string.h>
 #endif
 
+#if CLICK_USERLEVEL && defined(__AVX2__)
+# include <immintrin.h>
+#elif CLICK_USERLEVEL && defined(__SSE2__)
+# include <emmintrin.h>
+#endif
+
 #if !CLICK_LINUXMODULE
+/*
+ * The Internet checksum is a ones-complement sum of 16-bit words.  Since
+ * 2^16 == 1 in ones-complement arithmetic, we can equally well add 32-bit
+ * words into a 64-bit accumulator, which halves the number of additions and
+ * lets the vector units add several words at once; the carries are folded
+ * back at the end.  The result is identical to the 16-bit algorithm on any
+ * input, including the odd trailing byte and the ~+0/~-0 distinction.
+ */
+
+static inline uint64_t
+in_cksum_add32(const unsigned char *x, int nwords, uint64_t sum)
+{
+    uint32_t w;
+    for (; nwords > 0; --nwords, x += 4) {
+	memcpy(&w, x, 4);
+	sum += w;
+    }
+    return sum;
+}
+
+#if CLICK_USERLEVEL && defined(__AVX2__)
+/* Add 32-byte blocks: each block is widened to four 64-bit lanes per half so
+   the lanes cannot overflow. */
+static inline uint64_t
+in_cksum_add_vector(const unsigned char *x, int nblocks, uint64_t sum)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i acc0 = zero, acc1 = zero;
+    for (; nblocks > 0; --nblocks, x += 32) {
+	__m256i v = _mm256_loadu_si256((const __m256i *) x);
+	acc0 = _mm256_add_epi64(acc0, _mm256_unpacklo_epi32(v, zero));
+	acc1 = _mm256_add_epi64(acc1, _mm256_unpackhi_epi32(v, zero));
+    }
+    uint64_t lanes[4];
+    _mm256_storeu_si256((__m256i *) lanes, _mm256_add_epi64(acc0, acc1));
+    return sum + lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+# define IN_CKSUM_VECTOR_BYTES 32
+#elif CLICK_USERLEVEL && defined(__SSE2__)
+static inline uint64_t
+in_cksum_add_vector(const unsigned char *x, int nblocks, uint64_t sum)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc0 = zero, acc1 = zero;
+    for (; nblocks > 0; --nblocks, x += 16) {
+	__m128i v = _mm_loadu_si128((const __m128i *) x);
+	acc0 = _mm_add_epi64(acc0, _mm_unpacklo_epi32(v, zero));
+	acc1 = _mm_add_epi64(acc1, _mm_unpackhi_epi32(v, zero));
+    }
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, _mm_add_epi64(acc0, acc1));
+    return sum + lanes[0] + lanes[1];
+}
+# define IN_CKSUM_VECTOR_BYTES 16
+#endif
+
 uint16_t
 click_in_cksum(const unsigned char *addr, int len)
 {
-    int nleft = len;
-    const uint16_t *w = (const uint16_t *)addr;
-    uint32_t sum = 0;
+    uint64_t sum = 0;
     uint16_t answer = 0;
 
-    /*
-     * Our algorithm is simple, using a 32 bit accumulator (sum), we add
-     * sequential 16 bit words to it, and at the end, fold back all the
-     * carry bits from the top 16 bits into the lower 16 bits.
-     */
-    while (nleft > 1)  {
-	sum += *w++;
-	nleft -= 2;
+#ifdef IN_CKSUM_VECTOR_BYTES
+    /* short data, such as most IP headers, is not worth the setup */
+    if (len >= 4 * IN_CKSUM_VECTOR_BYTES) {
+	int nblocks = len / IN_CKSUM_VECTOR_BYTES;
+	sum = in_cksum_add_vector(addr, nblocks, sum);
+	addr += nblocks * IN_CKSUM_VECTOR_BYTES;
+	len -= nblocks * IN_CKSUM_VECTOR_BYTES;
     }
+#endif
+    sum = in_cksum_add32(addr, len >> 2, sum);
+    addr += len & ~3;
+    len &= 3;
 
-    /* mop up an odd byte, if necessary */
-    if (nleft == 1) {
-	*(unsigned char *)(&answer) = *(const unsigned char *)w ;
+    /* mop up a trailing halfword and an odd byte, if necessary */
+    if (len >= 2) {
+	memcpy(&answer, addr, 2);
+	sum += answer;
+	addr += 2;
+	len -= 2;
+    }
+    if (len == 1) {
+	answer = 0;
+	*(unsigned char *)(&answer) = *addr;
 	sum += answer;
     }
 
-    /* add back carry outs from top 16 bits to low 16 bits */
+    /* add back carry outs from the top bits to the low 16 bits */
+    sum = (sum & 0xffffffffU) + (sum >> 32);
+    sum = (sum & 0xffffffffU) + (sum >> 32);
+    sum = (sum & 0xffff) + (sum >> 16);
     sum = (sum & 0xffff) + (sum >> 16);
-    sum += (sum >> 16);
     /* guaranteed now that the lower 16 bits of sum are correct */
 
     answer = ~sum;              /* truncate to 16 bits */
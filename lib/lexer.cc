@@ -32,6 +32,9 @@
 #include <click/glue.hh>
 #include <click/straccum.hh>
 #include <click/variableenv.hh>
+#if CLICK_USERLEVEL
+# include <click/routerimage.hh>
+#endif
 #include <click/bitvector.hh>
 #include <click/standard/errorelement.hh>
 #if CLICK_USERLEVEL
@@ -394,7 +397,7 @@ Lexer::Compound::expand_into(Lexer *lexer, int which, VariableEnvironment &ve)
     String ename_slash = ename + "/";
     for (int i = 2; i < _elements.size(); ++i) {
         String cname = ename_slash + _element_names[i];
-        int eidx = lexer->_c->_element_map[cname];
+        int eidx = lexer->_c->_element_map.get(cname);
         if (eidx >= 0) {
             redeclaration_error(errh, "element", cname, lexer->element_landmark(which), lexer->element_landmark(eidx));
             eidx_map.push_back(-1);
@@ -564,9 +567,9 @@ Lexer::end_parse(int cookie)
 {
   lexical_scoping_out(cookie);
 
-  for (TunnelEnd **tep = _tunnels.begin(); tep != _tunnels.end(); ++tep)
-    while (TunnelEnd *t = *tep) {
-      *tep = t->next();
+  for (HashTable<int, TunnelEnd *>::iterator it = _tunnels.begin(); it; ++it)
+    while (TunnelEnd *t = it.value()) {
+      it.value() = t->next();
       delete t;
     }
   _tunnels.clear();
@@ -1093,10 +1096,11 @@ Lexer::get_element(String name, int etype, const String &conf,
   assert(name && etype >= 0 && etype < _element_types.size());
 
   // if an element 'name' already exists return it
-  if (_c->_element_map[name] >= 0)
-    return _c->_element_map[name];
+  int eid = _c->_element_map.get(name);
+  if (eid >= 0)
+    return eid;
 
-  int eid = _c->_elements.size();
+  eid = _c->_elements.size();
   _c->_element_map.set(name, eid);
 
   // check 'name' for validity
@@ -1138,7 +1142,7 @@ Lexer::Compound::deanonymize_element_name(int eidx)
 {
     // This function uses _element_map.
     String name = _element_names[eidx].substring(1);
-    if (_element_map[name] >= 0) {
+    if (_element_map.get(name) >= 0) {
         int at_pos = name.find_right('@');
         assert(at_pos >= 0);
         String prefix = name.substring(0, at_pos + 1);
@@ -1150,7 +1154,7 @@ Lexer::Compound::deanonymize_element_name(int eidx)
         do {
             anonymizer++;
             name = prefix + String(anonymizer);
-        } while (_element_map[name] >= 0);
+        } while (_element_map.get(name) >= 0);
     }
     _element_map.set(name, eidx);
     _element_names[eidx] = name;
@@ -1398,7 +1402,7 @@ Lexer::yelement_config(ElementState *e, bool this_implicit)
     // configuration string
     Lexeme t = lex();
     if (t.is('(') && !this_implicit) {
-        if (_c->_element_map[e->name] >= 0)
+        if (_c->_element_map.get(e->name) >= 0)
             lerror("configuration string ignored on element reference");
         e->configuration = lex_config();
         expect(')');
@@ -1453,7 +1457,7 @@ Lexer::yelement_next()
     // add elements
     int *resp = _ps->elements.begin();
     while (ElementState *e = _ps->_head) {
-        if (e->type >= 0 || (*resp = _c->_element_map[e->name]) < 0) {
+        if (e->type >= 0 || (*resp = _c->_element_map.get(e->name)) < 0) {
             if (e->decl_type >= 0 && e->type >= 0)
                 _errh->lerror(Compound::landmark_string(e->filename, e->lineno), "class %<%s%> used as element name", e->name.c_str());
             else if (e->decl_type < 0 && e->type < 0) {
@@ -1806,8 +1810,8 @@ Lexer::ygroup()
     int eidexes[3];
     add_tunnels(_ps->_element_name, eidexes);
 
-    _ps->elements.push_back(_c->_element_map["input"]);
-    _ps->elements.push_back(_c->_element_map["output"]);
+    _ps->elements.push_back(_c->_element_map.get("input"));
+    _ps->elements.push_back(_c->_element_map.get("output"));
     _c->_element_map["input"] = eidexes[1];
     _c->_element_map["output"] = eidexes[2];
     _ps = new ParseState(ParseState::t_group, _ps);
@@ -1829,8 +1833,8 @@ Lexer::ygroup_end()
     LandmarkErrorHandler lerrh(_errh, _file.landmark());
     const char *printable_name = (_ps->_element_name[0] == ';' ? "<anonymous group>" : _ps->_element_name.c_str());
     int group_nports[2];
-    group_nports[0] = _c->check_pseudoelement(_c->_element_map["input"], false, printable_name, &lerrh);
-    group_nports[1] = _c->check_pseudoelement(_c->_element_map["output"], true, printable_name, &lerrh);
+    group_nports[0] = _c->check_pseudoelement(_c->_element_map.get("input"), false, printable_name, &lerrh);
+    group_nports[1] = _c->check_pseudoelement(_c->_element_map.get("output"), true, printable_name, &lerrh);
 
     _c->_element_map["input"] = _ps->elements[_ps->elements.size() - 2];
     _c->_element_map["output"] = _ps->elements[_ps->elements.size() - 1];
@@ -2081,7 +2085,7 @@ Lexer::ystep()
         // the end of the chain, and it was "output".
         _ps->last_connection_ends_output = _ps->last_elements.size() > 0
             && _ps->last_elements.size() == 3 + _ps->last_elements[1] + _ps->last_elements[2]
-            && _ps->last_elements[0] == _c->_element_map["output"];
+            && _ps->last_elements[0] == _c->_element_map.get("output");
         _ps->last_elements.clear();
         _ps->state = ParseState::s_statement;
         break;
@@ -2237,6 +2241,71 @@ Lexer::create_router(Master *master)
 }
 
 
+#if CLICK_USERLEVEL
+static String
+full_processing(const String &code)
+{
+  // the element map always spells out both input and output processing
+  return code.find_left('/') < 0 ? code + "/" + code : code;
+}
+
+/** @brief Create a router from a precompiled image.
+ *
+ * The image's elements are already flat, so this skips lexing and compound
+ * expansion entirely.  Requirements are passed to @a lextra.  Errors are
+ * reported to @a errh; the caller should check for them before
+ * initializing the result. */
+Router *
+Lexer::create_router(const RouterImage &image, LexerExtra *lextra,
+                     ErrorHandler *errh, Master *master)
+{
+  int before = errh->nerrors();
+  for (int i = 0; i < image.requirements.size(); i += 2)
+    if (lextra)
+      lextra->require(image.requirements[i], image.requirements[i+1], errh);
+  if (errh->nerrors() != before)
+    return 0;
+
+  Router *router = new Router(image.configuration, master);
+  if (!router)
+    return 0;
+
+  Vector<int> router_id;
+  for (const RouterImage::Element *ie = image.elements.begin(); ie != image.elements.end(); ++ie) {
+    int etype = element_type(ie->class_name);
+    Element *e = 0;
+    String landmark = ie->filename + ":" + String(ie->lineno);
+    if (etype < 0)
+      errh->lerror(landmark, "unknown element class %<%s%>", ie->class_name.c_str());
+    else if (_element_types[etype].factory == compound_element_factory)
+      errh->lerror(landmark, "%<%s%> is not a primitive element class", ie->class_name.c_str());
+    else if (!(e = (*_element_types[etype].factory)(_element_types[etype].thunk)))
+      errh->lerror(landmark, "failed to create element %<%s%>", ie->name.c_str());
+    if (e && ie->processing && ie->processing != full_processing(e->processing()))
+      errh->lwarning(landmark, "%<%s%> processing changed since the configuration was precompiled", ie->class_name.c_str());
+    if (e)
+      router_id.push_back(router->add_element(e, ie->name, ie->configuration, ie->filename, ie->lineno));
+    else
+      router_id.push_back(-1);
+  }
+
+  // sort connections, as Router::add_connection is quadratic otherwise
+  Vector<Router::Connection> conn;
+  for (const RouterImage::Connection *c = image.connections.begin(); c != image.connections.end(); ++c)
+    if (router_id[c->from] >= 0 && router_id[c->to] >= 0)
+      conn.push_back(Router::Connection(router_id[c->from], c->from_port, router_id[c->to], c->to_port));
+  click_qsort(conn.begin(), conn.size());
+  for (Router::Connection *cp = conn.begin(); cp != conn.end(); ++cp)
+    router->add_connection((*cp)[1].idx, (*cp)[1].port, (*cp)[0].idx, (*cp)[0].port);
+
+  for (int i = 0; i < image.requirements.size(); i += 2)
+    router->add_requirement(image.requirements[i], image.requirements[i+1]);
+
+  return router;
+}
+#endif
+
+
 //
 // LEXEREXTRA
 //
@@ -2254,31 +2323,16 @@ LexerExtra::require(String, String, ErrorHandler *)
 Lexer::TunnelEnd *
 Lexer::find_tunnel(const Port &h, bool isoutput, bool insert)
 {
-  // binary search for tunnel
-  unsigned l = 0, r = _tunnels.size();
-  while (l < r) {
-    unsigned m = l + (r - l) / 2;
-    if (h.idx < _tunnels[m]->_port.idx)
-      r = m;
-    else if (h.idx > _tunnels[m]->_port.idx)
-      l = m + 1;
-    else {
-      l = m;
-      r = m + 1;
-      break;
-    }
-  }
-
-  // insert space if necessary
-  if (l >= r && insert) {
-    _tunnels.insert(_tunnels.begin() + l, 0);
-    ++r;
-  } else if (l >= r)
+  // find the tunnel ends for this element
+  TunnelEnd **tep;
+  if (insert)
+    tep = &_tunnels[h.idx];
+  else if (!(tep = _tunnels.get_pointer(h.idx)))
     return 0;
 
   // find match
   TunnelEnd *match = 0;
-  for (TunnelEnd *te = _tunnels[l]; te; te = te->next())
+  for (TunnelEnd *te = *tep; te; te = te->next())
     if (te->isoutput() == isoutput && te->port().port == h.port)
       return te;
     else if (te->isoutput() == isoutput && te->port().port == 0)
@@ -2286,14 +2340,14 @@ Lexer::find_tunnel(const Port &h, bool isoutput, bool insert)
 
   // add new end if necessary
   if (match && !insert) {
-    TunnelEnd *te = new TunnelEnd(h, isoutput, _tunnels[l]);
-    _tunnels[l] = te;
+    TunnelEnd *te = new TunnelEnd(h, isoutput, *tep);
+    *tep = te;
     TunnelEnd *ote = find_tunnel(Port(match->other()->port().idx, h.port), !isoutput, true);
     te->pair_with(ote);
     return te;
   } else if (insert) {
-    TunnelEnd *te = new TunnelEnd(h, isoutput, _tunnels[l]);
-    _tunnels[l] = te;
+    TunnelEnd *te = new TunnelEnd(h, isoutput, *tep);
+    *tep = te;
     return te;
   } else
     return 0;
@@ -125,13 +125,18 @@ Master::pause()
     }
 }
 
+/* Stop every thread from running tasks, timers and selects.  When called
+   from a handler on a router thread, that thread is left alone: it is
+   running the caller, not a task. */
 void
 Master::block_all()
 {
     for (int i = 1; i < _nthreads; ++i)
-        _threads[i]->schedule_block_tasks();
+        if (!_threads[i]->current_thread_is_running())
+            _threads[i]->schedule_block_tasks();
     for (int i = 1; i < _nthreads; ++i)
-        _threads[i]->block_tasks(true);
+        if (!_threads[i]->current_thread_is_running())
+            _threads[i]->block_tasks(true);
     pause();
 }
 
@@ -140,7 +145,8 @@ Master::unblock_all()
 {
     unpause();
     for (int i = 1; i < _nthreads; ++i)
-        _threads[i]->unblock_tasks();
+        if (!_threads[i]->current_thread_is_running())
+            _threads[i]->unblock_tasks();
 }
 
 
@@ -463,6 +463,7 @@ class NotifierRouterVisitor : public RouterVisitor { public:
     NotifierRouterVisitor(const char* name);
     bool visit(Element *e, bool isoutput, int port,
 	       Element *from_e, int from_port, int distance);
+    NotifierSignal search(Element *e, bool isoutput, int port);
     Vector<Notifier*> _notifiers;
     NotifierSignal _signal;
     bool _pass2;
@@ -511,6 +512,27 @@ NotifierRouterVisitor::visit(Element* e, bool isoutput, int port,
 	return true;
 }
 
+NotifierSignal
+NotifierRouterVisitor::search(Element *e, bool isoutput, int port)
+{
+    int ok = e->router()->visit(e, isoutput, port, this);
+
+    NotifierSignal signal = _signal;
+
+    // maybe run another pass
+    if (ok >= 0 && signal != NotifierSignal() && _need_pass2) {
+	_pass2 = true;
+	ok = e->router()->visit(e, isoutput, port, this);
+    }
+
+    // All bets are off if the search ran into a push output (upstream) or
+    // a pull input (downstream).  That means there was a regular Queue in
+    // the way (for example).
+    if (ok < 0)
+	return NotifierSignal();
+    return signal;
+}
+
 }
 
 /** @brief Calculate and return the NotifierSignal derived from all empty
@@ -525,20 +547,10 @@ NotifierSignal
 Notifier::upstream_signal(Element* e, int port, callback_type f, void *user_data, const char * sgn)
 {
     NotifierRouterVisitor filter(sgn);
-    int ok = e->router()->visit_upstream(e, port, &filter);
-
-    NotifierSignal signal = filter._signal;
-
-    // maybe run another pass
-    if (ok >= 0 && signal != NotifierSignal() && filter._need_pass2) {
-	filter._pass2 = true;
-	ok = e->router()->visit_upstream(e, port, &filter);
-    }
-    //click_chatter("Found %d signals : %s",filter._notifiers.size(),(*filter._notifiers.begin()));
-    // All bets are off if filter ran into a push output. That means there was
-    // a regular Queue in the way (for example).
-    if (ok < 0 || signal == NotifierSignal())
-	return NotifierSignal();
+    NotifierSignal signal = filter.search(e, false, port);
+    e->router()->add_notifier_search(e, false, port, sgn, f, user_data);
+    if (signal == NotifierSignal())
+	return signal;
 
     if (f || user_data)
 	for (int i = 0; i < filter._notifiers.size(); i++)
@@ -559,20 +571,10 @@ NotifierSignal
 Notifier::downstream_full_signal(Element* e, int port, callback_type f, void *user_data)
 {
     NotifierRouterVisitor filter(FULL_NOTIFIER);
-    int ok = e->router()->visit_downstream(e, port, &filter);
-
-    NotifierSignal signal = filter._signal;
-
-    // maybe run another pass
-    if (ok >= 0 && signal != NotifierSignal() && filter._need_pass2) {
-	filter._pass2 = true;
-	ok = e->router()->visit_downstream(e, port, &filter);
-    }
-
-    // All bets are off if filter ran into a pull input. That means there was
-    // a regular Queue in the way (for example).
-    if (ok < 0 || signal == NotifierSignal())
-	return NotifierSignal();
+    NotifierSignal signal = filter.search(e, true, port);
+    e->router()->add_notifier_search(e, true, port, FULL_NOTIFIER, f, user_data);
+    if (signal == NotifierSignal())
+	return signal;
 
     if (f || user_data)
 	for (int i = 0; i < filter._notifiers.size(); i++)
@@ -581,4 +583,27 @@ Notifier::downstream_full_signal(Element* e, int port, callback_type f, void *us
     return signal;
 }
 
+/** @brief Find the notifiers a signal search would combine.
+ * @param e an element
+ * @param isoutput true to search downstream of output @a port, false to
+ *   search upstream of input @a port
+ * @param port the port of @a e at which to start the search
+ * @param name notifier name, such as EMPTY_NOTIFIER or FULL_NOTIFIER
+ * @param[out] notifiers collects the notifiers found
+ * @return false if the search yields a busy signal, true otherwise
+ *
+ * Performs the same search as upstream_signal() or
+ * downstream_full_signal(), but registers nothing.  The router uses it to
+ * check that a graph change leaves an element's signals valid. */
+bool
+Notifier::search_notifiers(Element *e, bool isoutput, int port,
+			   const char *name, Vector<Notifier *> &notifiers)
+{
+    NotifierRouterVisitor filter(name);
+    if (filter.search(e, isoutput, port) == NotifierSignal())
+	return false;
+    notifiers.swap(filter._notifiers);
+    return true;
+}
+
 CLICK_ENDDECLS
@@ -27,6 +27,7 @@
 #include <click/ring.hh>
 #include <click/vector.hh>
 #include <click/netmapdevice.hh>
+#include <click/packetregion.hh>
 #if CLICK_USERLEVEL || CLICK_MINIOS
 # include <unistd.h>
 #endif
@@ -190,6 +191,20 @@ CLICK_DECLS
  * Avoid writing buggy code like this!  Use WritablePacket selectively, and
  * try to avoid calling WritablePacket::clone() when possible. */
 
+#if !CLICK_LINUXMODULE && !CLICK_PACKET_USE_DPDK && !CLICK_BSDMODULE
+/** @brief Free a data buffer allocated by alloc_data(). */
+static inline void
+free_buffer(unsigned char *head)
+{
+# if HAVE_CLICK_PACKET_REGION
+    if (PacketRegion::contains(head))
+	PacketRegion::deallocate(head);
+    else
+# endif
+	delete[] head;
+}
+#endif
+
 Packet::~Packet()
 {
     // This is a convenient place to put static assertions.
@@ -233,7 +248,7 @@ Packet::~Packet()
     } else
 #  endif
     if (_head) {
-            delete[] _head;
+            free_buffer(_head);
     }
 # elif CLICK_BSDMODULE
     if (_m)
@@ -243,6 +258,27 @@ Packet::~Packet()
 #endif
 }
 
+#if CLICK_PACKET_COMPACT_LAYOUT
+void *
+Packet::operator new(size_t size) throw ()
+{
+    void *p;
+    if (posix_memalign(&p, CLICK_CACHE_LINE_SIZE, size) != 0)
+	return 0;
+    return p;
+}
+
+void
+Packet::operator delete(void *p)
+{
+    free(p);
+}
+
+# define PACKET_HEADER_DELETE(p)	Packet::operator delete((void *) (p))
+#else
+# define PACKET_HEADER_DELETE(p)	::operator delete((void *) (p))
+#endif
+
 #if !CLICK_LINUXMODULE && !CLICK_PACKET_USE_DPDK
 
 # if HAVE_CLICK_PACKET_POOL
@@ -259,6 +295,10 @@ Packet::~Packet()
 #else
 #  define CLICK_PACKET_POOL_BUFSIZ		2048
 #endif
+#if HAVE_CLICK_PACKET_REGION
+static_assert(CLICK_PACKET_POOL_BUFSIZ == PacketRegion::buffer_size,
+	      "Packet region buffers must be packet pool sized.");
+#endif
 #  define CLICK_PACKET_POOL_SIZE		4096 // see LIMIT in packetpool-01.testie
 #  define CLICK_GLOBAL_PACKET_POOL_COUNT	32
 
@@ -451,7 +491,7 @@ WritablePacket::check_packet_pool_size(PacketPool &packet_pool) {
         if (!global_packet_pool.pbatch.insert(packet_pool.p)) { //Si le nombre de batch est au max -> delete
             while (WritablePacket *p = packet_pool.p) { //On supprime le batch
                 packet_pool.p = static_cast<WritablePacket *>(p->next());
-                ::operator delete((void *) p);
+                PACKET_HEADER_DELETE(p);
             }
         }
         packet_pool.p = 0;
@@ -460,7 +500,7 @@ WritablePacket::check_packet_pool_size(PacketPool &packet_pool) {
 #  else /* !HAVE_MULTITHREAD */
     if (packet_pool.pcount == CLICK_PACKET_POOL_SIZE) {
         WritablePacket* tmp = (WritablePacket*)packet_pool.p->next();
-        ::operator delete((void *) packet_pool.p);
+        PACKET_HEADER_DELETE(packet_pool.p);
         packet_pool.p = tmp;
         packet_pool.pcount--;
     }
@@ -484,10 +524,10 @@ WritablePacket::check_data_pool_size(PacketPool &packet_pool) {
                 else
 # endif
                 {
-                    ::operator delete[]((unsigned char *) pd->buffer());
+                    free_buffer(pd->buffer());
                 }
 #endif
-                ::operator delete((void *) pd);
+                PACKET_HEADER_DELETE(pd);
             }
         }
         packet_pool.pd = 0;
@@ -497,7 +537,7 @@ WritablePacket::check_data_pool_size(PacketPool &packet_pool) {
 #  else /* !HAVE_MULTITHREAD */
     if (packet_pool.pdcount == CLICK_PACKET_POOL_SIZE) {
         WritablePacket* tmp = (WritablePacket*)packet_pool.pd->next();
-        ::operator delete((void *) packet_pool.pd);
+        PACKET_HEADER_DELETE(packet_pool.pd);
         packet_pool.pd = tmp;
         packet_pool.pdcount--;
     }
@@ -610,6 +650,9 @@ Packet::alloc_data(uint32_t headroom, uint32_t length, uint32_t tailroom)
 		}
 #  elif HAVE_NETMAP_PACKET_POOL
     d = NetmapBufQ::local_pool()->extract_p();
+#  elif HAVE_CLICK_PACKET_REGION
+    if (n <= PacketRegion::buffer_size)
+	d = PacketRegion::allocate();
 #  endif
     } else {
 #if HAVE_DPDK_PACKET_POOL
@@ -1016,7 +1059,7 @@ Packet::expensive_uniqueify(int32_t extra_headroom, int32_t extra_tailroom,
     else if (_destructor) {
       _destructor(old_head, old_end - old_head, _destructor_argument);
     } else
-      delete[] old_head;
+      free_buffer(old_head);
 # if HAVE_DPDK_PACKET_POOL
       p->_destructor = desc;
       p->_destructor_argument = arg;
@@ -1225,7 +1268,7 @@ cleanup_pool(PacketPool *pp, int global)
     while (WritablePacket *p = pp->p) {
 	++pcount;
 	pp->p = static_cast<WritablePacket *>(p->next());
-	::operator delete((void *) p);
+	PACKET_HEADER_DELETE(p);
     }
     while (WritablePacket *pd = pp->pd) {
     ++pdcount;
@@ -1235,9 +1278,9 @@ cleanup_pool(PacketPool *pp, int global)
 #elif HAVE_NETMAP_PACKET_POOL
     NetmapBufQ::local_pool()->insert_p(pd->buffer());
 #else
-	delete[] reinterpret_cast<unsigned char *>(pd->buffer());
+	free_buffer(pd->buffer());
 #endif
-    ::operator delete((void *) pd);
+    PACKET_HEADER_DELETE(pd);
     }
 #if !HAVE_BATCH_RECYCLE
     assert(pcount <= CLICK_PACKET_POOL_SIZE);
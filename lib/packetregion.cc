@@ -0,0 +1,218 @@
+// -*- c-basic-offset: 4; related-file-name: "../include/click/packetregion.hh" -*-
+/*
+ * packetregion.{cc,hh} -- huge-page backed memory for packet data buffers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#include <click/packetregion.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+#if HAVE_CLICK_PACKET_REGION
+# include <sys/mman.h>
+# include <unistd.h>
+# include <errno.h>
+# include <string.h>
+#endif
+CLICK_DECLS
+
+#if HAVE_CLICK_PACKET_REGION
+
+unsigned char *PacketRegion::_begin;
+unsigned char *PacketRegion::_end;
+unsigned char *PacketRegion::_carve;
+PacketRegion::cache *PacketRegion::_caches;
+unsigned PacketRegion::_ncaches;
+SimpleSpinlock PacketRegion::_lock;
+Vector<PacketRegion::link *> PacketRegion::_depot;
+size_t PacketRegion::_page_size;
+bool PacketRegion::_huge_pages;
+
+static void *
+map_region(size_t &bytes, size_t &page_size, bool &huge_pages)
+{
+    void *data;
+# ifdef MAP_HUGETLB
+    static const int page_shifts[] = { 30, 21 };
+    for (int i = 0; i < 2; ++i) {
+	size_t psz = (size_t) 1 << page_shifts[i];
+	// a region smaller than a page would grow too much
+	if (bytes < psz)
+	    continue;
+	size_t length = (bytes + psz - 1) & ~(psz - 1);
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB;
+#  ifdef MAP_HUGE_SHIFT
+	flags |= page_shifts[i] << MAP_HUGE_SHIFT;
+#  else
+	// without MAP_HUGE_SHIFT we get the default huge page size
+	if (page_shifts[i] == 30)
+	    continue;
+#  endif
+	data = mmap(0, length, PROT_READ | PROT_WRITE, flags, -1, 0);
+	if (data != MAP_FAILED) {
+	    bytes = length;
+	    page_size = psz;
+	    huge_pages = true;
+	    return data;
+	}
+    }
+# endif
+    // no hugetlbfs pages: use normal pages, which the kernel may still back
+    // with transparent huge pages
+    size_t psz = getpagesize();
+    size_t length = (bytes + psz - 1) & ~(psz - 1);
+    data = mmap(0, length, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+	return 0;
+# ifdef MADV_HUGEPAGE
+    (void) madvise(data, length, MADV_HUGEPAGE);
+# endif
+    bytes = length;
+    page_size = psz;
+    huge_pages = false;
+    return data;
+}
+
+int
+PacketRegion::initialize(size_t bytes, ErrorHandler *errh)
+{
+    if (_begin)
+	return errh->error("packet region already initialized");
+    if (bytes < (size_t) buffer_size * batch)
+	return errh->error("packet region too small (at least %u bytes)", buffer_size * batch);
+
+    void *data = map_region(bytes, _page_size, _huge_pages);
+    if (!data)
+	return errh->error("cannot map %llu bytes for packet buffers: %s", (unsigned long long) bytes, strerror(errno));
+    if (!_huge_pages)
+	errh->warning("no huge pages available for packet buffers, using normal pages");
+
+    _ncaches = click_max_cpu_ids();
+    if (_ncaches < 1)
+	_ncaches = 1;
+    // new[] would not honor the caches' cache-line alignment before C++17
+    _caches = (cache *) click_aligned_alloc(sizeof(cache), sizeof(cache) * _ncaches);
+    if (!_caches) {
+	munmap(data, bytes);
+	return errh->error("out of memory");
+    }
+    for (cache *c = _caches; c != _caches + _ncaches; ++c) {
+	c->free = 0;
+	c->nfree = 0;
+	c->exhausted = 0;
+    }
+    _carve = reinterpret_cast<unsigned char *>(data);
+    _end = _carve + (bytes / buffer_size) * buffer_size;
+    click_compiler_fence();
+    _begin = _carve;
+    return 0;
+}
+
+unsigned char *
+PacketRegion::hard_allocate(cache &c)
+{
+    // once the region is carved up, skip the lock unless the depot has
+    // buffers; the unlocked check may miss a batch being flushed, which is
+    // harmless
+    if (_carve == _end && !_depot.size()) {
+	++c.exhausted;
+	return 0;
+    }
+
+    link *head = 0;
+    _lock.acquire();
+    if (_depot.size()) {
+	// take a batch of buffers freed by any thread
+	head = _depot.back();
+	_depot.pop_back();
+	c.nfree = batch;
+    } else if (_carve != _end) {
+	// carve a batch from the unused part of the region
+	unsigned char *first = _carve;
+	unsigned n = (_end - _carve) / buffer_size;
+	if (n > batch)
+	    n = batch;
+	_carve += n * buffer_size;
+	_lock.release();
+	for (unsigned char *x = _carve - buffer_size; x != first; x -= buffer_size) {
+	    reinterpret_cast<link *>(x)->next = head;
+	    head = reinterpret_cast<link *>(x);
+	}
+	c.free = head;
+	c.nfree = n - 1;
+	return first;
+    } else
+	++c.exhausted;
+    _lock.release();
+
+    if (!head)
+	return 0;
+    c.free = head->next;
+    --c.nfree;
+    return reinterpret_cast<unsigned char *>(head);
+}
+
+void
+PacketRegion::flush(cache &c)
+{
+    // detach the first batch of the free list and hand it to the depot
+    link *head = c.free, *tail = head;
+    for (unsigned i = 1; i < batch; ++i)
+	tail = tail->next;
+    c.free = tail->next;
+    tail->next = 0;
+    c.nfree -= batch;
+
+    _lock.acquire();
+    _depot.push_back(head);
+    _lock.release();
+}
+
+PacketRegion::Stats
+PacketRegion::stats()
+{
+    Stats s;
+    s.bytes = _end - _begin;
+    s.buffers = s.bytes / buffer_size;
+    s.page_size = _page_size;
+    s.huge_pages = _huge_pages;
+    s.exhausted = 0;
+
+    intptr_t in_use = (_carve - _begin) / buffer_size;
+    for (cache *c = _caches; c != _caches + _ncaches; ++c) {
+	in_use -= c->nfree;
+	s.exhausted += c->exhausted;
+    }
+    in_use -= _depot.size() * batch;
+    s.in_use = in_use < 0 ? 0 : in_use;
+    return s;
+}
+
+String
+PacketRegion::Stats::unparse() const
+{
+    StringAccum sa;
+    sa << "buffers " << buffers << '\n'
+       << "buffer_size " << (int) buffer_size << '\n'
+       << "in_use " << in_use << '\n'
+       << "bytes " << bytes << '\n'
+       << "page_size " << page_size << '\n'
+       << "huge_pages " << (huge_pages ? "true" : "false") << '\n'
+       << "exhausted " << exhausted << '\n';
+    return sa.take_string();
+}
+
+#endif
+
+CLICK_ENDDECLS
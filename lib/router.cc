@@ -38,9 +38,7 @@
 #if HAVE_NETMAP_PACKET_POOL
 #include <click/netmapdevice.hh>
 #endif
-#if CLICK_STATS >= 2
-# include <click/hashtable.hh>
-#endif
+#include <click/hashtable.hh>
 #include <click/standard/errorelement.hh>
 #include <click/standard/threadsched.hh>
 #if CLICK_BSDMODULE
@@ -51,6 +49,9 @@
 #if CLICK_USERLEVEL || CLICK_MINIOS
 # include <unistd.h>
 #endif
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+# include <pthread.h>
+#endif
 #if CLICK_NS
 # include "../elements/ns/fromsimdevice.hh"
 #endif
@@ -87,7 +88,8 @@ Router::Router(const String &configuration, Master *master)
       _configuration(configuration),
       _notifier_signals(0),
       _arena_factory(new HashMap_ArenaFactory),
-      _hotswap_router(0), _thread_sched(0), _name_info(0), _next_router(0)
+      _hotswap_router(0), _thread_sched(0), _profiling(false), _name_info(0),
+      _next_router(0)
 {
     _refcount = 0;
     _runcount = 0;
@@ -802,6 +804,95 @@ Router::set_connections()
     _have_connections = true;
 }
 
+#if HAVE_BATCH
+/* Reset each element to the batch mode it chose for itself, which
+   _element_batch_modes remembers, and propagate batch mode from the
+   BATCH_MODE_YES elements, which are the ones instantiating batches. */
+void
+Router::set_batch_modes()
+{
+    for (int i = 0; i < _elements.size(); i++) {
+        _elements[i]->in_batch_mode = (Element::batch_mode) _element_batch_modes[i];
+        _elements[i]->receives_batch = false;
+    }
+
+    for (int ord = 0; ord < _elements.size(); ord++) {
+        Element* e = _elements[_element_configure_order[ord]];
+        if (e->in_batch_mode == Element::BATCH_MODE_YES) {
+            BatchElement::BatchModePropagate p;
+            p.ispush = true;
+            for (int port = 0; port < e->noutputs(); port++) {
+                if (e->output_is_push(port))
+                    visit(e,true,port,&p);
+            }
+
+            p.ispush = false;
+            for (int port = 0; port < e->ninputs(); port++) {
+                if (e->input_is_pull(port))
+                    visit(e,false,port,&p);
+            }
+        }
+    }
+
+    for (int i = 0; i < _elements.size(); i++)
+        if (_elements[i]->in_batch_mode == Element::BATCH_MODE_NO)
+            _elements[i]->receives_batch = false; //This element is traversed by packets... nothing to do.
+}
+
+/** @brief Specialize port transfers to the initialized router graph.
+ *
+ * An element that receives batches without batch support unbatches them and
+ * sends start_batch() and end_batch() messages down its push outputs, so
+ * that batch-mode elements further downstream can rebuild batches.  Once
+ * batch modes are settled, mark the elements that have such a batch-mode
+ * element downstream; the others skip the messages.  With bound port
+ * transfer (--enable-bound-port-transfer, the "static graph" mode), a push
+ * output whose downstream element would only unbatch calls that element's
+ * push() directly for each packet. */
+void
+Router::bind_ports()
+{
+    // walk upstream from batch-mode elements through unbatching elements
+    Vector<int> first_in(nelements(), -1), next_in(_conn.size(), -1);
+    for (int c = 0; c < _conn.size(); ++c) {
+        int to = _conn[c][0].idx;
+        next_in[c] = first_in[to];
+        first_in[to] = c;
+    }
+    Vector<int> stack;
+    for (int i = 0; i < nelements(); ++i) {
+        _elements[i]->_rebatch = false;
+        if (_elements[i]->in_batch_mode == Element::BATCH_MODE_YES)
+            stack.push_back(i);
+    }
+    while (stack.size()) {
+        int t = stack.back();
+        stack.pop_back();
+        for (int c = first_in[t]; c >= 0; c = next_in[c]) {
+            const Port &from = _conn[c][1];
+            Element *e = _elements[from.idx];
+            if (e->output_is_push(from.port) && !e->_rebatch) {
+                e->_rebatch = true;
+                if (e->in_batch_mode != Element::BATCH_MODE_YES)
+                    stack.push_back(from.idx);
+            }
+        }
+    }
+
+# if HAVE_BOUND_PORT_TRANSFER
+    void (*unbatcher)(Element *, int, PacketBatch *) = (void (*)(Element *, int, PacketBatch *)) (&Element::push_batch);
+    for (int i = 0; i < nelements(); ++i) {
+        Element *e = _elements[i];
+        for (int p = 0; p < e->noutputs(); ++p) {
+            Element::Port &port = e->_ports[1][p];
+            port._unbatch = port.active() && !port._e->_rebatch
+                && port._bound_batch.push_batch == unbatcher;
+        }
+    }
+# endif
+}
+#endif
+
 
 // RUNCOUNT
 
@@ -1059,6 +1150,112 @@ configure_order_compar(const void *athunk, const void *bthunk, void *copthunk)
     return configure_order_phase[*a] - configure_order_phase[*b];
 }
 
+int
+Router::configure_element(int i, Vector<String> &conf, ErrorHandler *errh)
+{
+    RouterContextErrh cerrh(errh, "While configuring", element(i));
+    assert(!cerrh.nerrors());
+    conf.clear();
+    cp_argvec(_element_configurations[i], conf);
+    int r = _elements[i]->configure(conf, &cerrh);
+    if (r >= 0)
+        return Element::CLEANUP_CONFIGURED;
+    if (!cerrh.nerrors()) {
+        if (r == -ENOMEM)
+            cerrh.error("out of memory");
+        else
+            cerrh.error("unspecified error");
+    }
+    return Element::CLEANUP_CONFIGURE_FAILED;
+}
+
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+// Elements whose flags() contain "C" promise that configure() touches no
+// state outside the element, so in a configuration with many of them, each
+// configure phase's flagged elements are configured by all threads at once.
+// Their messages are recorded and reported in configure order afterwards.
+
+namespace {
+class RecordErrorHandler : public ErrorHandler { public:
+    void *emit(const String &str, void *user_data, bool) {
+        _messages.push_back(str);
+        return user_data;
+    }
+    Vector<String> _messages;
+};
+}
+
+struct Router::ParallelConfigure {
+    Router *router;
+    Vector<int> eindexes;
+    Vector<Vector<String> > messages;
+    int *element_stage;
+    atomic_uint32_t next;
+};
+
+void *
+Router::configure_parallel_thread(void *thunk)
+{
+    ParallelConfigure *pc = static_cast<ParallelConfigure *>(thunk);
+    Vector<String> conf;
+    uint32_t k;
+    while ((k = pc->next.fetch_and_add(1)) < (uint32_t) pc->eindexes.size()) {
+        RecordErrorHandler rerrh;
+        int i = pc->eindexes[k];
+        pc->element_stage[i] = pc->router->configure_element(i, conf, &rerrh);
+        pc->messages[k].swap(rerrh._messages);
+    }
+    return 0;
+}
+
+/* Configure the "C"-flagged elements of the configure phase starting at
+   configure order @a ord in parallel, if there are enough of them.  Returns
+   -1 if any of them failed. */
+int
+Router::configure_parallel(int ord, Vector<int> &element_stage, ErrorHandler *errh)
+{
+    enum { min_elements = 128 };
+    int nthreads = _master->nthreads();
+    if (nthreads <= 1)
+        return 0;
+
+    ParallelConfigure pc;
+    int phase = _elements[_element_configure_order[ord]]->configure_phase();
+    for (; ord < _elements.size(); ++ord) {
+        Element *e = _elements[_element_configure_order[ord]];
+        if (e->configure_phase() != phase)
+            break;
+        if (e->flag_value('C') >= 0)
+            pc.eindexes.push_back(e->eindex());
+    }
+    if (pc.eindexes.size() < min_elements)
+        return 0;
+
+    pc.router = this;
+    pc.messages.resize(pc.eindexes.size());
+    pc.element_stage = element_stage.begin();
+    pc.next = 0;
+    Vector<pthread_t> threads;
+    for (int t = 1; t < nthreads; ++t) {
+        pthread_t p;
+        if (pthread_create(&p, 0, configure_parallel_thread, &pc) == 0)
+            threads.push_back(p);
+    }
+    configure_parallel_thread(&pc);
+    for (int t = 0; t < threads.size(); ++t)
+        pthread_join(threads[t], 0);
+
+    int r = 0;
+    for (int k = 0; k < pc.eindexes.size(); ++k) {
+        for (String *m = pc.messages[k].begin(); m != pc.messages[k].end(); ++m)
+            errh->xmessage(*m);
+        if (element_stage[pc.eindexes[k]] == Element::CLEANUP_CONFIGURE_FAILED)
+            r = -1;
+    }
+    return r;
+}
+#endif
+
 inline Handler*
 Router::xhandler(int hi) const
 {
@@ -1146,59 +1343,30 @@ Router::initialize(ErrorHandler *errh)
         // Set the random seed to a "truly random" value by default.
         click_random_srandom();
         for (int ord = 0; ord < _elements.size(); ord++) {
-            int i = _element_configure_order[ord], r;
+            int i = _element_configure_order[ord];
+#if CLICK_USERLEVEL && HAVE_MULTITHREAD
+            if (ord == 0 || _elements[i]->configure_phase() != _elements[_element_configure_order[ord - 1]]->configure_phase())
+                if (configure_parallel(ord, element_stage, errh) < 0)
+                    all_ok = false;
+            if (element_stage[i] != Element::CLEANUP_BEFORE_CONFIGURE)
+                continue;
+#endif
 #if CLICK_DMALLOC
             sprintf(dmalloc_buf, "c%d  ", i);
             CLICK_DMALLOC_REG(dmalloc_buf);
 #endif
-            RouterContextErrh cerrh(errh, "While configuring", element(i));
-            assert(!cerrh.nerrors());
-            conf.clear();
-            cp_argvec(_element_configurations[i], conf);
-            if ((r = _elements[i]->configure(conf, &cerrh)) < 0) {
-                element_stage[i] = Element::CLEANUP_CONFIGURE_FAILED;
+            element_stage[i] = configure_element(i, conf, errh);
+            if (element_stage[i] == Element::CLEANUP_CONFIGURE_FAILED)
                 all_ok = false;
-                if (!cerrh.nerrors()) {
-                    if (r == -ENOMEM)
-                        cerrh.error("out of memory");
-                    else
-                        cerrh.error("unspecified error");
-                }
-            } else
-                element_stage[i] = Element::CLEANUP_CONFIGURED;
         }
     }
 
 #if HAVE_BATCH
     if (all_ok) {
-        //In the first phase we propagate batch mode from all BATCH_MODE_YES elements, being the one instanciating batches
-        for (int ord = 0; ord < _elements.size(); ord++) {
-            int i = _element_configure_order[ord];
-            Element* e = _elements[i];
-            if (e != NULL && e->in_batch_mode == Element::BATCH_MODE_YES) {
-                BatchElement::BatchModePropagate p;
-                p.ispush = true;
-                for (int i = 0; i < e->noutputs(); i++) {
-                    if (e->output_is_push(i))
-                        visit(e,true,i,&p);
-                }
-
-                p.ispush = false;
-                for (int i = 0; i < e->ninputs(); i++) {
-                    if (e->input_is_pull(i))
-                        visit(e,false,i,&p);
-                }
-            }
-        }
-
-        for (int ord = 0; ord < _elements.size(); ord++) {
-            int i = _element_configure_order[ord];
-            Element* e = _elements[i];
-            if (e->in_batch_mode == Element::BATCH_MODE_NO) {
-                e->receives_batch = false;
-                continue; //This element is traversed by packets... nothing to do.
-            }
-        }
+        _element_batch_modes.clear();
+        for (int i = 0; i < _elements.size(); i++)
+            _element_batch_modes.push_back(_elements[i]->in_batch_mode);
+        set_batch_modes();
     }
 #endif
 
@@ -1246,6 +1414,10 @@ Router::initialize(ErrorHandler *errh)
     // If there were errors, uninitialize any elements that we initialized
     // successfully and return -1 (error). Otherwise, we're all set!
     if (all_ok) {
+#if HAVE_BATCH
+        bind_ports();
+#endif
+
         // Get a home thread for every element, not just the ones that have
         // been explicitly queried so far.
         for (int i = 0; i <= nelements(); ++i) {
@@ -1321,6 +1493,600 @@ Router::set_hotswap_router(Router *r)
         _hotswap_router->use();
 }
 
+// HOTSWAP IN PLACE
+
+struct Router::Hotswap {
+    Router *r;                  // router with the new configuration
+    Router *old;                // takes this router's removed elements
+    Vector<int> lmap;           // r's element i is this router's lmap[i], or new
+    Vector<int> kept;           // this router's element j is r's kept[j], or removed
+    Vector<String> signatures;  // port signatures, by this router's index
+    Vector<int> removed;        // removed elements in configure order
+    Vector<int> changed;        // kept elements with new configurations
+    int nreconfigured;
+    Vector<int> stage;          // cleanup stages of new elements
+
+    // this router's state before the swap
+    int nsearches;
+    Vector<int> search_ok;
+    Vector<Vector<Notifier *> > search_found;
+    Vector<Bitvector> threads;
+    Vector<int> fullpush;
+#if HAVE_BATCH
+    Vector<int> batch_modes;
+    Vector<int> in_batch_mode;
+    Vector<int> receives_batch;
+#endif
+    Vector<Element *> elements;
+    Vector<String> names;
+    Vector<String> configurations;
+    Vector<uint32_t> landmarkids;
+    Vector<element_landmark_t> landmarks;
+    uint32_t last_landmarkid;
+    Vector<int> home_thread_ids;
+    Vector<int> configure_order;
+    Vector<Connection> conn;
+    Vector<int> conn_output_sorter;
+    Vector<int> ehandler_first_by_element;
+    int nehandlers;
+    Vector<int> flow_code_override_eindex;
+    Vector<String> flow_code_override;
+    Vector<String> attachment_names;
+    Vector<void *> attachments;
+    ThreadSched *thread_sched;
+};
+
+inline void
+Router::reattach(Element *e, Router *r, int eindex)
+{
+    e->_router = r;
+    e->_eindex = eindex;
+}
+
+/* Return a string describing @a e's ports: one character per input, then a
+   slash, then one per output.  Elements with different signatures cannot
+   stand in for each other. */
+static String
+port_signature(const Element *e)
+{
+    StringAccum sa;
+    for (int p = 0; p < e->ninputs(); ++p)
+        sa << (e->input_is_pull(p) ? 'l' : 'h');
+    sa << '/';
+    for (int p = 0; p < e->noutputs(); ++p)
+        sa << (e->output_is_push(p) ? 'h' : 'l');
+    return sa.take_string();
+}
+
+static inline bool
+element_name_char(char c)
+{
+    return isalnum((unsigned char) c) || c == '_' || c == '/' || c == '@';
+}
+
+/* Return true if configuration @a conf may refer to the element named
+   @a name, possibly relative to a compound element context. */
+static bool
+configuration_mentions(const String &conf, const String &name)
+{
+    int slash = -1;
+    do {
+        String word = name.substring(slash + 1);
+        for (int pos = 0; (pos = conf.find_left(word, pos)) >= 0; ++pos) {
+            int end = pos + word.length();
+            if ((pos == 0 || !element_name_char(conf[pos - 1]))
+                && (end == conf.length() || !element_name_char(conf[end])))
+                return true;
+        }
+        slash = name.find_left('/', slash + 1);
+    } while (slash >= 0);
+    return false;
+}
+
+static bool
+same_notifiers(const Vector<Notifier *> &a, const Vector<Notifier *> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (int i = 0; i < a.size(); ++i) {
+        int j = 0;
+        while (j < b.size() && b[j] != a[i])
+            ++j;
+        if (j == b.size())
+            return false;
+    }
+    return true;
+}
+
+/* Decide which of this router's elements survive into @a hs.r's
+   configuration.  An element survives if @a hs.r has an element with the
+   same name, class and ports, and the same configuration or one the element
+   can take through live_reconfigure().  Returns false if @a hs.r cannot be
+   applied in place. */
+bool
+Router::hotswap_match(Hotswap &hs)
+{
+    Router *r = hs.r;
+    if (_state != ROUTER_LIVE || r->_state != ROUTER_NEW || _hotswap_router
+        || r->_requirements.size() != _requirements.size())
+        return false;
+    for (int i = 0; i < _requirements.size(); ++i)
+        if (r->_requirements[i] != _requirements[i])
+            return false;
+
+    // A full hotswap reports any errors in the new graph.
+    ErrorHandler *serrh = ErrorHandler::silent_handler();
+    if (r->check_hookup_elements(serrh) < 0
+        || r->check_hookup_range(serrh) < 0)
+        return false;
+    r->make_gports();
+    if (r->check_push_and_pull(serrh) < 0
+        || r->check_hookup_completeness(serrh) < 0)
+        return false;
+
+    // Thread scheduler preferences are stored by element index.
+    if (_thread_sched) {
+        if (r->nelements() != nelements())
+            return false;
+        for (int i = 0; i < nelements(); ++i)
+            if (r->_element_names[i] != _element_names[i])
+                return false;
+    }
+
+    HashTable<String, int> eindex(-1);
+    for (int j = 0; j < nelements(); ++j)
+        eindex[_element_names[j]] = j;
+    hs.lmap.assign(r->nelements(), -1);
+    hs.kept.assign(nelements(), -1);
+    hs.signatures.assign(nelements(), String());
+    for (int i = 0; i < r->nelements(); ++i) {
+        int j = eindex.get(r->_element_names[i]);
+        if (j < 0 || strcmp(_elements[j]->class_name(), r->_elements[i]->class_name()) != 0
+            || (_element_configurations[j] != r->_element_configurations[i]
+                && !_elements[j]->can_live_reconfigure()))
+            continue;
+        hs.signatures[j] = port_signature(_elements[j]);
+        if (hs.signatures[j] == port_signature(r->_elements[i])) {
+            hs.lmap[i] = j;
+            hs.kept[j] = i;
+        }
+    }
+
+    // An element whose configuration names a removed element may hold a
+    // pointer to it, so it must be replaced too.
+    Vector<int> work;
+    for (int j = 0; j < nelements(); ++j)
+        if (hs.kept[j] < 0)
+            work.push_back(j);
+    while (work.size()) {
+        const String &name = _element_names[work.back()];
+        work.pop_back();
+        for (int k = 0; k < nelements(); ++k)
+            if (hs.kept[k] >= 0
+                && configuration_mentions(_element_configurations[k], name)) {
+                hs.lmap[hs.kept[k]] = -1;
+                hs.kept[k] = -1;
+                work.push_back(k);
+            }
+    }
+
+    for (int ord = 0; ord < nelements(); ++ord) {
+        int j = _element_configure_order[ord];
+        if (hs.kept[j] >= 0)
+            continue;
+        Element *e = _elements[j];
+        for (int a = 0; a < _attachments.size(); ++a)
+            if (_attachments[a] == e)
+                return false;
+        if (_thread_sched && e->cast("StaticThreadSched"))
+            return false;
+        hs.removed.push_back(j);
+    }
+
+    for (int i = 0; i < r->nelements(); ++i)
+        if (hs.lmap[i] >= 0
+            && _element_configurations[hs.lmap[i]] != r->_element_configurations[i])
+            hs.changed.push_back(i);
+    return true;
+}
+
+/* Swap @a hs.r's new elements and connections into this router, then
+   configure and initialize the new elements.  Returns 1 on success, or the
+   result of hotswap_rollback(). */
+int
+Router::hotswap_install(Hotswap &hs, ErrorHandler *errh)
+{
+    Router *r = hs.r;
+    int n = r->nelements();
+
+    // Remember the notifiers and threads kept elements see now.
+    hs.nsearches = _notifier_searches.size();
+    hs.search_found.resize(hs.nsearches);
+    for (int k = 0; k < hs.nsearches; ++k) {
+        const notifier_search_t &ns = _notifier_searches[k];
+        hs.search_ok.push_back(Notifier::search_notifiers(ns.e, ns.isoutput, ns.port, ns.name, hs.search_found[k]));
+    }
+    bool check_threads = _master->nthreads() > 1;
+    for (int j = 0; check_threads && j < nelements(); ++j)
+        if (hs.kept[j] >= 0)
+            for (int pull = 0; pull < 2; ++pull) {
+                bool fullpush;
+                hs.threads.push_back(_elements[j]->passing_threads(pull, fullpush));
+                hs.fullpush.push_back(fullpush);
+            }
+#if HAVE_BATCH
+    hs.batch_modes = _element_batch_modes;
+    for (int j = 0; j < nelements(); ++j) {
+        hs.in_batch_mode.push_back(_elements[j]->in_batch_mode);
+        hs.receives_batch.push_back(_elements[j]->receives_batch);
+    }
+#endif
+    hs.elements = _elements;
+    hs.names = _element_names;
+    hs.configurations = _element_configurations;
+    hs.landmarkids = _element_landmarkids;
+    hs.landmarks = _element_landmarks;
+    hs.last_landmarkid = _last_landmarkid;
+    hs.home_thread_ids = _element_home_thread_ids;
+    hs.configure_order = _element_configure_order;
+    sort_connections();
+    hs.conn = _conn;
+    hs.conn_output_sorter = _conn_output_sorter;
+    hs.ehandler_first_by_element = _ehandler_first_by_element;
+    hs.nehandlers = _ehandler_to_handler.size();
+    hs.flow_code_override_eindex = _flow_code_override_eindex;
+    hs.flow_code_override = _flow_code_override;
+    hs.attachment_names = _attachment_names;
+    hs.attachments = _attachments;
+    hs.thread_sched = _thread_sched;
+
+    // r's copies of kept elements are not needed.
+    for (int i = 0; i < n; ++i)
+        if (hs.lmap[i] >= 0) {
+            r->_elements[i]->cleanup(Element::CLEANUP_NO_ROUTER);
+            delete r->_elements[i];
+        }
+
+    // Removed elements move to a router of their own, so they keep their
+    // names for take_state() and can be cleaned up later.
+    Router *old = hs.old = new Router(String(), _master);
+    old->_element_home_thread_ids.push_back(_element_home_thread_ids[0]);
+    for (int k = 0; k < hs.removed.size(); ++k) {
+        int j = hs.removed[k];
+        old->_elements.push_back(_elements[j]);
+        old->_element_names.push_back(_element_names[j]);
+        old->_element_configurations.push_back(_element_configurations[j]);
+        old->_element_landmarkids.push_back(_element_landmarkids[j]);
+        old->_element_home_thread_ids.push_back(_element_home_thread_ids[j + 1]);
+        reattach(_elements[j], old, k);
+    }
+    old->_element_landmarks = _element_landmarks;
+    old->_last_landmarkid = _last_landmarkid;
+    old->_ehandler_first_by_element.assign(hs.removed.size(), -1);
+
+    // Install r's graph.
+    for (int i = 0; i < n; ++i) {
+        Element *e = (hs.lmap[i] >= 0 ? hs.elements[hs.lmap[i]] : r->_elements[i]);
+        r->_elements[i] = e;
+        reattach(e, this, i);
+    }
+    _elements.swap(r->_elements);
+    _element_names.swap(r->_element_names);
+    _element_configurations.swap(r->_element_configurations);
+    _element_landmarkids.swap(r->_element_landmarkids);
+    _element_landmarks.swap(r->_element_landmarks);
+    _last_landmarkid = r->_last_landmarkid;
+    r->_elements.clear();
+    r->_element_names.clear();
+    r->_element_configurations.clear();
+    r->_element_landmarkids.clear();
+    _element_name_sorter.clear();
+
+    _element_home_thread_ids.assign(n + 1, ThreadSched::THREAD_UNKNOWN);
+    _element_home_thread_ids[0] = hs.home_thread_ids[0];
+    Vector<int> configure_phase(n, 0);
+    _element_configure_order.assign(n, 0);
+    _ehandler_first_by_element.assign(n, -1);
+    for (int i = 0; i < n; ++i) {
+        if (hs.lmap[i] >= 0) {
+            _element_home_thread_ids[i + 1] = hs.home_thread_ids[hs.lmap[i] + 1];
+            _ehandler_first_by_element[i] = hs.ehandler_first_by_element[hs.lmap[i]];
+        }
+        configure_phase[i] = _elements[i]->configure_phase();
+        _element_configure_order[i] = i;
+    }
+    if (n)
+        click_qsort(&_element_configure_order[0], n, sizeof(int), configure_order_compar, configure_phase.begin());
+
+    _conn = r->_conn;
+    _conn_output_sorter = r->_conn_output_sorter;
+    _conn_sorted = true;
+
+    _flow_code_override_eindex.clear();
+    _flow_code_override.clear();
+    for (int k = 0; k < hs.flow_code_override.size(); ++k) {
+        int j = hs.flow_code_override_eindex[k];
+        if (j >= 0 && hs.kept[j] >= 0)
+            set_flow_code_override(hs.kept[j], hs.flow_code_override[k]);
+    }
+
+    // Connect the ports.  Kept elements must see the same port types.
+    make_gports();
+    if (check_push_and_pull(ErrorHandler::silent_handler()) < 0)
+        return hotswap_rollback(hs, 0);
+    for (int i = 0; i < n; ++i)
+        if (hs.lmap[i] >= 0 && port_signature(_elements[i]) != hs.signatures[hs.lmap[i]])
+            return hotswap_rollback(hs, 0);
+    set_connections();
+
+    // Configure new elements, then reconfigure changed ones.
+    hs.stage.assign(n, Element::CLEANUP_BEFORE_CONFIGURE);
+    bool all_ok = true;
+    Vector<String> conf;
+    for (int ord = 0; ord < n; ++ord) {
+        int i = _element_configure_order[ord];
+        if (hs.lmap[i] < 0) {
+            hs.stage[i] = configure_element(i, conf, errh);
+            if (hs.stage[i] == Element::CLEANUP_CONFIGURE_FAILED)
+                all_ok = false;
+        }
+    }
+    if (!all_ok)
+        return hotswap_rollback(hs, -EINVAL);
+
+    for (; hs.nreconfigured < hs.changed.size(); ++hs.nreconfigured) {
+        int i = hs.changed[hs.nreconfigured];
+        cp_argvec(_element_configurations[i], conf);
+        RouterContextErrh cerrh(errh, "While reconfiguring", _elements[i]);
+        if (_elements[i]->live_reconfigure(conf, &cerrh) < 0)
+            return hotswap_rollback(hs, -EINVAL);
+    }
+
+    // Kept elements' notifier signals must stay valid.
+    for (int k = 0; k < hs.nsearches; ++k) {
+        const notifier_search_t &ns = _notifier_searches[k];
+        if (ns.e->router() == this) {
+            Vector<Notifier *> found;
+            bool ok = Notifier::search_notifiers(ns.e, ns.isoutput, ns.port, ns.name, found);
+            if (ok != (bool) hs.search_ok[k]
+                || !same_notifiers(found, hs.search_found[k]))
+                return hotswap_rollback(hs, 0);
+        }
+    }
+
+#if HAVE_BATCH
+    _element_batch_modes.assign(n, Element::BATCH_MODE_NO);
+    for (int i = 0; i < n; ++i)
+        _element_batch_modes[i] = (hs.lmap[i] >= 0 ? hs.batch_modes[hs.lmap[i]] : _elements[i]->in_batch_mode);
+    set_batch_modes();
+#endif
+
+    // Initialize new elements.
+    for (int i = 0; i < n; ++i)
+        if (hs.lmap[i] < 0)
+            _elements[i]->add_default_handlers(true);
+    for (int i = 0; i < n; ++i)
+        if (hs.lmap[i] < 0)
+            _elements[i]->add_handlers();
+    _hotswap_router = old;
+    for (int ord = 0; ord < n; ++ord) {
+        int i = _element_configure_order[ord];
+        if (hs.lmap[i] >= 0)
+            continue;
+        RouterContextErrh cerrh(errh, "While initializing", _elements[i]);
+        if (_elements[i]->initialize(&cerrh) >= 0)
+            hs.stage[i] = Element::CLEANUP_INITIALIZED;
+        else {
+            if (!cerrh.nerrors() && !_elements[i]->cast("Error"))
+                cerrh.error("unspecified error");
+            hs.stage[i] = Element::CLEANUP_INITIALIZE_FAILED;
+            return hotswap_rollback(hs, -EINVAL);
+        }
+    }
+
+#if HAVE_BATCH
+    bind_ports();
+#endif
+    for (int i = 0; i < n; ++i)
+        if (hs.lmap[i] < 0)
+            _element_home_thread_ids[i + 1] = hard_home_thread_id(_elements[i]);
+
+    // Kept elements must see the same threads, since they may have chosen
+    // to lock or not based on them.
+    for (int j = 0, t = 0; check_threads && j < hs.kept.size(); ++j)
+        if (hs.kept[j] >= 0)
+            for (int pull = 0; pull < 2; ++pull, ++t) {
+                bool fullpush;
+                if (_elements[hs.kept[j]]->passing_threads(pull, fullpush) != hs.threads[t]
+                    || fullpush != (bool) hs.fullpush[t])
+                    return hotswap_rollback(hs, 0);
+            }
+
+    hotswap_commit(hs, errh);
+    return 1;
+}
+
+/* Undo hotswap_install(): remove the new elements, put the removed ones
+   back, and restore this router's graph.  Returns @a result. */
+int
+Router::hotswap_rollback(Hotswap &hs, int result)
+{
+    Router *r = hs.r;
+    int n = nelements();
+
+    for (int k = hs.nsearches; k < _notifier_searches.size(); ++k) {
+        const notifier_search_t &ns = _notifier_searches[k];
+        Vector<Notifier *> found;
+        if ((ns.f || ns.user_data)
+            && Notifier::search_notifiers(ns.e, ns.isoutput, ns.port, ns.name, found))
+            for (int x = 0; x < found.size(); ++x)
+                found[x]->remove_activate_callback(ns.f, ns.user_data);
+    }
+    _notifier_searches.resize(hs.nsearches);
+
+    // Remove the new elements through r.
+    Vector<int> stage;
+    for (int ord = 0; ord < n; ++ord) {
+        int i = _element_configure_order[ord];
+        if (hs.lmap[i] >= 0)
+            continue;
+        for (int eh = _ehandler_first_by_element[i]; eh >= 0; eh = _ehandler_next[eh])
+            xhandler(_ehandler_to_handler[eh])->_use_count--;
+        reattach(_elements[i], r, r->_elements.size());
+        r->_elements.push_back(_elements[i]);
+        stage.push_back(hs.stage.size() ? hs.stage[i] : Element::CLEANUP_BEFORE_CONFIGURE);
+    }
+    if (r->_elements.size()) {
+        _master->prepare_router(r);
+        _master->kill_router(r);
+        for (int k = r->_elements.size() - 1; k >= 0; --k) {
+            r->_elements[k]->cleanup((Element::CleanupStage) stage[k]);
+            delete r->_elements[k];
+        }
+        r->_elements.clear();
+    }
+
+    hs.old->_elements.clear();
+    _elements = hs.elements;
+    for (int j = 0; j < _elements.size(); ++j)
+        reattach(_elements[j], this, j);
+    _element_names = hs.names;
+    _element_configurations = hs.configurations;
+    _element_landmarkids = hs.landmarkids;
+    _element_landmarks = hs.landmarks;
+    _last_landmarkid = hs.last_landmarkid;
+    _element_name_sorter.clear();
+    _element_home_thread_ids = hs.home_thread_ids;
+    _element_configure_order = hs.configure_order;
+    _conn = hs.conn;
+    _conn_output_sorter = hs.conn_output_sorter;
+    _conn_sorted = true;
+    _ehandler_first_by_element = hs.ehandler_first_by_element;
+    _ehandler_to_handler.resize(hs.nehandlers);
+    _ehandler_next.resize(hs.nehandlers);
+    _flow_code_override_eindex = hs.flow_code_override_eindex;
+    _flow_code_override = hs.flow_code_override;
+    _attachment_names = hs.attachment_names;
+    _attachments = hs.attachments;
+    _thread_sched = hs.thread_sched;
+    _hotswap_router = 0;
+
+    make_gports();
+    check_push_and_pull(ErrorHandler::silent_handler());
+    set_connections();
+#if HAVE_BATCH
+    _element_batch_modes = hs.batch_modes;
+    for (int j = 0; j < _elements.size(); ++j) {
+        _elements[j]->in_batch_mode = (Element::batch_mode) hs.in_batch_mode[j];
+        _elements[j]->receives_batch = hs.receives_batch[j];
+    }
+    bind_ports();
+#endif
+
+    Vector<String> conf;
+    while (--hs.nreconfigured >= 0) {
+        int j = hs.lmap[hs.changed[hs.nreconfigured]];
+        cp_argvec(_element_configurations[j], conf);
+        _elements[j]->live_reconfigure(conf, ErrorHandler::silent_handler());
+    }
+
+    delete hs.old;
+    hs.old = 0;
+    return result;
+}
+
+/* Finish hotswap_install(): detach the removed elements from the rest of
+   the router, let new elements take their state, and leave them to be
+   deleted with @a hs.r. */
+void
+Router::hotswap_commit(Hotswap &hs, ErrorHandler *errh)
+{
+    Router *old = hs.old;
+
+    int nsearches = 0;
+    for (int k = 0; k < _notifier_searches.size(); ++k) {
+        const notifier_search_t &ns = _notifier_searches[k];
+        if (ns.e->router() != old)
+            _notifier_searches[nsearches++] = ns;
+        else if (hs.search_ok[k] && (ns.f || ns.user_data))
+            for (int x = 0; x < hs.search_found[k].size(); ++x)
+                hs.search_found[k][x]->remove_activate_callback(ns.f, ns.user_data);
+    }
+    _notifier_searches.resize(nsearches);
+
+    for (int k = 0; k < hs.removed.size(); ++k)
+        for (int eh = hs.ehandler_first_by_element[hs.removed[k]]; eh >= 0; eh = _ehandler_next[eh])
+            xhandler(_ehandler_to_handler[eh])->_use_count--;
+    compact_ehandlers();
+
+    // Unschedule the removed elements' tasks and timers.
+    for (int k = 0; k < old->nelements(); ++k)
+        old->_element_configure_order.push_back(k);
+    _master->prepare_router(old);
+    _master->kill_router(old);
+    old->_state = ROUTER_LIVE;
+
+    for (int ord = 0; ord < nelements(); ++ord) {
+        int i = _element_configure_order[ord];
+        if (hs.lmap[i] < 0)
+            if (Element *other = _elements[i]->hotswap_element()) {
+                RouterContextErrh cerrh(errh, "While hot-swapping state into", _elements[i]);
+                _elements[i]->take_state(other, &cerrh);
+            }
+    }
+    _hotswap_router = 0;
+
+    old->use();
+    hs.r->_hotswap_router = old;
+    hs.old = 0;
+}
+
+/** @brief Apply @a r's configuration to this live router in place.
+ * @param r new router, as parsed but not initialized
+ * @param errh error handler
+ * @return 1 if this router now has @a r's configuration, 0 if @a r cannot
+ * be applied in place, or a negative error code
+ *
+ * A full hotswap replaces every element, so packets in queues and device
+ * queues are lost, element state must be transferred by take_state(), and
+ * traffic stops while the new router initializes.  Instead, this function
+ * keeps every element that @a r has under the same name, with the same
+ * class and port types, and with the same configuration or one that the
+ * element accepts through live_reconfigure().  Only the other elements of
+ * @a r are configured and initialized; they are wired in with @a r's
+ * connections, and may take_state() from the elements they replace.  Thus
+ * adding a route or a classifier rule replaces the routing table or the
+ * classifier, but not the queues around it.  An element whose configuration
+ * names a replaced element is replaced as well, since it may hold a pointer
+ * to it.
+ *
+ * Returns 0 without changing anything if the two routers have different
+ * requirements, if @a r's graph has errors, if a removed element is a
+ * router attachment or the thread scheduler, or if the router has a thread
+ * scheduler and the element names differ.  It also undoes the change and
+ * returns 0 if a kept element would see different port types, notifiers or
+ * passing threads in the new graph.  Other state that elements derive from
+ * the graph during initialization is not checked.  If a new element fails
+ * to configure or initialize, or a changed element rejects its new
+ * configuration, the change is undone and the function returns -EINVAL.
+ *
+ * The caller must ensure that no other thread is running this router's
+ * tasks or timers, for instance with Master::block_all(), which may be
+ * called from a handler.  On return, @a r holds no elements of its own,
+ * and must be deleted with Router::unuse(); on success, that cleans up and
+ * deletes the removed elements. */
+int
+Router::hotswap_in_place(Router *r, ErrorHandler *errh)
+{
+    Hotswap hs;
+    hs.r = r;
+    hs.old = 0;
+    hs.nreconfigured = 0;
+    if (!hotswap_match(hs))
+        return 0;
+    return hotswap_install(hs, errh);
+}
+
 
 // HANDLERS
 
@@ -1450,7 +2216,8 @@ Router::find_ehandler(int eindex, const String &hname, bool allow_star) const
     while (eh >= 0) {
         int h = _ehandler_to_handler[eh];
         const String &hn = xhandler(h)->name();
-        if (hn == hname)
+        // most of an element's handler names differ in length
+        if (hn.length() == hname.length() && hn == hname)
             return eh;
         else if (hn.length() == 1 && hn[0] == '*')
             star_h = h;
@@ -1621,6 +2388,29 @@ Router::store_handler(const Element *e, Handler &to_store)
 }
 
 
+/* Rebuild the element handler lists, dropping entries that no element's
+   list reaches any more. */
+void
+Router::compact_ehandlers()
+{
+    Vector<int> to_handler, next;
+    for (int i = 0; i < nelements(); ++i) {
+        int eh = _ehandler_first_by_element[i], last = -1;
+        _ehandler_first_by_element[i] = -1;
+        for (; eh >= 0; eh = _ehandler_next[eh]) {
+            if (last < 0)
+                _ehandler_first_by_element[i] = to_handler.size();
+            else
+                next[last] = to_handler.size();
+            last = to_handler.size();
+            to_handler.push_back(_ehandler_to_handler[eh]);
+            next.push_back(-1);
+        }
+    }
+    _ehandler_to_handler.swap(to_handler);
+    _ehandler_next.swap(next);
+}
+
 // Public functions for finding handlers
 
 /** @brief Return @a router's handler with index @a hindex.
@@ -1962,6 +2752,32 @@ Router::new_notifier_signal(const char *name, NotifierSignal &signal)
     return 0;
 }
 
+/** @brief Record a notifier signal search.
+ * @param e element that searched
+ * @param isoutput true if the search went downstream from an output
+ * @param port port at which the search started
+ * @param name notifier name
+ * @param f callback registered with the notifiers found, if any
+ * @param user_data callback data
+ *
+ * Notifier::upstream_signal() and Notifier::downstream_full_signal() call
+ * this function, so that hotswap_in_place() can check that a graph change
+ * leaves @a e's signal valid, and remove @a e's callbacks if @a e is
+ * removed. */
+void
+Router::add_notifier_search(Element *e, bool isoutput, int port, const char *name,
+                            void (*f)(void *, Notifier *), void *user_data)
+{
+    notifier_search_t ns;
+    ns.e = e;
+    ns.isoutput = isoutput;
+    ns.port = port;
+    ns.name = name;
+    ns.f = f;
+    ns.user_data = user_data;
+    _notifier_searches.push_back(ns);
+}
+
 String
 Router::notifier_signal_name(const atomic_uint32_t *signal) const
 {
@@ -2228,10 +3044,69 @@ Router::configuration_string() const
     }
 }
 
+
+// PROFILING
+
+/** @brief  Turn profiling of every element on or off.
+ *
+ *  @sa Element::set_profiling, unparse_profile */
+void
+Router::set_profiling(bool on)
+{
+    for (int i = 0; i < _elements.size(); ++i)
+        _elements[i]->set_profiling(on);
+    _profiling = on;
+}
+
+/** @brief  Clear every element's profiling statistics. */
+void
+Router::reset_profile()
+{
+    for (int i = 0; i < _elements.size(); ++i)
+        _elements[i]->reset_profile();
+}
+
+/** @brief  Unparse a profiling summary into @a sa.
+ *
+ *  Writes one line per element that has been called while profiling, with
+ *  its name, class, number of calls, number of batch calls, packets, own
+ *  cycles, own cycles per packet, and a histogram of calls by batch size.
+ *  Histogram buckets are written as "SIZE:CALLS", where SIZE is a range
+ *  like "4-7"; empty buckets are omitted.  An element whose inputs see many
+ *  calls of size 1 while its upstream neighbor sees batches is unbatching
+ *  its traffic. */
+void
+Router::unparse_profile(StringAccum &sa) const
+{
+    sa << "# element class calls batch_calls packets own_cycles own_cycles/packet batch_sizes\n";
+    for (int i = 0; i < _elements.size(); ++i) {
+        Element *e = _elements[i];
+        Element::Profile p = e->profile();
+        if (!p.calls)
+            continue;
+        sa << e->name() << ' ' << e->class_name() << ' ' << p.calls << ' '
+           << p.batch_calls << ' ' << p.packets << ' ' << p.own_cycles << ' '
+           << int_divide(p.own_cycles, p.packets ? p.packets : 1);
+        for (int b = 0; b < Element::Profile::nbuckets; ++b)
+            if (p.batch_sizes[b]) {
+                sa << ' ';
+                if (b <= 1)
+                    sa << b;
+                else if (b == Element::Profile::nbuckets - 1)
+                    sa << (1U << (b - 1)) << '+';
+                else
+                    sa << (1U << (b - 1)) << '-' << (1U << b) - 1;
+                sa << ':' << p.batch_sizes[b];
+            }
+        sa << '\n';
+    }
+}
+
 enum { GH_VERSION, GH_CONFIG, GH_FLATCONFIG, GH_LIST, GH_REQUIREMENTS,
        GH_DRIVER, GH_ACTIVE_PORTS, GH_ACTIVE_PORT_STATS, GH_STRING_PROFILE,
        GH_STRING_PROFILE_LONG, GH_SCHEDULING_PROFILE, GH_STOP,
-       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES };
+       GH_ELEMENT_CYCLES, GH_CLASS_CYCLES, GH_RESET_CYCLES,
+       GH_PROFILING, GH_ELEMENT_PROFILE, GH_RESET_PROFILE };
 
 #if CLICK_STATS >= 2
 struct stats_info {
@@ -2268,6 +3143,14 @@ Router::router_read_handler(Element *e, void *thunk)
         }
         break;
 
+      case GH_PROFILING:
+        return String(r && r->profiling());
+
+      case GH_ELEMENT_PROFILE:
+        if (r)
+            r->unparse_profile(sa);
+        break;
+
       case GH_REQUIREMENTS:
         if (r)
             for (int i = 0; i < r->_requirements.size(); i++)
@@ -2438,6 +3321,16 @@ Router::router_write_handler(const String &s, Element *e, void *thunk, ErrorHand
             errh->message("no router to stop");
         break;
     }
+    case GH_PROFILING: {
+        bool on;
+        if (!BoolArg().parse(cp_uncomment(s), on))
+            return errh->error("syntax error");
+        r->set_profiling(on);
+        break;
+    }
+    case GH_RESET_PROFILE:
+        r->reset_profile();
+        break;
 #if CLICK_STATS >= 2
     case GH_RESET_CYCLES:
         for (int i = 0; i < (r ? r->nelements() : 0); i++)
@@ -2463,6 +3356,10 @@ Router::static_initialize()
         add_read_handler(0, "handlers", Element::read_handlers_handler, 0);
         add_read_handler(0, "list", router_read_handler, (void *)GH_LIST);
         add_write_handler(0, "stop", router_write_handler, (void *)GH_STOP);
+        add_read_handler(0, "profiling", router_read_handler, (void *)GH_PROFILING);
+        add_write_handler(0, "profiling", router_write_handler, (void *)GH_PROFILING);
+        add_read_handler(0, "element_profile", router_read_handler, (void *)GH_ELEMENT_PROFILE);
+        add_write_handler(0, "reset_profile", router_write_handler, (void *)GH_RESET_PROFILE);
 #if CLICK_STATS >= 1
         add_read_handler(0, "active_ports", router_read_handler, (void *)GH_ACTIVE_PORTS);
         add_read_handler(0, "active_port_stats", router_read_handler, (void *)GH_ACTIVE_PORT_STATS);
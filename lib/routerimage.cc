@@ -0,0 +1,184 @@
+// -*- related-file-name: "../include/click/routerimage.hh" -*-
+/*
+ * routerimage.{cc,hh} -- precompiled router configurations
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#include <click/routerimage.hh>
+#include <click/error.hh>
+#include <click/straccum.hh>
+CLICK_DECLS
+
+/* Image format:
+
+   "\177CLICKRI"		magic
+   u32 version
+   u32 N, then N strings	requirements, as (type, value) pairs
+   u32 N, then N elements	each: name, class, configuration, filename,
+				u32 lineno, processing code
+   u32 N, then N connections	each: u32 from, from port, to, to port
+   string			flattened configuration text
+
+   A u32 is 4 bytes, big-endian.  A string is a u32 length followed by that
+   many bytes. */
+
+static const char magic[] = "\177CLICKRI";
+enum { magic_len = 8 };
+
+bool
+RouterImage::is_image(const String &str)
+{
+    return str.length() >= magic_len && memcmp(str.data(), magic, magic_len) == 0;
+}
+
+static void
+append_u32(StringAccum &sa, uint32_t x)
+{
+    if (char *s = sa.extend(4)) {
+	s[0] = x >> 24;
+	s[1] = x >> 16;
+	s[2] = x >> 8;
+	s[3] = x;
+    }
+}
+
+static void
+append_string(StringAccum &sa, const String &str)
+{
+    append_u32(sa, str.length());
+    sa << str;
+}
+
+String
+RouterImage::unparse() const
+{
+    StringAccum sa;
+    sa.append(magic, magic_len);
+    append_u32(sa, version);
+
+    append_u32(sa, requirements.size());
+    for (const String *r = requirements.begin(); r != requirements.end(); ++r)
+	append_string(sa, *r);
+
+    append_u32(sa, elements.size());
+    for (const Element *e = elements.begin(); e != elements.end(); ++e) {
+	append_string(sa, e->name);
+	append_string(sa, e->class_name);
+	append_string(sa, e->configuration);
+	append_string(sa, e->filename);
+	append_u32(sa, e->lineno);
+	append_string(sa, e->processing);
+    }
+
+    append_u32(sa, connections.size());
+    for (const Connection *c = connections.begin(); c != connections.end(); ++c) {
+	append_u32(sa, c->from);
+	append_u32(sa, c->from_port);
+	append_u32(sa, c->to);
+	append_u32(sa, c->to_port);
+    }
+
+    append_string(sa, configuration);
+    return sa.take_string();
+}
+
+namespace {
+struct ImageReader {
+    const String &str;
+    const unsigned char *s;
+    const unsigned char *end;
+    bool ok;
+
+    ImageReader(const String &str_)
+	: str(str_), s(reinterpret_cast<const unsigned char *>(str_.begin())),
+	  end(reinterpret_cast<const unsigned char *>(str_.end())), ok(true) {
+    }
+    uint32_t u32() {
+	if (end - s < 4) {
+	    ok = false;
+	    return 0;
+	}
+	uint32_t x = ((uint32_t) s[0] << 24) | (s[1] << 16) | (s[2] << 8) | s[3];
+	s += 4;
+	return x;
+    }
+    // a count of items at least @a item_size bytes long
+    int count(int item_size) {
+	uint32_t n = u32();
+	if (n > (uint32_t) (end - s) / item_size)
+	    ok = false;
+	return ok ? n : 0;
+    }
+    String string() {
+	uint32_t len = u32();
+	if (len > (uint32_t) (end - s)) {
+	    ok = false;
+	    return String();
+	}
+	const char *x = reinterpret_cast<const char *>(s);
+	s += len;
+	return str.substring(x, x + len);
+    }
+};
+}
+
+int
+RouterImage::parse(const String &str, ErrorHandler *errh)
+{
+    if (!errh)
+	errh = ErrorHandler::silent_handler();
+    if (!is_image(str))
+	return errh->error("not a precompiled router image");
+
+    ImageReader r(str);
+    r.s += magic_len;
+    uint32_t v = r.u32();
+    if (r.ok && v != version)
+	return errh->error("router image version %u not supported (expected %d)", v, version);
+
+    requirements.resize(r.count(4));
+    for (String *rq = requirements.begin(); rq != requirements.end(); ++rq)
+	*rq = r.string();
+    if (requirements.size() % 2)
+	r.ok = false;
+
+    elements.resize(r.count(24));
+    for (Element *e = elements.begin(); e != elements.end(); ++e) {
+	e->name = r.string();
+	e->class_name = r.string();
+	e->configuration = r.string();
+	e->filename = r.string();
+	e->lineno = r.u32();
+	e->processing = r.string();
+    }
+
+    connections.resize(r.count(16));
+    for (Connection *c = connections.begin(); c != connections.end(); ++c) {
+	c->from = r.u32();
+	c->from_port = r.u32();
+	c->to = r.u32();
+	c->to_port = r.u32();
+	if ((unsigned) c->from >= (unsigned) elements.size()
+	    || (unsigned) c->to >= (unsigned) elements.size()
+	    || c->from_port < 0 || c->to_port < 0)
+	    r.ok = false;
+    }
+
+    configuration = r.string();
+    if (!r.ok || r.s != r.end)
+	return errh->error("router image corrupted");
+    return 0;
+}
+
+CLICK_ENDDECLS
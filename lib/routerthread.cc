@@ -639,6 +639,14 @@ RouterThread::driver()
         if (_pending_head.x)
             process_pending();
 
+#if TIMESTAMP_TSC
+        if (unlikely(Timestamp::tsc_calibrate_due()))
+            Timestamp::tsc_calibrate_poll();
+#endif
+#if CLICK_USERLEVEL
+        Timestamp::refresh_recent_tsc();
+#endif
+
         // run tasks
         do {
 #if HAVE_ADAPTIVE_SCHEDULER
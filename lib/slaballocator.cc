@@ -0,0 +1,252 @@
+// -*- c-basic-offset: 4; related-file-name: "../include/click/slaballocator.hh" -*-
+/*
+ * slaballocator.cc -- per-thread slab allocator for flow state
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/glue.hh>
+#include <click/slaballocator.hh>
+#include <click/straccum.hh>
+#include <click/algorithm.hh>
+#if CLICK_USERLEVEL
+# include <sys/mman.h>
+#endif
+CLICK_DECLS
+
+enum { slab_new, slab_mmap, slab_huge };
+
+SlabAllocator::SlabAllocator(size_t size)
+    : _size(0), _ncaches(click_max_cpu_ids()), _pool(new pool)
+{
+    if (_ncaches < 1)
+	_ncaches = 1;
+    // new[] would not honor the caches' cache-line alignment before C++17
+    _caches = (cache *) click_aligned_alloc(sizeof(cache), sizeof(cache) * _ncaches);
+    for (cache *c = _caches; c != _caches + _ncaches; ++c) {
+	c->free = c->spare = 0;
+	c->nfree = 0;
+	c->pos = c->end = c->begin = 0;
+	c->carved = 0;
+	c->slab_size = min_slab_size;
+    }
+    _pool->slabs = 0;
+    _pool->reserved_bytes = 0;
+    _pool->nslabs = _pool->nhuge_slabs = 0;
+    increase_size(size);
+#ifdef VALGRIND_CREATE_MEMPOOL
+    VALGRIND_CREATE_MEMPOOL(_pool, 0, 0);
+#endif
+}
+
+SlabAllocator::~SlabAllocator()
+{
+    while (slab *s = _pool->slabs) {
+	_pool->slabs = s->next;
+	free_slab(s);
+    }
+#ifdef VALGRIND_DESTROY_MEMPOOL
+    VALGRIND_DESTROY_MEMPOOL(_pool);
+#endif
+    click_aligned_free(_caches);
+    delete _pool;
+}
+
+void
+SlabAllocator::increase_size(size_t new_size)
+{
+    assert(!_pool->slabs && new_size >= _size);
+    // keep objects pointer-aligned
+    _size = (new_size + sizeof(void *) - 1) & ~(sizeof(void *) - 1);
+    if (_size < sizeof(link))
+	_size = sizeof(link);
+
+    // move about 16KB of objects per batch
+    size_t batch = 16384 / _size;
+    if (batch < min_batch)
+	batch = min_batch;
+    else if (batch > max_batch)
+	batch = max_batch;
+    _batch = batch;
+}
+
+void *
+SlabAllocator::new_slab(size_t length, int &kind)
+{
+#if CLICK_USERLEVEL
+    if (length >= huge_slab_size) {
+	void *data;
+# ifdef MAP_HUGETLB
+	data = mmap(0, length, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (data != MAP_FAILED) {
+	    kind = slab_huge;
+	    return data;
+	}
+# endif
+	// transparent huge pages only back aligned ranges, so map extra and
+	// trim the slab to a huge page boundary
+	data = mmap(0, length + huge_slab_size, PROT_READ | PROT_WRITE,
+		    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (data == MAP_FAILED)
+	    return 0;
+	char *x = reinterpret_cast<char *>(data);
+	size_t head = -(uintptr_t) x & (huge_slab_size - 1);
+	if (head)
+	    munmap(x, head);
+	munmap(x + head + length, huge_slab_size - head);
+	data = x + head;
+# ifdef MADV_HUGEPAGE
+	(void) madvise(data, length, MADV_HUGEPAGE);
+# endif
+	kind = slab_mmap;
+	return data;
+    }
+#endif
+    kind = slab_new;
+    return new char[length];
+}
+
+void
+SlabAllocator::free_slab(slab *s)
+{
+#if CLICK_USERLEVEL
+    if (s->kind != slab_new) {
+	munmap(s, s->length);
+	return;
+    }
+#endif
+    delete[] reinterpret_cast<char *>(s);
+}
+
+void *
+SlabAllocator::hard_allocate(cache &c)
+{
+    size_t size = _size;
+
+    // take this thread's spare batch, or a batch freed by any thread; the
+    // unlocked check may miss a batch being added, which is harmless
+    link *l = c.spare;
+    if (l)
+	c.spare = 0;
+    else if (_pool->depot.size()) {
+	_pool->lock.acquire();
+	if (_pool->depot.size()) {
+	    l = _pool->depot.back();
+	    _pool->depot.pop_back();
+	}
+	_pool->lock.release();
+    }
+    if (l) {
+#ifdef VALGRIND_MEMPOOL_ALLOC
+	VALGRIND_MEMPOOL_ALLOC(_pool, l, size);
+	VALGRIND_MAKE_MEM_DEFINED(&l->next, sizeof(l->next));
+#endif
+	c.free = l->next;
+	c.nfree = _batch - 1;
+#ifdef VALGRIND_MAKE_MEM_DEFINED
+	VALGRIND_MAKE_MEM_UNDEFINED(&l->next, sizeof(l->next));
+#endif
+	return l;
+    }
+
+    // otherwise carve up a new slab, twice as large as this thread's last
+    size_t length = c.slab_size;
+    if (length < sizeof(slab) + size * min_batch)
+	length = sizeof(slab) + size * min_batch;
+    if (length > huge_slab_size)
+	length = (length + huge_slab_size - 1) & ~(size_t) (huge_slab_size - 1);
+    int kind;
+    slab *s = reinterpret_cast<slab *>(new_slab(length, kind));
+    if (!s)
+	return 0;
+    s->length = length;
+    s->kind = kind;
+    if (c.slab_size < huge_slab_size)
+	c.slab_size *= 2;
+
+    _pool->lock.acquire();
+    s->next = _pool->slabs;
+    _pool->slabs = s;
+    _pool->reserved_bytes += length;
+    ++_pool->nslabs;
+    if (kind == slab_huge)
+	++_pool->nhuge_slabs;
+    _pool->lock.release();
+
+    char *data = reinterpret_cast<char *>(s + 1);
+    c.carved += (c.end - c.begin) / size;
+    c.begin = data;
+    c.pos = data + size;
+    c.end = data + ((length - sizeof(slab)) / size) * size;
+#ifdef VALGRIND_MEMPOOL_ALLOC
+    VALGRIND_MEMPOOL_ALLOC(_pool, data, size);
+#endif
+    return data;
+}
+
+void
+SlabAllocator::flush(cache &c)
+{
+    // the full free list becomes the spare; an older spare goes to the depot
+    if (c.spare) {
+	_pool->lock.acquire();
+	_pool->depot.push_back(c.spare);
+	_pool->lock.release();
+    }
+    c.spare = c.free;
+    c.free = 0;
+    c.nfree = 0;
+}
+
+void
+SlabAllocator::swap(SlabAllocator &x)
+{
+    click_swap(_size, x._size);
+    click_swap(_batch, x._batch);
+    click_swap(_caches, x._caches);
+    click_swap(_ncaches, x._ncaches);
+    click_swap(_pool, x._pool);
+}
+
+void
+SlabAllocator::stats(Stats &stats) const
+{
+    // objects carved from slabs, less those on free lists and in the depot;
+    // threads update their caches unlocked, so this is approximate
+    intptr_t objects = 0;
+    for (cache *c = _caches; c != _caches + _ncaches; ++c)
+	objects += c->carved + (c->pos - c->begin) / _size - c->nfree
+	    - (c->spare ? _batch : 0);
+    objects -= _pool->depot.size() * _batch;
+    if (objects < 0)
+	objects = 0;
+    stats.objects += objects;
+    stats.object_bytes += objects * _size;
+    stats.reserved_bytes += _pool->reserved_bytes;
+    stats.slabs += _pool->nslabs;
+    stats.huge_slabs += _pool->nhuge_slabs;
+}
+
+String
+SlabAllocator::Stats::unparse() const
+{
+    StringAccum sa;
+    sa << "objects " << objects << '\n'
+       << "object_bytes " << object_bytes << '\n'
+       << "reserved_bytes " << reserved_bytes << '\n'
+       << "slabs " << slabs << '\n'
+       << "huge_slabs " << huge_slabs << '\n';
+    return sa.take_string();
+}
+
+CLICK_ENDDECLS
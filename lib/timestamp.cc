@@ -24,6 +24,13 @@
 # include <unistd.h>
 # include <sys/ioctl.h>
 #endif
+#if TIMESTAMP_TSC
+# include <click/machine.hh>
+# include <click/atomic.hh>
+# if __GNUC__
+#  include <cpuid.h>
+# endif
+#endif
 CLICK_DECLS
 
 /** @file timestamp.hh
@@ -146,6 +153,148 @@ Timestamp::warp_jump_steady(const Timestamp &expiry)
 }
 #endif
 
+#if TIMESTAMP_TSC
+const TimestampTSC::calibration * volatile TimestampTSC::active;
+TimestampTSC::calibration TimestampTSC::cal[TimestampTSC::ncal];
+TimestampTSC::calibration TimestampTSC::sample;
+volatile click_cycles_t TimestampTSC::next_cycles = ~(click_cycles_t) 0;
+bool TimestampTSC::calibrating;
+# if HAVE___THREAD_STORAGE_CLASS
+__thread int64_t TimestampTSC::recent_nsec[2];
+# else
+int64_t TimestampTSC::recent_nsec[2];
+# endif
+static atomic_uint32_t tsc_lock;
+
+/* Return true iff the CPU advertises an invariant timestamp counter, which
+   ticks at a constant rate regardless of frequency scaling and sleep
+   states. */
+static bool
+tsc_invariant()
+{
+# if __GNUC__
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid(0x80000000, &eax, &ebx, &ecx, &edx) && eax >= 0x80000007
+        && __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx))
+        return edx & (1U << 8);
+# endif
+    return false;
+}
+
+/* Read the cycle counter together with both system clocks.  Keeps the
+   tightest of a few tries so that a preemption between the reads does not
+   skew the result. */
+static void
+tsc_sample(click_cycles_t &cycles, int64_t nsec[2])
+{
+    click_cycles_t best = ~(click_cycles_t) 0;
+    for (int i = 0; i < 8; ++i) {
+        click_cycles_t c0 = click_get_cycles();
+        Timestamp system = Timestamp::now_unwarped();
+        Timestamp steady = Timestamp::now_steady_unwarped();
+        click_cycles_t c1 = click_get_cycles();
+        if (c1 - c0 < best) {
+            best = c1 - c0;
+            cycles = c0 + (c1 - c0) / 2;
+            nsec[0] = system.nsecval();
+            nsec[1] = steady.nsecval();
+        }
+    }
+}
+
+enum { tsc_calibrate_nsec = 10000000, tsc_anchor_nsec = 1000000000 };
+
+void
+Timestamp::tsc_calibrate_start()
+{
+    TimestampTSC::calibrating = tsc_invariant();
+    if (TimestampTSC::calibrating) {
+        tsc_sample(TimestampTSC::sample.base_cycles, TimestampTSC::sample.base_nsec);
+        TimestampTSC::next_cycles = 0;
+    } else
+        TimestampTSC::next_cycles = ~(click_cycles_t) 0;
+}
+
+bool
+Timestamp::tsc_anchor()
+{
+    TimestampTSC::calibration &s = TimestampTSC::sample;
+    const TimestampTSC::calibration *old = TimestampTSC::active;
+    if (TimestampTSC::calibrating) {
+        if (now_steady_unwarped().nsecval() - s.base_nsec[1] < tsc_calibrate_nsec)
+            return false;
+    } else if (!old)
+        return false;
+    else if (click_get_cycles() < TimestampTSC::next_cycles)
+        return true;		// another thread just re-anchored
+
+    TimestampTSC::calibration c;
+    tsc_sample(c.base_cycles, c.base_nsec);
+    if (c.base_cycles <= s.base_cycles || c.base_nsec[1] <= s.base_nsec[1]) {
+        // cannot measure a rate; keep the current calibration, if any
+        TimestampTSC::calibrating = false;
+        TimestampTSC::next_cycles = old ? c.base_cycles + old->hz : ~(click_cycles_t) 0;
+        s = c;
+        return old;
+    }
+    // The counter's rate over the interval since the last sample; over a
+    // second or more, this follows the steady clock's frequency adjustments.
+    double rate = (double) (c.base_nsec[1] - s.base_nsec[1])
+        / (c.base_cycles - s.base_cycles);
+
+    TimestampTSC::calibration *n = TimestampTSC::cal;
+    if (old)
+        n = TimestampTSC::cal + (old - TimestampTSC::cal + 1) % TimestampTSC::ncal;
+    n->hz = (click_cycles_t) (1e9 / rate + 0.5);
+    n->base_cycles = c.base_cycles;
+    n->base_nsec[1] = c.base_nsec[1];
+    n->nsec_per_cycle = rate;
+    if (old) {
+        // Continue steady time where the old calibration puts it, and
+        // catch up with the steady clock over the next second.  Jump if
+        // more than half a second behind.  If ahead, at most halve the
+        // rate, so time never runs backwards.
+        int64_t predicted = old->nsec(c.base_cycles, true);
+        int64_t error = c.base_nsec[1] - predicted;
+        if (error < tsc_anchor_nsec / 2) {
+            if (error < -tsc_anchor_nsec / 2)
+                error = -tsc_anchor_nsec / 2;
+            n->base_nsec[1] = predicted;
+            n->nsec_per_cycle = rate * (1 + (double) error / tsc_anchor_nsec);
+        }
+    }
+    // System time moves with steady time, offset as of this sample.
+    n->base_nsec[0] = n->base_nsec[1] + (c.base_nsec[0] - c.base_nsec[1]);
+    s = c;
+
+    click_compiler_fence();
+    TimestampTSC::active = n;
+    TimestampTSC::calibrating = false;
+    TimestampTSC::next_cycles = c.base_cycles + (click_cycles_t) (tsc_anchor_nsec / rate);
+    return true;
+}
+
+bool
+Timestamp::tsc_calibrate_poll()
+{
+    if (tsc_lock.compare_swap(0, 1) != 0)
+        return TimestampTSC::active;
+    bool r = tsc_anchor();
+    click_compiler_fence();
+    tsc_lock = 0;
+    return r;
+}
+
+bool
+Timestamp::tsc_calibrate()
+{
+    tsc_calibrate_start();
+    while (TimestampTSC::calibrating && !tsc_calibrate_poll())
+        click_relax_fence();
+    return TimestampTSC::active;
+}
+#endif
+
 #if !CLICK_LINUXMODULE && !CLICK_BSDMODULE && !CLICK_MINIOS
 /** @brief Set this timestamp to a timeval obtained by calling ioctl.
     @param fd file descriptor
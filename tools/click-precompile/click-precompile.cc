@@ -0,0 +1,260 @@
+/*
+ * click-precompile.cc -- write a Click configuration as a precompiled
+ * router image
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, subject to the conditions
+ * listed in the Click LICENSE file. These conditions include: you must
+ * preserve this copyright notice, and you cannot mention the copyright
+ * holders in advertising related to the Software without their permission.
+ * The Software is provided WITHOUT ANY WARRANTY, EXPRESS OR IMPLIED. This
+ * notice is a summary of the Click LICENSE file; the license in that file is
+ * legally binding.
+ */
+
+#include <click/config.h>
+#include <click/pathvars.h>
+
+#include <click/error.hh>
+#include <click/driver.hh>
+#include <click/archive.hh>
+#include <click/routerimage.hh>
+#include "lexert.hh"
+#include "routert.hh"
+#include "elementmap.hh"
+#include "processingt.hh"
+#include "toolutils.hh"
+#include <click/clp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+
+#define HELP_OPT		300
+#define VERSION_OPT		301
+#define CLICKPATH_OPT		302
+#define ROUTER_OPT		303
+#define EXPRESSION_OPT		304
+#define OUTPUT_OPT		305
+
+static const Clp_Option options[] = {
+  { "clickpath", 'C', CLICKPATH_OPT, Clp_ValString, 0 },
+  { "expression", 'e', EXPRESSION_OPT, Clp_ValString, 0 },
+  { "file", 'f', ROUTER_OPT, Clp_ValString, 0 },
+  { "help", 0, HELP_OPT, 0, 0 },
+  { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
+  { "version", 'v', VERSION_OPT, 0, 0 },
+};
+
+static const char *program_name;
+
+void
+short_usage()
+{
+  fprintf(stderr, "Usage: %s [OPTION]... [ROUTERFILE]\n\
+Try '%s --help' for more information.\n",
+	  program_name, program_name);
+}
+
+void
+usage()
+{
+  printf("\
+'Click-precompile' reads a Click configuration, flattens it, checks it for\n\
+the user-level driver, and writes it as a precompiled router image. The\n\
+user-level driver loads router images without lexing or compound expansion.\n\
+\n\
+Usage: %s [OPTION]... [ROUTERFILE]\n\
+\n\
+Options:\n\
+  -f, --file FILE           Read router configuration from FILE.\n\
+  -e, --expression EXPR     Use EXPR as router configuration.\n\
+  -o, --output FILE         Write router image to FILE.\n\
+  -C, --clickpath PATH      Use PATH for CLICKPATH.\n\
+      --help                Print this message and exit.\n\
+  -v, --version             Print version number and exit.\n\
+\n\
+Report bugs to <click@librelist.com>.\n", program_name);
+}
+
+static void
+split_landmark(const String &landmark, String &filename, unsigned &lineno)
+{
+  int colon = landmark.find_right(':');
+  if (colon >= 0 && colon + 1 < landmark.length()) {
+    unsigned l = 0;
+    const char *s = landmark.begin() + colon + 1;
+    for (; s != landmark.end() && *s >= '0' && *s <= '9'; ++s)
+      l = 10 * l + *s - '0';
+    if (s == landmark.end()) {
+      filename = landmark.substring(0, colon);
+      lineno = l;
+      return;
+    }
+  }
+  filename = landmark;
+  lineno = 0;
+}
+
+static String
+router_image(RouterT *r, const ElementMap &elementmap)
+{
+  RouterImage image;
+  image.requirements = r->requirements();
+  image.configuration = r->configuration_string();
+
+  Vector<int> image_index(r->nelements(), -1);
+  for (RouterT::iterator x = r->begin_elements(); x; x++) {
+    image_index[x->eindex()] = image.elements.size();
+    image.elements.push_back(RouterImage::Element());
+    RouterImage::Element &ie = image.elements.back();
+    ie.name = x->name();
+    ie.class_name = x->type_name();
+    ie.configuration = x->configuration();
+    split_landmark(x->landmark(), ie.filename, ie.lineno);
+    ie.processing = elementmap.traits(ie.class_name).processing_code;
+  }
+
+  for (RouterT::conn_iterator it = r->begin_connections(); it; ++it) {
+    RouterImage::Connection c;
+    c.from = image_index[it->from_eindex()];
+    c.from_port = it->from_port();
+    c.to = image_index[it->to_eindex()];
+    c.to_port = it->to_port();
+    if (c.from >= 0 && c.to >= 0)
+      image.connections.push_back(c);
+  }
+
+  return image.unparse();
+}
+
+int
+main(int argc, char **argv)
+{
+  click_static_initialize();
+  CLICK_DEFAULT_PROVIDES;
+  ErrorHandler *errh = ErrorHandler::default_handler();
+  ErrorHandler *p_errh = new PrefixErrorHandler(errh, "click-precompile: ");
+
+  // read command line arguments
+  Clp_Parser *clp =
+    Clp_NewParser(argc, argv, sizeof(options) / sizeof(options[0]), options);
+  Clp_SetOptionChar(clp, '+', Clp_ShortNegated);
+  program_name = Clp_ProgramName(clp);
+
+  const char *router_file = 0;
+  bool file_is_expr = false;
+  const char *output_file = 0;
+
+  while (1) {
+    int opt = Clp_Next(clp);
+    switch (opt) {
+
+     case HELP_OPT:
+      usage();
+      exit(0);
+      break;
+
+     case VERSION_OPT:
+      printf("click-precompile (Click) %s\n", CLICK_VERSION);
+      printf("This is free software; see the source for copying conditions.\n\
+There is NO warranty, not even for merchantability or fitness for a\n\
+particular purpose.\n");
+      exit(0);
+      break;
+
+     case CLICKPATH_OPT:
+      set_clickpath(clp->vstr);
+      break;
+
+     case OUTPUT_OPT:
+      if (output_file) {
+	p_errh->error("--output file specified twice");
+	goto bad_option;
+      }
+      output_file = clp->vstr;
+      break;
+
+     case ROUTER_OPT:
+     case EXPRESSION_OPT:
+     router_file:
+      if (router_file) {
+	p_errh->error("router configuration specified twice");
+	goto bad_option;
+      }
+      router_file = clp->vstr;
+      file_is_expr = (opt == EXPRESSION_OPT);
+      break;
+
+     case Clp_NotOption:
+      if (!click_maybe_define(clp->vstr, p_errh))
+	  goto router_file;
+      break;
+
+     case Clp_BadOption:
+     bad_option:
+      short_usage();
+      exit(1);
+      break;
+
+     case Clp_Done:
+      goto done;
+
+    }
+  }
+
+ done:
+  // global variables are bound now; the driver cannot override them later
+  RouterT *r = read_router(router_file, file_is_expr, errh);
+  if (r)
+    r->flatten(errh, true);
+  if (!r || errh->nerrors() > 0)
+    exit(1);
+
+  // check the configuration as click-check would for the user-level driver
+  ElementMap elementmap;
+  elementmap.parse_all_files(r, CLICK_DATADIR, p_errh);
+  if (!elementmap.driver_compatible(r, Driver::USERLEVEL))
+    errh->fatal("configuration incompatible with userlevel driver");
+  elementmap.set_driver(Driver::USERLEVEL);
+  {
+    ProcessingT p(r, &elementmap, errh);
+    p.check_types(errh);
+  }
+  if (errh->nerrors() > 0)
+    exit(1);
+
+  String image = router_image(r, elementmap);
+
+  // keep the other members of an archive, such as packages
+  const Vector<ArchiveElement> &archive = r->archive();
+  if (archive.size()) {
+    Vector<ArchiveElement> narchive;
+    ArchiveElement config_ae;
+    config_ae.name = "config";
+    config_ae.date = time(0);
+    config_ae.uid = geteuid();
+    config_ae.gid = getegid();
+    config_ae.mode = 0644;
+    config_ae.data = image;
+    narchive.push_back(config_ae);
+    for (int i = 0; i < archive.size(); i++)
+      if (archive[i].live() && archive[i].name != "config")
+	narchive.push_back(archive[i]);
+    if (narchive.size() > 1)
+      image = ArchiveElement::unparse(narchive, errh);
+  }
+
+  FILE *out;
+  if (!output_file || strcmp(output_file, "-") == 0)
+    out = stdout;
+  else if (!(out = fopen(output_file, "wb")))
+    errh->fatal("%s: %s", output_file, strerror(errno));
+  ignore_result(fwrite(image.data(), 1, image.length(), out));
+  if (out != stdout)
+    fclose(out);
+  return 0;
+}
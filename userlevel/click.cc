@@ -58,6 +58,7 @@
 #include <click/userutils.hh>
 #include <click/args.hh>
 #include <click/handlercall.hh>
+#include <click/packetregion.hh>
 #include "elements/standard/quitwatcher.hh"
 #include "elements/userlevel/controlsocket.hh"
 CLICK_USING_DECLS
@@ -82,6 +83,8 @@ CLICK_USING_DECLS
 #define SOCKET_OPT              318
 #define THREADS_AFF_OPT         319
 #define DPDK_OPT                320
+#define PROFILE_OPT             321
+#define PACKET_MEMORY_OPT       322
 
 static const Clp_Option options[] = {
     { "allow-reconfigure", 'R', ALLOW_RECONFIG_OPT, 0, Clp_Negate },
@@ -92,8 +95,10 @@ static const Clp_Option options[] = {
     { "handler", 'h', HANDLER_OPT, Clp_ValString, 0 },
     { "help", 0, HELP_OPT, 0, 0 },
     { "output", 'o', OUTPUT_OPT, Clp_ValString, 0 },
+    { "packet-memory", 0, PACKET_MEMORY_OPT, Clp_ValString, 0 },
     { "socket", 0, SOCKET_OPT, Clp_ValInt, 0 },
     { "port", 'p', PORT_OPT, Clp_ValString, 0 },
+    { "profile", 0, PROFILE_OPT, 0, Clp_Negate },
     { "quit", 'q', QUIT_OPT, 0, 0 },
     { "simtime", 0, SIMTIME_OPT, Clp_ValDouble, Clp_Optional },
     { "simulation-time", 0, SIMTIME_OPT, Clp_ValDouble, Clp_Optional },
@@ -132,6 +137,11 @@ Options:\n\
   -f, --file FILE               Read router configuration from FILE.\n\
   -e, --expression EXPR         Use EXPR as router configuration.\n\
   -j, --threads N               Start N threads (default 1).\n", program_name);
+#if HAVE_CLICK_PACKET_REGION
+    printf("\
+      --packet-memory SIZE      Carve packet buffers from SIZE bytes (K, M, G)\n\
+                                of huge pages mapped at startup.\n");
+#endif
 #if HAVE_DPDK
     printf("\
       --dpdk DPDK_ARGS --       Enable DPDK and give DPDK's own arguments.\n");
@@ -150,7 +160,8 @@ Options:\n\
   -x, --exit-handler ELEMENT.H  Use handler ELEMENT.H value for exit status.\n\
   -o, --output FILE             Write flat configuration to FILE.\n\
   -q, --quit                    Do not run driver.\n\
-  -t, --time                    Print information on how long driver took.\n\
+  -t, --time                    Print how long startup and the driver took.\n\
+      --profile                 Profile elements; print a summary on exit.\n\
   -w, --no-warnings             Do not print warnings.\n\
       --simtime                 Run in simulation time.\n\
   -C, --clickpath PATH          Use PATH for CLICKPATH.\n\
@@ -164,6 +175,7 @@ static Master* click_master;
 static Router* click_router;
 static ErrorHandler* errh;
 static bool running = false;
+static Timestamp initialize_time;	// when the first router's initialize began
 
 extern "C" {
 static void
@@ -332,6 +344,29 @@ static void* hotswap_threadfunc(void*)
 }
 #endif
 
+// A hotswap in place leaves the removed elements in the router it read.
+// A task deletes that router later, since the handler that asked for the
+// hotswap may belong to one of the removed elements.
+static Vector<Router*> hotswap_garbage;
+static bool hotswap_garbage_hook(Task *, void *);
+static Task hotswap_garbage_task(hotswap_garbage_hook, 0);
+
+static bool
+hotswap_garbage_hook(Task*, void*)
+{
+    Vector<Router*> garbage;
+#if HAVE_MULTITHREAD
+    pthread_mutex_lock(&hotswap_lock);
+#endif
+    garbage.swap(hotswap_garbage);
+#if HAVE_MULTITHREAD
+    pthread_mutex_unlock(&hotswap_lock);
+#endif
+    for (Router **it = garbage.begin(); it != garbage.end(); ++it)
+        delete *it;
+    return true;
+}
+
 // switching configurations
 
 static Vector<String> cs_unix_sockets;
@@ -351,12 +386,16 @@ click_driver_control_socket_name(int number)
 }
 
 static Router *
-parse_configuration(const String &text, bool text_is_expr, bool hotswap,
-                    ErrorHandler *errh)
+read_configuration(const String &text, bool text_is_expr, bool hotswap,
+                   ErrorHandler *errh)
 {
     int before_errors = errh->nerrors();
     Router *router = click_read_router(text, text_is_expr, errh, false,
                                        click_master);
+    if (router && errh->nerrors() != before_errors) {
+        delete router;
+        router = 0;
+    }
     if (!router)
         return 0;
 
@@ -369,7 +408,12 @@ parse_configuration(const String &text, bool text_is_expr, bool hotswap,
         router->add_element(new ControlSocket, click_driver_control_socket_name(ncs), "UNIX, " + *it + retries, "click", 0);
     for (String *it = cs_sockets.begin(); it != cs_sockets.end(); ++it, ++ncs)
         router->add_element(new ControlSocket, click_driver_control_socket_name(ncs), "SOCKET, " + *it + retries, "click", 0);
+    return router;
+}
 
+static Router *
+initialize_configuration(Router *router, bool hotswap, ErrorHandler *errh)
+{
   // catch signals (only need to do the first time)
   if (!hotswap) {
       // catch control-C and SIGTERM
@@ -396,8 +440,9 @@ parse_configuration(const String &text, bool text_is_expr, bool hotswap,
   if (hotswap && click_router && click_router->initialized())
       router->set_hotswap_router(click_router);
 
-  if (errh->nerrors() == before_errors
-      && router->initialize(errh) >= 0)
+  if (!hotswap)
+    initialize_time = Timestamp::now_steady();
+  if (router->initialize(errh) >= 0)
     return router;
   else {
     delete router;
@@ -405,10 +450,72 @@ parse_configuration(const String &text, bool text_is_expr, bool hotswap,
   }
 }
 
+static Router *
+parse_configuration(const String &text, bool text_is_expr, bool hotswap,
+                    ErrorHandler *errh)
+{
+    if (Router *router = read_configuration(text, text_is_expr, hotswap, errh))
+        return initialize_configuration(router, hotswap, errh);
+    else
+        return 0;
+}
+
+/* Give the driver ControlSockets of the configuration read for
+   hotconfig_handler() their running counterparts' configurations, so that
+   a hotswap in place keeps the running ones. */
+static void
+keep_driver_control_sockets(Router *router)
+{
+    int ncs = cs_ports.size() + cs_unix_sockets.size() + cs_sockets.size();
+    for (int i = 0; i < ncs; ++i) {
+        String name = click_driver_control_socket_name(i);
+        if (Element *e = click_router->find(name))
+            router->set_econfiguration(router->find(name)->eindex(), click_router->econfiguration(e->eindex()));
+    }
+}
+
 static int
 hotconfig_handler(const String &text, Element *, void *, ErrorHandler *errh)
 {
-  if (Router *new_router = parse_configuration(text, true, true, errh)) {
+  Router *new_router = read_configuration(text, true, true, errh);
+  if (!new_router)
+      return -EINVAL;
+
+  // Try to change the running router in place: elements the new
+  // configuration keeps also keep their state and queued packets, and only
+  // new elements are initialized.
+  if (click_router && click_router->initialized() && !hotswap_router) {
+#if HAVE_MULTITHREAD
+      // Stop the other threads while the graph changes.  If a full hotswap
+      // holds the lock, queue this one behind it instead of waiting, since
+      // that hotswap may be waiting for this thread.
+      if (pthread_mutex_trylock(&hotswap_lock) == 0) {
+          click_master->block_all();
+#endif
+          keep_driver_control_sockets(new_router);
+          int result = click_router->hotswap_in_place(new_router, errh);
+          if (result > 0) {
+              hotswap_garbage.push_back(new_router);
+              hotswap_garbage_task.reschedule();
+          }
+#if HAVE_MULTITHREAD
+          click_master->unblock_all();
+          pthread_mutex_unlock(&hotswap_lock);
+#endif
+          if (result > 0)
+              return 0;
+          delete new_router;
+          if (result < 0)
+              return result;
+          // hotswap_in_place() has used up the configuration; read it again
+          if (!(new_router = read_configuration(text, true, true, errh)))
+              return -EINVAL;
+#if HAVE_MULTITHREAD
+      }
+#endif
+  }
+
+  if ((new_router = initialize_configuration(new_router, true, errh))) {
 #if HAVE_MULTITHREAD
       pthread_mutex_lock(&hotswap_lock);
 #endif
@@ -430,6 +537,42 @@ hotconfig_handler(const String &text, Element *, void *, ErrorHandler *errh)
 }
 
 
+#if HAVE_CLICK_PACKET_REGION
+// packet memory
+
+static bool
+parse_memory_size(const char *s, size_t &result)
+{
+    char *end;
+    errno = 0;
+    unsigned long long x = strtoull(s, &end, 10);
+    if (end == s || errno)
+        return false;
+    int shift = 0;
+    if (*end == 'k' || *end == 'K')
+        shift = 10;
+    else if (*end == 'm' || *end == 'M')
+        shift = 20;
+    else if (*end == 'g' || *end == 'G')
+        shift = 30;
+    if (shift)
+        ++end;
+    if (*end == 'B' || *end == 'b')
+        ++end;
+    if (*end || x > (~(size_t) 0 >> shift))
+        return false;
+    result = (size_t) x << shift;
+    return true;
+}
+
+static String
+packet_memory_read_handler(Element *, void *)
+{
+    return PacketRegion::stats().unparse();
+}
+#endif
+
+
 // timewarping
 
 static String
@@ -530,6 +673,10 @@ main(int argc, char **argv)
   const char *output_file = 0;
   bool quit_immediately = false;
   bool report_time = false;
+#if HAVE_CLICK_PACKET_REGION
+  size_t packet_memory = 0;
+#endif
+  bool profile = false;
   bool allow_reconfigure = false;
   Vector<String> handlers;
   String exit_handler;
@@ -617,6 +764,21 @@ main(int argc, char **argv)
       report_time = true;
       break;
 
+     case PROFILE_OPT:
+      profile = !clp->negated;
+      break;
+
+     case PACKET_MEMORY_OPT:
+#if HAVE_CLICK_PACKET_REGION
+      if (!parse_memory_size(clp->vstr, packet_memory) || !packet_memory) {
+          Clp_OptionError(clp, "%<%O%> expects a memory size, not %<%s%>", clp->vstr);
+          goto bad_option;
+      }
+#else
+      errh->warning("Click was built without packet memory support, ignoring --packet-memory");
+#endif
+      break;
+
      case WARNINGS_OPT:
       warnings = !clp->negated;
       break;
@@ -716,6 +878,13 @@ particular purpose.\n");
     }
 #endif
 
+#if HAVE_CLICK_PACKET_REGION
+  // map packet buffers now that the number of threads is known
+  if (packet_memory && PacketRegion::initialize(packet_memory, errh) < 0)
+      return cleanup(clp, 1);
+  Router::add_read_handler(0, "packet_memory", packet_memory_read_handler, 0);
+#endif
+
   // provide hotconfig handler if asked
   if (allow_reconfigure)
       Router::add_write_handler(0, "hotconfig", hotconfig_handler, 0, Handler::f_raw | Handler::f_nonexclusive);
@@ -725,10 +894,12 @@ particular purpose.\n");
 
   // parse configuration
   click_master = new Master(click_nthreads);
+  Timestamp parse_time = Timestamp::now_steady();
   click_router = parse_configuration(router_file, file_is_expr, false, errh);
   if (!click_router)
     return cleanup(clp, 1);
   click_router->use();
+  Timestamp startup_done_time = Timestamp::now_steady();
 
   int exit_value = 0;
 #if (HAVE_MULTITHREAD)
@@ -757,6 +928,9 @@ particular purpose.\n");
     }
   }
 
+  if (profile)
+    click_router->set_profiling(true);
+
   struct rusage before, after;
   getrusage(RUSAGE_SELF, &before);
   Timestamp before_time = Timestamp::now_unwarped();
@@ -771,6 +945,7 @@ particular purpose.\n");
       hotswap_thunk_router = new Router("", click_master);
       hotswap_thunk_router->initialize(errh);
       hotswap_task.initialize(hotswap_thunk_router->root_element(), false);
+      hotswap_garbage_task.initialize(hotswap_thunk_router->root_element(), false);
       hotswap_thunk_router->activate(false, errh);
     }
     for (int t = 0; t < click_nthreads; ++t)
@@ -810,6 +985,9 @@ particular purpose.\n");
   getrusage(RUSAGE_SELF, &after);
   // report time
   if (report_time) {
+    printf("%d elements: parse %.3fs, initialize %.3fs\n", click_router->nelements(),
+           (initialize_time - parse_time).doubleval(),
+           (startup_done_time - initialize_time).doubleval());
     struct timeval diff;
     timersub(&after.ru_utime, &before.ru_utime, &diff);
     round_timeval(&diff, 1000);
@@ -823,6 +1001,13 @@ particular purpose.\n");
     printf("\n");
   }
 
+  // report profile
+  if (profile) {
+    StringAccum sa;
+    click_router->unparse_profile(sa);
+    ignore_result(fwrite(sa.data(), 1, sa.length(), stderr));
+  }
+
   // call handlers
   if (handlers.size())
     if (call_read_handlers(handlers, errh) < 0)
@@ -860,6 +1045,8 @@ particular purpose.\n");
 #endif
 
 click_cleanup:
+  for (Router **it = hotswap_garbage.begin(); it != hotswap_garbage.end(); ++it)
+      delete *it;
   click_router->unuse();
   return cleanup(clp, exit_value);
 }